@@ -0,0 +1,77 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <bmmcache.h>
+#include <primitives/block.h>
+#include <random.h>
+#include <uint256.h>
+
+#include <deque>
+#include <vector>
+
+// Roughly the number of blocks on the mainchain
+static const int MAIN_CHAIN_LENGTH = 600000;
+
+// Depth of the reorgs
+static const int MAIN_REORG_DEPTH = 6;
+
+static std::deque<uint256> GenerateHashChain(FastRandomContext& rand, int nCount)
+{
+    std::deque<uint256> deqHash;
+    for (int i = 0; i < nCount; i++)
+        deqHash.push_back(rand.rand256());
+    return deqHash;
+}
+
+// Switch the tip of a long cached chain between two branches, like a
+// mainchain reorg that is followed by another one.
+static void BMMCacheReorg(benchmark::State& state)
+{
+    FastRandomContext rand(true);
+
+    BMMCache cache;
+    std::deque<uint256> deqHash = GenerateHashChain(rand, MAIN_CHAIN_LENGTH);
+    bool fReorg = false;
+    std::vector<uint256> vOrphan;
+    cache.UpdateMainBlockCache(deqHash, fReorg, vOrphan);
+
+    uint256 hashFork = cache.GetMainBlockHashCache()[MAIN_CHAIN_LENGTH - MAIN_REORG_DEPTH - 1];
+    std::deque<uint256> deqBranchA = GenerateHashChain(rand, MAIN_REORG_DEPTH + 1);
+    std::deque<uint256> deqBranchB = GenerateHashChain(rand, MAIN_REORG_DEPTH + 1);
+    deqBranchA.push_front(hashFork);
+    deqBranchB.push_front(hashFork);
+
+    bool fBranchA = true;
+    while (state.KeepRunning()) {
+        std::deque<uint256> deqHashNew = fBranchA ? deqBranchA : deqBranchB;
+        vOrphan.clear();
+        cache.UpdateMainBlockCache(deqHashNew, fReorg, vOrphan);
+        fBranchA = !fBranchA;
+    }
+}
+
+// Look up the height and prevblock of random blocks in a long cached chain
+static void BMMCacheLookup(benchmark::State& state)
+{
+    FastRandomContext rand(true);
+
+    BMMCache cache;
+    std::deque<uint256> deqHash = GenerateHashChain(rand, MAIN_CHAIN_LENGTH);
+    std::vector<uint256> vHash(deqHash.begin(), deqHash.end());
+    bool fReorg = false;
+    std::vector<uint256> vOrphan;
+    cache.UpdateMainBlockCache(deqHash, fReorg, vOrphan);
+
+    uint64_t nFound = 0;
+    while (state.KeepRunning()) {
+        const uint256& hash = vHash[rand.randrange(vHash.size())];
+        nFound += cache.HaveMainBlock(hash);
+        nFound += cache.GetMainPrevBlockHash(hash).IsNull();
+        nFound += cache.GetMainchainBlockHeight(hash);
+    }
+}
+
+BENCHMARK(BMMCacheReorg, 150 * 1000);
+BENCHMARK(BMMCacheLookup, 2000 * 1000);
@@ -4,9 +4,12 @@
 
 #include <bench/bench.h>
 #include <coins.h>
+#include <flatmap.h>
 #include <policy/policy.h>
+#include <random.h>
 #include <wallet/crypter.h>
 
+#include <unordered_map>
 #include <vector>
 
 // FIXME: Dedup with SetupDummyInputs in test/transaction_tests.cpp.
@@ -84,4 +87,69 @@ static void CCoinsCaching(benchmark::State& state)
     }
 }
 
+typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CoinsUnorderedMap;
+typedef flatmap<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CoinsFlatMap;
+
+// Number of coins in the maps
+static const size_t COINS_MAP_SIZE = 100000;
+
+static std::vector<COutPoint> RandomOutPoints(size_t nCount)
+{
+    FastRandomContext rand(true);
+    std::vector<COutPoint> vOutPoint;
+    vOutPoint.reserve(nCount);
+    for (size_t i = 0; i < nCount; i++)
+        vOutPoint.emplace_back(rand.rand256(), rand.randrange(4));
+    return vOutPoint;
+}
+
+// Fill the map the way a cache is filled while connecting blocks, then
+// write it out and clear it as CCoinsViewCache::Flush does
+template <typename Map>
+static void CoinsMapFillAndFlush(benchmark::State& state)
+{
+    const std::vector<COutPoint> vOutPoint = RandomOutPoints(COINS_MAP_SIZE);
+    Map map;
+
+    while (state.KeepRunning()) {
+        for (const COutPoint& outpoint : vOutPoint) {
+            Coin coin(CTxOut(1, CScript() << OP_TRUE), 1, false);
+            auto it = map.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::forward_as_tuple(std::move(coin))).first;
+            it->second.flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH;
+        }
+
+        size_t nWritten = 0;
+        for (auto it = map.begin(); it != map.end(); it = map.erase(it))
+            nWritten += it->second.flags & CCoinsCacheEntry::DIRTY;
+        assert(nWritten == COINS_MAP_SIZE);
+        map.clear();
+    }
+}
+
+// Look up coins in a full map, half of which are in it
+template <typename Map>
+static void CoinsMapLookup(benchmark::State& state)
+{
+    const std::vector<COutPoint> vOutPoint = RandomOutPoints(2 * COINS_MAP_SIZE);
+    Map map;
+    for (size_t i = 0; i < COINS_MAP_SIZE; i++)
+        map.emplace(std::piecewise_construct, std::forward_as_tuple(vOutPoint[2 * i]), std::forward_as_tuple(Coin(CTxOut(1, CScript() << OP_TRUE), 1, false)));
+
+    while (state.KeepRunning()) {
+        size_t nFound = 0;
+        for (const COutPoint& outpoint : vOutPoint)
+            nFound += map.find(outpoint) != map.end();
+        assert(nFound == COINS_MAP_SIZE);
+    }
+}
+
+static void CoinsUnorderedMapFillAndFlush(benchmark::State& state) { CoinsMapFillAndFlush<CoinsUnorderedMap>(state); }
+static void CoinsFlatMapFillAndFlush(benchmark::State& state) { CoinsMapFillAndFlush<CoinsFlatMap>(state); }
+static void CoinsUnorderedMapLookup(benchmark::State& state) { CoinsMapLookup<CoinsUnorderedMap>(state); }
+static void CoinsFlatMapLookup(benchmark::State& state) { CoinsMapLookup<CoinsFlatMap>(state); }
+
 BENCHMARK(CCoinsCaching, 170 * 1000);
+BENCHMARK(CoinsUnorderedMapFillAndFlush, 40);
+BENCHMARK(CoinsFlatMapFillAndFlush, 40);
+BENCHMARK(CoinsUnorderedMapLookup, 40);
+BENCHMARK(CoinsFlatMapLookup, 40);
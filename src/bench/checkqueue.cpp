@@ -6,11 +6,15 @@
 #include <util.h>
 #include <validation.h>
 #include <checkqueue.h>
+#include <key.h>
 #include <prevector.h>
+#include <script/sign.h>
 #include <vector>
 #include <boost/thread/thread.hpp>
 #include <random.h>
 
+#include <array>
+
 
 static const int MIN_CORES = 2;
 static const size_t BATCHES = 101;
@@ -18,25 +22,32 @@ static const size_t BATCH_SIZE = 30;
 static const int PREVECTOR_SIZE = 28;
 static const unsigned int QUEUE_BATCH_SIZE = 128;
 
+// Number of P2WPKH inputs of the block verified by the script benchmarks,
+// added as transactions of SCRIPT_TX_INPUTS inputs
+static const size_t SCRIPT_INPUTS = 2000;
+static const size_t SCRIPT_TX_INPUTS = 2;
+
+struct PrevectorJob {
+    prevector<PREVECTOR_SIZE, uint8_t> p;
+    PrevectorJob(){
+    }
+    explicit PrevectorJob(FastRandomContext& insecure_rand){
+        p.resize(insecure_rand.randrange(PREVECTOR_SIZE*2));
+    }
+    bool operator()()
+    {
+        return true;
+    }
+    void swap(PrevectorJob& x){p.swap(x.p);};
+};
+
 // This Benchmark tests the CheckQueue with a slightly realistic workload,
 // where checks all contain a prevector that is indirect 50% of the time
 // and there is a little bit of work done between calls to Add.
-static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
+template <typename Queue>
+static void CheckQueueSpeedPrevectorJob(benchmark::State& state)
 {
-    struct PrevectorJob {
-        prevector<PREVECTOR_SIZE, uint8_t> p;
-        PrevectorJob(){
-        }
-        explicit PrevectorJob(FastRandomContext& insecure_rand){
-            p.resize(insecure_rand.randrange(PREVECTOR_SIZE*2));
-        }
-        bool operator()()
-        {
-            return true;
-        }
-        void swap(PrevectorJob& x){p.swap(x.p);};
-    };
-    CCheckQueue<PrevectorJob> queue {QUEUE_BATCH_SIZE};
+    Queue queue {QUEUE_BATCH_SIZE};
     boost::thread_group tg;
     for (auto x = 0; x < std::max(MIN_CORES, GetNumCores()); ++x) {
        tg.create_thread([&]{queue.Thread();});
@@ -44,7 +55,7 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     while (state.KeepRunning()) {
         // Make insecure_rand here so that each iteration is identical.
         FastRandomContext insecure_rand(true);
-        CCheckQueueControl<PrevectorJob> control(&queue);
+        CCheckQueueControl<PrevectorJob, Queue> control(&queue);
         std::vector<std::vector<PrevectorJob>> vBatches(BATCHES);
         for (auto& vChecks : vBatches) {
             vChecks.reserve(BATCH_SIZE);
@@ -59,4 +70,111 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     tg.interrupt_all();
     tg.join_all();
 }
+
+static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
+{
+    CheckQueueSpeedPrevectorJob<CCheckQueue<PrevectorJob>>(state);
+}
+
+static void CWorkStealingCheckQueueSpeedPrevectorJob(benchmark::State& state)
+{
+    CheckQueueSpeedPrevectorJob<CWorkStealingCheckQueue<PrevectorJob>>(state);
+}
+
+/** A signed P2WPKH spend, the check of its input is the expensive part of block connection */
+struct ScriptSpend {
+    CMutableTransaction txCredit;
+    CMutableTransaction txSpend;
+
+    ScriptSpend()
+    {
+        CKey key;
+        static const std::array<unsigned char, 32> vchKey = {
+            {
+                0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1
+            }
+        };
+        key.Set(vchKey.begin(), vchKey.end(), false);
+        CPubKey pubkey = key.GetPubKey();
+        uint160 pubkeyHash;
+        CHash160().Write(pubkey.begin(), pubkey.size()).Finalize(pubkeyHash.begin());
+
+        txCredit.vin.resize(1);
+        txCredit.vout.resize(1);
+        txCredit.vout[0].scriptPubKey = CScript() << 0 << ToByteVector(pubkeyHash);
+        txCredit.vout[0].nValue = 1;
+
+        txSpend.vin.resize(1);
+        txSpend.vout.resize(1);
+        txSpend.vin[0].prevout = COutPoint(txCredit.GetHash(), 0);
+        txSpend.vout[0].nValue = 1;
+
+        CScript witScriptPubkey = CScript() << OP_DUP << OP_HASH160 << ToByteVector(pubkeyHash) << OP_EQUALVERIFY << OP_CHECKSIG;
+        CScriptWitness& witness = txSpend.vin[0].scriptWitness;
+        witness.stack.emplace_back();
+        key.Sign(SignatureHash(witScriptPubkey, txSpend, 0, SIGHASH_ALL, txCredit.vout[0].nValue, SIGVERSION_WITNESS_V0), witness.stack.back(), 0);
+        witness.stack.back().push_back(static_cast<unsigned char>(SIGHASH_ALL));
+        witness.stack.push_back(ToByteVector(pubkey));
+    }
+};
+
+/** Verification of one input, like CScriptCheck */
+struct ScriptJob {
+    const ScriptSpend* spend;
+    ScriptJob() : spend(nullptr) {}
+    explicit ScriptJob(const ScriptSpend* spendIn) : spend(spendIn) {}
+    bool operator()()
+    {
+        return VerifyScript(spend->txSpend.vin[0].scriptSig, spend->txCredit.vout[0].scriptPubKey,
+                &spend->txSpend.vin[0].scriptWitness, SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_P2SH,
+                MutableTransactionSignatureChecker(&spend->txSpend, 0, spend->txCredit.vout[0].nValue));
+    }
+    void swap(ScriptJob& x) { std::swap(spend, x.spend); }
+};
+
+// Verify the inputs of a block the way ConnectBlock does: the master adds
+// the checks of each transaction and joins the workers once all are added.
+// Queues are compared at the same thread count, which includes the master.
+template <typename Queue>
+static void CheckQueueScripts(benchmark::State& state, int nThreads)
+{
+    static const ScriptSpend spend;
+
+    Queue queue {QUEUE_BATCH_SIZE};
+    boost::thread_group tg;
+    for (auto x = 0; x < nThreads - 1; ++x) {
+       tg.create_thread([&]{queue.Thread();});
+    }
+    while (state.KeepRunning()) {
+        CCheckQueueControl<ScriptJob, Queue> control(&queue);
+        for (size_t i = 0; i < SCRIPT_INPUTS; i += SCRIPT_TX_INPUTS) {
+            std::vector<ScriptJob> vChecks(SCRIPT_TX_INPUTS, ScriptJob(&spend));
+            control.Add(vChecks);
+        }
+        bool fOk = control.Wait();
+        assert(fOk);
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+static void CCheckQueueScripts2Threads(benchmark::State& state) { CheckQueueScripts<CCheckQueue<ScriptJob>>(state, 2); }
+static void CCheckQueueScripts4Threads(benchmark::State& state) { CheckQueueScripts<CCheckQueue<ScriptJob>>(state, 4); }
+static void CCheckQueueScripts8Threads(benchmark::State& state) { CheckQueueScripts<CCheckQueue<ScriptJob>>(state, 8); }
+static void CCheckQueueScripts16Threads(benchmark::State& state) { CheckQueueScripts<CCheckQueue<ScriptJob>>(state, MAX_SCRIPTCHECK_THREADS); }
+static void CWorkStealingCheckQueueScripts2Threads(benchmark::State& state) { CheckQueueScripts<CWorkStealingCheckQueue<ScriptJob>>(state, 2); }
+static void CWorkStealingCheckQueueScripts4Threads(benchmark::State& state) { CheckQueueScripts<CWorkStealingCheckQueue<ScriptJob>>(state, 4); }
+static void CWorkStealingCheckQueueScripts8Threads(benchmark::State& state) { CheckQueueScripts<CWorkStealingCheckQueue<ScriptJob>>(state, 8); }
+static void CWorkStealingCheckQueueScripts16Threads(benchmark::State& state) { CheckQueueScripts<CWorkStealingCheckQueue<ScriptJob>>(state, MAX_SCRIPTCHECK_THREADS); }
+
 BENCHMARK(CCheckQueueSpeedPrevectorJob, 1400);
+BENCHMARK(CWorkStealingCheckQueueSpeedPrevectorJob, 1400);
+
+BENCHMARK(CCheckQueueScripts2Threads, 5);
+BENCHMARK(CCheckQueueScripts4Threads, 5);
+BENCHMARK(CCheckQueueScripts8Threads, 5);
+BENCHMARK(CCheckQueueScripts16Threads, 5);
+BENCHMARK(CWorkStealingCheckQueueScripts2Threads, 5);
+BENCHMARK(CWorkStealingCheckQueueScripts4Threads, 5);
+BENCHMARK(CWorkStealingCheckQueueScripts8Threads, 5);
+BENCHMARK(CWorkStealingCheckQueueScripts16Threads, 5);
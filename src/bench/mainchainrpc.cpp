@@ -0,0 +1,176 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <mainchainrpc.h>
+#include <random.h>
+#include <sidechainclient.h>
+#include <uint256.h>
+#include <univalue.h>
+#include <util.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+using boost::asio::ip::tcp;
+
+// Mainchain block count returned by the mock
+static const int MOCK_MAIN_BLOCK_COUNT = 600000;
+
+// Number of deposits verified with one batch of requests
+static const int DEPOSIT_VERIFY_COUNT = 1000;
+
+/**
+ * Minimal mainchain RPC server on a local port. It answers single and batch
+ * JSON-RPC requests over keep-alive connections with canned results, so that
+ * the benchmarks measure our side of a round trip: building the request, the
+ * connection pool, HTTP parsing and reading the reply.
+ */
+class MockMainchainRPC
+{
+public:
+    MockMainchainRPC() : acceptor(io_service, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0)), fStop(false)
+    {
+        gArgs.ForceSetArg("-rpcuser", "bench");
+        gArgs.ForceSetArg("-rpcpassword", "bench");
+        gArgs.ForceSetArg("-mainchainrpcport", std::to_string(acceptor.local_endpoint().port()));
+
+        threadAccept = std::thread(&MockMainchainRPC::ThreadAccept, this);
+    }
+
+    ~MockMainchainRPC()
+    {
+        // Close our side so that the connection threads read EOF, then wake
+        // up the accept thread with a connection of our own
+        CloseMainchainRPCConnections();
+        fStop = true;
+        try {
+            tcp::socket socket(io_service);
+            socket.connect(acceptor.local_endpoint());
+        } catch (const boost::system::system_error&) {
+        }
+        threadAccept.join();
+        for (std::thread& thread : vThreadConn)
+            thread.join();
+    }
+
+private:
+    boost::asio::io_service io_service;
+    tcp::acceptor acceptor;
+    std::atomic<bool> fStop;
+    std::thread threadAccept;
+    std::vector<std::thread> vThreadConn;
+
+    void ThreadAccept()
+    {
+        while (true) {
+            std::shared_ptr<tcp::socket> socket = std::make_shared<tcp::socket>(io_service);
+            boost::system::error_code e;
+            acceptor.accept(*socket, e);
+            if (fStop || e)
+                return;
+            vThreadConn.emplace_back(&MockMainchainRPC::ThreadConnection, socket);
+        }
+    }
+
+    static UniValue Reply(const UniValue& request)
+    {
+        const UniValue& method = find_value(request, "method");
+        const UniValue& params = find_value(request, "params");
+
+        UniValue result;
+        if (method.isStr() && method.get_str() == "getblockcount")
+            result = UniValue(MOCK_MAIN_BLOCK_COUNT);
+        else
+        if (method.isStr() && method.get_str() == "verifydeposit" && params.isArray() && params.size() > 1)
+            result = params[1]; // Every deposit is found, the txid is returned
+
+        UniValue reply(UniValue::VOBJ);
+        reply.pushKV("result", result);
+        reply.pushKV("error", NullUniValue);
+        reply.pushKV("id", find_value(request, "id"));
+        return reply;
+    }
+
+    static void ThreadConnection(std::shared_ptr<tcp::socket> socket)
+    {
+        boost::asio::streambuf buf;
+        boost::system::error_code e;
+        while (true) {
+            // Read the headers and then the body by its Content-Length
+            size_t nHeader = boost::asio::read_until(*socket, buf, "\r\n\r\n", e);
+            if (e)
+                return;
+            std::string strHeader(boost::asio::buffers_begin(buf.data()), boost::asio::buffers_begin(buf.data()) + nHeader);
+            buf.consume(nHeader);
+
+            size_t nLength = 0;
+            size_t nPos = strHeader.find("Content-Length:");
+            if (nPos != std::string::npos)
+                nLength = std::stoul(strHeader.substr(nPos + 15));
+            if (buf.size() < nLength)
+                boost::asio::read(*socket, buf, boost::asio::transfer_exactly(nLength - buf.size()), e);
+            if (e)
+                return;
+            std::string strBody(boost::asio::buffers_begin(buf.data()), boost::asio::buffers_begin(buf.data()) + nLength);
+            buf.consume(nLength);
+
+            UniValue request;
+            UniValue reply;
+            if (request.read(strBody) && request.isArray()) {
+                reply.setArray();
+                for (size_t i = 0; i < request.size(); i++)
+                    reply.push_back(Reply(request[i]));
+            } else {
+                reply = Reply(request);
+            }
+
+            std::string strReply = reply.write();
+            std::string strResponse = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n";
+            strResponse += "Content-Length: " + std::to_string(strReply.size()) + "\r\n\r\n";
+            strResponse += strReply;
+            boost::asio::write(*socket, boost::asio::buffer(strResponse), e);
+            if (e)
+                return;
+        }
+    }
+};
+
+// Single request round trip on a pooled keep-alive connection
+static void MainchainRPCRoundTrip(benchmark::State& state)
+{
+    MockMainchainRPC mock;
+    SidechainClient client;
+
+    while (state.KeepRunning()) {
+        int nBlocks = 0;
+        bool fSuccess = client.GetBlockCount(nBlocks);
+        assert(fSuccess && nBlocks == MOCK_MAIN_BLOCK_COUNT);
+    }
+}
+
+// Verify a backlog of deposits with batch requests sent in parallel
+static void MainchainRPCVerifyDepositBatch(benchmark::State& state)
+{
+    MockMainchainRPC mock;
+    SidechainClient client;
+    FastRandomContext rand(true);
+
+    std::vector<SidechainDepositQuery> vQuery;
+    for (int i = 0; i < DEPOSIT_VERIFY_COUNT; i++)
+        vQuery.emplace_back(rand.rand256(), rand.rand256(), 1);
+
+    while (state.KeepRunning()) {
+        bool fSuccess = client.VerifyDepositBatch(vQuery);
+        assert(fSuccess && vQuery.back().fVerified);
+    }
+}
+
+BENCHMARK(MainchainRPCRoundTrip, 2000);
+BENCHMARK(MainchainRPCVerifyDepositBatch, 20);
@@ -0,0 +1,285 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <chainparams.h>
+#include <fs.h>
+#include <policy/wtprime.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <random.h>
+#include <sidechain.h>
+#include <txdb.h>
+#include <util.h>
+#include <utiltime.h>
+#include <validation.h>
+
+#include <algorithm>
+#include <vector>
+
+// Number of deposits in a large backlog, like after mainchain downtime
+static const int DEPOSIT_BACKLOG_SIZE = 5000;
+
+// Number of unspent WT(s) waiting for a WT^, small and large backlog
+static const int WT_BACKLOG_SMALL = 1000;
+static const int WT_BACKLOG_LARGE = 10000;
+
+// Create a chain of deposits where each deposit spends the CTIP output of the
+// deposit before it
+static std::vector<SidechainDeposit> CreateDepositChain(FastRandomContext& rand, int nCount)
+{
+    std::vector<SidechainDeposit> vDeposit;
+
+    COutPoint prevout(rand.rand256(), 0);
+    CAmount amountCTIP = 0;
+    for (int i = 0; i < nCount; i++) {
+        CMutableTransaction dtx;
+        dtx.vin.resize(2);
+        dtx.vin[0].prevout = prevout;
+        dtx.vin[1].prevout = COutPoint(rand.rand256(), 0);
+        dtx.vout.resize(2);
+        dtx.vout[0].nValue = 1 * COIN;
+        dtx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+
+        // The burn output is the new CTIP
+        amountCTIP += 1 * COIN;
+        dtx.vout[1].nValue = amountCTIP;
+        dtx.vout[1].scriptPubKey = CScript() << OP_RETURN;
+
+        SidechainDeposit deposit;
+        deposit.nSidechain = THIS_SIDECHAIN;
+        deposit.strDest = "";
+        deposit.amtUserPayout = 1 * COIN;
+        deposit.dtx = MakeTransactionRef(dtx);
+        deposit.nBurnIndex = 1;
+        deposit.nTx = 1;
+        deposit.hashMainchainBlock = rand.rand256();
+        vDeposit.push_back(deposit);
+
+        prevout = COutPoint(deposit.dtx->GetHash(), 1);
+    }
+    return vDeposit;
+}
+
+// Sort a shuffled backlog of deposits into CTIP spend order
+static void SidechainSortDeposits(benchmark::State& state)
+{
+    FastRandomContext rand(true);
+
+    std::vector<SidechainDeposit> vDeposit = CreateDepositChain(rand, DEPOSIT_BACKLOG_SIZE);
+    for (size_t i = vDeposit.size() - 1; i > 0; i--)
+        std::swap(vDeposit[i], vDeposit[rand.randrange(i + 1)]);
+
+    while (state.KeepRunning()) {
+        std::vector<SidechainDeposit> vDepositSorted;
+        bool fSorted = SortDeposits(vDeposit, vDepositSorted);
+        assert(fSorted);
+    }
+}
+
+static std::vector<SidechainWT> CreateWTs(FastRandomContext& rand, int nCount)
+{
+    std::vector<SidechainWT> vWT;
+    vWT.reserve(nCount);
+    for (int i = 0; i < nCount; i++) {
+        SidechainWT wt;
+        wt.nSidechain = THIS_SIDECHAIN;
+        wt.strDestination = "1BvBMSEYstWetqTFn5Au4m4GFg7xJaNVN2";
+        wt.strRefundDestination = "";
+        wt.amount = 1 * COIN;
+        wt.mainchainFee = rand.randrange(10000);
+        wt.status = WT_UNSPENT;
+        wt.hashBlindWTX = rand.rand256();
+        vWT.push_back(wt);
+    }
+    return vWT;
+}
+
+/**
+ * Sidechain DB in memory, set as psidechaintree for the code that uses it
+ * directly. The data directory points to a temporary one while it exists.
+ */
+class SidechainTreeSetup
+{
+public:
+    SidechainTreeSetup()
+    {
+        SelectParams(CBaseChainParams::REGTEST);
+
+        fDatadirSet = gArgs.IsArgSet("-datadir");
+        strDatadir = gArgs.GetArg("-datadir", "");
+
+        ClearDatadirCache();
+        pathTemp = fs::temp_directory_path() / strprintf("bench_bitcoin_%lu_%i", (unsigned long)GetTime(), (int)GetRand(100000));
+        fs::create_directories(pathTemp);
+        gArgs.ForceSetArg("-datadir", pathTemp.string());
+
+        psidechaintreedb.reset(new CSidechainTreeDB(1 << 20, true));
+        psidechaintree.reset(new CSidechainTreeCache(psidechaintreedb.get()));
+    }
+
+    ~SidechainTreeSetup()
+    {
+        psidechaintree.reset();
+        psidechaintreedb.reset();
+        fs::remove_all(pathTemp);
+
+        if (fDatadirSet)
+            gArgs.ForceSetArg("-datadir", strDatadir);
+        else
+            gArgs.ClearArg("-datadir");
+        ClearDatadirCache();
+    }
+
+    // Write objects to the DB like ConnectBlock does
+    void Write(const std::vector<SidechainWT>& vWT)
+    {
+        std::vector<std::pair<uint256, const SidechainObj*>> vObj;
+        for (const SidechainWT& wt : vWT)
+            vObj.emplace_back(wt.GetID(), &wt);
+        psidechaintree->WriteSidechainIndex(vObj);
+        psidechaintree->Flush();
+    }
+
+private:
+    fs::path pathTemp;
+    bool fDatadirSet;
+    std::string strDatadir;
+};
+
+// Create the WT^ with CreateWTPrimeTx from a backlog of WT(s) in the
+// sidechain DB. A new WT with the highest fee is added before each run, so
+// that the candidate is created again with every output.
+static void WTPrimeBuild(benchmark::State& state, int nWT)
+{
+    SidechainTreeSetup setup;
+    FastRandomContext rand(true);
+
+    setup.Write(CreateWTs(rand, nWT));
+
+    CAmount nFee = 10000;
+    while (state.KeepRunning()) {
+        std::vector<SidechainWT> vWTNew = CreateWTs(rand, 1);
+        vWTNew[0].mainchainFee = nFee++;
+        setup.Write(vWTNew);
+
+        CTransactionRef wtPrimeTx;
+        CTransactionRef wtPrimeDataTx;
+        LOCK(cs_main);
+        bool fCreated = CreateWTPrimeTx(0, wtPrimeTx, wtPrimeDataTx, true /* fReplicationCheck */);
+        assert(fCreated && wtPrimeTx->vout.size() > 2);
+    }
+}
+
+static void SidechainWTPrimeBuildSmall(benchmark::State& state)
+{
+    WTPrimeBuild(state, WT_BACKLOG_SMALL);
+}
+
+static void SidechainWTPrimeBuildLarge(benchmark::State& state)
+{
+    WTPrimeBuild(state, WT_BACKLOG_LARGE);
+}
+
+// Check a full WT^ against the WT(s) in the sidechain DB
+static void SidechainVerifyWTPrimes(benchmark::State& state)
+{
+    SidechainTreeSetup setup;
+    FastRandomContext rand(true);
+
+    std::vector<SidechainWT> vWTUnspent = CreateWTs(rand, WT_BACKLOG_LARGE);
+    setup.Write(vWTUnspent);
+
+    std::vector<SidechainWT> vWTSelected = psidechaintree->GetWTsByStatus(THIS_SIDECHAIN, WT_UNSPENT, MAX_WTPRIME_WT);
+    WTPrimeBuilder builder;
+    for (const SidechainWT& wt : vWTSelected) {
+        if (!builder.AddWT(wt, wt.GetID()))
+            break;
+    }
+
+    SidechainWTPrime wtPrime;
+    wtPrime.nSidechain = THIS_SIDECHAIN;
+    wtPrime.vWT = builder.GetWTIDs();
+    CMutableTransaction mtx = builder.GetTx();
+    mtx.vout[1].scriptPubKey = EncodeWTFees(builder.GetMainchainFees());
+    wtPrime.wtPrime = MakeTransactionRef(std::move(mtx));
+
+    CMutableTransaction mtxData;
+    mtxData.vout.push_back(CTxOut(0, wtPrime.GetScript()));
+    SidechainObjIndex sidechainObjs = ParseSidechainObjs(CTransaction(mtxData));
+
+    while (state.KeepRunning()) {
+        std::string strFail;
+        std::vector<SidechainWT> vWT;
+        uint256 hashWTPrime;
+        uint256 hashWTPrimeID;
+        bool fValid = VerifyWTPrimes(strFail, 0, sidechainObjs, vWT, hashWTPrime, hashWTPrimeID);
+        assert(fValid && vWT.size() == wtPrime.vWT.size());
+    }
+}
+
+// Read every WT of a large backlog from the sidechain DB
+static void SidechainTreeDBGetWTs(benchmark::State& state)
+{
+    SidechainTreeSetup setup;
+    FastRandomContext rand(true);
+
+    setup.Write(CreateWTs(rand, WT_BACKLOG_LARGE));
+
+    while (state.KeepRunning()) {
+        std::vector<SidechainWT> vWT = psidechaintreedb->GetWTs(THIS_SIDECHAIN);
+        assert(vWT.size() == WT_BACKLOG_LARGE);
+    }
+}
+
+// Read the unspent WT(s) with the highest fees from the status index
+static void SidechainTreeDBGetWTsByStatus(benchmark::State& state)
+{
+    SidechainTreeSetup setup;
+    FastRandomContext rand(true);
+
+    setup.Write(CreateWTs(rand, WT_BACKLOG_LARGE));
+
+    while (state.KeepRunning()) {
+        std::vector<SidechainWT> vWT = psidechaintreedb->GetWTsByStatus(THIS_SIDECHAIN, WT_UNSPENT, MAX_WTPRIME_WT);
+        assert(vWT.size() == MAX_WTPRIME_WT);
+    }
+}
+
+// Parse the sidechain objects of a block full of WT(s) and write them to the
+// sidechain DB, the sidechain part of connecting the block
+static void SidechainConnectBlockWTs(benchmark::State& state)
+{
+    SidechainTreeSetup setup;
+    FastRandomContext rand(true);
+
+    CBlock block;
+    for (const SidechainWT& wt : CreateWTs(rand, WT_BACKLOG_SMALL)) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(1);
+        mtx.vin[0].prevout = COutPoint(rand.rand256(), 0);
+        mtx.vout.push_back(CTxOut(wt.amount, CScript() << OP_RETURN));
+        mtx.vout.push_back(CTxOut(0, wt.GetScript()));
+        block.vtx.push_back(MakeTransactionRef(std::move(mtx)));
+    }
+
+    while (state.KeepRunning()) {
+        // A new merkle root each time so that the index isn't reused
+        block.hashMerkleRoot = rand.rand256();
+        std::shared_ptr<const SidechainObjIndex> objs = GetBlockSidechainObjs(block);
+
+        std::vector<std::pair<uint256, const SidechainObj*>> vObj;
+        for (const SidechainWT& wt : objs->vWT)
+            vObj.emplace_back(wt.GetID(), &wt);
+        psidechaintree->WriteSidechainIndex(vObj);
+    }
+}
+
+BENCHMARK(SidechainSortDeposits, 50);
+BENCHMARK(SidechainWTPrimeBuildSmall, 200);
+BENCHMARK(SidechainWTPrimeBuildLarge, 20);
+BENCHMARK(SidechainVerifyWTPrimes, 50);
+BENCHMARK(SidechainTreeDBGetWTs, 10);
+BENCHMARK(SidechainTreeDBGetWTsByStatus, 100);
+BENCHMARK(SidechainConnectBlockWTs, 50);
@@ -1,15 +1,276 @@
 #include <bmmcache.h>
 
 #include <primitives/block.h>
+#include <txdb.h>
 #include <util.h>
 
-BMMCache::BMMCache()
+#include <algorithm>
+#include <assert.h>
+
+MainBlockHashIndex::MainBlockHashIndex() : nOffset(0), nFirstHeight(0)
+{
+
+}
+
+void MainBlockHashIndex::Clear()
+{
+    std::vector<uint256>().swap(vHash);
+    std::vector<Slot>().swap(vSlot);
+    nOffset = 0;
+    nFirstHeight = 0;
+}
+
+void MainBlockHashIndex::SetFirstHeight(size_t nHeight)
+{
+    assert(Empty());
+
+    vHash.clear();
+    nOffset = 0;
+    nFirstHeight = nHeight;
+}
+
+void MainBlockHashIndex::PushBack(const uint256& hash)
+{
+    assert(GetEndHeight() < EMPTY_SLOT);
+
+    // Keep the table at most half full so that probe sequences stay short
+    if ((Size() + 1) * 2 > vSlot.size()) {
+        size_t nSlots = std::max(vSlot.size(), (size_t)64);
+        while ((Size() + 1) * 2 > nSlots)
+            nSlots *= 2;
+        Rehash(nSlots);
+    }
+
+    vHash.push_back(hash);
+    InsertSlot(GetKey(hash), GetEndHeight() - 1);
+}
+
+void MainBlockHashIndex::PopBack()
+{
+    assert(!Empty());
+
+    size_t nSlot = FindSlot(GetKey(Back()), GetEndHeight() - 1);
+    assert(nSlot < vSlot.size());
+    EraseSlot(nSlot);
+
+    vHash.pop_back();
+    if (Empty()) {
+        vHash.clear();
+        nOffset = 0;
+    }
+}
+
+void MainBlockHashIndex::PopFront(size_t n)
+{
+    assert(n <= Size());
+
+    for (size_t i = 0; i < n; i++) {
+        size_t nSlot = FindSlot(GetKey(At(nFirstHeight)), nFirstHeight);
+        assert(nSlot < vSlot.size());
+        EraseSlot(nSlot);
+
+        nOffset++;
+        nFirstHeight++;
+    }
+
+    // Reclaim the front of the array once half of it is unused, so that
+    // dropping blocks is amortized constant time.
+    if (nOffset * 2 >= vHash.size()) {
+        vHash.erase(vHash.begin(), vHash.begin() + nOffset);
+        nOffset = 0;
+    }
+}
+
+bool MainBlockHashIndex::Find(const uint256& hash, size_t& nHeight) const
+{
+    if (vSlot.empty())
+        return false;
+
+    const uint64_t nKey = GetKey(hash);
+    const size_t nMask = vSlot.size() - 1;
+    for (size_t i = nKey & nMask; vSlot[i].nHeight != EMPTY_SLOT; i = (i + 1) & nMask) {
+        if (vSlot[i].nKey == nKey && At(vSlot[i].nHeight) == hash) {
+            nHeight = vSlot[i].nHeight;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MainBlockHashIndex::Contains(const uint256& hash) const
+{
+    size_t nHeight;
+    return Find(hash, nHeight);
+}
+
+size_t MainBlockHashIndex::FindSlot(uint64_t nKey, size_t nHeight) const
+{
+    if (vSlot.empty())
+        return 0;
+
+    const size_t nMask = vSlot.size() - 1;
+    for (size_t i = nKey & nMask; vSlot[i].nHeight != EMPTY_SLOT; i = (i + 1) & nMask) {
+        if (vSlot[i].nHeight == nHeight)
+            return i;
+    }
+    return vSlot.size();
+}
+
+void MainBlockHashIndex::InsertSlot(uint64_t nKey, uint32_t nHeight)
+{
+    const size_t nMask = vSlot.size() - 1;
+    size_t i = nKey & nMask;
+    while (vSlot[i].nHeight != EMPTY_SLOT)
+        i = (i + 1) & nMask;
+
+    vSlot[i].nKey = nKey;
+    vSlot[i].nHeight = nHeight;
+}
+
+void MainBlockHashIndex::EraseSlot(size_t nSlot)
+{
+    // Backward shift deletion: move later entries of the probe sequence into
+    // the gap unless that would put them before their home slot. This keeps
+    // lookups correct without leaving tombstones behind.
+    const size_t nMask = vSlot.size() - 1;
+    size_t i = nSlot;
+    size_t j = nSlot;
+    while (true) {
+        j = (j + 1) & nMask;
+        if (vSlot[j].nHeight == EMPTY_SLOT)
+            break;
+
+        size_t nHome = vSlot[j].nKey & nMask;
+        bool fStay = i <= j ? (i < nHome && nHome <= j) : (i < nHome || nHome <= j);
+        if (fStay)
+            continue;
+
+        vSlot[i] = vSlot[j];
+        i = j;
+    }
+    vSlot[i].nHeight = EMPTY_SLOT;
+}
+
+void MainBlockHashIndex::Rehash(size_t nSlots)
+{
+    Slot empty;
+    empty.nKey = 0;
+    empty.nHeight = EMPTY_SLOT;
+    vSlot.assign(nSlots, empty);
+
+    for (size_t nHeight = nFirstHeight; nHeight < GetEndHeight(); nHeight++)
+        InsertSlot(GetKey(At(nHeight)), nHeight);
+}
+
+VerifiedHashCache::VerifiedHashCache() : nMaxEntries(0)
+{
+    SetMaxSize(((size_t)DEFAULT_BMM_CACHE_SIZE << 20) / 2);
+}
+
+void VerifiedHashCache::SetMaxSize(size_t nBytes)
+{
+    boost::unique_lock<boost::shared_mutex> lock(cs);
+
+    nMaxEntries = std::min(std::max(nBytes / ENTRY_BYTES, (size_t)1), (size_t)1 << 30);
+
+    // Drop the oldest entries over the new limit and rebuild the table
+    while (deqEntry.size() > nMaxEntries)
+        deqEntry.pop_front();
+
+    table.setup(nMaxEntries * 2);
+    for (const auto& entry : deqEntry)
+        table.insert(entry.first);
+}
+
+bool VerifiedHashCache::Contains(const uint256& hash) const
+{
+    boost::shared_lock<boost::shared_mutex> lock(cs);
+    return table.contains(hash, false);
+}
+
+void VerifiedHashCache::Insert(const uint256& hash, int nHeight)
+{
+    boost::unique_lock<boost::shared_mutex> lock(cs);
+    InsertEntry(hash, nHeight);
+    EvictEntries();
+}
+
+void VerifiedHashCache::Load(const std::vector<uint256>& vHash, const std::vector<int>& vHeight)
+{
+    if (vHash.size() != vHeight.size())
+        return;
+
+    boost::unique_lock<boost::shared_mutex> lock(cs);
+    for (size_t i = 0; i < vHash.size(); i++)
+        InsertEntry(vHash[i], vHeight[i]);
+    EvictEntries();
+}
+
+void VerifiedHashCache::GetEntries(std::vector<uint256>& vHash, std::vector<int>& vHeight) const
+{
+    boost::shared_lock<boost::shared_mutex> lock(cs);
+
+    vHash.clear();
+    vHeight.clear();
+    vHash.reserve(deqEntry.size());
+    vHeight.reserve(deqEntry.size());
+    for (const auto& entry : deqEntry) {
+        vHash.push_back(entry.first);
+        vHeight.push_back(entry.second);
+    }
+}
+
+void VerifiedHashCache::Clear()
+{
+    boost::unique_lock<boost::shared_mutex> lock(cs);
+    deqEntry.clear();
+    table.setup(nMaxEntries * 2);
+}
+
+size_t VerifiedHashCache::Size() const
+{
+    boost::shared_lock<boost::shared_mutex> lock(cs);
+    return deqEntry.size();
+}
+
+size_t VerifiedHashCache::GetMaxEntries() const
+{
+    boost::shared_lock<boost::shared_mutex> lock(cs);
+    return nMaxEntries;
+}
+
+void VerifiedHashCache::InsertEntry(const uint256& hash, int nHeight)
+{
+    // A hash that was evicted can still be found until its slot is reused,
+    // it is added again once that happened and it has been verified again.
+    if (table.contains(hash, false))
+        return;
+
+    // Keep the entries ordered by height so that the oldest are evicted
+    // first, a reorg doesn't make newly verified entries older.
+    if (!deqEntry.empty())
+        nHeight = std::max(nHeight, deqEntry.back().second);
+
+    table.insert(hash);
+    deqEntry.emplace_back(hash, nHeight);
+}
+
+void VerifiedHashCache::EvictEntries()
+{
+    while (deqEntry.size() > nMaxEntries) {
+        table.contains(deqEntry.front().first, true);
+        deqEntry.pop_front();
+    }
+}
+
+BMMCache::BMMCache() : nSidechainHeight(0), pmainblockdb(nullptr), nMainBlockWindow(0)
 {
 
 }
 
 bool BMMCache::StoreBMMBlock(const CBlock& block)
 {
+    LOCK(cs_bmmblocks);
     if (!block.vtx.size())
         return false;
 
@@ -26,6 +287,7 @@ bool BMMCache::StoreBMMBlock(const CBlock& block)
 
 bool BMMCache::GetBMMBlock(const uint256& hashMerkleRoot, CBlock& block)
 {
+    LOCK(cs_bmmblocks);
     if (mapBMMBlocks.find(hashMerkleRoot) == mapBMMBlocks.end())
         return false;
 
@@ -36,6 +298,7 @@ bool BMMCache::GetBMMBlock(const uint256& hashMerkleRoot, CBlock& block)
 
 std::vector<CBlock> BMMCache::GetBMMBlockCache() const
 {
+    LOCK(cs_bmmblocks);
     std::vector<CBlock> vBlock;
     for (const auto& b : mapBMMBlocks) {
         vBlock.push_back(b.second);
@@ -45,6 +308,7 @@ std::vector<CBlock> BMMCache::GetBMMBlockCache() const
 
 std::vector<uint256> BMMCache::GetBroadcastedWTPrimeCache() const
 {
+    LOCK(cs_wt);
     std::vector<uint256> vHash;
     for (const auto& u : setWTPrimeBroadcasted) {
         vHash.push_back(u);
@@ -54,36 +318,89 @@ std::vector<uint256> BMMCache::GetBroadcastedWTPrimeCache() const
 
 std::vector<uint256> BMMCache::GetMainBlockHashCache() const
 {
-    return vMainBlockHash;
+    boost::shared_lock<boost::shared_mutex> lock(cs_mainblock);
+    std::vector<uint256> vHash;
+    vHash.reserve(mainBlockIndex.GetEndHeight());
+
+    // Hashes that aren't kept in memory are read from disk
+    for (size_t i = 0; i < mainBlockIndex.GetFirstHeight(); i++) {
+        uint256 hash;
+        if (!pmainblockdb || !pmainblockdb->ReadMainBlockHash(i, hash)) {
+            LogPrintf("%s: Error - failed to read mainchain block hash at height: %u\n", __func__, i);
+            return std::vector<uint256>();
+        }
+        vHash.push_back(hash);
+    }
+
+    for (size_t i = mainBlockIndex.GetFirstHeight(); i < mainBlockIndex.GetEndHeight(); i++)
+        vHash.push_back(mainBlockIndex.At(i));
+
+    return vHash;
 }
 
 std::vector<uint256> BMMCache::GetRecentMainBlockHashes() const
 {
+    boost::shared_lock<boost::shared_mutex> lock(cs_mainblock);
     // Return up to three of the most recent mainchain block hashes
     std::vector<uint256> vHash;
-    std::vector<uint256>::const_reverse_iterator rit = vMainBlockHash.rbegin();
-    for (; rit != vMainBlockHash.rend(); rit++) {
-        vHash.push_back(*rit);
-        if (vHash.size() == 3)
-            break;
-    }
-    std::reverse(vHash.begin(), vHash.end());
+    size_t nEnd = mainBlockIndex.GetEndHeight();
+    size_t nBegin = std::max(mainBlockIndex.GetFirstHeight(), nEnd < 3 ? 0 : nEnd - 3);
+    for (size_t i = nBegin; i < nEnd; i++)
+        vHash.push_back(mainBlockIndex.At(i));
+
     return vHash;
 }
 
 void BMMCache::ClearBMMBlocks()
 {
+    LOCK(cs_bmmblocks);
     mapBMMBlocks.clear();
+    mapBMMRequest.clear();
 }
 
 void BMMCache::StoreBroadcastedWTPrime(const uint256& hashWTPrime)
 {
+    LOCK(cs_wt);
     setWTPrimeBroadcasted.insert(hashWTPrime);
 }
 
-void BMMCache::StorePrevBlockBMMCreated(const uint256& hashPrevBlock)
+void BMMCache::StoreBMMRequest(const uint256& hashMerkleRoot, const uint256& hashPrevMain)
+{
+    LOCK(cs_bmmblocks);
+    setPrevBlockBMMCreated.insert(hashPrevMain);
+
+    std::vector<uint256>& vRequest = mapBMMRequest[hashPrevMain];
+    if (std::find(vRequest.begin(), vRequest.end(), hashMerkleRoot) == vRequest.end())
+        vRequest.push_back(hashMerkleRoot);
+}
+
+std::vector<uint256> BMMCache::GetBMMRequestsForMainBlock(const uint256& hashMainBlock) const
 {
-    setPrevBlockBMMCreated.insert(hashPrevBlock);
+    // Find the mainchain blocks that requests included in hashMainBlock
+    // could have been created for
+    std::vector<uint256> vHashPrev;
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_mainblock);
+        size_t nHeight;
+        if (!FindMainBlock(hashMainBlock, nHeight))
+            return std::vector<uint256>();
+
+        for (size_t i = 1; i <= BMM_REQUEST_WINDOW && i <= nHeight; i++) {
+            uint256 hashPrev;
+            if (!GetMainBlockHash(nHeight - i, hashPrev))
+                break;
+            vHashPrev.push_back(hashPrev);
+        }
+    }
+
+    LOCK(cs_bmmblocks);
+    std::vector<uint256> vHashMerkleRoot;
+    for (const uint256& hashPrev : vHashPrev) {
+        auto it = mapBMMRequest.find(hashPrev);
+        if (it != mapBMMRequest.end())
+            vHashMerkleRoot.insert(vHashMerkleRoot.end(), it->second.begin(), it->second.end());
+    }
+    return vHashMerkleRoot;
 }
 
 bool BMMCache::HaveBroadcastedWTPrime(const uint256& hashWTPrime) const
@@ -91,6 +408,7 @@ bool BMMCache::HaveBroadcastedWTPrime(const uint256& hashWTPrime) const
     if (hashWTPrime.IsNull())
         return false;
 
+    LOCK(cs_wt);
     if (setWTPrimeBroadcasted.count(hashWTPrime))
         return true;
 
@@ -102,7 +420,7 @@ bool BMMCache::HaveVerifiedBMM(const uint256& hashBlock) const
     if (hashBlock.IsNull())
         return false;
 
-    return (setBMMVerified.count(hashBlock));
+    return verifiedBMM.Contains(hashBlock);
 }
 
 void BMMCache::CacheVerifiedBMM(const uint256& hashBlock)
@@ -110,7 +428,7 @@ void BMMCache::CacheVerifiedBMM(const uint256& hashBlock)
     if (hashBlock.IsNull())
         return;
 
-    setBMMVerified.insert(hashBlock);
+    verifiedBMM.Insert(hashBlock, nSidechainHeight);
 }
 
 bool BMMCache::HaveVerifiedDeposit(const uint256& txid) const
@@ -118,7 +436,7 @@ bool BMMCache::HaveVerifiedDeposit(const uint256& txid) const
     if (txid.IsNull())
         return false;
 
-    return (setDepositVerified.count(txid));
+    return verifiedDeposit.Contains(txid);
 }
 
 void BMMCache::CacheVerifiedDeposit(const uint256& txid)
@@ -126,45 +444,71 @@ void BMMCache::CacheVerifiedDeposit(const uint256& txid)
     if (txid.IsNull())
         return;
 
-    setDepositVerified.insert(txid);
+    verifiedDeposit.Insert(txid, nSidechainHeight);
 }
 
-std::vector<uint256> BMMCache::GetVerifiedBMMCache() const
+void BMMCache::GetVerifiedBMMCache(std::vector<uint256>& vHash, std::vector<int>& vHeight) const
 {
-    std::vector<uint256> vHash;
-    for (const auto& u : setBMMVerified) {
-        vHash.push_back(u);
-    }
-    return vHash;
+    verifiedBMM.GetEntries(vHash, vHeight);
 }
 
-std::vector<uint256> BMMCache::GetVerifiedDepositCache() const
+void BMMCache::GetVerifiedDepositCache(std::vector<uint256>& vHash, std::vector<int>& vHeight) const
 {
-    std::vector<uint256> vHash;
-    for (const auto& u : setDepositVerified) {
-        vHash.push_back(u);
-    }
-    return vHash;
+    verifiedDeposit.GetEntries(vHash, vHeight);
+}
+
+void BMMCache::LoadVerifiedBMMCache(const std::vector<uint256>& vHash, const std::vector<int>& vHeight)
+{
+    verifiedBMM.Load(vHash, vHeight);
+}
+
+void BMMCache::LoadVerifiedDepositCache(const std::vector<uint256>& vHash, const std::vector<int>& vHeight)
+{
+    verifiedDeposit.Load(vHash, vHeight);
+}
+
+void BMMCache::ClearVerifiedCache()
+{
+    verifiedBMM.Clear();
+    verifiedDeposit.Clear();
+}
+
+void BMMCache::SetVerifiedCacheSize(size_t nBytes)
+{
+    verifiedBMM.SetMaxSize(nBytes / 2);
+    verifiedDeposit.SetMaxSize(nBytes / 2);
+}
+
+void BMMCache::SetSidechainHeight(int nHeight)
+{
+    nSidechainHeight = nHeight;
 }
 
 void BMMCache::CacheMainBlockHash(const uint256& hash)
+{
+    boost::unique_lock<boost::shared_mutex> lock(cs_mainblock);
+    AddMainBlockHash(hash);
+}
+
+void BMMCache::AddMainBlockHash(const uint256& hash)
 {
     // Don't re-cache the genesis block
-    if (vMainBlockHash.size() == 1 && hash == vMainBlockHash.front())
+    if (mainBlockIndex.GetEndHeight() == 1 && hash == mainBlockIndex.Back())
         return;
 
-    // Add to ordered vector of main block hashes
-    vMainBlockHash.push_back(hash);
-
-    // Add to index of hashes
-    MainBlockIndex index;
-    index.hash = hash;
-    index.index = vMainBlockHash.size() - 1;
+    // Add to ordered and indexed main block hashes
+    mainBlockIndex.PushBack(hash);
 
-    mapMainBlock[hash] = index;
+    SpillMainBlocks();
 }
 
 bool BMMCache::UpdateMainBlockCache(std::deque<uint256>& deqHashNew, bool& fReorg, std::vector<uint256>& vOrphan)
+{
+    boost::unique_lock<boost::shared_mutex> lock(cs_mainblock);
+    return UpdateMainBlockIndex(deqHashNew, fReorg, vOrphan);
+}
+
+bool BMMCache::UpdateMainBlockIndex(std::deque<uint256>& deqHashNew, bool& fReorg, std::vector<uint256>& vOrphan)
 {
     if (deqHashNew.empty()) {
         LogPrintf("%s: Error - called with empty list of new block hashes!\n", __func__);
@@ -172,35 +516,32 @@ bool BMMCache::UpdateMainBlockCache(std::deque<uint256>& deqHashNew, bool& fReor
     }
 
     // If the main block cache doesn't have the genesis block yet, add it first
-    if (vMainBlockHash.empty())
-        CacheMainBlockHash(deqHashNew.front());
+    if (mainBlockIndex.GetEndHeight() == 0)
+        AddMainBlockHash(deqHashNew.front());
 
     // Figure out the block in our cache that we will append the new blocks to
-    MainBlockIndex index;
-    if (mapMainBlock.count(deqHashNew.front())) {
-        index = mapMainBlock[deqHashNew.front()];
-    } else {
-        LogPrintf("%s: Error - New blocks do not connect to cached chain!\n", __func__);
+    size_t nHeight;
+    if (!mainBlockIndex.Find(deqHashNew.front(), nHeight)) {
+        if (FindMainBlock(deqHashNew.front(), nHeight))
+            LogPrintf("%s: Error - New blocks connect to cached chain below the in memory window!\n", __func__);
+        else
+            LogPrintf("%s: Error - New blocks do not connect to cached chain!\n", __func__);
         return false;
     }
 
     // If there were any blocks in our cache after the block we will be building
     // on, remove them, add them to vOrphan as they were disconnected, set
     // fReorg true.
-    if (index.index != vMainBlockHash.size() - 1) {
+    if (nHeight != mainBlockIndex.GetEndHeight() - 1) {
         LogPrintf("%s: Mainchain reorg detected!\n", __func__);
         fReorg = true;
     }
 
-    for (size_t i = vMainBlockHash.size() - 1; i > index.index; i--) {
-        vOrphan.push_back(vMainBlockHash[i]);
-        vMainBlockHash.pop_back();
+    while (mainBlockIndex.GetEndHeight() - 1 > nHeight) {
+        vOrphan.push_back(mainBlockIndex.Back());
+        mainBlockIndex.PopBack();
     }
 
-    // Remove disconnected blocks from index map
-    for (const uint256& u : vOrphan)
-        mapMainBlock.erase(u);
-
     // It's possible that the first block in the list of new blocks (which
     // connects to our cached chain by a prevblock) was already cached.
     // The first block that connected by prevblock to one of our cached blocks
@@ -209,99 +550,248 @@ bool BMMCache::UpdateMainBlockCache(std::deque<uint256>& deqHashNew, bool& fReor
     //
     // Check if we already know the first block in the deque and remove it if
     // we do.
-    if (HaveMainBlock(deqHashNew.front()))
+    if (mainBlockIndex.Contains(deqHashNew.front()))
         deqHashNew.pop_front();
 
     // Append new blocks
     for (const uint256& u : deqHashNew)
-        CacheMainBlockHash(u);
+        AddMainBlockHash(u);
 
-    LogPrintf("%s: Updated cached mainchain tip to: %s.\n", __func__, deqHashNew.back().ToString());
+    LogPrintf("%s: Updated cached mainchain tip to: %s.\n", __func__, mainBlockIndex.Back().ToString());
 
     return true;
 }
 
+void BMMCache::SetMainBlockDB(CMainBlockDB* pdb, size_t nWindow)
+{
+    boost::unique_lock<boost::shared_mutex> lock(cs_mainblock);
+    pmainblockdb = pdb;
+
+    // A window of 0 keeps all of the mainchain block hashes in memory
+    if (pdb && nWindow)
+        nMainBlockWindow = std::max(nWindow, (size_t)MIN_MAIN_BLOCK_CACHE_WINDOW);
+    else
+        nMainBlockWindow = 0;
+}
+
+bool BMMCache::ReadMainBlockDB()
+{
+    boost::unique_lock<boost::shared_mutex> lock(cs_mainblock);
+    if (!pmainblockdb || mainBlockIndex.GetEndHeight())
+        return false;
+
+    uint32_t nCount = 0;
+    if (!pmainblockdb->ReadMainBlockCount(nCount) || !nCount)
+        return false;
+
+    size_t nFirst = 0;
+    if (nMainBlockWindow && nCount > nMainBlockWindow)
+        nFirst = nCount - nMainBlockWindow;
+
+    mainBlockIndex.SetFirstHeight(nFirst);
+    for (size_t i = nFirst; i < nCount; i++) {
+        uint256 hash;
+        if (!pmainblockdb->ReadMainBlockHash(i, hash)) {
+            LogPrintf("%s: Error - failed to read mainchain block hash at height: %u\n", __func__, i);
+            mainBlockIndex.Clear();
+            return false;
+        }
+        mainBlockIndex.PushBack(hash);
+    }
+
+    return true;
+}
+
+bool BMMCache::WriteMainBlockDB()
+{
+    boost::shared_lock<boost::shared_mutex> lock(cs_mainblock);
+    if (!pmainblockdb)
+        return false;
+
+    std::vector<uint256> vHash;
+    vHash.reserve(mainBlockIndex.Size());
+    for (size_t i = mainBlockIndex.GetFirstHeight(); i < mainBlockIndex.GetEndHeight(); i++)
+        vHash.push_back(mainBlockIndex.At(i));
+
+    return pmainblockdb->WriteMainBlocks(mainBlockIndex.GetFirstHeight(), vHash, mainBlockIndex.GetEndHeight());
+}
+
+bool BMMCache::ConnectMainBlock(const uint256& hashBlock, const uint256& hashPrevBlock, bool& fReorg, std::vector<uint256>& vOrphan)
+{
+    boost::unique_lock<boost::shared_mutex> lock(cs_mainblock);
+    // Already our tip, nothing to do
+    if (!mainBlockIndex.Empty() && hashBlock == mainBlockIndex.Back())
+        return true;
+
+    // A cached block other than the tip became the tip again without being
+    // connected (mainchain rewind) - can't be handled from here.
+    size_t nHeight;
+    if (FindMainBlock(hashBlock, nHeight))
+        return false;
+
+    if (!FindMainBlock(hashPrevBlock, nHeight))
+        return false;
+
+    // Build on the prevblock, disconnecting any cached blocks after it
+    std::deque<uint256> deqHashNew;
+    deqHashNew.push_back(hashPrevBlock);
+    deqHashNew.push_back(hashBlock);
+
+    return UpdateMainBlockIndex(deqHashNew, fReorg, vOrphan);
+}
+
 uint256 BMMCache::GetLastMainBlockHash() const
 {
-    if (vMainBlockHash.empty())
+    boost::shared_lock<boost::shared_mutex> lock(cs_mainblock);
+    if (mainBlockIndex.Empty())
         return uint256();
 
-    return vMainBlockHash.back();
+    return mainBlockIndex.Back();
 }
 
 uint256 BMMCache::GetMainPrevBlockHash(const uint256& hashBlock) const
 {
-    if (vMainBlockHash.size() < 2)
+    boost::shared_lock<boost::shared_mutex> lock(cs_mainblock);
+    if (mainBlockIndex.GetEndHeight() < 2)
         return uint256();
 
-    if (!mapMainBlock.count(hashBlock))
+    size_t nHeight;
+    if (!FindMainBlock(hashBlock, nHeight) || nHeight == 0)
         return uint256();
 
-    const MainBlockIndex index = mapMainBlock.at(hashBlock);
-
-    size_t indexPrev = index.index;
-    if (indexPrev == 0)
+    uint256 hashPrev;
+    if (!GetMainBlockHash(nHeight - 1, hashPrev))
         return uint256();
 
-    indexPrev -= 1;
-    if (indexPrev >= vMainBlockHash.size())
-        return uint256();
-
-    return vMainBlockHash[indexPrev];
+    return hashPrev;
 }
 
 int BMMCache::GetCachedBlockCount() const
 {
-    return vMainBlockHash.size();
+    boost::shared_lock<boost::shared_mutex> lock(cs_mainblock);
+    return mainBlockIndex.GetEndHeight();
 }
 
 int BMMCache::GetMainchainBlockHeight(const uint256& hash) const
 {
-    if (!mapMainBlock.count(hash))
+    boost::shared_lock<boost::shared_mutex> lock(cs_mainblock);
+    size_t nHeight;
+    if (!FindMainBlock(hash, nHeight))
         return -1;
 
-    const MainBlockIndex index = mapMainBlock.at(hash);
-
-    return index.index - 1;
+    return nHeight - 1;
 }
 
 bool BMMCache::HaveMainBlock(const uint256& hash) const
 {
-    return mapMainBlock.count(hash);
+    boost::shared_lock<boost::shared_mutex> lock(cs_mainblock);
+    size_t nHeight;
+    return FindMainBlock(hash, nHeight);
 }
 
 bool BMMCache::HaveBMMRequestForPrevBlock(const uint256& hashPrevBlock) const
 {
+    LOCK(cs_bmmblocks);
     return setPrevBlockBMMCreated.count(hashPrevBlock);
 }
 
 void BMMCache::AddCheckedMainBlock(const uint256& hashBlock)
 {
+    LOCK(cs_bmmblocks);
     setMainBlockChecked.insert(hashBlock);
 }
 
 bool BMMCache::MainBlockChecked(const uint256& hashBlock) const
 {
+    LOCK(cs_bmmblocks);
     return setMainBlockChecked.count(hashBlock);
 }
 
 void BMMCache::ResetMainBlockCache()
 {
-    vMainBlockHash.clear();
-    mapMainBlock.clear();
+    boost::unique_lock<boost::shared_mutex> lock(cs_mainblock);
+    mainBlockIndex.Clear();
+
+    // Anything left on disk is ignored once the count is reset
+    if (pmainblockdb && !pmainblockdb->WriteMainBlockCount(0))
+        LogPrintf("%s: Error - failed to reset mainchain block hashes on disk!\n", __func__);
 }
 
 void BMMCache::CacheWTID(const uint256& wtid)
 {
+    LOCK(cs_wt);
     setWTIDCache.insert(wtid);
 }
 
 std::set<uint256> BMMCache::GetCachedWTID()
 {
+    LOCK(cs_wt);
     return setWTIDCache;
 }
 
 bool BMMCache::IsMyWT(const uint256& wtid)
 {
+    LOCK(cs_wt);
     return setWTIDCache.count(wtid);
 }
+
+bool BMMCache::FindMainBlock(const uint256& hash, size_t& nHeight) const
+{
+    if (mainBlockIndex.Find(hash, nHeight))
+        return true;
+
+    if (!pmainblockdb || !mainBlockIndex.GetFirstHeight())
+        return false;
+
+    // The database may also have stale entries above the in memory window
+    // from before a reorg, only heights below the window are used.
+    uint32_t nHeightDB;
+    if (!pmainblockdb->ReadMainBlockHeight(hash, nHeightDB) || nHeightDB >= mainBlockIndex.GetFirstHeight())
+        return false;
+
+    uint256 hashDB;
+    if (!pmainblockdb->ReadMainBlockHash(nHeightDB, hashDB) || hashDB != hash)
+        return false;
+
+    nHeight = nHeightDB;
+    return true;
+}
+
+bool BMMCache::GetMainBlockHash(size_t nHeight, uint256& hash) const
+{
+    if (nHeight >= mainBlockIndex.GetEndHeight())
+        return false;
+
+    if (nHeight >= mainBlockIndex.GetFirstHeight()) {
+        hash = mainBlockIndex.At(nHeight);
+        return true;
+    }
+
+    return pmainblockdb && pmainblockdb->ReadMainBlockHash(nHeight, hash);
+}
+
+void BMMCache::SpillMainBlocks()
+{
+    if (!pmainblockdb || !nMainBlockWindow)
+        return;
+
+    // Write in batches rather than for every new block
+    if (mainBlockIndex.Size() < nMainBlockWindow + MAIN_BLOCK_CACHE_SPILL_BATCH)
+        return;
+
+    size_t nFirst = mainBlockIndex.GetFirstHeight();
+    size_t nSpill = mainBlockIndex.Size() - nMainBlockWindow;
+
+    std::vector<uint256> vHash;
+    vHash.reserve(nSpill);
+    for (size_t i = nFirst; i < nFirst + nSpill; i++)
+        vHash.push_back(mainBlockIndex.At(i));
+
+    // If writing fails the hashes just stay in memory until the next attempt
+    if (!pmainblockdb->WriteMainBlocks(nFirst, vHash, nFirst + nSpill)) {
+        LogPrintf("%s: Error - failed to write mainchain block hashes to disk!\n", __func__);
+        return;
+    }
+
+    mainBlockIndex.PopFront(nSpill);
+}
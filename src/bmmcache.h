@@ -1,21 +1,209 @@
 #ifndef BITCOIN_BMMCACHE_H
 #define BITCOIN_BMMCACHE_H
 
+#include "crypto/common.h"
+#include "cuckoocache.h"
+#include "sync.h"
 #include "uint256.h"
 
+#include <atomic>
 #include <deque>
 #include <map>
 #include <set>
+#include <stdint.h>
 #include <vector>
 
+#include <boost/thread/shared_mutex.hpp>
+
 class CBlock;
+class CMainBlockDB;
+
+//! Default number of recent mainchain block hashes kept in memory
+static const unsigned int DEFAULT_MAIN_BLOCK_CACHE_WINDOW = 10000;
+
+//! Minimum number of recent mainchain block hashes kept in memory
+static const unsigned int MIN_MAIN_BLOCK_CACHE_WINDOW = 100;
+
+//! Number of mainchain block hashes written to disk at once when the in
+//! memory window is exceeded
+static const unsigned int MAIN_BLOCK_CACHE_SPILL_BATCH = 1000;
+
+/**
+ * Mainchain block hashes of a contiguous range of heights, with a hash table
+ * to look up the height of a hash in constant time.
+ *
+ * The hashes are stored in order of height in a single array. The table uses
+ * open addressing with linear probing, keyed by the first 64 bits of the
+ * block hash, and stores only the height of each hash. A probe compares the
+ * full hash in the height array so truncated key collisions are harmless.
+ *
+ * Hashes are only ever added or removed at the ends of the range: new blocks
+ * and reorgs at the back, old blocks dropped at the front.
+ */
+class MainBlockHashIndex
+{
+public:
+    MainBlockHashIndex();
+
+    void Clear();
+
+    /** Set the height of the first hash, only allowed while empty */
+    void SetFirstHeight(size_t nHeight);
+
+    /** Add the hash of the block at height GetEndHeight() */
+    void PushBack(const uint256& hash);
+
+    /** Remove the highest block */
+    void PopBack();
+
+    /** Remove the n lowest blocks */
+    void PopFront(size_t n);
+
+    /** Look up the height of a hash, returns false if it isn't in range */
+    bool Find(const uint256& hash, size_t& nHeight) const;
+
+    bool Contains(const uint256& hash) const;
+
+    /** Hash of the block at nHeight which must be in range */
+    const uint256& At(size_t nHeight) const { return vHash[nOffset + nHeight - nFirstHeight]; }
+
+    const uint256& Back() const { return vHash.back(); }
+
+    bool Empty() const { return vHash.size() == nOffset; }
+
+    /** Number of hashes in range */
+    size_t Size() const { return vHash.size() - nOffset; }
+
+    /** Height of the first hash in range */
+    size_t GetFirstHeight() const { return nFirstHeight; }
+
+    /** Height after the last hash in range */
+    size_t GetEndHeight() const { return nFirstHeight + Size(); }
+
+private:
+    struct Slot
+    {
+        uint64_t nKey;
+        uint32_t nHeight;
+    };
+
+    static const uint32_t EMPTY_SLOT = 0xffffffff;
+
+    static uint64_t GetKey(const uint256& hash) { return hash.GetCheapHash(); }
+
+    size_t FindSlot(uint64_t nKey, size_t nHeight) const;
+    void InsertSlot(uint64_t nKey, uint32_t nHeight);
+    void EraseSlot(size_t nSlot);
+    void Rehash(size_t nSlots);
+
+    // Block hashes in order of height. The first nOffset entries were dropped
+    // from the front and are reclaimed once they make up half of the array.
+    std::vector<uint256> vHash;
+    size_t nOffset;
+    size_t nFirstHeight;
 
-struct MainBlockIndex
+    // Hash table, the number of slots is a power of two
+    std::vector<Slot> vSlot;
+};
+
+//! Number of mainchain blocks after its prevblock that can include a BMM
+//! request. The request commits to its mainchain prevblock, so only the
+//! block built on it can include the request.
+static const unsigned int BMM_REQUEST_WINDOW = 1;
+
+//! -bmmcachesize default (MiB), shared by the verified BMM and deposit caches
+static const unsigned int DEFAULT_BMM_CACHE_SIZE = 16;
+
+/**
+ * Hash functions for CuckooCache of sidechain block hashes and txids. Block
+ * hashes may end in zero bytes from proof of work, so only the first 24
+ * bytes are used.
+ */
+class BMMCacheHasher
 {
-    size_t index;
-    uint256 hash;
+public:
+    template <uint8_t hash_select>
+    uint32_t operator()(const uint256& key) const
+    {
+        static_assert(hash_select < 8, "BMMCacheHasher only has 8 hashes available.");
+        uint32_t u = ReadLE32(key.begin() + 4 * (hash_select % 6));
+        if (hash_select >= 6)
+            u = ((u << 16) | (u >> 16)) ^ ReadLE32(key.begin() + 4 * (hash_select - 4));
+        return u;
+    }
 };
 
+/**
+ * Hashes verified with the mainchain, limited to a memory budget. Each hash
+ * is stored with the sidechain height at which it was verified, and once the
+ * cache is full the hashes verified at the lowest height are evicted first.
+ * Evicted hashes have to be verified with the mainchain again.
+ *
+ * Lookups go to a CuckooCache under a shared lock so that they don't block
+ * each other, the entries are also kept oldest first for eviction and for
+ * writing to disk.
+ */
+class VerifiedHashCache
+{
+public:
+    //! Approximate memory used per entry: two table slots and the age entry
+    static const size_t ENTRY_BYTES = 2 * sizeof(uint256) + sizeof(std::pair<uint256, int>);
+
+    VerifiedHashCache();
+
+    /** Set the memory budget, evicting the oldest entries if needed */
+    void SetMaxSize(size_t nBytes);
+
+    bool Contains(const uint256& hash) const;
+
+    /** Add a hash that was verified when the sidechain tip was at nHeight */
+    void Insert(const uint256& hash, int nHeight);
+
+    /** Bulk add hashes and the heights they were verified at, oldest first */
+    void Load(const std::vector<uint256>& vHash, const std::vector<int>& vHeight);
+
+    /** Get the hashes and the heights they were verified at, oldest first */
+    void GetEntries(std::vector<uint256>& vHash, std::vector<int>& vHeight) const;
+
+    /** Remove every entry */
+    void Clear();
+
+    size_t Size() const;
+
+    size_t GetMaxEntries() const;
+
+private:
+    typedef CuckooCache::cache<uint256, BMMCacheHasher> map_type;
+
+    // Insert without evicting, cs must be held exclusively
+    void InsertEntry(const uint256& hash, int nHeight);
+
+    // Evict the oldest entries over the limit, cs must be held exclusively
+    void EvictEntries();
+
+    mutable boost::shared_mutex cs;
+
+    // The table has twice as many slots as entries allowed so that the
+    // CuckooCache rarely has to evict entries on its own
+    map_type table;
+
+    // Entries in the order they were added, which is by sidechain height
+    // other than after a reorg
+    std::deque<std::pair<uint256, int /* nHeight */> > deqEntry;
+
+    size_t nMaxEntries;
+};
+
+/**
+ * Caches of BMM and mainchain data used by validation, the miner, RPC and
+ * the GUI from different threads.
+ *
+ * BMMCache is internally synchronized, with a separate lock for each group
+ * of members so that unrelated callers don't contend. The verified BMM and
+ * verified deposit caches, which are checked for every block and deposit,
+ * and the mainchain block hashes are read-mostly: readers share the lock and
+ * only run into each other when something is being added.
+ */
 class BMMCache
 {
 public:
@@ -37,7 +225,14 @@ public:
 
     void StoreBroadcastedWTPrime(const uint256& hashWTPrime);
 
-    void StorePrevBlockBMMCreated(const uint256& hashPrevBlock);
+    // Record a BMM request for the BMM block with hashMerkleRoot, created
+    // when hashPrevMain was the mainchain tip
+    void StoreBMMRequest(const uint256& hashMerkleRoot, const uint256& hashPrevMain);
+
+    // Get the merkle roots of our BMM requests that could be included in
+    // this mainchain block, based on the prevblock each request was created
+    // for and BMM_REQUEST_WINDOW
+    std::vector<uint256> GetBMMRequestsForMainBlock(const uint256& hashMainBlock) const;
 
     bool HaveBroadcastedWTPrime(const uint256& hashWTPrime) const;
 
@@ -53,9 +248,28 @@ public:
     // Cache that we verified a deposit with the mainchain
     void CacheVerifiedDeposit(const uint256& txid);
 
-    std::vector<uint256> GetVerifiedBMMCache() const;
+    // Get the verified BMM cache and the sidechain heights at which the blocks
+    // were verified, oldest first
+    void GetVerifiedBMMCache(std::vector<uint256>& vHash, std::vector<int>& vHeight) const;
+
+    // Get the verified deposit cache and the sidechain heights at which the
+    // deposits were verified, oldest first
+    void GetVerifiedDepositCache(std::vector<uint256>& vHash, std::vector<int>& vHeight) const;
+
+    // Load verified BMM and deposits from disk, oldest first
+    void LoadVerifiedBMMCache(const std::vector<uint256>& vHash, const std::vector<int>& vHeight);
+
+    void LoadVerifiedDepositCache(const std::vector<uint256>& vHash, const std::vector<int>& vHeight);
+
+    // Forget every verified BMM and deposit
+    void ClearVerifiedCache();
+
+    // Set the memory budget shared by the verified BMM and deposit caches
+    void SetVerifiedCacheSize(size_t nBytes);
 
-    std::vector<uint256> GetVerifiedDepositCache() const;
+    // Set the sidechain tip height that newly verified BMM and deposits are
+    // cached with
+    void SetSidechainHeight(int nHeight);
 
     void CacheMainBlockHash(const uint256& hash);
 
@@ -63,6 +277,24 @@ public:
 
     bool UpdateMainBlockCache(std::deque<uint256>& deqHashNew, bool& fReorg, std::vector<uint256>& vOrphan);
 
+    // Set the database that mainchain block hashes outside of the in memory
+    // window are written to, and the size of the window. Without a database
+    // all mainchain block hashes are kept in memory.
+    void SetMainBlockDB(CMainBlockDB* pdb, size_t nWindow);
+
+    // Read the most recent mainchain block hashes into memory from the
+    // database. The cache must be empty.
+    bool ReadMainBlockDB();
+
+    // Write the mainchain block hashes held in memory to the database
+    bool WriteMainBlockDB();
+
+    // Connect a new mainchain tip to the cache by its prevblock, for example
+    // from a mainchain zmq notification. Returns false if the prevblock isn't
+    // cached, meaning notifications were missed and the cache must be synced
+    // with the mainchain instead.
+    bool ConnectMainBlock(const uint256& hashBlock, const uint256& hashPrevBlock, bool& fReorg, std::vector<uint256>& vOrphan);
+
     uint256 GetLastMainBlockHash() const;
 
     uint256 GetMainPrevBlockHash(const uint256& hashBlock) const;
@@ -88,31 +320,34 @@ public:
     bool IsMyWT(const uint256& wtid);
 
 private:
-    // BMM blocks that we have created with the intention of connecting to the
-    // side blockchain once the BMM h* hash is included on the mainchain
-    std::map<uint256 /* hashMerkleRoot */, CBlock> mapBMMBlocks;
+    // Add a mainchain block hash, cs_mainblock must be held exclusively
+    void AddMainBlockHash(const uint256& hash);
 
-    // Cache of sidechain block hashes which we have already verified with the
-    // mainchain as having the BMM h* hash included.
-    std::set<uint256 /* hashBlock */> setBMMVerified;
+    // UpdateMainBlockCache with cs_mainblock held exclusively
+    bool UpdateMainBlockIndex(std::deque<uint256>& deqHashNew, bool& fReorg, std::vector<uint256>& vOrphan);
 
-    // Cache of deposit txid which we have already verified with the mainchain
-    std::set<uint256 /* txid */> setDepositVerified;
+    // Look up the height of a mainchain block hash in memory or on disk
+    bool FindMainBlock(const uint256& hash, size_t& nHeight) const;
 
-    // WT^(s) that we have already broadcasted to the mainchain.
-    std::set<uint256> setWTPrimeBroadcasted;
+    // Look up the mainchain block hash at a height in memory or on disk
+    bool GetMainBlockHash(size_t nHeight, uint256& hash) const;
+
+    // Write the oldest mainchain block hashes to disk once the window is full
+    void SpillMainBlocks();
 
-    // Index of mainchain block hash in vMainBlockHash
-    std::map<uint256 /* hashMainchainBlock */, MainBlockIndex> mapMainBlock;
+    // Protects mapBMMBlocks, mapBMMRequest, setPrevBlockBMMCreated and
+    // setMainBlockChecked
+    mutable CCriticalSection cs_bmmblocks;
 
-    // List of all known mainchain block hashes in order
-    std::vector<uint256> vMainBlockHash;
+    // BMM blocks that we have created with the intention of connecting to the
+    // side blockchain once the BMM h* hash is included on the mainchain
+    std::map<uint256 /* hashMerkleRoot */, CBlock> mapBMMBlocks;
+
+    // Merkle roots of the BMM blocks we have sent requests for, by the
+    // mainchain prevblock of the request. Only the mainchain blocks within
+    // BMM_REQUEST_WINDOW of a prevblock are checked for its requests.
+    std::map<uint256 /* hashPrevMain */, std::vector<uint256> > mapBMMRequest;
 
-    // TODO we could also cache a map of mainchain block hashes that we created
-    // BMM requests for. That way, to check for BMM commitments we can just
-    // check recent blocks that we created a commitment for instead of scanning
-    // all of them.
-    //
     // Set of hashes for which we've created a BMM request with this mainchain
     // prevblock. (Meaning the BMM request was created when the hash was the
     // mainchain tip)
@@ -121,8 +356,37 @@ private:
     // Set of main block hashes that we've already checked for our BMM requests
     std::set<uint256> setMainBlockChecked;
 
+    // Cache of sidechain block hashes which we have already verified with the
+    // mainchain as having the BMM h* hash included.
+    VerifiedHashCache verifiedBMM;
+
+    // Cache of deposit txid which we have already verified with the mainchain
+    VerifiedHashCache verifiedDeposit;
+
+    // Sidechain tip height for new entries of verifiedBMM and verifiedDeposit
+    std::atomic<int> nSidechainHeight;
+
+    // Protects setWTPrimeBroadcasted and setWTIDCache
+    mutable CCriticalSection cs_wt;
+
+    // WT^(s) that we have already broadcasted to the mainchain.
+    std::set<uint256> setWTPrimeBroadcasted;
+
     // WT IDs for WT(s) created by the user
     std::set<uint256> setWTIDCache;
+
+    // Protects mainBlockIndex, pmainblockdb and nMainBlockWindow
+    mutable boost::shared_mutex cs_mainblock;
+
+    // Recent mainchain block hashes in order of height. Older ones are in
+    // pmainblockdb.
+    MainBlockHashIndex mainBlockIndex;
+
+    // Database of mainchain block hashes below mainBlockIndex, if set
+    CMainBlockDB* pmainblockdb;
+
+    // Number of mainchain block hashes to keep in memory
+    size_t nMainBlockWindow;
 };
 
 #endif // BITCOIN_BMMCACHE_H
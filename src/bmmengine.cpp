@@ -0,0 +1,250 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bmmengine.h>
+
+#include <bmmcache.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <miner.h>
+#include <sidechainclient.h>
+#include <sync.h>
+#include <ui_interface.h>
+#include <util.h>
+#include <utiltime.h>
+#include <validation.h>
+
+#include <algorithm>
+#include <functional>
+
+std::unique_ptr<BMMEngine> pbmmengine;
+
+// Add a sample to the sum and maximum of a latency stat
+static void AddLatency(int64_t nTime, int64_t& nTotal, int64_t& nMax)
+{
+    nTotal += nTime;
+    nMax = std::max(nMax, nTime);
+}
+
+BMMEngine::BMMEngine(CAmount amountIn) : amount(amountIn), fStop(false),
+    fWake(false), fRebuild(true), fRunning(false), nLastBuild(0)
+{
+}
+
+BMMEngine::~BMMEngine()
+{
+    Stop();
+}
+
+void BMMEngine::Start()
+{
+    if (fRunning)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mut);
+        fStop = false;
+        fRebuild = true;
+    }
+
+    connMainchainTip = uiInterface.NotifyMainchainTip.connect(std::bind(&BMMEngine::Wake, this, false));
+    RegisterValidationInterface(this);
+
+    fRunning = true;
+    threadBMM = std::thread(&TraceThread<std::function<void()> >, "bmm",
+            std::function<void()>(std::bind(&BMMEngine::ThreadBMM, this)));
+}
+
+void BMMEngine::Stop()
+{
+    if (!fRunning)
+        return;
+
+    UnregisterValidationInterface(this);
+    connMainchainTip.disconnect();
+
+    {
+        std::lock_guard<std::mutex> lock(mut);
+        fStop = true;
+    }
+    cond.notify_one();
+
+    if (threadBMM.joinable())
+        threadBMM.join();
+
+    fRunning = false;
+}
+
+BMMEngineStats BMMEngine::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(mutStats);
+    return stats;
+}
+
+void BMMEngine::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload)
+{
+    Wake(true /* fRebuild */);
+}
+
+void BMMEngine::TransactionAddedToMempool(const CTransactionRef &ptxn)
+{
+    Wake(true /* fRebuild */);
+}
+
+void BMMEngine::Wake(bool fRebuildIn)
+{
+    {
+        std::lock_guard<std::mutex> lock(mut);
+        fWake = true;
+        if (fRebuildIn)
+            fRebuild = true;
+    }
+    cond.notify_one();
+}
+
+void BMMEngine::ThreadBMM()
+{
+    int64_t nLastSync = 0;
+    bool fRebuildPending = false;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mut);
+            cond.wait_for(lock, std::chrono::milliseconds(BMM_ENGINE_REBUILD_INTERVAL),
+                    [this]{ return fStop || fWake; });
+            if (fStop)
+                return;
+
+            fWake = false;
+            if (fRebuild)
+                fRebuildPending = true;
+            fRebuild = false;
+        }
+
+        // Sync the main block cache ourselves from time to time. While
+        // mainchain tip notifications are received this doesn't poll.
+        if (GetTime() - nLastSync >= BMM_ENGINE_POLL_INTERVAL) {
+            nLastSync = GetTime();
+
+            bool fReorg = false;
+            std::vector<uint256> vOrphan;
+            if (!SyncMainBlockHashCache(fReorg, vOrphan))
+                LogPrintf("%s: Failed to update main block hash cache!\n", __func__);
+            if (fReorg)
+                HandleMainchainReorg(vOrphan);
+        }
+
+        uint256 hashMainTip = bmmCache.GetLastMainBlockHash();
+        if (!hashMainTip.IsNull() && hashMainTip != hashMainTipHandled) {
+            HandleMainchainTip(hashMainTip);
+            hashMainTipHandled = hashMainTip;
+
+            // Build the block for the next mainchain tip
+            fRebuildPending = true;
+            nLastBuild = 0;
+        }
+
+        if (fRebuildPending && GetTimeMillis() - nLastBuild >= BMM_ENGINE_REBUILD_INTERVAL) {
+            BuildNextBlock();
+            fRebuildPending = false;
+        }
+    }
+}
+
+void BMMEngine::HandleMainchainTip(const uint256& hashMainTip)
+{
+    int64_t nTimeStart = GetTimeMicros();
+
+    SidechainClient client;
+
+    // Check the mainchain blocks we haven't checked yet (normally only the
+    // new tip) for our BMM request and submit our block if it was included
+    std::string strError;
+    uint256 hashConnected;
+    uint256 hashConnectedMerkleRoot;
+    if (!client.CheckBMMRequests(bmmCache.GetRecentMainBlockHashes(), hashConnected, hashConnectedMerkleRoot, strError))
+        LogPrintf("%s: %s\n", __func__, strError);
+
+    int64_t nTimeChecked = GetTimeMicros();
+
+    // The requests we made for the old mainchain tip are invalid now
+    bmmCache.ClearBMMBlocks();
+
+    uint256 hashRequest;
+    uint256 txid;
+    bool fAttempted = !bmmCache.HaveBMMRequestForPrevBlock(hashMainTip);
+    if (fAttempted) {
+        // If our tip changed (for example because the block we just
+        // submitted connected) the prebuilt block is stale
+        uint256 hashTip;
+        {
+            LOCK(cs_main);
+            if (chainActive.Tip())
+                hashTip = chainActive.Tip()->GetBlockHash();
+        }
+        if (!pblockNext || pblockNext->hashPrevBlock != hashTip)
+            BuildNextBlock();
+
+        if (pblockNext) {
+            CBlock block = *pblockNext;
+            if (UpdatePrevBlockCommit(block, hashMainTip) && bmmCache.StoreBMMBlock(block)) {
+                hashRequest = block.hashMerkleRoot;
+                txid = client.SendBMMRequest(hashRequest, hashMainTip, 0, amount);
+                bmmCache.StoreBMMRequest(hashRequest, hashMainTip);
+            }
+        }
+        if (txid.IsNull())
+            LogPrintf("%s: Failed to create BMM request for mainchain block: %s\n", __func__, hashMainTip.ToString());
+    }
+
+    int64_t nTimeRequested = GetTimeMicros();
+
+    LogPrint(BCLog::BENCH, "%s: mainchain tip %s checked in %.2fms, request sent in %.2fms\n", __func__,
+            hashMainTip.ToString(), (nTimeChecked - nTimeStart) * 0.001, (nTimeRequested - nTimeStart) * 0.001);
+
+    std::lock_guard<std::mutex> lock(mutStats);
+    stats.nMainTips++;
+    stats.hashLastMainTip = hashMainTip;
+    AddLatency(nTimeChecked - nTimeStart, stats.nCheckTotal, stats.nCheckMax);
+    if (!hashConnected.IsNull()) {
+        stats.nConnected++;
+        stats.hashLastConnected = hashConnected;
+    }
+    if (fAttempted && !txid.IsNull()) {
+        stats.nRequests++;
+        stats.hashLastRequest = hashRequest;
+        stats.txidLastRequest = txid;
+        AddLatency(nTimeRequested - nTimeStart, stats.nRequestTotal, stats.nRequestMax);
+    } else if (fAttempted) {
+        stats.nRequestFailures++;
+    }
+}
+
+bool BMMEngine::BuildNextBlock()
+{
+    int64_t nTimeStart = GetTimeMicros();
+
+    std::unique_ptr<CBlock> pblock(new CBlock());
+    std::string strError;
+    bool fBuilt = BlockAssembler(Params()).GenerateBMMBlock(*pblock, strError);
+
+    int64_t nTime = GetTimeMicros() - nTimeStart;
+    nLastBuild = GetTimeMillis();
+
+    if (fBuilt) {
+        pblockNext = std::move(pblock);
+    } else {
+        pblockNext.reset();
+        LogPrint(BCLog::BENCH, "%s: Failed to build BMM block: %s\n", __func__, strError);
+    }
+
+    std::lock_guard<std::mutex> lock(mutStats);
+    if (fBuilt) {
+        stats.nBuilt++;
+        AddLatency(nTime, stats.nBuildTotal, stats.nBuildMax);
+    } else {
+        stats.nBuildFailures++;
+    }
+
+    return fBuilt;
+}
@@ -0,0 +1,128 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BMMENGINE_H
+#define BITCOIN_BMMENGINE_H
+
+#include <amount.h>
+#include <primitives/block.h>
+#include <uint256.h>
+#include <validationinterface.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <boost/signals2/connection.hpp>
+
+//! Default for -bmmautomate
+static const bool DEFAULT_BMM_AUTOMATE = false;
+
+//! Default for -bmmamount, paid to the mainchain miner for each BMM request
+static const CAmount DEFAULT_BMM_AMOUNT = 0.0001 * COIN;
+
+//! Seconds between main block cache syncs done by the BMM engine itself
+static const int64_t BMM_ENGINE_POLL_INTERVAL = 5;
+
+//! Minimum milliseconds between rebuilds of the next BMM block for mempool changes
+static const int64_t BMM_ENGINE_REBUILD_INTERVAL = 1000;
+
+/** Counters and latencies of the BMM engine */
+struct BMMEngineStats
+{
+    //! New mainchain tips handled
+    uint64_t nMainTips = 0;
+    //! BMM blocks built ahead of a mainchain tip
+    uint64_t nBuilt = 0;
+    //! BMM blocks that failed to build
+    uint64_t nBuildFailures = 0;
+    //! BMM requests sent to the mainchain
+    uint64_t nRequests = 0;
+    //! BMM requests that could not be sent
+    uint64_t nRequestFailures = 0;
+    //! BMM blocks found in a mainchain block and submitted
+    uint64_t nConnected = 0;
+    //! Sum and maximum of BMM block build time in microseconds
+    int64_t nBuildTotal = 0;
+    int64_t nBuildMax = 0;
+    //! Sum and maximum of the time in microseconds to check a new mainchain
+    //! tip for our BMM requests
+    int64_t nCheckTotal = 0;
+    int64_t nCheckMax = 0;
+    //! Sum and maximum of the time in microseconds from seeing a new
+    //! mainchain tip to sending the BMM request for it
+    int64_t nRequestTotal = 0;
+    int64_t nRequestMax = 0;
+
+    uint256 hashLastMainTip;
+    uint256 hashLastRequest; // Merkle root of the last BMM block requested
+    uint256 txidLastRequest;
+    uint256 hashLastConnected;
+};
+
+/**
+ * Automated BMM in the background. A BMM block is built ahead of time and
+ * rebuilt when our tip or mempool changes. When the mainchain tip changes the
+ * new mainchain block is checked for our current BMM request, and the
+ * prebuilt block is pointed at the new tip and requested right away.
+ */
+class BMMEngine : public CValidationInterface
+{
+public:
+    explicit BMMEngine(CAmount amountIn);
+    ~BMMEngine();
+
+    void Start();
+    void Stop();
+
+    bool IsRunning() const { return fRunning; }
+
+    CAmount GetAmount() const { return amount; }
+
+    BMMEngineStats GetStats() const;
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override;
+    void TransactionAddedToMempool(const CTransactionRef &ptxn) override;
+
+private:
+    void ThreadBMM();
+
+    /** Wake the engine thread, with fRebuild to also rebuild the next block */
+    void Wake(bool fRebuild);
+
+    /** Check a new mainchain tip for our BMM request and request the next
+     * BMM block for it */
+    void HandleMainchainTip(const uint256& hashMainTip);
+
+    /** Build the next BMM block on our current tip */
+    bool BuildNextBlock();
+
+    const CAmount amount;
+
+    std::mutex mut;
+    std::condition_variable cond;
+    bool fStop;
+    bool fWake;
+    bool fRebuild;
+
+    std::atomic<bool> fRunning;
+    std::thread threadBMM;
+    boost::signals2::connection connMainchainTip;
+
+    // Only used by the engine thread
+    std::unique_ptr<CBlock> pblockNext;
+    uint256 hashMainTipHandled;
+    int64_t nLastBuild;
+
+    mutable std::mutex mutStats;
+    BMMEngineStats stats;
+};
+
+/** The BMM engine, if started with -bmmautomate */
+extern std::unique_ptr<BMMEngine> pbmmengine;
+
+#endif // BITCOIN_BMMENGINE_H
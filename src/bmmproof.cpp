@@ -0,0 +1,199 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bmmproof.h>
+
+#include <arith_uint256.h>
+#include <bmmcache.h>
+#include <consensus/merkle.h>
+#include <script/script.h>
+#include <validation.h>
+
+BMMProofCache bmmProofCache;
+
+std::vector<uint256> BMMProof::GetCriticalHashes() const
+{
+    std::vector<uint256> vHash;
+    for (const CTxOut& out : coinbase->vout) {
+        uint256 hashCritical;
+        if (out.scriptPubKey.IsCriticalHashCommit(hashCritical))
+            vHash.push_back(hashCritical);
+    }
+    return vHash;
+}
+
+BMMProof CreateBMMProof(const CMainchainBlock& block)
+{
+    BMMProof proof;
+    proof.header = block.GetBlockHeader();
+    if (block.vtx.empty())
+        return proof;
+
+    std::vector<uint256> vLeaves;
+    vLeaves.reserve(block.vtx.size());
+    for (const CTransactionRef& tx : block.vtx)
+        vLeaves.push_back(tx->GetHash());
+
+    proof.coinbase = block.vtx[0];
+    proof.vMerkleBranch = ComputeMerkleBranch(vLeaves, 0);
+
+    return proof;
+}
+
+bool CheckBMMProofContents(const BMMProof& proof, std::string& strFail)
+{
+    bool fNegative;
+    bool fOverflow;
+    arith_uint256 bnTarget;
+    bnTarget.SetCompact(proof.header.nBits, &fNegative, &fOverflow);
+    if (fNegative || fOverflow || bnTarget == 0) {
+        strFail = "invalid mainchain nBits";
+        return false;
+    }
+    if (UintToArith256(proof.GetMainBlockHash()) > bnTarget) {
+        strFail = "mainchain proof of work failed";
+        return false;
+    }
+
+    if (!proof.coinbase->IsCoinBase()) {
+        strFail = "not a coinbase";
+        return false;
+    }
+
+    if (proof.vMerkleBranch.size() > MAX_BMM_PROOF_BRANCH) {
+        strFail = "merkle branch too long";
+        return false;
+    }
+
+    if (ComputeMerkleRootFromBranch(proof.coinbase->GetHash(), proof.vMerkleBranch, 0) != proof.header.hashMerkleRoot) {
+        strFail = "coinbase not in mainchain block";
+        return false;
+    }
+
+    if (proof.GetCriticalHashes().empty()) {
+        strFail = "no h* commit";
+        return false;
+    }
+
+    return true;
+}
+
+bool CheckBMMProof(const CBlockHeader& header, const BMMProof& proof, std::string& strFail)
+{
+    if (proof.GetMainBlockHash() != header.hashMainchainBlock) {
+        strFail = "mainchain header does not match";
+        return false;
+    }
+
+    // The main block cache only has blocks of the best mainchain
+    if (!bmmCache.HaveMainBlock(header.hashMainchainBlock)) {
+        strFail = "mainchain block unknown";
+        return false;
+    }
+
+    if (!CheckBMMProofContents(proof, strFail))
+        return false;
+
+    for (const uint256& hashCritical : proof.GetCriticalHashes()) {
+        if (hashCritical == header.hashMerkleRoot)
+            return true;
+    }
+
+    strFail = "h* not committed";
+    return false;
+}
+
+size_t BMMProofCache::Add(const BMMProof& proof, int64_t nPeer)
+{
+    const uint256 hashMainBlock = proof.GetMainBlockHash();
+    std::shared_ptr<const BMMProof> pproof = std::make_shared<const BMMProof>(proof);
+
+    LOCK(cs);
+    std::vector<uint256> vHashCritical = proof.GetCriticalHashes();
+    if (vHashCritical.size() > MAX_BMM_PROOF_HASHES)
+        vHashCritical.resize(MAX_BMM_PROOF_HASHES);
+
+    size_t nAdded = 0;
+    for (const uint256& hashCritical : vHashCritical) {
+        ProofKey key(hashMainBlock, hashCritical);
+        ProofEntry entry{pproof, nPeer, nSequenceNext};
+        if (!mapProof.emplace(key, entry).second)
+            continue;
+        nAdded++;
+
+        mapOrder.emplace(nSequenceNext, key);
+        if (nPeer != NO_PEER) {
+            std::map<uint64_t, ProofKey>& mapPeer = mapPeerOrder[nPeer];
+            mapPeer.emplace(nSequenceNext, key);
+            if (mapPeer.size() > MAX_BMM_PROOF_CACHE_PEER)
+                Erase(mapProof.find(mapPeer.begin()->second));
+        }
+        nSequenceNext++;
+
+        if (mapProof.size() > MAX_BMM_PROOF_CACHE)
+            Erase(mapProof.find(mapOrder.begin()->second));
+    }
+    return nAdded;
+}
+
+void BMMProofCache::Erase(std::map<ProofKey, ProofEntry>::iterator it)
+{
+    AssertLockHeld(cs);
+    const ProofEntry& entry = it->second;
+    mapOrder.erase(entry.nSequence);
+    if (entry.nPeer != NO_PEER) {
+        auto itPeer = mapPeerOrder.find(entry.nPeer);
+        itPeer->second.erase(entry.nSequence);
+        if (itPeer->second.empty())
+            mapPeerOrder.erase(itPeer);
+    }
+    mapProof.erase(it);
+}
+
+bool BMMProofCache::Get(const uint256& hashMainBlock, const uint256& hashCritical, BMMProof& proof) const
+{
+    LOCK(cs);
+    std::map<ProofKey, ProofEntry>::const_iterator it = mapProof.find(ProofKey(hashMainBlock, hashCritical));
+    if (it == mapProof.end())
+        return false;
+
+    proof = *it->second.proof;
+    return true;
+}
+
+size_t BMMProofCache::Size() const
+{
+    LOCK(cs);
+    return mapProof.size();
+}
+
+size_t BMMProofCache::PeerSize(int64_t nPeer) const
+{
+    LOCK(cs);
+    auto it = mapPeerOrder.find(nPeer);
+    return it == mapPeerOrder.end() ? 0 : it->second.size();
+}
+
+void BMMProofCache::ForgetPeer(int64_t nPeer)
+{
+    LOCK(cs);
+    auto itPeer = mapPeerOrder.find(nPeer);
+    if (itPeer == mapPeerOrder.end())
+        return;
+
+    // Erasing the last slot of the peer erases its order map too
+    std::vector<ProofKey> vKey;
+    for (const auto& it : itPeer->second)
+        vKey.push_back(it.second);
+    for (const ProofKey& key : vKey)
+        Erase(mapProof.find(key));
+}
+
+void BMMProofCache::Clear()
+{
+    LOCK(cs);
+    mapProof.clear();
+    mapOrder.clear();
+    mapPeerOrder.clear();
+}
@@ -0,0 +1,134 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BMMPROOF_H
+#define BITCOIN_BMMPROOF_H
+
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <serialize.h>
+#include <sync.h>
+#include <uint256.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+//! Maximum number of proofs kept while waiting for the headers they prove
+static const size_t MAX_BMM_PROOF_CACHE = 4000;
+
+//! Maximum number of proofs kept from a single peer, one headers message worth
+static const size_t MAX_BMM_PROOF_CACHE_PEER = 2000;
+
+//! Maximum number of h* commits of one proof that are cached, a mainchain
+//! coinbase has one for every sidechain BMM'd in the block
+static const size_t MAX_BMM_PROOF_HASHES = 32;
+
+//! Maximum depth of the mainchain coinbase merkle branch
+static const size_t MAX_BMM_PROOF_BRANCH = 32;
+
+/**
+ * Self-contained proof that a BMM h* was committed to by a mainchain block:
+ * the mainchain block header, its coinbase with the h* commit and the merkle
+ * branch of the coinbase.
+ *
+ * The proof is checked against the main block cache, which follows the best
+ * mainchain, so checking it doesn't require a request to the mainchain.
+ */
+class BMMProof
+{
+public:
+    CMainchainBlockHeader header;
+    CTransactionRef coinbase;
+    std::vector<uint256> vMerkleBranch;
+
+    BMMProof() : coinbase(MakeTransactionRef()) { }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(header);
+        READWRITE(coinbase);
+        READWRITE(vMerkleBranch);
+    }
+
+    uint256 GetMainBlockHash() const { return header.GetHash(); }
+
+    //! Return the h* commits of the coinbase
+    std::vector<uint256> GetCriticalHashes() const;
+};
+
+/** Create the BMM proof for the coinbase of a mainchain block */
+BMMProof CreateBMMProof(const CMainchainBlock& block);
+
+/**
+ * Check the parts of a proof that don't depend on the sidechain header or the
+ * main block cache: the mainchain header meets the proof of work of its
+ * nBits, and the coinbase is part of the block and has an h* commit. A proof
+ * that fails can't prove anything, so peers sending one are penalized.
+ */
+bool CheckBMMProofContents(const BMMProof& proof, std::string& strFail);
+
+/**
+ * Check that the proof shows the BMM of a sidechain block header: the proof
+ * header is the header's mainchain block which is part of the main block
+ * cache, the coinbase is part of it and commits to the header's merkle root.
+ * Doesn't take cs_main and doesn't wait on the mainchain.
+ */
+bool CheckBMMProof(const CBlockHeader& header, const BMMProof& proof, std::string& strFail);
+
+/**
+ * Proofs received from peers or requested from the mainchain, waiting for the
+ * sidechain headers that they prove. Proofs are looked up by mainchain block
+ * and h*. Every h* takes a slot, up to MAX_BMM_PROOF_HASHES for a proof. A
+ * peer's oldest slots are dropped once it has MAX_BMM_PROOF_CACHE_PEER, and
+ * the oldest overall once MAX_BMM_PROOF_CACHE are kept.
+ * Internally synchronized.
+ */
+class BMMProofCache
+{
+public:
+    //! Peer id of the proofs that aren't received from a peer
+    static const int64_t NO_PEER = -1;
+
+    //! Add a proof under each of its h* commits, returns the number added
+    size_t Add(const BMMProof& proof, int64_t nPeer = NO_PEER);
+
+    bool Get(const uint256& hashMainBlock, const uint256& hashCritical, BMMProof& proof) const;
+
+    size_t Size() const;
+
+    //! Number of slots taken by a peer's proofs
+    size_t PeerSize(int64_t nPeer) const;
+
+    //! Drop the proofs of a peer that disconnected
+    void ForgetPeer(int64_t nPeer);
+
+    void Clear();
+
+private:
+    typedef std::pair<uint256 /* hashMainBlock */, uint256 /* hashCritical */> ProofKey;
+
+    struct ProofEntry {
+        std::shared_ptr<const BMMProof> proof;
+        int64_t nPeer;
+        uint64_t nSequence;
+    };
+
+    void Erase(std::map<ProofKey, ProofEntry>::iterator it);
+
+    mutable CCriticalSection cs;
+    std::map<ProofKey, ProofEntry> mapProof;
+    //! Slots by the order they were added in, overall and for each peer
+    std::map<uint64_t, ProofKey> mapOrder;
+    std::map<int64_t, std::map<uint64_t, ProofKey> > mapPeerOrder;
+    uint64_t nSequenceNext = 0;
+};
+
+extern BMMProofCache bmmProofCache;
+
+#endif // BITCOIN_BMMPROOF_H
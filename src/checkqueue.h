@@ -8,13 +8,17 @@
 #include <sync.h>
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
 
-template <typename T>
-class CCheckQueueControl;
+//! Maximum number of work queues of a CWorkStealingCheckQueue, the master's included
+static const unsigned int MAX_CHECKQUEUE_WORKER_QUEUES = 64;
 
 /** 
  * Queue for verifications that have to be performed.
@@ -163,22 +167,242 @@ public:
 
 };
 
-/** 
- * RAII-style controller object for a CCheckQueue that guarantees the passed
- * queue is finished before continuing.
+/**
+ * Queue for verifications that have to be performed, with the same interface
+ * and the same master / worker model as CCheckQueue, but without a shared
+ * queue and lock that every worker hands off to the next.
+ *
+ * Each worker (and the master) owns a deque of checks. Add() spreads the
+ * checks over the deques, and a worker takes batches from the back of its own
+ * deque, under a lock that only contends with the occasional thief. A worker
+ * whose deque is empty steals half of the checks at the front of another
+ * worker's deque. Workers only sleep when nothing is queued anywhere.
  */
 template <typename T>
+class CWorkStealingCheckQueue
+{
+private:
+    //! A deque of checks owned by one worker, the others steal from the front
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<T> deq;
+    };
+
+    //! The workers' deques, index 0 is the master's
+    std::unique_ptr<WorkerQueue[]> vQueue;
+
+    //! The number of worker threads that have started
+    std::atomic<unsigned int> nWorkers;
+
+    //! The next deque that Add() starts filling
+    unsigned int nNextQueue;
+
+    //! The number of checks in the deques, not yet taken by a worker
+    std::atomic<int64_t> nQueued;
+
+    //! The number of checks added that haven't completed yet
+    std::atomic<int64_t> nTodo;
+
+    //! The temporary evaluation result.
+    std::atomic<bool> fAllOk;
+
+    //! Idle workers block on condWorker, the master on condMaster
+    boost::mutex mutexWorker;
+    boost::condition_variable condWorker;
+    std::atomic<int> nSleeping;
+    boost::mutex mutexMaster;
+    boost::condition_variable condMaster;
+
+    //! The maximum number of elements to be processed in one batch
+    unsigned int nBatchSize;
+
+    unsigned int ActiveQueues() const
+    {
+        return std::min(nWorkers.load() + 1, MAX_CHECKQUEUE_WORKER_QUEUES);
+    }
+
+    /**
+     * Take a batch of checks: from the back of our own deque, otherwise
+     * half of the front of the first other deque that has checks.
+     */
+    bool TakeWork(unsigned int nOwn, std::vector<T>& vChecks)
+    {
+        {
+            WorkerQueue& own = vQueue[nOwn];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.deq.empty()) {
+                size_t nNow = std::max<size_t>(1, std::min<size_t>(nBatchSize, (own.deq.size() + 1) / 2));
+                for (size_t i = 0; i < nNow; i++) {
+                    vChecks.emplace_back();
+                    vChecks.back().swap(own.deq.back());
+                    own.deq.pop_back();
+                }
+                nQueued -= nNow;
+                return true;
+            }
+        }
+
+        if (nQueued <= 0)
+            return false;
+
+        const unsigned int nQueues = ActiveQueues();
+        for (unsigned int i = 1; i < nQueues; i++) {
+            WorkerQueue& victim = vQueue[(nOwn + i) % nQueues];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.deq.empty())
+                continue;
+
+            size_t nNow = std::max<size_t>(1, std::min<size_t>(nBatchSize, victim.deq.size() / 2));
+            for (size_t j = 0; j < nNow; j++) {
+                vChecks.emplace_back();
+                vChecks.back().swap(victim.deq.front());
+                victim.deq.pop_front();
+            }
+            nQueued -= nNow;
+            return true;
+        }
+        return false;
+    }
+
+    /** Run a batch, and only count it as done once the checks are destroyed */
+    void RunBatch(std::vector<T>& vChecks)
+    {
+        bool fOk = fAllOk;
+        for (T& check : vChecks)
+            if (fOk)
+                fOk = check();
+        if (!fOk)
+            fAllOk = false;
+
+        const int64_t nDone = vChecks.size();
+        vChecks.clear();
+        if (nTodo.fetch_sub(nDone) == nDone) {
+            // We processed the last element; inform the master it can exit and return the result
+            boost::unique_lock<boost::mutex> lock(mutexMaster);
+            condMaster.notify_one();
+        }
+    }
+
+public:
+    //! Mutex to ensure only one concurrent CCheckQueueControl
+    boost::mutex ControlMutex;
+
+    //! Create a new check queue
+    explicit CWorkStealingCheckQueue(unsigned int nBatchSizeIn) :
+        vQueue(new WorkerQueue[MAX_CHECKQUEUE_WORKER_QUEUES]), nWorkers(0), nNextQueue(0), nQueued(0), nTodo(0),
+        fAllOk(true), nSleeping(0), nBatchSize(nBatchSizeIn) {}
+
+    //! Worker thread
+    void Thread()
+    {
+        // Workers beyond the number of deques share them
+        const unsigned int nOwn = 1 + nWorkers++ % (MAX_CHECKQUEUE_WORKER_QUEUES - 1);
+
+        std::vector<T> vChecks;
+        vChecks.reserve(nBatchSize);
+        while (true) {
+            if (TakeWork(nOwn, vChecks)) {
+                RunBatch(vChecks);
+                continue;
+            }
+
+            boost::unique_lock<boost::mutex> lock(mutexWorker);
+            nSleeping++;
+            try {
+                while (nQueued <= 0)
+                    condWorker.wait(lock);
+            } catch (...) {
+                nSleeping--;
+                throw;
+            }
+            nSleeping--;
+        }
+    }
+
+    //! Wait until execution finishes, and return whether all evaluations were successful.
+    bool Wait()
+    {
+        std::vector<T> vChecks;
+        vChecks.reserve(nBatchSize);
+        while (true) {
+            if (TakeWork(0, vChecks)) {
+                RunBatch(vChecks);
+                continue;
+            }
+
+            // Nothing is queued, and only the master adds checks: wait for
+            // the batches that the workers are running
+            boost::unique_lock<boost::mutex> lock(mutexMaster);
+            while (nTodo > 0 && nQueued <= 0)
+                condMaster.wait(lock);
+            if (nTodo == 0)
+                break;
+        }
+
+        // reset the status for new work later
+        bool fRet = fAllOk;
+        fAllOk = true;
+        return fRet;
+    }
+
+    //! Add a batch of checks to the queue
+    void Add(std::vector<T>& vChecks)
+    {
+        if (vChecks.empty())
+            return;
+
+        nTodo += vChecks.size();
+
+        // Spread the checks over the deques in contiguous chunks
+        const unsigned int nQueues = ActiveQueues();
+        const size_t nChunk = (vChecks.size() + nQueues - 1) / nQueues;
+        size_t nChunks = 0;
+        for (size_t nBegin = 0; nBegin < vChecks.size(); nBegin += nChunk) {
+            const size_t nEnd = std::min(nBegin + nChunk, vChecks.size());
+            WorkerQueue& queue = vQueue[nNextQueue];
+            nNextQueue = (nNextQueue + 1) % nQueues;
+            {
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                for (size_t i = nBegin; i < nEnd; i++) {
+                    queue.deq.emplace_back();
+                    queue.deq.back().swap(vChecks[i]);
+                }
+            }
+            nQueued += nEnd - nBegin;
+            nChunks++;
+        }
+
+        if (nSleeping > 0) {
+            boost::unique_lock<boost::mutex> lock(mutexWorker);
+            if (nChunks == 1)
+                condWorker.notify_one();
+            else
+                condWorker.notify_all();
+        }
+    }
+
+    ~CWorkStealingCheckQueue()
+    {
+    }
+
+};
+
+/** 
+ * RAII-style controller object for a CCheckQueue or a CWorkStealingCheckQueue
+ * that guarantees the passed queue is finished before continuing.
+ */
+template <typename T, typename Queue = CCheckQueue<T> >
 class CCheckQueueControl
 {
 private:
-    CCheckQueue<T> * const pqueue;
+    Queue * const pqueue;
     bool fDone;
 
 public:
     CCheckQueueControl() = delete;
     CCheckQueueControl(const CCheckQueueControl&) = delete;
     CCheckQueueControl& operator=(const CCheckQueueControl&) = delete;
-    explicit CCheckQueueControl(CCheckQueue<T> * const pqueueIn) : pqueue(pqueueIn), fDone(false)
+    explicit CCheckQueueControl(Queue * const pqueueIn) : pqueue(pqueueIn), fDone(false)
     {
         // passed queue is supposed to be unused, or nullptr
         if (pqueue != nullptr) {
@@ -0,0 +1,166 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coinsprefetch.h>
+
+#include <util.h>
+#include <utiltime.h>
+
+#include <algorithm>
+#include <functional>
+#include <set>
+
+std::unique_ptr<CoinsPrefetcher> pcoinsprefetcher;
+
+CoinsPrefetcher::CoinsPrefetcher(int nThreads) : fStop(false), fOpen(false), nJob(0), nActive(0), pbase(nullptr), nNext(0)
+{
+    for (int i = 1; i < nThreads; i++) {
+        vThread.emplace_back(&TraceThread<std::function<void()> >, "prefetch",
+                std::function<void()>(std::bind(&CoinsPrefetcher::ThreadPrefetch, this)));
+    }
+}
+
+CoinsPrefetcher::~CoinsPrefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fStop = true;
+    }
+    condWorker.notify_all();
+
+    for (std::thread& thread : vThread)
+        thread.join();
+}
+
+void CoinsPrefetcher::ReadCoins()
+{
+    const size_t nSize = vOutPoint.size();
+    size_t nBegin;
+    while ((nBegin = nNext.fetch_add(PREFETCH_BATCH_SIZE)) < nSize) {
+        size_t nEnd = std::min(nBegin + PREFETCH_BATCH_SIZE, nSize);
+        for (size_t i = nBegin; i < nEnd; i++) {
+            // A failed read is left to ConnectBlock, which reads the coin
+            // again through the cache and handles the error
+            try {
+                vFound[i] = pbase->GetCoin(vOutPoint[i], vCoin[i]);
+            } catch (const std::exception&) {
+                vFound[i] = 0;
+            }
+        }
+    }
+}
+
+void CoinsPrefetcher::ThreadPrefetch()
+{
+    uint64_t nJobLast = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            condWorker.wait(lock, [&]{ return fStop || (fOpen && nJob != nJobLast); });
+            if (fStop)
+                return;
+
+            nJobLast = nJob;
+            nActive++;
+        }
+
+        ReadCoins();
+
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            nActive--;
+        }
+        condDone.notify_one();
+    }
+}
+
+CoinsPrefetchStats CoinsPrefetcher::Prefetch(const CBlock& block, CCoinsViewCache& cache, const CCoinsView& base)
+{
+    int64_t nTimeStart = GetTimeMicros();
+
+    CoinsPrefetchStats blockStats;
+    blockStats.nBlocks = 1;
+
+    // Outputs created by the block aren't in the UTXO set yet
+    std::set<uint256> setTxid;
+    for (const CTransactionRef& tx : block.vtx)
+        setTxid.insert(tx->GetHash());
+
+    std::vector<COutPoint> vMissing;
+    for (const CTransactionRef& tx : block.vtx) {
+        if (tx->IsCoinBase())
+            continue;
+
+        for (const CTxIn& in : tx->vin) {
+            blockStats.nInputs++;
+            if (setTxid.count(in.prevout.hash))
+                blockStats.nInBlock++;
+            else
+            if (cache.HaveCoinInCache(in.prevout))
+                blockStats.nHits++;
+            else
+                vMissing.push_back(in.prevout);
+        }
+    }
+    blockStats.nMisses = vMissing.size();
+
+    if (!vMissing.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            vOutPoint = std::move(vMissing);
+            vCoin.assign(vOutPoint.size(), Coin());
+            vFound.assign(vOutPoint.size(), 0);
+            pbase = &base;
+            nNext = 0;
+            nJob++;
+            fOpen = vOutPoint.size() > PREFETCH_BATCH_SIZE;
+        }
+        if (fOpen)
+            condWorker.notify_all();
+
+        ReadCoins();
+
+        // Workers that didn't start on the job yet skip it
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            fOpen = false;
+            condDone.wait(lock, [this]{ return nActive == 0; });
+        }
+
+        for (size_t i = 0; i < vOutPoint.size(); i++) {
+            if (vFound[i])
+                cache.EmplaceCoinFromBase(vOutPoint[i], std::move(vCoin[i]));
+            else
+                blockStats.nNotFound++;
+        }
+
+        vOutPoint.clear();
+        vCoin.clear();
+        vFound.clear();
+        pbase = nullptr;
+    }
+
+    blockStats.nTimeTotal = GetTimeMicros() - nTimeStart;
+    blockStats.nTimeMax = blockStats.nTimeTotal;
+
+    {
+        std::lock_guard<std::mutex> lock(csStats);
+        stats.nBlocks++;
+        stats.nInputs += blockStats.nInputs;
+        stats.nInBlock += blockStats.nInBlock;
+        stats.nHits += blockStats.nHits;
+        stats.nMisses += blockStats.nMisses;
+        stats.nNotFound += blockStats.nNotFound;
+        stats.nTimeTotal += blockStats.nTimeTotal;
+        stats.nTimeMax = std::max(stats.nTimeMax, blockStats.nTimeTotal);
+    }
+
+    return blockStats;
+}
+
+CoinsPrefetchStats CoinsPrefetcher::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(csStats);
+    return stats;
+}
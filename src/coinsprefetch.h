@@ -0,0 +1,105 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSPREFETCH_H
+#define BITCOIN_COINSPREFETCH_H
+
+#include <coins.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//! Default for -prefetchthreads
+static const int DEFAULT_PREFETCH_THREADS = 4;
+
+//! Maximum number of threads reading a block's inputs
+static const int MAX_PREFETCH_THREADS = 16;
+
+//! Number of inputs a thread reads before taking more
+static const size_t PREFETCH_BATCH_SIZE = 16;
+
+struct CoinsPrefetchStats
+{
+    uint64_t nBlocks = 0;
+    //! Inputs of the blocks' transactions
+    uint64_t nInputs = 0;
+    //! Inputs spending outputs created by the same block, not looked up
+    uint64_t nInBlock = 0;
+    //! Inputs found in the coins cache
+    uint64_t nHits = 0;
+    //! Inputs read from the coins database
+    uint64_t nMisses = 0;
+    //! Inputs read from the coins database but not found
+    uint64_t nNotFound = 0;
+    //! Time spent prefetching in microseconds
+    int64_t nTimeTotal = 0;
+    int64_t nTimeMax = 0;
+};
+
+/**
+ * Warms the coins cache with the inputs of a block before it is connected.
+ *
+ * ConnectBlock looks up the coins spent by a block one at a time, and each
+ * one missing from the cache is a synchronous database read. Instead, the
+ * inputs that aren't cached are read from the database by a pool of threads
+ * together with the calling thread, and then added to the cache unmodified.
+ *
+ * The cache isn't thread safe, so only the calling thread touches it, and
+ * the caller must hold the lock protecting it (cs_main for pcoinsTip) so
+ * that the database can't be flushed to while the coins are read.
+ */
+class CoinsPrefetcher
+{
+public:
+    //! nThreads readers, including the thread calling Prefetch
+    explicit CoinsPrefetcher(int nThreads);
+    ~CoinsPrefetcher();
+
+    /**
+     * Add the coins spent by block that are missing from cache to it, read
+     * from base which must be the database cache is backed by. Returns the
+     * statistics for this block.
+     */
+    CoinsPrefetchStats Prefetch(const CBlock& block, CCoinsViewCache& cache, const CCoinsView& base);
+
+    int GetThreadCount() const { return (int)vThread.size() + 1; }
+
+    CoinsPrefetchStats GetStats() const;
+
+private:
+    void ThreadPrefetch();
+
+    /** Read the coins of the current job until there are none left */
+    void ReadCoins();
+
+    std::mutex cs;
+    std::condition_variable condWorker;
+    std::condition_variable condDone;
+    bool fStop;
+
+    // The current job, only changed while no worker is reading it
+    bool fOpen;
+    uint64_t nJob;
+    int nActive;
+    const CCoinsView* pbase;
+    std::vector<COutPoint> vOutPoint;
+    std::vector<Coin> vCoin;
+    std::vector<char> vFound;
+    std::atomic<size_t> nNext;
+
+    std::vector<std::thread> vThread;
+
+    mutable std::mutex csStats;
+    CoinsPrefetchStats stats;
+};
+
+extern std::unique_ptr<CoinsPrefetcher> pcoinsprefetcher;
+
+#endif // BITCOIN_COINSPREFETCH_H
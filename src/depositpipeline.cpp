@@ -0,0 +1,321 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <depositpipeline.h>
+
+#include <bmmcache.h>
+#include <sidechainclient.h>
+#include <sync.h>
+#include <txdb.h>
+#include <ui_interface.h>
+#include <util.h>
+#include <utiltime.h>
+#include <validation.h>
+
+#include <algorithm>
+#include <functional>
+#include <set>
+
+std::unique_ptr<DepositPipeline> pdepositpipeline;
+
+// Whether deposit d spends the CTIP output created by deposit prev
+static bool SpendsCTIP(const SidechainDeposit& d, const SidechainDeposit& prev)
+{
+    for (const CTxIn& in : d.dtx->vin) {
+        if (in.prevout.hash == prev.dtx->GetHash() && in.prevout.n == prev.nBurnIndex)
+            return true;
+    }
+    return false;
+}
+
+void VerifyDepositsParallel(const std::vector<SidechainDeposit>& vDeposit, std::vector<bool>& vVerified)
+{
+    vVerified.assign(vDeposit.size(), false);
+
+    // Only ask the mainchain about deposits we haven't verified before
+    std::vector<size_t> vToVerify;
+    for (size_t i = 0; i < vDeposit.size(); i++) {
+        const SidechainDeposit& d = vDeposit[i];
+        if (d.hashMainchainBlock.IsNull())
+            continue;
+
+        if (bmmCache.HaveVerifiedDeposit(d.dtx->GetHash()))
+            vVerified[i] = true;
+        else
+            vToVerify.push_back(i);
+    }
+
+    if (vToVerify.empty())
+        return;
+
+    // Each thread takes the next batch until all are sent
+    const size_t nBatches = (vToVerify.size() + DEPOSIT_VERIFY_BATCH_SIZE - 1) / DEPOSIT_VERIFY_BATCH_SIZE;
+    std::atomic<size_t> nNextBatch(0);
+    std::vector<char> vResult(vDeposit.size(), 0);
+
+    auto verify = [&]() {
+        SidechainClient client;
+        size_t nBatch;
+        while ((nBatch = nNextBatch++) < nBatches) {
+            size_t nBegin = nBatch * DEPOSIT_VERIFY_BATCH_SIZE;
+            size_t nEnd = std::min(nBegin + DEPOSIT_VERIFY_BATCH_SIZE, vToVerify.size());
+
+            std::vector<SidechainDepositQuery> vQuery;
+            vQuery.reserve(nEnd - nBegin);
+            for (size_t i = nBegin; i < nEnd; i++) {
+                const SidechainDeposit& d = vDeposit[vToVerify[i]];
+                vQuery.emplace_back(d.hashMainchainBlock, d.dtx->GetHash(), d.nTx);
+            }
+
+            if (!client.VerifyDepositBatch(vQuery))
+                continue;
+
+            for (size_t i = nBegin; i < nEnd; i++) {
+                if (!vQuery[i - nBegin].fVerified)
+                    continue;
+
+                // Cache that we have verified the deposit
+                bmmCache.CacheVerifiedDeposit(vQuery[i - nBegin].txid);
+                vResult[vToVerify[i]] = 1;
+            }
+        }
+    };
+
+    std::vector<std::thread> vThread;
+    size_t nThreads = std::min(nBatches, DEPOSIT_VERIFY_THREADS);
+    for (size_t i = 1; i < nThreads; i++) {
+        vThread.emplace_back(&TraceThread<std::function<void()> >, "depositverify",
+                std::function<void()>(verify));
+    }
+    verify();
+    for (std::thread& thread : vThread)
+        thread.join();
+
+    for (size_t i : vToVerify)
+        vVerified[i] = vResult[i];
+}
+
+DepositPipeline::DepositPipeline() : fStop(false), fWake(false), fSynced(false), fRunning(false)
+{
+}
+
+DepositPipeline::~DepositPipeline()
+{
+    Stop();
+}
+
+void DepositPipeline::Start()
+{
+    if (fRunning)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fStop = false;
+        fWake = true;
+    }
+
+    connMainchainTip = uiInterface.NotifyMainchainTip.connect(std::bind(&DepositPipeline::Wake, this));
+    RegisterValidationInterface(this);
+
+    fRunning = true;
+    threadDeposits = std::thread(&TraceThread<std::function<void()> >, "deposits",
+            std::function<void()>(std::bind(&DepositPipeline::ThreadDeposits, this)));
+}
+
+void DepositPipeline::Stop()
+{
+    if (!fRunning)
+        return;
+
+    UnregisterValidationInterface(this);
+    connMainchainTip.disconnect();
+
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fStop = true;
+    }
+    cond.notify_one();
+
+    if (threadDeposits.joinable())
+        threadDeposits.join();
+
+    fRunning = false;
+}
+
+bool DepositPipeline::GetDeposits(const uint256& hashLastDeposit, std::vector<SidechainDeposit>& vDepositOut) const
+{
+    std::lock_guard<std::mutex> lock(cs);
+    if (!fSynced)
+        return false;
+
+    if (hashBase == hashLastDeposit) {
+        vDepositOut = vDeposit;
+        return true;
+    }
+
+    // Our tip may have connected queued deposits since the last update
+    for (size_t i = 0; i < vDeposit.size(); i++) {
+        if (vDeposit[i].dtx->GetHash() == hashLastDeposit) {
+            vDepositOut.assign(vDeposit.begin() + i + 1, vDeposit.end());
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void DepositPipeline::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload)
+{
+    Wake();
+}
+
+void DepositPipeline::Wake()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fWake = true;
+    }
+    cond.notify_one();
+}
+
+void DepositPipeline::ThreadDeposits()
+{
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            cond.wait_for(lock, std::chrono::seconds(DEPOSIT_FETCH_INTERVAL),
+                    [this]{ return fStop || fWake; });
+            if (fStop)
+                return;
+
+            fWake = false;
+        }
+
+        Update();
+    }
+}
+
+void DepositPipeline::TrimQueue(const uint256& hashLastDeposit)
+{
+    if (hashBase == hashLastDeposit)
+        return;
+
+    for (size_t i = 0; i < vDeposit.size(); i++) {
+        if (vDeposit[i].dtx->GetHash() == hashLastDeposit) {
+            vDeposit.erase(vDeposit.begin(), vDeposit.begin() + i + 1);
+            hashBase = hashLastDeposit;
+            return;
+        }
+    }
+
+    // Reorg or deposits connected that we didn't queue, start over from the
+    // last deposit connected
+    vDeposit.clear();
+    hashBase = hashLastDeposit;
+    fSynced = false;
+}
+
+void DepositPipeline::Update()
+{
+    int64_t nTimeStart = GetTimeMicros();
+
+    // The last deposit connected to the sidechain
+    SidechainDeposit lastDeposit;
+    bool fHaveLast;
+    {
+        LOCK(cs_main);
+        fHaveLast = psidechaintree->GetLastDeposit(lastDeposit);
+    }
+    const uint256 hashLast = fHaveLast ? lastDeposit.dtx->GetHash() : uint256();
+
+    std::vector<SidechainDeposit> vQueued;
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        TrimQueue(hashLast);
+        vQueued = vDeposit;
+    }
+
+    // Request the deposits after the last one we know about
+    uint256 hashCursor = hashLast;
+    uint32_t nCursor = fHaveLast ? lastDeposit.nBurnIndex : 0;
+    if (!vQueued.empty()) {
+        hashCursor = vQueued.back().dtx->GetHash();
+        nCursor = vQueued.back().nBurnIndex;
+    }
+
+    SidechainClient client;
+    std::vector<SidechainDeposit> vFetched = client.UpdateDeposits(SIDECHAIN_ADDRESS_BYTES, hashCursor, nCursor);
+
+    int64_t nTimeFetched = GetTimeMicros();
+
+    // Skip deposits that are queued or connected already
+    std::set<uint256> setQueued;
+    for (const SidechainDeposit& d : vQueued)
+        setQueued.insert(d.dtx->GetHash());
+
+    std::vector<SidechainDeposit> vNew;
+    {
+        LOCK(cs_main);
+        for (const SidechainDeposit& d : vFetched) {
+            if (setQueued.count(d.dtx->GetHash()))
+                continue;
+            if (psidechaintree->HaveDepositNonAmount(d.GetID()))
+                continue;
+            vNew.push_back(d);
+        }
+    }
+
+    std::vector<bool> vVerified;
+    VerifyDepositsParallel(vNew, vVerified);
+
+    int64_t nTimeVerified = GetTimeMicros();
+
+    std::set<uint256> setVerified = setQueued;
+    for (size_t i = 0; i < vNew.size(); i++) {
+        if (vVerified[i])
+            setVerified.insert(vNew[i].dtx->GetHash());
+    }
+
+    // Sort the queued and new deposits together into CTIP spend order
+    std::vector<SidechainDeposit> vAll = vQueued;
+    vAll.insert(vAll.end(), vNew.begin(), vNew.end());
+
+    std::vector<SidechainDeposit> vSorted;
+    bool fSorted = SortDeposits(vAll, vSorted);
+    if (fSorted && fHaveLast && !vSorted.empty() && !SpendsCTIP(vSorted.front(), lastDeposit))
+        fSorted = false;
+
+    // Deposits after one that couldn't be verified can't be used yet
+    if (fSorted) {
+        for (size_t i = 0; i < vSorted.size(); i++) {
+            if (!setVerified.count(vSorted[i].dtx->GetHash())) {
+                vSorted.resize(i);
+                break;
+            }
+        }
+    }
+
+    size_t nQueued = 0;
+    {
+        std::lock_guard<std::mutex> lock(cs);
+
+        // Our tip changed while we were talking to the mainchain, the next
+        // update will pick up from the new last deposit
+        if (hashBase != hashLast)
+            return;
+
+        if (fSorted) {
+            vDeposit = std::move(vSorted);
+        } else {
+            LogPrintf("%s: Failed to sort new deposits, requesting them again.\n", __func__);
+            vDeposit.clear();
+        }
+        fSynced = fSorted;
+        nQueued = vDeposit.size();
+    }
+
+    LogPrint(BCLog::BENCH, "%s: %u new deposits, %u queued. Fetched in %.2fms, verified in %.2fms\n", __func__,
+            vNew.size(), nQueued, (nTimeFetched - nTimeStart) * 0.001, (nTimeVerified - nTimeFetched) * 0.001);
+}
@@ -0,0 +1,102 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_DEPOSITPIPELINE_H
+#define BITCOIN_DEPOSITPIPELINE_H
+
+#include <sidechain.h>
+#include <uint256.h>
+#include <validationinterface.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/signals2/connection.hpp>
+
+//! Default for -fetchdeposits
+static const bool DEFAULT_FETCH_DEPOSITS = false;
+
+//! Seconds between requests for new deposits when no mainchain tip
+//! notifications are received
+static const int64_t DEPOSIT_FETCH_INTERVAL = 10;
+
+//! Number of deposits verified with each batch of mainchain requests
+static const size_t DEPOSIT_VERIFY_BATCH_SIZE = 100;
+
+//! Maximum number of deposit verification batches sent at the same time
+static const size_t DEPOSIT_VERIFY_THREADS = 4;
+
+/**
+ * Keeps a queue of new deposits from the mainchain ready for the miner, so
+ * that creating a block template doesn't wait on the mainchain.
+ *
+ * The queue holds deposits that are verified with the mainchain, sorted into
+ * CTIP spend order, and follows the last deposit connected to the sidechain.
+ * New deposits are requested from the last queued deposit on, and verified
+ * in batches sent in parallel. Deposits are dropped from the front of the
+ * queue once our tip connects them.
+ */
+class DepositPipeline : public CValidationInterface
+{
+public:
+    DepositPipeline();
+    ~DepositPipeline();
+
+    void Start();
+    void Stop();
+
+    bool IsRunning() const { return fRunning; }
+
+    /**
+     * Get the queued deposits that follow the deposit hashLastDeposit (null
+     * if the sidechain has no deposits yet). Returns false if the queue isn't
+     * in sync with it, and new deposits must be requested by the caller.
+     */
+    bool GetDeposits(const uint256& hashLastDeposit, std::vector<SidechainDeposit>& vDepositOut) const;
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override;
+
+private:
+    void ThreadDeposits();
+
+    void Wake();
+
+    /** Request, verify and queue new deposits */
+    void Update();
+
+    /**
+     * Drop queued deposits up to hashLastDeposit which was connected, or all
+     * of them if the queue doesn't follow it. cs must be held.
+     */
+    void TrimQueue(const uint256& hashLastDeposit);
+
+    mutable std::mutex cs;
+    std::condition_variable cond;
+    bool fStop;
+    bool fWake;
+
+    // Verified deposits in CTIP spend order following hashBase, the last
+    // deposit connected to the sidechain when the queue was updated
+    std::vector<SidechainDeposit> vDeposit;
+    uint256 hashBase;
+    bool fSynced;
+
+    std::atomic<bool> fRunning;
+    std::thread threadDeposits;
+    boost::signals2::connection connMainchainTip;
+};
+
+/** Verify deposits with the mainchain in batches sent in parallel, setting
+ * vVerified per deposit. Deposits verified before are not sent again. */
+void VerifyDepositsParallel(const std::vector<SidechainDeposit>& vDeposit, std::vector<bool>& vVerified);
+
+/** The deposit pipeline, if started with -fetchdeposits */
+extern std::unique_ptr<DepositPipeline> pdepositpipeline;
+
+#endif // BITCOIN_DEPOSITPIPELINE_H
@@ -0,0 +1,344 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_FLATMAP_H
+#define BITCOIN_FLATMAP_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/** Hash map with open addressing, and entries allocated from a pool.
+ *
+ * The table that is probed is a flat array of 8 byte slots, each holding the
+ * 32-bit hash of an entry and its index in the pool, so a lookup reads
+ * consecutive slots and only touches entries whose hash matches. Entries
+ * are constructed in place in chunks of CHUNK_SIZE, and erased entries are
+ * reused, so there is no allocation per entry and no per-entry overhead
+ * besides the slot.
+ *
+ * Implements the part of the std::unordered_map interface the coins cache
+ * uses, with the same guarantees:
+ *   - References to entries stay valid until they are erased, growing the
+ *     table only moves slots.
+ *   - Inserting may invalidate iterators, erasing only invalidates the
+ *     iterator to the erased entry, so erase(it) can be used while
+ *     iterating.
+ */
+template <typename K, typename T, typename Hash = std::hash<K>, typename KeyEqual = std::equal_to<K> >
+class flatmap
+{
+public:
+    typedef K key_type;
+    typedef T mapped_type;
+    typedef std::pair<const K, T> value_type;
+    typedef size_t size_type;
+
+    //! Entries allocated at once
+    static const size_t CHUNK_BITS = 8;
+    static const size_t CHUNK_SIZE = 1 << CHUNK_BITS;
+
+    //! Smallest table allocated
+    static const size_t MIN_CAPACITY = 16;
+
+private:
+    static const uint32_t SLOT_EMPTY = 0xffffffff;
+    static const uint32_t SLOT_DELETED = 0xfffffffe;
+
+    struct Slot {
+        uint32_t hash;
+        uint32_t entry;
+    };
+
+    typedef typename std::aligned_storage<sizeof(value_type), alignof(value_type)>::type Storage;
+
+    Hash hasher;
+    KeyEqual equal;
+
+    std::unique_ptr<Slot[]> table;
+    size_t nCapacity;
+    size_t nSize;
+    size_t nDeleted;
+
+    std::vector<std::unique_ptr<Storage[]> > vChunk;
+    //! Entries taken from the chunks, including the ones freed
+    uint32_t nEntries;
+    //! Last freed entry, the free list continues in its storage
+    uint32_t nFree;
+
+    Storage* EntryStorage(uint32_t i) const
+    {
+        return &vChunk[i >> CHUNK_BITS][i & (CHUNK_SIZE - 1)];
+    }
+
+    value_type* Entry(uint32_t i) const
+    {
+        return reinterpret_cast<value_type*>(EntryStorage(i));
+    }
+
+    uint32_t AllocEntry()
+    {
+        if (nFree != SLOT_EMPTY) {
+            uint32_t i = nFree;
+            memcpy(&nFree, EntryStorage(i), sizeof(nFree));
+            return i;
+        }
+        assert(nEntries < SLOT_DELETED);
+        if ((nEntries >> CHUNK_BITS) == vChunk.size())
+            vChunk.emplace_back(new Storage[CHUNK_SIZE]);
+        return nEntries++;
+    }
+
+    //! Free an entry that is destroyed already
+    void FreeEntry(uint32_t i)
+    {
+        // The link is written to the raw storage, no value_type lives there
+        memcpy(EntryStorage(i), &nFree, sizeof(nFree));
+        nFree = i;
+    }
+
+    uint32_t HashKey(const K& key) const
+    {
+        uint64_t h = hasher(key);
+        return (uint32_t)(h ^ (h >> 32));
+    }
+
+    /** Find the slot of key, or the slot to insert it in if it isn't found */
+    std::pair<size_t, bool> Probe(const K& key, uint32_t hash) const
+    {
+        const size_t nMask = nCapacity - 1;
+        size_t nInsert = nCapacity;
+        for (size_t pos = hash & nMask;; pos = (pos + 1) & nMask) {
+            const Slot& slot = table[pos];
+            if (slot.entry == SLOT_EMPTY)
+                return std::make_pair(nInsert == nCapacity ? pos : nInsert, false);
+            if (slot.entry == SLOT_DELETED) {
+                if (nInsert == nCapacity)
+                    nInsert = pos;
+            } else if (slot.hash == hash && equal(Entry(slot.entry)->first, key)) {
+                return std::make_pair(pos, true);
+            }
+        }
+    }
+
+    /** Move the slots to a table of nCapacityNew, dropping deleted slots */
+    void Rehash(size_t nCapacityNew)
+    {
+        std::unique_ptr<Slot[]> tableNew(new Slot[nCapacityNew]);
+        for (size_t i = 0; i < nCapacityNew; i++)
+            tableNew[i].entry = SLOT_EMPTY;
+
+        const size_t nMask = nCapacityNew - 1;
+        for (size_t i = 0; i < nCapacity; i++) {
+            if (table[i].entry >= SLOT_DELETED)
+                continue;
+            size_t pos = table[i].hash & nMask;
+            while (tableNew[pos].entry != SLOT_EMPTY)
+                pos = (pos + 1) & nMask;
+            tableNew[pos] = table[i];
+        }
+
+        table = std::move(tableNew);
+        nCapacity = nCapacityNew;
+        nDeleted = 0;
+    }
+
+    //! Make room for one more slot. Used and deleted slots are kept at no
+    //! more than 3/4 of the table, after a rehash live ones take at most half.
+    void Reserve()
+    {
+        if ((nSize + nDeleted + 1) * 4 <= nCapacity * 3)
+            return;
+
+        size_t nCapacityNew = nCapacity ? nCapacity : MIN_CAPACITY;
+        while ((nSize + 1) * 2 > nCapacityNew)
+            nCapacityNew *= 2;
+        Rehash(nCapacityNew);
+    }
+
+    size_t NextUsed(size_t pos) const
+    {
+        while (pos < nCapacity && table[pos].entry >= SLOT_DELETED)
+            pos++;
+        return pos;
+    }
+
+    template <bool IsConst>
+    class iter
+    {
+        typedef typename std::conditional<IsConst, const flatmap*, flatmap*>::type map_pointer;
+        map_pointer map;
+        size_t pos;
+
+        friend class flatmap;
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef typename flatmap::value_type value_type;
+        typedef ptrdiff_t difference_type;
+        typedef typename std::conditional<IsConst, const value_type*, value_type*>::type pointer;
+        typedef typename std::conditional<IsConst, const value_type&, value_type&>::type reference;
+
+        iter() : map(nullptr), pos(0) {}
+        iter(map_pointer mapIn, size_t posIn) : map(mapIn), pos(posIn) {}
+
+        //! iterator converts to const_iterator
+        template <bool WasConst, typename = typename std::enable_if<IsConst && !WasConst>::type>
+        iter(const iter<WasConst>& it) : map(it.map), pos(it.pos) {}
+
+        reference operator*() const { return *map->Entry(map->table[pos].entry); }
+        pointer operator->() const { return map->Entry(map->table[pos].entry); }
+
+        iter& operator++() { pos = map->NextUsed(pos + 1); return *this; }
+        iter operator++(int) { iter copy(*this); ++(*this); return copy; }
+
+        bool operator==(const iter& other) const { return pos == other.pos; }
+        bool operator!=(const iter& other) const { return pos != other.pos; }
+
+        template <bool> friend class iter;
+    };
+
+public:
+    typedef iter<false> iterator;
+    typedef iter<true> const_iterator;
+
+    flatmap() : table(), nCapacity(0), nSize(0), nDeleted(0), nEntries(0), nFree(SLOT_EMPTY) {}
+
+    flatmap(const flatmap&) = delete;
+    flatmap& operator=(const flatmap&) = delete;
+
+    ~flatmap() { clear(); }
+
+    iterator begin() { return iterator(this, NextUsed(0)); }
+    const_iterator begin() const { return const_iterator(this, NextUsed(0)); }
+    iterator end() { return iterator(this, nCapacity); }
+    const_iterator end() const { return const_iterator(this, nCapacity); }
+
+    size_type size() const { return nSize; }
+    bool empty() const { return nSize == 0; }
+
+    iterator find(const K& key)
+    {
+        if (nSize == 0)
+            return end();
+        std::pair<size_t, bool> probe = Probe(key, HashKey(key));
+        return probe.second ? iterator(this, probe.first) : end();
+    }
+
+    const_iterator find(const K& key) const
+    {
+        if (nSize == 0)
+            return end();
+        std::pair<size_t, bool> probe = Probe(key, HashKey(key));
+        return probe.second ? const_iterator(this, probe.first) : end();
+    }
+
+    size_type count(const K& key) const { return find(key) != end(); }
+
+    /** Construct an entry from args, unless its key is in the map already */
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args)
+    {
+        uint32_t i = AllocEntry();
+        value_type* entry = Entry(i);
+        try {
+            new (entry) value_type(std::forward<Args>(args)...);
+        } catch (...) {
+            FreeEntry(i);
+            throw;
+        }
+
+        const uint32_t hash = HashKey(entry->first);
+        if (nSize) {
+            std::pair<size_t, bool> probe = Probe(entry->first, hash);
+            if (probe.second) {
+                entry->~value_type();
+                FreeEntry(i);
+                return std::make_pair(iterator(this, probe.first), false);
+            }
+        }
+
+        Reserve();
+        size_t pos = Probe(entry->first, hash).first;
+        if (table[pos].entry == SLOT_DELETED)
+            nDeleted--;
+        table[pos].hash = hash;
+        table[pos].entry = i;
+        nSize++;
+
+        return std::make_pair(iterator(this, pos), true);
+    }
+
+    T& operator[](const K& key)
+    {
+        iterator it = find(key);
+        if (it == end())
+            it = emplace(std::piecewise_construct, std::forward_as_tuple(key), std::tuple<>()).first;
+        return it->second;
+    }
+
+    /** Erase the entry, returning an iterator to the next one */
+    iterator erase(const_iterator it)
+    {
+        const size_t pos = it.pos;
+        const uint32_t i = table[pos].entry;
+        Entry(i)->~value_type();
+        FreeEntry(i);
+
+        // A slot followed by an empty one ends every probe that reaches it
+        if (table[(pos + 1) & (nCapacity - 1)].entry == SLOT_EMPTY) {
+            table[pos].entry = SLOT_EMPTY;
+        } else {
+            table[pos].entry = SLOT_DELETED;
+            nDeleted++;
+        }
+        nSize--;
+
+        return iterator(this, NextUsed(pos + 1));
+    }
+
+    size_type erase(const K& key)
+    {
+        iterator it = find(key);
+        if (it == end())
+            return 0;
+        erase(it);
+        return 1;
+    }
+
+    /** Destroy every entry and release the table and the pool */
+    void clear()
+    {
+        for (size_t pos = 0; pos < nCapacity; pos++) {
+            if (table[pos].entry < SLOT_DELETED)
+                Entry(table[pos].entry)->~value_type();
+        }
+        table.reset();
+        vChunk.clear();
+        vChunk.shrink_to_fit();
+        nCapacity = 0;
+        nSize = 0;
+        nDeleted = 0;
+        nEntries = 0;
+        nFree = SLOT_EMPTY;
+    }
+
+    //! Allocated sizes, for memusage
+    size_t table_bytes() const { return nCapacity * sizeof(Slot); }
+    size_t chunk_count() const { return vChunk.size(); }
+    size_t chunk_vector_bytes() const { return vChunk.capacity() * sizeof(std::unique_ptr<Storage[]>); }
+    static size_t chunk_bytes() { return CHUNK_SIZE * sizeof(Storage); }
+};
+
+#endif // BITCOIN_FLATMAP_H
@@ -11,15 +11,20 @@
 
 #include <addrman.h>
 #include <amount.h>
+#include <bmmcache.h>
+#include <bmmengine.h>
+#include <depositpipeline.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
+#include <coinsprefetch.h>
 #include <compat/sanity.h>
 #include <consensus/validation.h>
 #include <fs.h>
 #include <httpserver.h>
 #include <httprpc.h>
 #include <key.h>
+#include <mainchainrpc.h>
 #include <validation.h>
 #include <miner.h>
 #include <netbase.h>
@@ -64,6 +69,7 @@
 #include <openssl/crypto.h>
 
 #if ENABLE_ZMQ
+#include <zmq/zmqmainchainsubscriber.h>
 #include <zmq/zmqnotificationinterface.h>
 #endif
 
@@ -77,6 +83,7 @@ std::unique_ptr<PeerLogicValidation> peerLogic;
 
 #if ENABLE_ZMQ
 static CZMQNotificationInterface* pzmqNotificationInterface = nullptr;
+static CZMQMainchainSubscriber* pzmqMainchainSubscriber = nullptr;
 #endif
 
 #ifdef WIN32
@@ -203,6 +210,23 @@ void Shutdown()
 
     StopTorControl();
 
+    if (pbmmengine) {
+        pbmmengine->Stop();
+        pbmmengine.reset();
+    }
+    if (pdepositpipeline) {
+        pdepositpipeline->Stop();
+        pdepositpipeline.reset();
+    }
+
+#if ENABLE_ZMQ
+    // Stop following the mainchain tip before the caches are written
+    if (pzmqMainchainSubscriber) {
+        delete pzmqMainchainSubscriber;
+        pzmqMainchainSubscriber = nullptr;
+    }
+#endif
+
     // After everything has been shut down, but before things get flushed, stop the
     // CScheduler/checkqueue threadGroup
     threadGroup.interrupt_all();
@@ -220,6 +244,11 @@ void Shutdown()
 
     // Write the mainchain block hash cache to disk
     DumpMainBlockCache();
+    bmmCache.SetMainBlockDB(nullptr, 0);
+    pmainblockdb.reset();
+
+    // Close idle connections to the mainchain
+    CloseMainchainRPCConnections();
 
     if (fFeeEstimatesInitialized)
     {
@@ -253,11 +282,13 @@ void Shutdown()
         if (pcoinsTip != nullptr) {
             FlushStateToDisk();
         }
+        pcoinsprefetcher.reset();
         pcoinsTip.reset();
         pcoinscatcher.reset();
         pcoinsdbview.reset();
         pblocktree.reset();
         psidechaintree.reset();
+        psidechaintreedb.reset();
     }
 #ifdef ENABLE_WALLET
     StopWallets();
@@ -345,6 +376,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-blockreconstructionextratxn=<n>", strprintf(_("Extra transactions to keep in memory for compact block reconstructions (default: %u)"), DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN));
     if (showDebug)
         strUsage += HelpMessageOpt("-blocksonly", strprintf(_("Whether to operate in a blocks only mode (default: %u)"), DEFAULT_BLOCKSONLY));
+    strUsage += HelpMessageOpt("-bmmcachesize=<n>", strprintf(_("Maximum memory in megabytes for caching BMM and deposits verified with the mainchain (default: %u)"), DEFAULT_BMM_CACHE_SIZE));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(_("Specify configuration file. Relative paths will be prefixed by datadir location. (default: %s)"), BITCOIN_CONF_FILENAME));
     if (mode == HMM_BITCOIND)
     {
@@ -361,11 +393,14 @@ std::string HelpMessage(HelpMessageMode mode)
     if (showDebug)
         strUsage += HelpMessageOpt("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file on startup"));
+    strUsage += HelpMessageOpt("-mainblockcachewindow=<n>", strprintf(_("Number of recent mainchain block hashes to keep in memory, older ones are read from disk (0 = keep all, minimum %u, default: %u)"), MIN_MAIN_BLOCK_CACHE_WINDOW, DEFAULT_MAIN_BLOCK_CACHE_WINDOW));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt("-prefetchthreads=<n>", strprintf(_("Set the number of threads reading the inputs of a block from the UTXO database before it is connected (0 to %d, 0 = disable, default: %d)"),
+        MAX_PREFETCH_THREADS, DEFAULT_PREFETCH_THREADS));
     strUsage += HelpMessageOpt("-persistmempool", strprintf(_("Whether to save the mempool on shutdown and load on restart (default: %u)"), DEFAULT_PERSIST_MEMPOOL));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file. Relative paths will be prefixed by a net-specific datadir location. (default: %s)"), BITCOIN_PID_FILENAME));
@@ -430,8 +465,14 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-zmqpubhashtx=<address>", _("Enable publish hash transaction in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawblock=<address>", _("Enable publish raw block in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtx=<address>", _("Enable publish raw transaction in <address>"));
+    strUsage += HelpMessageOpt("-zmqsubmainchainrawblock=<address>", _("Follow the mainchain tip using the raw block notifications the mainchain publishes in <address>"));
 #endif
 
+    strUsage += HelpMessageGroup(_("BMM options:"));
+    strUsage += HelpMessageOpt("-bmmamount=<amt>", strprintf(_("Amount (in %s) paid to the mainchain miner for each automated BMM request (default: %s)"), CURRENCY_UNIT, FormatMoney(DEFAULT_BMM_AMOUNT)));
+    strUsage += HelpMessageOpt("-bmmautomate", strprintf(_("Create BMM requests in the background whenever the mainchain tip changes (default: %u)"), DEFAULT_BMM_AUTOMATE));
+    strUsage += HelpMessageOpt("-fetchdeposits", strprintf(_("Request and verify new deposits from the mainchain in the background for block creation (default: %u, 1 with -bmmautomate)"), DEFAULT_FETCH_DEPOSITS));
+
     strUsage += HelpMessageGroup(_("Debugging/Testing options:"));
     if (showDebug)
     {
@@ -503,6 +544,9 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-blockversion=<n>", "Override block version to test forking scenarios");
 
     strUsage += HelpMessageGroup(_("RPC server options:"));
+    strUsage += HelpMessageOpt("-mainchainrpcconnections=<n>", strprintf(_("Maximum number of idle keep-alive connections to the mainchain RPC server (default: %u)"), DEFAULT_MAINCHAIN_RPC_CONNECTIONS));
+    strUsage += HelpMessageOpt("-mainchainrpcport=<port>", _("Connect to the mainchain RPC server on <port> (default: 8332 or regtest: 18443)"));
+    strUsage += HelpMessageOpt("-mainchainrpctimeout=<n>", strprintf(_("Seconds to wait for the mainchain RPC server to accept a connection, take a request or send more of its reply (default: %d)"), DEFAULT_MAINCHAIN_RPC_TIMEOUT));
     strUsage += HelpMessageOpt("-rest", strprintf(_("Accept public REST requests (default: %u)"), DEFAULT_REST_ENABLE));
     strUsage += HelpMessageOpt("-rpcallowip=<ip>", _("Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times"));
     strUsage += HelpMessageOpt("-rpcauth=<userpw>", _("Username and hashed password for JSON-RPC connections. The field <userpw> comes in the format: <USERNAME>:<SALT>$<HASH>. A canonical python script is included in share/rpcuser. The client then connects normally using the rpcuser=<USERNAME>/rpcpassword=<PASSWORD> pair of arguments. This option can be specified multiple times"));
@@ -811,6 +855,12 @@ void InitParameterInteraction()
             LogPrintf("%s: Ignoring blockmaxsize setting which is overridden by blockmaxweight", __func__);
         }
     }
+
+    // Automated BMM creates a block template for every mainchain block
+    if (gArgs.GetBoolArg("-bmmautomate", DEFAULT_BMM_AUTOMATE)) {
+        if (gArgs.SoftSetBoolArg("-fetchdeposits", true))
+            LogPrintf("%s: parameter interaction: -bmmautomate=1 -> setting -fetchdeposits=1\n", __func__);
+    }
 }
 
 static std::string ResolveErrMsg(const char * const optname, const std::string& strBind)
@@ -1238,6 +1288,11 @@ bool AppInitMain()
             threadGroup.create_thread(&ThreadScriptCheck);
     }
 
+    int nPrefetchThreads = std::max(0, std::min((int)gArgs.GetArg("-prefetchthreads", DEFAULT_PREFETCH_THREADS), MAX_PREFETCH_THREADS));
+    LogPrintf("Using %u threads for UTXO prefetch\n", nPrefetchThreads);
+    if (nPrefetchThreads)
+        pcoinsprefetcher.reset(new CoinsPrefetcher(nPrefetchThreads));
+
     // Start the lightweight task scheduler thread
     CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
     threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
@@ -1388,6 +1443,7 @@ bool AppInitMain()
     // ********************************************************* Step 7: load block chain
 
     // Load the BMM cache from disk
+    bmmCache.SetVerifiedCacheSize(std::max<int64_t>(1, gArgs.GetArg("-bmmcachesize", DEFAULT_BMM_CACHE_SIZE)) << 20);
     LoadBMMCache();
 
     // Load the users WT ID cache
@@ -1435,7 +1491,13 @@ bool AppInitMain()
                 // fails if it's still open from the previous loop. Close it first:
                 pblocktree.reset();
                 pblocktree.reset(new CBlockTreeDB(nBlockTreeDBCache, false, fReset));
-                psidechaintree.reset(new CSidechainTreeDB(nSidechainTreeDBCache, false, fReset));
+                psidechaintree.reset();
+                psidechaintreedb.reset(new CSidechainTreeDB(nSidechainTreeDBCache, false, fReset));
+                if (!psidechaintreedb->ReindexWTStatus()) {
+                    strLoadError = _("Error loading sidechain database");
+                    break;
+                }
+                psidechaintree.reset(new CSidechainTreeCache(psidechaintreedb.get()));
 
                 if (fReset) {
                     pblocktree->WriteReindexing(true);
@@ -1599,6 +1661,12 @@ bool AppInitMain()
     fFeeEstimatesInitialized = true;
 
     // Load the mainchain block hash cache from disk
+    try {
+        pmainblockdb.reset(new CMainBlockDB(nMainBlockDBCache << 20));
+    } catch (const std::exception& e) {
+        return InitError(strprintf(_("Error opening mainchain block database: %s"), e.what()));
+    }
+    bmmCache.SetMainBlockDB(pmainblockdb.get(), std::max<int64_t>(0, gArgs.GetArg("-mainblockcachewindow", DEFAULT_MAIN_BLOCK_CACHE_WINDOW)));
     LoadMainBlockCache();
 
     // ********************************************************* Step 8: load wallet
@@ -1689,6 +1757,26 @@ bool AppInitMain()
         }
     }
 
+#if ENABLE_ZMQ
+    // Keep the mainchain block cache updated with mainchain notifications
+    pzmqMainchainSubscriber = CZMQMainchainSubscriber::Create();
+#endif
+
+    if (gArgs.GetBoolArg("-fetchdeposits", DEFAULT_FETCH_DEPOSITS)) {
+        pdepositpipeline.reset(new DepositPipeline());
+        pdepositpipeline->Start();
+    }
+
+    if (gArgs.GetBoolArg("-bmmautomate", DEFAULT_BMM_AUTOMATE)) {
+        CAmount bmmAmount = DEFAULT_BMM_AMOUNT;
+        if (gArgs.IsArgSet("-bmmamount")) {
+            if (!ParseMoney(gArgs.GetArg("-bmmamount", ""), bmmAmount) || bmmAmount <= 0)
+                return InitError(AmountErrMsg("bmmamount", gArgs.GetArg("-bmmamount", "")));
+        }
+        pbmmengine.reset(new BMMEngine(bmmAmount));
+        pbmmengine->Start();
+    }
+
     // ********************************************************* Step 11: start node
 
     int chain_active_height;
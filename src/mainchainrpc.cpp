@@ -0,0 +1,631 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <mainchainrpc.h>
+
+#include <util.h>
+#include <utilstrencodings.h>
+#include <utiltime.h>
+
+#include <algorithm>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <boost/array.hpp>
+#include <boost/asio.hpp>
+
+using boost::asio::ip::tcp;
+
+//! Longest status or header line we will accept from the mainchain
+static const size_t MAX_HTTP_LINE_SIZE = 8192;
+
+//! Seconds a connection may sit idle before we stop reusing it. This is kept
+//! well below the mainchain's default -rpcservertimeout (30 seconds) so that we
+//! don't send requests on a connection the server is about to close.
+static const int64_t MAINCHAIN_RPC_IDLE_TIMEOUT = 15;
+
+MainchainHTTPResponse::MainchainHTTPResponse()
+{
+    Reset();
+}
+
+void MainchainHTTPResponse::Reset()
+{
+    state = STATE_STATUS_LINE;
+    strLine.clear();
+    strBody.clear();
+    nStatus = 0;
+    fHaveData = false;
+    fKeepAlive = true;
+    fChunked = false;
+    fHaveLength = false;
+    nRemaining = 0;
+}
+
+bool MainchainHTTPResponse::ReadLine(const char*& p, const char* pEnd)
+{
+    while (p < pEnd) {
+        const char c = *p++;
+        if (c == '\n') {
+            if (!strLine.empty() && strLine.back() == '\r')
+                strLine.pop_back();
+            return true;
+        }
+        strLine.push_back(c);
+        if (strLine.size() > MAX_HTTP_LINE_SIZE) {
+            state = STATE_ERROR;
+            return false;
+        }
+    }
+    return false;
+}
+
+bool MainchainHTTPResponse::ParseStatusLine()
+{
+    // HTTP/1.x <code> <reason>
+    if (strLine.size() < 12 || strLine.compare(0, 7, "HTTP/1.") != 0 || strLine[8] != ' ')
+        return false;
+
+    // HTTP/1.0 servers close the connection unless told otherwise
+    if (strLine[7] == '0')
+        fKeepAlive = false;
+
+    int nCode = 0;
+    for (size_t i = 9; i < 12; i++) {
+        if (strLine[i] < '0' || strLine[i] > '9')
+            return false;
+        nCode = nCode * 10 + (strLine[i] - '0');
+    }
+    nStatus = nCode;
+
+    return true;
+}
+
+bool MainchainHTTPResponse::ParseHeaderLine()
+{
+    size_t nColon = strLine.find(':');
+    if (nColon == std::string::npos || nColon == 0)
+        return false;
+
+    std::string strName = strLine.substr(0, nColon);
+    std::string strValue = strLine.substr(nColon + 1);
+    std::transform(strName.begin(), strName.end(), strName.begin(), ::tolower);
+    std::transform(strValue.begin(), strValue.end(), strValue.begin(), ::tolower);
+
+    // Trim whitespace around the value
+    size_t nBegin = strValue.find_first_not_of(" \t");
+    size_t nEnd = strValue.find_last_not_of(" \t");
+    strValue = nBegin == std::string::npos ? "" : strValue.substr(nBegin, nEnd - nBegin + 1);
+
+    if (strName == "content-length") {
+        uint64_t nLength = 0;
+        if (!ParseUInt64(strValue, &nLength))
+            return false;
+        fHaveLength = true;
+        nRemaining = nLength;
+    }
+    else
+    if (strName == "transfer-encoding") {
+        if (strValue.find("chunked") != std::string::npos)
+            fChunked = true;
+    }
+    else
+    if (strName == "connection") {
+        if (strValue.find("close") != std::string::npos)
+            fKeepAlive = false;
+        else
+        if (strValue.find("keep-alive") != std::string::npos)
+            fKeepAlive = true;
+    }
+
+    return true;
+}
+
+void MainchainHTTPResponse::EndHeaders()
+{
+    // Skip interim responses (100 Continue) and wait for the real one
+    if (nStatus / 100 == 1) {
+        state = STATE_STATUS_LINE;
+        fChunked = false;
+        fHaveLength = false;
+        nRemaining = 0;
+        return;
+    }
+
+    // Chunked encoding takes precedence over Content-Length (RFC 7230 3.3.3)
+    if (fChunked) {
+        state = STATE_CHUNK_SIZE;
+    }
+    else
+    if (fHaveLength) {
+        state = nRemaining ? STATE_BODY_LENGTH : STATE_DONE;
+    }
+    else
+    if (nStatus == 204 || nStatus == 304) {
+        state = STATE_DONE;
+    }
+    else {
+        // Without a length the body ends when the connection is closed
+        state = STATE_BODY_UNTIL_CLOSE;
+        fKeepAlive = false;
+    }
+}
+
+size_t MainchainHTTPResponse::Feed(const char* pData, size_t nSize)
+{
+    const char* p = pData;
+    const char* pEnd = pData + nSize;
+
+    if (nSize)
+        fHaveData = true;
+
+    while (p < pEnd && state != STATE_DONE && state != STATE_ERROR) {
+        switch (state) {
+        case STATE_STATUS_LINE:
+            if (!ReadLine(p, pEnd))
+                break;
+            state = ParseStatusLine() ? STATE_HEADERS : STATE_ERROR;
+            strLine.clear();
+            break;
+        case STATE_HEADERS:
+        case STATE_TRAILERS:
+            if (!ReadLine(p, pEnd))
+                break;
+            if (strLine.empty()) {
+                if (state == STATE_HEADERS)
+                    EndHeaders();
+                else
+                    state = STATE_DONE;
+            }
+            else
+            if (state == STATE_HEADERS && !ParseHeaderLine()) {
+                state = STATE_ERROR;
+            }
+            strLine.clear();
+            break;
+        case STATE_BODY_LENGTH:
+        case STATE_CHUNK_DATA: {
+            size_t n = std::min<uint64_t>(nRemaining, pEnd - p);
+            strBody.append(p, n);
+            p += n;
+            nRemaining -= n;
+            if (!nRemaining)
+                state = state == STATE_BODY_LENGTH ? STATE_DONE : STATE_CHUNK_DATA_END;
+            break;
+        }
+        case STATE_BODY_UNTIL_CLOSE:
+            strBody.append(p, pEnd - p);
+            p = pEnd;
+            break;
+        case STATE_CHUNK_SIZE: {
+            if (!ReadLine(p, pEnd))
+                break;
+            // Ignore chunk extensions
+            std::string strSize = strLine.substr(0, strLine.find(';'));
+            strSize.erase(strSize.find_last_not_of(" \t") + 1);
+            if (strSize.empty() || strSize.size() > 15) {
+                state = STATE_ERROR;
+                break;
+            }
+            nRemaining = 0;
+            for (char c : strSize) {
+                signed char nDigit = HexDigit(c);
+                if (nDigit < 0) {
+                    state = STATE_ERROR;
+                    break;
+                }
+                nRemaining = (nRemaining << 4) | nDigit;
+            }
+            if (state == STATE_ERROR)
+                break;
+            state = nRemaining ? STATE_CHUNK_DATA : STATE_TRAILERS;
+            strLine.clear();
+            break;
+        }
+        case STATE_CHUNK_DATA_END:
+            if (!ReadLine(p, pEnd))
+                break;
+            state = strLine.empty() ? STATE_CHUNK_SIZE : STATE_ERROR;
+            strLine.clear();
+            break;
+        case STATE_DONE:
+        case STATE_ERROR:
+            break;
+        }
+    }
+
+    return p - pData;
+}
+
+void MainchainHTTPResponse::FeedEOF()
+{
+    fKeepAlive = false;
+    if (state == STATE_BODY_UNTIL_CLOSE)
+        state = STATE_DONE;
+    else
+    if (state != STATE_DONE)
+        state = STATE_ERROR;
+}
+
+namespace {
+
+typedef std::function<void(const boost::system::error_code&, size_t)> IOHandler;
+
+/**
+ * Connection to the mainchain with its own io_service, so that the thread
+ * using it can wait for its operations with a deadline.
+ */
+struct MainchainConnection
+{
+    MainchainConnection() : socket(io_service), timer(io_service), nLastUsed(0) { }
+
+    boost::asio::io_service io_service;
+    tcp::socket socket;
+    boost::asio::deadline_timer timer;
+    int64_t nLastUsed;
+
+    /**
+     * Start an asynchronous operation and wait for it to complete. If it
+     * doesn't complete within nTimeout seconds the socket is closed and ec
+     * is set to timed_out. Returns the number of bytes transferred.
+     */
+    size_t Run(const std::function<void(const IOHandler&)>& start, int64_t nTimeout, boost::system::error_code& ec);
+};
+
+size_t MainchainConnection::Run(const std::function<void(const IOHandler&)>& start, int64_t nTimeout, boost::system::error_code& ec)
+{
+    ec = boost::asio::error::would_block;
+    size_t nBytes = 0;
+    bool fTimedOut = false;
+
+    start([&ec, &nBytes](const boost::system::error_code& e, size_t n) { ec = e; nBytes = n; });
+
+    timer.expires_from_now(boost::posix_time::seconds(nTimeout));
+    timer.async_wait([this, &ec, &fTimedOut](const boost::system::error_code& e) {
+        if (e == boost::asio::error::operation_aborted || ec != boost::asio::error::would_block)
+            return;
+        // Closing the socket makes the operation complete with an error
+        fTimedOut = true;
+        boost::system::error_code eClose;
+        socket.close(eClose);
+    });
+
+    io_service.reset();
+    while (ec == boost::asio::error::would_block)
+        io_service.run_one();
+
+    // Let the timer handler run before its captures go out of scope
+    timer.cancel();
+    io_service.reset();
+    io_service.run();
+
+    if (fTimedOut)
+        ec = boost::asio::error::timed_out;
+    return nBytes;
+}
+
+/**
+ * Pool of keep-alive connections to the local mainchain node. Connections are
+ * taken out of the pool for the duration of a request, so any number of
+ * threads may send requests at the same time. At most -mainchainrpcconnections
+ * idle connections are kept open.
+ */
+class MainchainConnectionPool
+{
+public:
+    bool Send(int nPort, const std::string& strRequest, bool fIdempotent, MainchainHTTPResponse& response);
+    MainchainRPCStats GetStats();
+    void CloseAll();
+
+private:
+    std::mutex cs;
+    std::vector<std::unique_ptr<MainchainConnection>> vIdle;
+    int nPoolPort = 0;
+    MainchainRPCStats stats;
+
+    std::unique_ptr<MainchainConnection> Acquire(int nPort);
+    std::unique_ptr<MainchainConnection> Connect(int nPort, int64_t nTimeout);
+    void Release(std::unique_ptr<MainchainConnection> conn, int nPort);
+    void RecordResult(bool fReused, bool fSuccess, int64_t nLatency);
+};
+
+/**
+ * Write the request and read a complete response, waiting at most nTimeout
+ * seconds for each step. Throws on socket errors and timeouts, fSent tells
+ * whether the whole request was written before that.
+ */
+void DoExchange(MainchainConnection& conn, const std::string& strRequest, int64_t nTimeout, MainchainHTTPResponse& response, bool& fSent)
+{
+    fSent = false;
+
+    boost::system::error_code e;
+    conn.Run([&conn, &strRequest](const IOHandler& handler) {
+        boost::asio::async_write(conn.socket, boost::asio::buffer(strRequest), handler);
+    }, nTimeout, e);
+    if (e)
+        throw boost::system::system_error(e);
+
+    fSent = true;
+
+    boost::array<char, 4096> buf;
+    while (!response.IsComplete() && !response.IsError()) {
+        size_t nRead = conn.Run([&conn, &buf](const IOHandler& handler) {
+            conn.socket.async_read_some(boost::asio::buffer(buf), handler);
+        }, nTimeout, e);
+        if (nRead)
+            response.Feed(buf.data(), nRead);
+
+        if (e == boost::asio::error::eof) {
+            response.FeedEOF();
+            break;
+        }
+        else if (e)
+            throw boost::system::system_error(e);
+    }
+}
+
+std::unique_ptr<MainchainConnection> MainchainConnectionPool::Acquire(int nPort)
+{
+    std::lock_guard<std::mutex> lock(cs);
+
+    // Drop connections to a different port (network changed) and connections
+    // that have been idle long enough that the server may close them.
+    int64_t nNow = GetTime();
+    if (nPort != nPoolPort) {
+        vIdle.clear();
+        nPoolPort = nPort;
+    }
+    vIdle.erase(std::remove_if(vIdle.begin(), vIdle.end(),
+                [nNow](const std::unique_ptr<MainchainConnection>& c)
+                {return nNow - c->nLastUsed > MAINCHAIN_RPC_IDLE_TIMEOUT;}), vIdle.end());
+
+    if (vIdle.empty())
+        return nullptr;
+
+    std::unique_ptr<MainchainConnection> conn = std::move(vIdle.back());
+    vIdle.pop_back();
+    return conn;
+}
+
+std::unique_ptr<MainchainConnection> MainchainConnectionPool::Connect(int nPort, int64_t nTimeout)
+{
+    std::unique_ptr<MainchainConnection> conn(new MainchainConnection());
+    const tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), nPort);
+
+    boost::system::error_code e;
+    MainchainConnection& c = *conn;
+    c.Run([&c, &endpoint](const IOHandler& handler) {
+        c.socket.async_connect(endpoint, [handler](const boost::system::error_code& ec) { handler(ec, 0); });
+    }, nTimeout, e);
+    if (e)
+        throw boost::system::system_error(e);
+
+    // Requests are small and we wait for each response, don't let Nagle's
+    // algorithm hold them back.
+    conn->socket.set_option(tcp::no_delay(true));
+
+    std::lock_guard<std::mutex> lock(cs);
+    stats.nConnections++;
+
+    return conn;
+}
+
+void MainchainConnectionPool::Release(std::unique_ptr<MainchainConnection> conn, int nPort)
+{
+    size_t nMaxIdle = std::max<int64_t>(0, gArgs.GetArg("-mainchainrpcconnections", DEFAULT_MAINCHAIN_RPC_CONNECTIONS));
+
+    std::lock_guard<std::mutex> lock(cs);
+    if (nPort != nPoolPort || vIdle.size() >= nMaxIdle)
+        return;
+
+    conn->nLastUsed = GetTime();
+    vIdle.push_back(std::move(conn));
+}
+
+void MainchainConnectionPool::RecordResult(bool fReused, bool fSuccess, int64_t nLatency)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    stats.nRequests++;
+    if (fReused)
+        stats.nReused++;
+    if (!fSuccess)
+        stats.nFailures++;
+    stats.nLatencyTotal += nLatency;
+    stats.nLatencyMax = std::max(stats.nLatencyMax, nLatency);
+}
+
+bool MainchainConnectionPool::Send(int nPort, const std::string& strRequest, bool fIdempotent, MainchainHTTPResponse& response)
+{
+    int64_t nTimeStart = GetTimeMicros();
+    int64_t nTimeout = std::max<int64_t>(1, gArgs.GetArg("-mainchainrpctimeout", DEFAULT_MAINCHAIN_RPC_TIMEOUT));
+
+    std::unique_ptr<MainchainConnection> conn = Acquire(nPort);
+    bool fReused = conn != nullptr;
+
+    try {
+        if (conn) {
+            // The server may have closed an idle connection since we last
+            // used it. Retry once on a fresh connection if nothing came back,
+            // but only if the request wasn't written yet or is safe to run
+            // twice: the server may have run it before closing. A server
+            // that stopped responding isn't given a second chance.
+            bool fSent = false;
+            try {
+                DoExchange(*conn, strRequest, nTimeout, response, fSent);
+            } catch (const boost::system::system_error& e) {
+                if (response.HaveData() || e.code() == boost::asio::error::timed_out)
+                    throw;
+            }
+            if (!response.HaveData()) {
+                if (fSent && !fIdempotent)
+                    throw std::runtime_error("connection closed before a reply, request not sent again");
+                response.Reset();
+                conn.reset();
+                fReused = false;
+            }
+        }
+        if (!conn) {
+            bool fSent = false;
+            conn = Connect(nPort, nTimeout);
+            DoExchange(*conn, strRequest, nTimeout, response, fSent);
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("ERROR Sidechain client (SendMainchainRPC): %s\n", e.what());
+        RecordResult(fReused, false, GetTimeMicros() - nTimeStart);
+        return false;
+    }
+
+    bool fSuccess = response.IsComplete() && response.GetStatus() == 200;
+    RecordResult(fReused, fSuccess, GetTimeMicros() - nTimeStart);
+
+    if (response.IsComplete() && response.KeepAlive())
+        Release(std::move(conn), nPort);
+
+    return fSuccess;
+}
+
+MainchainRPCStats MainchainConnectionPool::GetStats()
+{
+    std::lock_guard<std::mutex> lock(cs);
+    MainchainRPCStats ret = stats;
+    ret.nIdle = vIdle.size();
+    return ret;
+}
+
+void MainchainConnectionPool::CloseAll()
+{
+    std::lock_guard<std::mutex> lock(cs);
+    vIdle.clear();
+}
+
+MainchainConnectionPool& GetConnectionPool()
+{
+    static MainchainConnectionPool pool;
+    return pool;
+}
+
+} // namespace
+
+bool SendMainchainRPC(const std::string& json, std::string& strBody, bool fIdempotent)
+{
+    // Format user:pass for authentication
+    std::string auth = gArgs.GetArg("-rpcuser", "") + ":" + gArgs.GetArg("-rpcpassword", "");
+    if (auth == ":")
+        return false;
+
+    // Mainnet RPC = 8332
+    // Testnet RPC = 18332
+    // Regtest RPC = 18443
+    //
+    bool fRegtest = gArgs.GetBoolArg("-regtest", false);
+    int nPort = gArgs.GetArg("-mainchainrpcport", fRegtest ? 18443 : 8332);
+
+    std::string strRequest;
+    strRequest.reserve(json.size() + 256);
+    strRequest.append("POST / HTTP/1.1\r\n");
+    strRequest.append("Host: 127.0.0.1\r\n");
+    strRequest.append("Content-Type: application/json\r\n");
+    strRequest.append("Authorization: Basic " + EncodeBase64(auth) + "\r\n");
+    strRequest.append("Connection: keep-alive\r\n");
+    strRequest.append("Content-Length: " + std::to_string(json.size()) + "\r\n\r\n");
+    strRequest.append(json);
+
+    MainchainHTTPResponse response;
+    if (!GetConnectionPool().Send(nPort, strRequest, fIdempotent, response))
+        return false;
+
+    response.SwapBody(strBody);
+
+    return true;
+}
+
+bool ParseMainchainRPCBatchReply(const std::string& strBody, size_t nBegin, size_t nEnd, std::vector<UniValue>& vResult)
+{
+    UniValue reply;
+    if (!reply.read(strBody) || !reply.isArray()) {
+        LogPrintf("%s: Invalid batch reply from mainchain\n", __func__);
+        return false;
+    }
+
+    for (size_t i = 0; i < reply.size(); i++) {
+        const UniValue& obj = reply[i];
+        if (!obj.isObject())
+            return false;
+
+        const UniValue& id = find_value(obj, "id");
+        if (!id.isNum())
+            return false;
+
+        int64_t nID = id.get_int64();
+        if (nID < (int64_t)nBegin || nID >= (int64_t)nEnd || (size_t)nID >= vResult.size())
+            return false;
+
+        // Calls that failed on the mainchain keep a null result
+        if (find_value(obj, "error").isNull())
+            vResult[nID] = find_value(obj, "result");
+    }
+
+    return true;
+}
+
+/** Send calls [nBegin, nEnd) as a single batch request */
+static bool SendMainchainRPCBatchRange(const std::vector<MainchainRPCCall>& vCall, size_t nBegin, size_t nEnd, std::vector<UniValue>& vResult)
+{
+    // Use the index of each call as its id to match up the replies
+    UniValue batch(UniValue::VARR);
+    for (size_t i = nBegin; i < nEnd; i++) {
+        UniValue request(UniValue::VOBJ);
+        request.pushKV("jsonrpc", "1.0");
+        request.pushKV("id", (uint64_t)i);
+        request.pushKV("method", vCall[i].strMethod);
+        request.pushKV("params", vCall[i].params);
+        batch.push_back(request);
+    }
+
+    std::string strBody;
+    if (!SendMainchainRPC(batch.write(), strBody, true /* fIdempotent */))
+        return false;
+
+    return ParseMainchainRPCBatchReply(strBody, nBegin, nEnd, vResult);
+}
+
+bool SendMainchainRPCBatch(const std::vector<MainchainRPCCall>& vCall, std::vector<UniValue>& vResult)
+{
+    vResult.assign(vCall.size(), NullUniValue);
+
+    if (vCall.size() <= MAINCHAIN_RPC_BATCH_SIZE)
+        return vCall.empty() || SendMainchainRPCBatchRange(vCall, 0, vCall.size(), vResult);
+
+    // Send the batches in parallel, each one on its own pooled connection.
+    // The batches fill in disjoint ranges of vResult.
+    size_t nParallel = std::max<int64_t>(1, gArgs.GetArg("-mainchainrpcconnections", DEFAULT_MAINCHAIN_RPC_CONNECTIONS));
+    bool fSuccess = true;
+    for (size_t nBegin = 0; nBegin < vCall.size(); ) {
+        std::vector<std::future<bool>> vFuture;
+        for (; nBegin < vCall.size() && vFuture.size() < nParallel; nBegin += MAINCHAIN_RPC_BATCH_SIZE) {
+            size_t nEnd = std::min(vCall.size(), nBegin + MAINCHAIN_RPC_BATCH_SIZE);
+            vFuture.push_back(std::async(std::launch::async, SendMainchainRPCBatchRange,
+                        std::cref(vCall), nBegin, nEnd, std::ref(vResult)));
+        }
+        for (std::future<bool>& f : vFuture)
+            fSuccess &= f.get();
+        if (!fSuccess)
+            return false;
+    }
+
+    return true;
+}
+
+MainchainRPCStats GetMainchainRPCStats()
+{
+    return GetConnectionPool().GetStats();
+}
+
+void CloseMainchainRPCConnections()
+{
+    GetConnectionPool().CloseAll();
+}
@@ -0,0 +1,160 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MAINCHAINRPC_H
+#define BITCOIN_MAINCHAINRPC_H
+
+#include <univalue.h>
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//! Default number of idle keep-alive connections kept open to the mainchain
+static const unsigned int DEFAULT_MAINCHAIN_RPC_CONNECTIONS = 4;
+
+//! Default seconds to wait for the mainchain to accept a connection, take a
+//! request or send more of its response
+static const int64_t DEFAULT_MAINCHAIN_RPC_TIMEOUT = 30;
+
+//! Maximum number of calls sent to the mainchain in a single batch request
+static const size_t MAINCHAIN_RPC_BATCH_SIZE = 500;
+
+/**
+ * Incremental parser for HTTP/1.x responses from the mainchain RPC server.
+ *
+ * Data can be fed in arbitrary pieces as it is read from the socket. The body
+ * is delimited by Content-Length, chunked transfer encoding or (as a last
+ * resort) the server closing the connection.
+ */
+class MainchainHTTPResponse
+{
+public:
+    MainchainHTTPResponse();
+
+    /** Reset the parser so that it can be used for the next response */
+    void Reset();
+
+    /**
+     * Feed data read from the connection. Returns the number of bytes that
+     * were consumed, which is less than nSize only once the response is
+     * complete (or failed to parse).
+     */
+    size_t Feed(const char* pData, size_t nSize);
+
+    /** Signal that the server closed the connection */
+    void FeedEOF();
+
+    bool IsComplete() const { return state == STATE_DONE; }
+    bool IsError() const { return state == STATE_ERROR; }
+
+    /** Whether any part of a response has been received */
+    bool HaveData() const { return fHaveData; }
+
+    int GetStatus() const { return nStatus; }
+
+    /** Whether the server will keep the connection open for reuse */
+    bool KeepAlive() const { return fKeepAlive; }
+
+    const std::string& GetBody() const { return strBody; }
+
+    /** Move the body out of the parser without copying it */
+    void SwapBody(std::string& str) { str.swap(strBody); }
+
+private:
+    enum State {
+        STATE_STATUS_LINE,
+        STATE_HEADERS,
+        STATE_BODY_LENGTH,
+        STATE_BODY_UNTIL_CLOSE,
+        STATE_CHUNK_SIZE,
+        STATE_CHUNK_DATA,
+        STATE_CHUNK_DATA_END,
+        STATE_TRAILERS,
+        STATE_DONE,
+        STATE_ERROR,
+    };
+
+    State state;
+    std::string strLine;
+    std::string strBody;
+    int nStatus;
+    bool fHaveData;
+    bool fKeepAlive;
+    bool fChunked;
+    bool fHaveLength;
+    uint64_t nRemaining;
+
+    /** Extract the next CRLF (or LF) terminated line, returns false if the
+     * line is not complete yet */
+    bool ReadLine(const char*& p, const char* pEnd);
+
+    bool ParseStatusLine();
+    bool ParseHeaderLine();
+    void EndHeaders();
+};
+
+/** Counters for the connections used to talk to the mainchain node */
+struct MainchainRPCStats
+{
+    //! Requests that were sent to the mainchain
+    uint64_t nRequests = 0;
+    //! Requests that were sent on an already open connection
+    uint64_t nReused = 0;
+    //! TCP connections that were opened
+    uint64_t nConnections = 0;
+    //! Requests that failed (connection or HTTP error)
+    uint64_t nFailures = 0;
+    //! Open connections currently idle in the pool
+    uint64_t nIdle = 0;
+    //! Sum and maximum of request round trip time in microseconds
+    int64_t nLatencyTotal = 0;
+    int64_t nLatencyMax = 0;
+};
+
+/**
+ * Send a JSON-RPC request to the local mainchain node using a pool of
+ * persistent HTTP/1.1 keep-alive connections. Returns false if the request
+ * could not be sent, the server did not respond with HTTP 200 or stopped
+ * responding for -mainchainrpctimeout seconds. On success strBody is set to
+ * the response body.
+ *
+ * A request that was sent on a connection the server closed without a reply
+ * is only sent again if fIdempotent is set, as the server may have run it.
+ * Requests that change mainchain state must not set it.
+ */
+bool SendMainchainRPC(const std::string& json, std::string& strBody, bool fIdempotent);
+
+/** A single call of a JSON-RPC batch request */
+struct MainchainRPCCall
+{
+    MainchainRPCCall(const std::string& strMethodIn, const UniValue& paramsIn) : strMethod(strMethodIn), params(paramsIn) { }
+
+    std::string strMethod;
+    UniValue params;
+};
+
+/**
+ * Send calls to the mainchain packed into JSON-RPC batch requests of at most
+ * MAINCHAIN_RPC_BATCH_SIZE calls each. Up to -mainchainrpcconnections batches
+ * are sent in parallel. On return vResult[i] holds the result of vCall[i], or
+ * null if that call returned an error. Returns false if a batch could not be
+ * sent or its reply could not be parsed. Batches are sent as idempotent
+ * requests, so the calls must only read mainchain state.
+ */
+bool SendMainchainRPCBatch(const std::vector<MainchainRPCCall>& vCall, std::vector<UniValue>& vResult);
+
+/**
+ * Parse the reply to a batch request made of calls [nBegin, nEnd) and store
+ * the results in vResult by their id. Replies may arrive in any order.
+ */
+bool ParseMainchainRPCBatchReply(const std::string& strBody, size_t nBegin, size_t nEnd, std::vector<UniValue>& vResult);
+
+/** Get a snapshot of the mainchain RPC connection counters */
+MainchainRPCStats GetMainchainRPCStats();
+
+/** Close all idle connections to the mainchain */
+void CloseMainchainRPCConnections();
+
+#endif // BITCOIN_MAINCHAINRPC_H
@@ -15,6 +15,7 @@
 #include <consensus/tx_verify.h>
 #include <consensus/merkle.h>
 #include <consensus/validation.h>
+#include <depositpipeline.h>
 #include <hash.h>
 #include <validation.h>
 #include <net.h>
@@ -248,25 +249,12 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     if (!fCreatedWTPrime) {
         uint64_t nRefundAdded = 0;
         for (const CTxMemPool::txiter& it : vWTRefund) {
-            CTransactionRef tx = it->GetSharedTx();
-            if (tx == nullptr) continue;
-
-            // Find the refund script
-            uint256 wtID;
-            wtID.SetNull();
-            std::vector<unsigned char> vchSig;
-            for (const CTxOut& o : tx->vout) {
-                if (!o.scriptPubKey.IsWTRefundRequest(wtID, vchSig))
-                    continue;
-                break;
-            }
-            if (wtID.IsNull())
-                continue;
+            const MemPoolSidechainInfo& info = it->GetSidechainInfo();
 
             // Verify refund request & get WT data
             SidechainWT wt;
-            if (!VerifyWTRefundRequest(wtID, vchSig, wt)) {
-                LogPrintf("%s: Miner failed to verify WT refund request! WT ID: %s\n", __func__, wtID.ToString());
+            if (!VerifyWTRefundRequest(info.wtID, info.vchRefundSig, wt)) {
+                LogPrintf("%s: Miner failed to verify WT refund request! WT ID: %s\n", __func__, info.wtID.ToString());
                 return nullptr;
             }
 
@@ -283,41 +271,45 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
     // Get list of deposits from the mainchain
 
-    std::vector<SidechainDeposit> vDeposit;
-
     SidechainDeposit lastDeposit;
     uint256 hashLastDeposit;
     uint32_t nBurnIndex = 0;
     bool fHaveDeposits = psidechaintree->GetLastDeposit(lastDeposit);
     if (fHaveDeposits) {
-        hashLastDeposit = lastDeposit.dtx.GetHash();
+        hashLastDeposit = lastDeposit.dtx->GetHash();
         nBurnIndex = lastDeposit.nBurnIndex;
     }
-    vDeposit = client.UpdateDeposits(SIDECHAIN_ADDRESS_BYTES, hashLastDeposit, nBurnIndex);
-
-    // Find new deposits
-    std::vector<SidechainDeposit> vDepositNew;
-    for (const SidechainDeposit& d: vDeposit) {
-        // We look up the deposit using the hash of the deposit without the
-        // payout amount set because we do not know the payout amount yet.
-        if (!psidechaintree->HaveDepositNonAmount(d.GetID())) {
-            vDepositNew.push_back(d);
+
+    // Use the verified and sorted deposits queued by the deposit pipeline if
+    // it is in sync with our tip, otherwise request them now
+    std::vector<SidechainDeposit> vDepositSorted;
+    if (!pdepositpipeline || !pdepositpipeline->GetDeposits(hashLastDeposit, vDepositSorted)) {
+        std::vector<SidechainDeposit> vDeposit;
+        vDeposit = client.UpdateDeposits(SIDECHAIN_ADDRESS_BYTES, hashLastDeposit, nBurnIndex);
+
+        // Find new deposits
+        std::vector<SidechainDeposit> vDepositNew;
+        for (const SidechainDeposit& d: vDeposit) {
+            // We look up the deposit using the hash of the deposit without the
+            // payout amount set because we do not know the payout amount yet.
+            if (!psidechaintree->HaveDepositNonAmount(d.GetID())) {
+                vDepositNew.push_back(d);
+            }
         }
-    }
 
-    // Check deposit burn index
-    for (const SidechainDeposit& d : vDepositNew) {
-        if (d.nBurnIndex >= d.dtx.vout.size()) {
-            LogPrintf("%s: Error: new deposit has invalid burn index:\n%s\n", __func__, d.ToString());
-            return nullptr;
+        // Check deposit burn index
+        for (const SidechainDeposit& d : vDepositNew) {
+            if (d.nBurnIndex >= d.dtx->vout.size()) {
+                LogPrintf("%s: Error: new deposit has invalid burn index:\n%s\n", __func__, d.ToString());
+                return nullptr;
+            }
         }
-    }
 
-    // Sort the deposits into CTIP UTXO spend order
-    std::vector<SidechainDeposit> vDepositSorted;
-    if (!SortDeposits(vDepositNew, vDepositSorted)) {
-        LogPrintf("%s: Error: Failed to sort deposits!\n", __func__);
-        return nullptr;
+        // Sort the deposits into CTIP UTXO spend order
+        if (!SortDeposits(vDepositNew, vDepositSorted)) {
+            LogPrintf("%s: Error: Failed to sort deposits!\n", __func__);
+            return nullptr;
+        }
     }
 
     // Create deposit payout output(s)
@@ -350,12 +342,12 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     if (fHaveDeposits && vDepositSorted.size()) {
         bool fFound = false;
         const SidechainDeposit& first = vDepositSorted.front();
-        for (const CTxIn& in : first.dtx.vin) {
-            if (in.prevout.hash == lastDeposit.dtx.GetHash()
-                    && lastDeposit.dtx.vout.size() > in.prevout.n
+        for (const CTxIn& in : first.dtx->vin) {
+            if (in.prevout.hash == lastDeposit.dtx->GetHash()
+                    && lastDeposit.dtx->vout.size() > in.prevout.n
                     && lastDeposit.nBurnIndex == in.prevout.n) {
                 // Calculate payout amount
-                CAmount ctipAmount = lastDeposit.dtx.vout[lastDeposit.nBurnIndex].nValue;
+                CAmount ctipAmount = lastDeposit.dtx->vout[lastDeposit.nBurnIndex].nValue;
                 if (first.amtUserPayout > ctipAmount)
                     vDepositSorted.front().amtUserPayout -= ctipAmount;
                 else
@@ -366,7 +358,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
             }
         }
         if (!fFound) {
-            LogPrintf("%s: Error: No CTIP found for first deposit in sorted list: %s (mainchain txid)\n", __func__, first.dtx.GetHash().ToString());
+            LogPrintf("%s: Error: No CTIP found for first deposit in sorted list: %s (mainchain txid)\n", __func__, first.dtx->GetHash().ToString());
             return nullptr;
         }
     } else {
@@ -391,12 +383,12 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
             // the user payout amount. Note that we've already sorted by CTIP so
             // they all should exist but we are going to double check anyways.
             bool fFound = false;
-            for (const CTxIn& in : it->dtx.vin) {
-                if (in.prevout.hash == itPrev->dtx.GetHash()
-                        && itPrev->dtx.vout.size() > in.prevout.n
+            for (const CTxIn& in : it->dtx->vin) {
+                if (in.prevout.hash == itPrev->dtx->GetHash()
+                        && itPrev->dtx->vout.size() > in.prevout.n
                         && itPrev->nBurnIndex == in.prevout.n) {
                     // Calculate payout amount
-                    CAmount ctipAmount = itPrev->dtx.vout[itPrev->nBurnIndex].nValue;
+                    CAmount ctipAmount = itPrev->dtx->vout[itPrev->nBurnIndex].nValue;
 
                     if (it->amtUserPayout > ctipAmount)
                         it->amtUserPayout -= ctipAmount;
@@ -408,7 +400,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
                 }
             }
             if (!fFound) {
-                LogPrintf("%s: Error: Failed to calculate payout amount - no CTIP found for deposit: %s (mainchain txid)\n", __func__, it->dtx.GetHash().ToString());
+                LogPrintf("%s: Error: Failed to calculate payout amount - no CTIP found for deposit: %s (mainchain txid)\n", __func__, it->dtx->GetHash().ToString());
                 return nullptr;
             }
         }
@@ -661,40 +653,27 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
     while (mi != mempool.mapTx.get<ancestor_score>().end() || !mapModifiedTx.empty())
     {
         // Skip WT refunds if we don't want to include them
-        if (!fIncludeWTRefunds && mi->IsWTRefund()) {
+        bool fWTRefund = mi != mempool.mapTx.get<ancestor_score>().end() && mi->IsWTRefund();
+        if (!fIncludeWTRefunds && fWTRefund) {
             ++mi;
             continue;
         }
 
-        // Very WT refund in the mempool again before adding it to a block
-        if (mi->IsWTRefund()) {
-            CTransactionRef tx = mi->GetSharedTx();
-            if (tx == nullptr) {
-                ++mi;
-                continue;
-            }
-
-            // Find the refund script
-            uint256 wtID;
-            wtID.SetNull();
-            std::vector<unsigned char> vchSig;
-            for (const CTxOut& o : tx->vout) {
-                if (!o.scriptPubKey.IsWTRefundRequest(wtID, vchSig))
-                    continue;
-                break;
-            }
-            if (wtID.IsNull())
-                continue;
+        // Verify WT refund in the mempool again before adding it to a block,
+        // using the refund request the mempool entry was accepted with
+        if (fWTRefund) {
+            const MemPoolSidechainInfo& info = mi->GetSidechainInfo();
 
             // Double check that we haven't already added another refund request
             // txn for this same WT ID (that would be invalid).
-            if (setWTRefund.count(wtID)) {
+            if (setWTRefund.count(info.wtID)) {
                 LogPrintf("%s: Invalid (duplicate WT ID) WT refund in mempool!\n", __func__);
+                ++mi;
                 continue;
             }
 
             SidechainWT wt;
-            if (!VerifyWTRefundRequest(wtID, vchSig, wt)) {
+            if (!VerifyWTRefundRequest(info.wtID, info.vchRefundSig, wt)) {
                 ++mi;
                 continue;
             }
@@ -803,6 +782,7 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
             // Keep track of WT refunds that are added
             if (sortedEntries[i]->IsWTRefund()) {
                 vWTRefund.push_back(sortedEntries[i]);
+                setWTRefund.insert(sortedEntries[i]->GetWTID());
             }
 
             AddToBlock(sortedEntries[i]);
@@ -837,6 +817,29 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
 }
 
+bool UpdatePrevBlockCommit(CBlock& block, const uint256& hashPrevMain)
+{
+    if (block.vtx.empty())
+        return false;
+
+    CMutableTransaction txCoinbase(*block.vtx[0]);
+    for (CTxOut& out : txCoinbase.vout) {
+        uint256 hashPrevMainOld;
+        uint256 hashPrevSide;
+        if (!out.scriptPubKey.IsPrevBlockCommit(hashPrevMainOld, hashPrevSide))
+            continue;
+
+        if (hashPrevMainOld == hashPrevMain)
+            return true;
+
+        out.scriptPubKey = GeneratePrevBlockCommit(hashPrevMain, hashPrevSide);
+        block.vtx[0] = MakeTransactionRef(std::move(txCoinbase));
+        block.hashMerkleRoot = BlockMerkleRoot(block);
+        return true;
+    }
+    return false;
+}
+
 bool BlockAssembler::GenerateBMMBlock(CBlock& block, std::string& strError, CAmount* nFeesOut, const std::vector<CMutableTransaction>& vtx, const uint256& hashPrevBlock, const CScript& scriptPubKey)
 {
     // Either generate a new scriptPubKey or use the one that has optionally
@@ -212,6 +212,11 @@ private:
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
 
+/** Point the previous mainchain block commit in the coinbase of a BMM block
+ *  at a new mainchain tip, so that a block built ahead of time can be used
+ *  for the next BMM request. Returns false if there is no commit. */
+bool UpdatePrevBlockCommit(CBlock& block, const uint256& hashPrevMain);
+
 bool CreateDepositTx(CMutableTransaction& depositTx);
 
 #endif // BITCOIN_MINER_H
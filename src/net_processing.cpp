@@ -8,6 +8,7 @@
 #include <addrman.h>
 #include <arith_uint256.h>
 #include <blockencodings.h>
+#include <bmmproof.h>
 #include <chainparams.h>
 #include <consensus/validation.h>
 #include <hash.h>
@@ -24,6 +25,7 @@
 #include <reverse_iterator.h>
 #include <scheduler.h>
 #include <tinyformat.h>
+#include <txdb.h>
 #include <txmempool.h>
 #include <ui_interface.h>
 #include <util.h>
@@ -191,6 +193,8 @@ struct CNodeState {
     bool fPreferHeaders;
     //! Whether this peer wants invs or cmpctblocks (when possible) for block announcements.
     bool fPreferHeaderAndIDs;
+    //! Whether this peer wants the BMM proofs of the headers we send it.
+    bool fWantsBMMProofs;
     /**
       * Whether this peer will send us cmpctblocks if we request them.
       * This is not used to gate request logic, as we really only care about fSupportsDesiredCmpctVersion,
@@ -255,6 +259,7 @@ struct CNodeState {
         fPreferredDownload = false;
         fPreferHeaders = false;
         fPreferHeaderAndIDs = false;
+        fWantsBMMProofs = false;
         fProvidesHeaderAndIDs = false;
         fHaveWitness = false;
         fWantsCmpctWitness = false;
@@ -594,6 +599,7 @@ void PeerLogicValidation::FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTim
         mapBlocksInFlight.erase(entry.hash);
     }
     EraseOrphansFor(nodeid);
+    bmmProofCache.ForgetPeer(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
     nPeersWithValidatedDownloads -= (state->nBlocksInFlightValidHeaders != 0);
     assert(nPeersWithValidatedDownloads >= 0);
@@ -1274,6 +1280,43 @@ inline void static SendBlockTransactions(const CBlock& block, const BlockTransac
     connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCKTXN, resp));
 }
 
+/** Whether we have the sidechain header a BMM proof is for. Its BMM was
+ * checked when it was accepted, so the proof isn't needed. */
+static bool HaveBMMProofHeader(const BMMProof& proof)
+{
+    AssertLockHeld(cs_main);
+    std::map<uint256, CBlockIndex*>::const_iterator it = mapBlockMainHashIndex.find(proof.GetMainBlockHash());
+    if (it == mapBlockMainHashIndex.end())
+        return false;
+
+    for (const uint256& hashCritical : proof.GetCriticalHashes()) {
+        if (hashCritical == it->second->hashMerkleRoot)
+            return true;
+    }
+    return false;
+}
+
+/** Send the BMM proofs we have for headers that we are about to send, if the
+ * peer asked for them with "sendbmmproofs" */
+static void PushBMMProofs(CNode* pto, CConnman* connman, const std::vector<CBlock>& vHeaders)
+{
+    AssertLockHeld(cs_main);
+    if (!State(pto->GetId())->fWantsBMMProofs)
+        return;
+
+    std::vector<BMMProof> vProof;
+    for (const CBlock& header : vHeaders) {
+        BMMProof proof;
+        if (pblocktree->ReadBMMProof(header.GetHash(), proof))
+            vProof.push_back(proof);
+    }
+    if (vProof.empty())
+        return;
+
+    const CNetMsgMaker msgMaker(pto->GetSendVersion());
+    connman->PushMessage(pto, msgMaker.Make(NetMsgType::BMMPROOFS, vProof));
+}
+
 bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman, const std::vector<CBlockHeader>& headers, const CChainParams& chainparams, bool punish_duplicate_invalid)
 {
     const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
@@ -1729,6 +1772,10 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             // non-NODE NETWORK peers can announce blocks (such as pruning
             // nodes)
             connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDHEADERS));
+
+            // Ask for the BMM proofs of the headers we are sent, so that we
+            // can check their BMM without asking the mainchain
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDBMMPROOFS));
         }
         if (pfrom->nVersion >= SHORT_IDS_BLOCKS_VERSION) {
             // Tell our peer we are willing to provide version 1 or 2 cmpctblocks
@@ -1810,6 +1857,12 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         State(pfrom->GetId())->fPreferHeaders = true;
     }
 
+    else if (strCommand == NetMsgType::SENDBMMPROOFS)
+    {
+        LOCK(cs_main);
+        State(pfrom->GetId())->fWantsBMMProofs = true;
+    }
+
     else if (strCommand == NetMsgType::SENDCMPCT)
     {
         bool fAnnounceUsingCMPCTBLOCK = false;
@@ -2083,6 +2136,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         // will re-announce the new block via headers (or compact blocks again)
         // in the SendMessages logic.
         nodestate->pindexBestHeaderSent = pindex ? pindex : chainActive.Tip();
+        PushBMMProofs(pfrom, connman, vHeaders);
         connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
     }
 
@@ -2595,6 +2649,35 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         return ProcessHeadersMessage(pfrom, connman, headers, chainparams, should_punish);
     }
 
+    else if (strCommand == NetMsgType::BMMPROOFS && !fImporting && !fReindex) // Ignore proofs received while importing
+    {
+        std::vector<BMMProof> vProof;
+        vRecv >> vProof;
+
+        if (vProof.size() > MAX_HEADERS_RESULTS) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 20, strprintf("bmmproofs message size = %u", vProof.size()));
+            return false;
+        }
+
+        // A proof that can't be valid for any header is the peer's fault,
+        // the rest of the proof is checked once the headers it proves arrive
+        for (const BMMProof& proof : vProof) {
+            std::string strFail;
+            if (!CheckBMMProofContents(proof, strFail)) {
+                LOCK(cs_main);
+                Misbehaving(pfrom->GetId(), 50, strprintf("invalid bmm proof: %s", strFail));
+                return false;
+            }
+        }
+
+        LOCK(cs_main);
+        for (const BMMProof& proof : vProof) {
+            if (!HaveBMMProofHeader(proof))
+                bmmProofCache.Add(proof, pfrom->GetId());
+        }
+    }
+
     else if (strCommand == NetMsgType::BLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
     {
         std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
@@ -3355,6 +3438,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                         LogPrint(BCLog::NET, "%s: sending header %s to peer=%d\n", __func__,
                                 vHeaders.front().GetHash().ToString(), pto->GetId());
                     }
+                    PushBMMProofs(pto, connman, vHeaders);
                     connman->PushMessage(pto, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
                     state.pindexBestHeaderSent = pBestIndex;
                 } else
@@ -10,4 +10,7 @@
 
 static const unsigned int MAX_WTPRIME_WEIGHT = (CORE_MAX_STANDARD_TX_WEIGHT / CORE_WITNESS_SCALE_FACTOR) / 2;
 
+//! Upper bound on the number of WT outputs that fit in a WT^ (9 byte minimum output)
+static const unsigned int MAX_WTPRIME_WT = MAX_WTPRIME_WEIGHT / (CORE_WITNESS_SCALE_FACTOR * 9);
+
 #endif // BITCOIN_POLICY_WTPRIME_H
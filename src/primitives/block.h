@@ -10,8 +10,11 @@
 #include <serialize.h>
 #include <uint256.h>
 
+#include <memory>
 #include <string>
 
+struct SidechainObjIndex;
+
 class CBlockHeader
 {
 public:
@@ -73,6 +76,7 @@ public:
 
     // memory only
     mutable bool fChecked;
+    mutable std::shared_ptr<const SidechainObjIndex> sidechainObjs;
 
     CBlock()
     {
@@ -98,6 +102,7 @@ public:
         CBlockHeader::SetNull();
         vtx.clear();
         fChecked = false;
+        sidechainObjs.reset();
     }
 
     CBlockHeader GetBlockHeader() const
@@ -237,6 +237,16 @@ extern const char *GETBLOCKTXN;
  * @since protocol version 70014 as described by BIP 152
  */
 extern const char *BLOCKTXN;
+/**
+ * Indicates that a node wants to receive the BMM proofs of the block headers
+ * that are sent to it, in a "bmmproofs" message before the "headers" message.
+ */
+extern const char *SENDBMMPROOFS;
+/**
+ * Contains a vector of BMMProof objects, for the headers in the "headers"
+ * message that follows it.
+ */
+extern const char *BMMPROOFS;
 };
 
 /* Get a vector of all valid message types (see above) */
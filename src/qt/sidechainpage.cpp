@@ -21,6 +21,7 @@
 
 #include <base58.h>
 #include <bmmcache.h>
+#include <bmmengine.h>
 #include <coins.h>
 #include <consensus/validation.h>
 #include <core_io.h>
@@ -1150,7 +1151,7 @@ void SidechainPage::SetCurrentWTPrime(const std::string& strHash, bool fRequeste
     ui->labelBlockHeight->setText(QString::number(wtPrime.nHeight));
 
     // Set transaction size
-    int64_t sz = GetTransactionWeight(wtPrime.wtPrime);
+    int64_t sz = GetTransactionWeight(*wtPrime.wtPrime);
 
     QString size;
     size += QString::number(sz);
@@ -1163,6 +1164,15 @@ void SidechainPage::SetCurrentWTPrime(const std::string& strHash, bool fRequeste
 
 void SidechainPage::StartBMM()
 {
+    if (pbmmengine && pbmmengine->IsRunning()) {
+        QMessageBox messageBox;
+        messageBox.setDefaultButton(QMessageBox::Ok);
+        messageBox.setWindowTitle("Automated BMM is running");
+        messageBox.setText("BMM requests are already being created in the background (-bmmautomate).");
+        messageBox.exec();
+        return;
+    }
+
     bmmTimer->start(ui->spinBoxRefreshInterval->value() * 1000);
     ui->pushButtonStartBMM->setEnabled(false);
     ui->pushButtonStopBMM->setEnabled(true);
@@ -1225,9 +1235,9 @@ void SidechainPage::UpdateSidechainWealth()
 
     SidechainDeposit deposit;
     if (psidechaintree->GetLastDeposit(deposit)) {
-        if (deposit.nBurnIndex >= deposit.dtx.vout.size())
+        if (deposit.nBurnIndex >= deposit.dtx->vout.size())
             return;
-        amountCTIP = deposit.dtx.vout[deposit.nBurnIndex].nValue;
+        amountCTIP = deposit.dtx->vout[deposit.nBurnIndex].nValue;
     }
 
     int unit = walletModel->getOptionsModel()->getDisplayUnit();
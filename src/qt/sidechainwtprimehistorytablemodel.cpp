@@ -138,8 +138,8 @@ void SidechainWTPrimeHistoryTableModel::UpdateModel()
         WTPrimeHistoryTableObject object;
 
         // Insert new WT^ into table
-        object.hash = QString::fromStdString(wt.wtPrime.GetHash().ToString());
-        object.amount = CTransaction(wt.wtPrime).GetValueOut();
+        object.hash = QString::fromStdString(wt.wtPrime->GetHash().ToString());
+        object.amount = wt.wtPrime->GetValueOut();
         object.status = QString::fromStdString(wt.GetStatusStr());
         object.height = wt.nHeight;
         model.append(QVariant::fromValue(object));
@@ -10,6 +10,7 @@
 #include <chainparams.h>
 #include <checkpoints.h>
 #include <coins.h>
+#include <coinsprefetch.h>
 #include <consensus/validation.h>
 #include <validation.h>
 #include <core_io.h>
@@ -1569,6 +1570,53 @@ UniValue getchaintxstats(const JSONRPCRequest& request)
     return ret;
 }
 
+UniValue getcoinsprefetchinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size())
+        throw std::runtime_error(
+            "getcoinsprefetchinfo\n"
+            "\nArguments: none\n"
+            "\nGet statistics about reading the inputs of blocks before they are connected (-prefetchthreads)\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"running\": true|false,    (boolean) Whether inputs are prefetched\n"
+            "  \"threads\": n,             (numeric) Threads reading inputs\n"
+            "  \"blocks\": n,              (numeric) Blocks prefetched\n"
+            "  \"inputs\": n,              (numeric) Inputs of the blocks\n"
+            "  \"inblock\": n,             (numeric) Inputs spending outputs of the same block\n"
+            "  \"hits\": n,                (numeric) Inputs already in the coins cache\n"
+            "  \"misses\": n,              (numeric) Inputs read from the coins database\n"
+            "  \"notfound\": n,            (numeric) Inputs read from the coins database but not found\n"
+            "  \"avgtime\": n,             (numeric) Average prefetch time per block in microseconds\n"
+            "  \"maxtime\": n,             (numeric) Maximum prefetch time per block in microseconds\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getcoinsprefetchinfo", "")
+            + HelpExampleRpc("getcoinsprefetchinfo", "")
+        );
+
+    LOCK(cs_main);
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("running", pcoinsprefetcher != nullptr);
+    if (!pcoinsprefetcher)
+        return result;
+
+    CoinsPrefetchStats stats = pcoinsprefetcher->GetStats();
+
+    result.pushKV("threads", pcoinsprefetcher->GetThreadCount());
+    result.pushKV("blocks", stats.nBlocks);
+    result.pushKV("inputs", stats.nInputs);
+    result.pushKV("inblock", stats.nInBlock);
+    result.pushKV("hits", stats.nHits);
+    result.pushKV("misses", stats.nMisses);
+    result.pushKV("notfound", stats.nNotFound);
+    result.pushKV("avgtime", stats.nBlocks ? stats.nTimeTotal / (int64_t)stats.nBlocks : 0);
+    result.pushKV("maxtime", stats.nTimeMax);
+
+    return result;
+}
+
 UniValue savemempool(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 0) {
@@ -1599,6 +1647,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getblockhash",           &getblockhash,           {"height"} },
     { "blockchain",         "getblockheader",         &getblockheader,         {"blockhash","verbose"} },
     { "blockchain",         "getchaintips",           &getchaintips,           {} },
+    { "blockchain",         "getcoinsprefetchinfo",   &getcoinsprefetchinfo,   {} },
     { "blockchain",         "getchainheaders",        &getchainheaders,        {"count"} },
     { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    {"txid","verbose"} },
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  {"txid","verbose"} },
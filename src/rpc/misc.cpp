@@ -5,6 +5,7 @@
 
 #include <base58.h>
 #include <bmmcache.h>
+#include <bmmengine.h>
 #include <chain.h>
 #include <clientversion.h>
 #include <core_io.h>
@@ -12,6 +13,7 @@
 #include <init.h>
 #include <validation.h>
 #include <httpserver.h>
+#include <mainchainrpc.h>
 #include <net.h>
 #include <netbase.h>
 #include <rpc/blockchain.h>
@@ -484,6 +486,9 @@ UniValue refreshbmm(const JSONRPCRequest& request)
             "error                 (string) Output from sidechain client.\n"
         );
 
+    if (pbmmengine && pbmmengine->IsRunning())
+        throw JSONRPCError(RPC_MISC_ERROR, "Automated BMM is running in the background (-bmmautomate)!");
+
     bool fReorg = false;
     std::vector<uint256> vDisconnected;
     if (!UpdateMainBlockHashCache(fReorg, vDisconnected))
@@ -594,6 +599,103 @@ UniValue getmainchainblockcount(const JSONRPCRequest& request)
     return result;
 }
 
+UniValue getmainchainrpcinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size())
+        throw std::runtime_error(
+            "getmainchainrpcinfo\n"
+            "\nArguments: none\n"
+            "\nGet statistics about the connections used to talk to the mainchain\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"requests\": n,        (numeric) Requests sent to the mainchain\n"
+            "  \"reused\": n,          (numeric) Requests sent on an already open connection\n"
+            "  \"connections\": n,     (numeric) Connections opened\n"
+            "  \"failures\": n,        (numeric) Requests that failed\n"
+            "  \"idle\": n,            (numeric) Idle connections currently open\n"
+            "  \"avglatency\": n,      (numeric) Average request round trip time in microseconds\n"
+            "  \"maxlatency\": n,      (numeric) Maximum request round trip time in microseconds\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getmainchainrpcinfo", "")
+            + HelpExampleRpc("getmainchainrpcinfo", "")
+        );
+
+    MainchainRPCStats stats = GetMainchainRPCStats();
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("requests", stats.nRequests);
+    result.pushKV("reused", stats.nReused);
+    result.pushKV("connections", stats.nConnections);
+    result.pushKV("failures", stats.nFailures);
+    result.pushKV("idle", stats.nIdle);
+    result.pushKV("avglatency", stats.nRequests ? stats.nLatencyTotal / (int64_t)stats.nRequests : 0);
+    result.pushKV("maxlatency", stats.nLatencyMax);
+
+    return result;
+}
+
+UniValue getbmmengineinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size())
+        throw std::runtime_error(
+            "getbmmengineinfo\n"
+            "\nArguments: none\n"
+            "\nGet statistics about automated BMM (-bmmautomate)\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"running\": true|false,    (boolean) Whether automated BMM is running\n"
+            "  \"amount\": x.xxx,          (numeric) Amount paid for each BMM request\n"
+            "  \"maintips\": n,            (numeric) New mainchain tips handled\n"
+            "  \"built\": n,               (numeric) BMM blocks built\n"
+            "  \"buildfailures\": n,       (numeric) BMM blocks that failed to build\n"
+            "  \"requests\": n,            (numeric) BMM requests sent\n"
+            "  \"requestfailures\": n,     (numeric) BMM requests that could not be sent\n"
+            "  \"connected\": n,           (numeric) BMM blocks found in the mainchain and submitted\n"
+            "  \"avgbuildtime\": n,        (numeric) Average BMM block build time in microseconds\n"
+            "  \"maxbuildtime\": n,        (numeric) Maximum BMM block build time in microseconds\n"
+            "  \"avgchecktime\": n,        (numeric) Average time to check a new mainchain tip in microseconds\n"
+            "  \"maxchecktime\": n,        (numeric) Maximum time to check a new mainchain tip in microseconds\n"
+            "  \"avgrequesttime\": n,      (numeric) Average time from new mainchain tip to BMM request in microseconds\n"
+            "  \"maxrequesttime\": n,      (numeric) Maximum time from new mainchain tip to BMM request in microseconds\n"
+            "  \"lastmaintip\": \"hash\",    (string) Last mainchain tip handled\n"
+            "  \"lastrequest\": \"hash\",    (string) Merkle root of the last BMM block requested\n"
+            "  \"lastrequesttxid\": \"hash\", (string) Mainchain txid of the last BMM request\n"
+            "  \"lastconnected\": \"hash\",  (string) Last BMM block submitted\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getbmmengineinfo", "")
+            + HelpExampleRpc("getbmmengineinfo", "")
+        );
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("running", pbmmengine && pbmmengine->IsRunning());
+    if (!pbmmengine)
+        return result;
+
+    BMMEngineStats stats = pbmmengine->GetStats();
+
+    result.pushKV("amount", ValueFromAmount(pbmmengine->GetAmount()));
+    result.pushKV("maintips", stats.nMainTips);
+    result.pushKV("built", stats.nBuilt);
+    result.pushKV("buildfailures", stats.nBuildFailures);
+    result.pushKV("requests", stats.nRequests);
+    result.pushKV("requestfailures", stats.nRequestFailures);
+    result.pushKV("connected", stats.nConnected);
+    result.pushKV("avgbuildtime", stats.nBuilt ? stats.nBuildTotal / (int64_t)stats.nBuilt : 0);
+    result.pushKV("maxbuildtime", stats.nBuildMax);
+    result.pushKV("avgchecktime", stats.nMainTips ? stats.nCheckTotal / (int64_t)stats.nMainTips : 0);
+    result.pushKV("maxchecktime", stats.nCheckMax);
+    result.pushKV("avgrequesttime", stats.nRequests ? stats.nRequestTotal / (int64_t)stats.nRequests : 0);
+    result.pushKV("maxrequesttime", stats.nRequestMax);
+    result.pushKV("lastmaintip", stats.hashLastMainTip.ToString());
+    result.pushKV("lastrequest", stats.hashLastRequest.ToString());
+    result.pushKV("lastrequesttxid", stats.txidLastRequest.ToString());
+    result.pushKV("lastconnected", stats.hashLastConnected.ToString());
+
+    return result;
+}
+
 UniValue getmainchainblockhash(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1)
@@ -718,7 +820,7 @@ UniValue rebroadcastwtprimehex(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_MISC_ERROR, "Failed to load latest WT^ from database");
 
     SidechainClient client;
-    std::string strHex = EncodeHexTx(wtPrime.wtPrime);
+    std::string strHex = EncodeHexTx(*wtPrime.wtPrime);
     if (!client.BroadcastWTPrime(strHex))
         throw JSONRPCError(RPC_MISC_ERROR, "Failed to broadcast latest WT^");
 
@@ -802,9 +904,11 @@ static const CRPCCommand commands[] =
 
     /* Sidechain RPC functions */
     { "sidechain",          "refreshbmm",               &refreshbmm,               {}},
+    { "sidechain",          "getbmmengineinfo",         &getbmmengineinfo,         {}},
     { "sidechain",          "getaveragemainchainfees",  &getaveragemainchainfees,  {"blockcount", "startheight"}},
     { "sidechain",          "getmainchainblockcount",   &getmainchainblockcount,   {}},
     { "sidechain",          "getmainchainblockhash",    &getmainchainblockhash,    {"height"}},
+    { "sidechain",          "getmainchainrpcinfo",      &getmainchainrpcinfo,      {}},
     { "sidechain",          "verifymainblockcache",     &verifymainblockcache,     {}},
     { "sidechain",          "updatemainblockcache",     &updatemainblockcache,     {}},
     { "sidechain",          "listmywithdrawals",        &listmywithdrawals,        {}},
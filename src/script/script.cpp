@@ -331,7 +331,30 @@ bool CScript::IsPrevBlockCommit(uint256& hashPrevMain, uint256& hashPrevSide) co
     return true;
 }
 
-bool CScript::IsSidechainObj(std::vector<unsigned char>& vch) const
+bool CScript::IsCriticalHashCommit(uint256& hashCritical) const
+{
+    // Check script size
+    size_t size = this->size();
+    if (size != 37) // sha256 hash + opcodes
+        return false;
+
+    // Check script header
+    if ((*this)[0] != OP_RETURN ||
+            (*this)[1] != 0xD1 ||
+            (*this)[2] != 0x61 ||
+            (*this)[3] != 0x73 ||
+            (*this)[4] != 0x68)
+        return false;
+
+    hashCritical = uint256(std::vector<unsigned char>(this->begin() + 5, this->begin() + 37));
+
+    if (hashCritical.IsNull())
+        return false;
+
+    return true;
+}
+
+bool CScript::IsSidechainObj() const
 {
     // Check script size
     size_t size = this->size();
@@ -346,6 +369,14 @@ bool CScript::IsSidechainObj(std::vector<unsigned char>& vch) const
             (*this)[4] != 0x6F)
         return false;
 
+    return true;
+}
+
+bool CScript::IsSidechainObj(std::vector<unsigned char>& vch) const
+{
+    if (!IsSidechainObj())
+        return false;
+
     vch = std::vector<unsigned char>(this->begin() + 5, this->end());
 
     return true;
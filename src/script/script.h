@@ -650,6 +650,8 @@ public:
     bool IsWTPrimeSpentCommit(uint256& hashWTPrime) const;
     bool IsWTRefundRequest(uint256& wtID, std::vector<unsigned char>& vchSig) const;
     bool IsPrevBlockCommit(uint256& hashPrevMain, uint256& hashPrevSide) const;
+    bool IsCriticalHashCommit(uint256& hashCritical) const;
+    bool IsSidechainObj() const;
     bool IsSidechainObj(std::vector<unsigned char>& vch) const;
 
     /** Called by IsStandardTx and P2SH/BIP62 VerifyScript (which makes it consensus-critical). */
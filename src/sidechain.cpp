@@ -4,9 +4,13 @@
 
 #include <sidechain.h>
 
+#include <base58.h>
 #include <clientversion.h>
+#include <consensus/validation.h>
 #include <core_io.h>
 #include <hash.h>
+#include <policy/wtprime.h>
+#include <script/standard.h>
 #include <streams.h>
 #include <utilmoneystr.h>
 #include <utilstrencodings.h>
@@ -68,12 +72,19 @@ std::string SidechainWT::GetStatusStr(void) const
     return "Unknown";
 }
 
+CScript SidechainWT::GetDestinationScript() const
+{
+    // TODO check IsValidDestination
+    CTxDestination dest = DecodeDestination(strDestination, true /* fMainchain */);
+    return GetScriptForDestination(dest);
+}
+
 std::string SidechainWTPrime::ToString() const
 {
     std::stringstream str;
     str << "sidechainop=" << sidechainop << std::endl;
     str << "nSidechain=" << std::to_string(nSidechain) << std::endl;
-    str << "wtprime=" << CTransaction(wtPrime).ToString() << std::endl;
+    str << "wtprime=" << wtPrime->ToString() << std::endl;
     str << "status=" << GetStatusStr() << std::endl;
     return str.str();
 }
@@ -101,12 +112,12 @@ std::string SidechainDeposit::ToString() const
     str << "nSidechain=" << std::to_string(nSidechain) << std::endl;
     str << "strDest=" << strDest << std::endl;
     str << "payout=" << FormatMoney(amtUserPayout) << std::endl;
-    str << "mainchaintxid=" << dtx.GetHash().ToString() << std::endl;
+    str << "mainchaintxid=" << dtx->GetHash().ToString() << std::endl;
     str << "nBurnIndex=" << std::to_string(nBurnIndex) << std::endl;
     str << "nTx=" << std::to_string(nTx) << std::endl;
     str << "hashMainchainBlock=" << hashMainchainBlock.ToString() << std::endl;
     str << "inputs:\n";
-    for (const CTxIn& in : dtx.vin) {
+    for (const CTxIn& in : dtx->vin) {
         str << in.prevout.ToString() << std::endl;
     }
     return str.str();
@@ -141,17 +152,201 @@ SidechainObj* ParseSidechainObj(const std::vector<unsigned char>& vch)
     return NULL;
 }
 
-struct CompareWTMainchainFee
+void SidechainObjIndex::Add(const CTransaction& tx, uint32_t nTx)
+{
+    for (uint32_t nOut = 0; nOut < tx.vout.size(); nOut++) {
+        const CScript& scriptPubKey = tx.vout[nOut].scriptPubKey;
+        if (!scriptPubKey.IsSidechainObj())
+            continue;
+
+        Entry entry;
+        entry.nTx = nTx;
+        entry.nOut = nOut;
+        entry.sidechainop = 0;
+        entry.nPos = 0;
+
+        // Deserialize straight from the script, after the 5 byte header
+        const char op = scriptPubKey.size() > 5 ? scriptPubKey[5] : 0;
+        CDataStream ds((const char*) scriptPubKey.data() + 5,
+                (const char*) scriptPubKey.data() + scriptPubKey.size(), SER_DISK, CLIENT_VERSION);
+        try {
+            if (op == DB_SIDECHAIN_WT_OP) {
+                SidechainWT wt;
+                wt.Unserialize(ds);
+                entry.nPos = vWT.size();
+                vWT.push_back(std::move(wt));
+                entry.sidechainop = op;
+            }
+            else
+            if (op == DB_SIDECHAIN_WTPRIME_OP) {
+                SidechainWTPrime wtPrime;
+                wtPrime.Unserialize(ds);
+                entry.nPos = vWTPrime.size();
+                vWTPrime.push_back(std::move(wtPrime));
+                entry.sidechainop = op;
+            }
+            else
+            if (op == DB_SIDECHAIN_DEPOSIT_OP) {
+                SidechainDeposit deposit;
+                deposit.Unserialize(ds);
+                entry.nPos = vDeposit.size();
+                vDeposit.push_back(std::move(deposit));
+                entry.sidechainop = op;
+            }
+        } catch (const std::exception&) {
+            // Left invalid
+        }
+
+        vObj.push_back(entry);
+    }
+}
+
+const SidechainObj& SidechainObjIndex::Get(const Entry& entry) const
+{
+    assert(entry.IsValid());
+    if (entry.sidechainop == DB_SIDECHAIN_WT_OP)
+        return vWT[entry.nPos];
+    else
+    if (entry.sidechainop == DB_SIDECHAIN_WTPRIME_OP)
+        return vWTPrime[entry.nPos];
+
+    return vDeposit[entry.nPos];
+}
+
+const SidechainObjIndex::Entry* SidechainObjIndex::Find(uint32_t nTx, uint32_t nOut) const
+{
+    auto it = std::lower_bound(vObj.begin(), vObj.end(), std::make_pair(nTx, nOut),
+            [](const Entry& entry, const std::pair<uint32_t, uint32_t>& pos) {
+                return std::make_pair(entry.nTx, entry.nOut) < pos;
+            });
+    if (it == vObj.end() || it->nTx != nTx || it->nOut != nOut)
+        return nullptr;
+
+    return &*it;
+}
+
+struct CompareEntryTx
 {
-    bool operator()(const SidechainWT& a, const SidechainWT& b) const
+    bool operator()(const SidechainObjIndex::Entry& entry, uint32_t nTx) const
     {
-        return a.mainchainFee > b.mainchainFee;
+        return entry.nTx < nTx;
+    }
+    bool operator()(uint32_t nTx, const SidechainObjIndex::Entry& entry) const
+    {
+        return nTx < entry.nTx;
     }
 };
 
+std::pair<std::vector<SidechainObjIndex::Entry>::const_iterator, std::vector<SidechainObjIndex::Entry>::const_iterator>
+SidechainObjIndex::GetTx(uint32_t nTx) const
+{
+    return std::equal_range(vObj.begin(), vObj.end(), nTx, CompareEntryTx());
+}
+
+SidechainObjIndex ParseSidechainObjs(const CTransaction& tx)
+{
+    SidechainObjIndex objs;
+    objs.Add(tx, 0);
+    return objs;
+}
+
+std::shared_ptr<const SidechainObjIndex> GetBlockSidechainObjs(const CBlock& block, bool fStore)
+{
+    std::shared_ptr<const SidechainObjIndex> objs = std::atomic_load(&block.sidechainObjs);
+    if (objs && objs->hashMerkleRoot == block.hashMerkleRoot)
+        return objs;
+
+    std::shared_ptr<SidechainObjIndex> objsNew = std::make_shared<SidechainObjIndex>();
+    objsNew->hashMerkleRoot = block.hashMerkleRoot;
+    for (uint32_t nTx = 0; nTx < block.vtx.size(); nTx++)
+        objsNew->Add(*block.vtx[nTx], nTx);
+
+    if (fStore)
+        std::atomic_store(&block.sidechainObjs, std::shared_ptr<const SidechainObjIndex>(objsNew));
+
+    return objsNew;
+}
+
+WTPrimeBuilder::WTPrimeBuilder()
+{
+    mtx.nVersion = 2;
+
+    // Add SIDECHAIN_WTPRIME_RETURN_DEST OP_RETURN output
+    mtx.vout.push_back(CTxOut(0, CScript() << OP_RETURN << ParseHex(HexStr(SIDECHAIN_WTPRIME_RETURN_DEST))));
+
+    // Add a dummy output for mainchain fee encoding (updated by the caller)
+    mtx.vout.push_back(CTxOut(0, CScript() << OP_RETURN << CScriptNum(1LL << 40)));
+
+    mtx.vin.resize(1); // Dummy vin for serialization...
+    mtx.vin[0].scriptSig = CScript() << OP_0;
+
+    amountMainchainFees = 0;
+    nWeight = GetTransactionWeight(mtx);
+}
+
+void WTPrimeBuilder::Clear()
+{
+    Truncate(0);
+}
+
+void WTPrimeBuilder::Truncate(size_t n)
+{
+    while (vWTID.size() > n) {
+        // The WT^ has no witness data so every byte weighs the same
+        const size_t nOut = mtx.vout.size();
+        nWeight -= (::GetSerializeSize(mtx.vout.back(), SER_NETWORK, PROTOCOL_VERSION)
+                + GetSizeOfCompactSize(nOut) - GetSizeOfCompactSize(nOut - 1)) * WITNESS_SCALE_FACTOR;
+        mtx.vout.pop_back();
+
+        amountMainchainFees -= vMainchainFee.back();
+        vMainchainFee.pop_back();
+        vWTID.pop_back();
+    }
+}
+
+bool WTPrimeBuilder::AddWT(const SidechainWT& wt, const uint256& wtid)
+{
+    // Output to mainchain keyID
+    CTxOut out(wt.amount - wt.mainchainFee, wt.GetDestinationScript());
+
+    const size_t nOut = mtx.vout.size();
+    int64_t nOutWeight = (::GetSerializeSize(out, SER_NETWORK, PROTOCOL_VERSION)
+            + GetSizeOfCompactSize(nOut + 1) - GetSizeOfCompactSize(nOut)) * WITNESS_SCALE_FACTOR;
+
+    // Make sure we have room for more outputs
+    if (nWeight + nOutWeight > MAX_WTPRIME_WEIGHT)
+        return false;
+
+    mtx.vout.push_back(out);
+    nWeight += nOutWeight;
+
+    amountMainchainFees += wt.mainchainFee;
+    vMainchainFee.push_back(wt.mainchainFee);
+    vWTID.push_back(wtid);
+
+    return true;
+}
+
+bool CompareWTMainchainFee::operator()(const std::pair<SidechainWT, uint256>& a, const std::pair<SidechainWT, uint256>& b) const
+{
+    CAmount feeA = std::max(a.first.mainchainFee, CAmount(0));
+    CAmount feeB = std::max(b.first.mainchainFee, CAmount(0));
+    if (feeA != feeB)
+        return feeA > feeB;
+    return a.second < b.second;
+}
+
 void SortWTByFee(std::vector<SidechainWT>& vWT)
 {
-    std::sort(vWT.begin(), vWT.end(), CompareWTMainchainFee());
+    std::vector<std::pair<SidechainWT, uint256> > vWTID;
+    vWTID.reserve(vWT.size());
+    for (const SidechainWT& wt : vWT)
+        vWTID.emplace_back(wt, wt.GetID());
+
+    std::sort(vWTID.begin(), vWTID.end(), CompareWTMainchainFee());
+
+    for (size_t i = 0; i < vWT.size(); i++)
+        vWT[i] = vWTID[i].first;
 }
 
 struct CompareWTPrimeHeight
@@ -14,7 +14,9 @@
 #include <uint256.h>
 
 #include <limits.h>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 //
@@ -148,6 +150,9 @@ struct SidechainWT: public SidechainObj {
     std::string ToString(void) const;
     std::string GetStatusStr(void) const;
 
+    //! Decode the mainchain script paying strDestination
+    CScript GetDestinationScript() const;
+
     uint256 GetID() const {
         SidechainWT wt(*this);
         wt.status = WT_UNSPENT;
@@ -160,7 +165,7 @@ struct SidechainWT: public SidechainObj {
  */
 struct SidechainWTPrime: public SidechainObj {
     uint8_t nSidechain;
-    CMutableTransaction wtPrime;
+    CTransactionRef wtPrime;
     std::vector<uint256> vWT; // The id in ldb of WT(s) that this WT^ is using
     int nHeight;
     // If the WT^ fails we keep track of the sidechain height that it was marked
@@ -169,7 +174,7 @@ struct SidechainWTPrime: public SidechainObj {
     int nFailHeight;
     char status;
 
-    SidechainWTPrime(void) : SidechainObj() { sidechainop = DB_SIDECHAIN_WTPRIME_OP; status = WTPRIME_CREATED; nHeight = 0;}
+    SidechainWTPrime(void) : SidechainObj() { sidechainop = DB_SIDECHAIN_WTPRIME_OP; wtPrime = MakeTransactionRef(); status = WTPRIME_CREATED; nHeight = 0;}
     virtual ~SidechainWTPrime(void) { }
 
     ADD_SERIALIZE_METHODS
@@ -205,12 +210,12 @@ struct SidechainDeposit : public SidechainObj {
     uint8_t nSidechain;
     std::string strDest;
     CAmount amtUserPayout;
-    CMutableTransaction dtx; // Mainchain deposit transaction
+    CTransactionRef dtx; // Mainchain deposit transaction
     uint32_t nBurnIndex; // Deposit burn output index
     uint32_t nTx; // Deposit transaction number in mainchain block
     uint256 hashMainchainBlock;
 
-    SidechainDeposit(void) : SidechainObj() { sidechainop = DB_SIDECHAIN_DEPOSIT_OP; }
+    SidechainDeposit(void) : SidechainObj() { sidechainop = DB_SIDECHAIN_DEPOSIT_OP; dtx = MakeTransactionRef(); }
     virtual ~SidechainDeposit(void) { }
 
     SidechainDeposit(const SidechainDeposit* d) {
@@ -246,7 +251,7 @@ struct SidechainDeposit : public SidechainObj {
                 nSidechain == d.nSidechain &&
                 strDest == d.strDest &&
                 amtUserPayout == d.amtUserPayout &&
-                dtx == d.dtx &&
+                *dtx == *d.dtx &&
                 nBurnIndex == d.nBurnIndex &&
                 nTx == d.nTx &&
                 hashMainchainBlock == d.hashMainchainBlock) {
@@ -268,11 +273,107 @@ struct SidechainDeposit : public SidechainObj {
  */
 SidechainObj* ParseSidechainObj(const std::vector<unsigned char>& vch);
 
+/**
+ * The sidechain objects of a block or transaction, parsed once and shared by
+ * all of the checks that need them. Objects are stored by type, vObj lists
+ * them in output order.
+ */
+struct SidechainObjIndex {
+    struct Entry {
+        uint32_t nTx; // Transaction position in the block
+        uint32_t nOut; // Output position in the transaction
+        char sidechainop; // Zero if the sidechain object script is invalid
+        uint32_t nPos; // Position in vWT, vWTPrime or vDeposit
+
+        bool IsValid() const { return sidechainop != 0; }
+    };
+
+    std::vector<Entry> vObj;
+    std::vector<SidechainWT> vWT;
+    std::vector<SidechainWTPrime> vWTPrime;
+    std::vector<SidechainDeposit> vDeposit;
+
+    //! Merkle root of the block the objects were parsed from
+    uint256 hashMerkleRoot;
+
+    //! Parse the sidechain object outputs of tx and append them
+    void Add(const CTransaction& tx, uint32_t nTx);
+
+    //! Return the object of a valid entry
+    const SidechainObj& Get(const Entry& entry) const;
+
+    //! Return the entry of an output, or nullptr if it isn't a sidechain object
+    const Entry* Find(uint32_t nTx, uint32_t nOut) const;
+
+    //! Return the range of vObj that belongs to transaction nTx
+    std::pair<std::vector<Entry>::const_iterator, std::vector<Entry>::const_iterator> GetTx(uint32_t nTx) const;
+};
+
+/** Parse the sidechain objects of a single transaction */
+SidechainObjIndex ParseSidechainObjs(const CTransaction& tx);
+
+/**
+ * Return the sidechain objects of a block. The index kept on the block is
+ * reused if it was built for the current merkle root. With fStore a newly
+ * built index is kept on the block, only do this once the merkle root has
+ * been checked.
+ */
+std::shared_ptr<const SidechainObjIndex> GetBlockSidechainObjs(const CBlock& block, bool fStore = false);
+
+/**
+ * Builds the WT^ transaction one WT output at a time. The serialized size is
+ * tracked as outputs are added so the weight limit is checked without
+ * re-serializing the transaction. A builder can be kept between WT^ creation
+ * attempts: truncate it to the WT(s) that are still selected and add the
+ * new ones.
+ */
+class WTPrimeBuilder
+{
+public:
+    WTPrimeBuilder();
+
+    //! Remove all WT outputs
+    void Clear();
+
+    //! Keep only the first n WT outputs
+    void Truncate(size_t n);
+
+    /** Add the output paying wt, unless it would take the WT^ over
+     * MAX_WTPRIME_WEIGHT. Returns false if the output wasn't added. */
+    bool AddWT(const SidechainWT& wt, const uint256& wtid);
+
+    //! The WT^ with the mainchain fee output still holding a placeholder
+    const CMutableTransaction& GetTx() const { return mtx; }
+
+    //! The ID of each WT in the WT^, in output order
+    const std::vector<uint256>& GetWTIDs() const { return vWTID; }
+
+    CAmount GetMainchainFees() const { return amountMainchainFees; }
+
+    int64_t GetWeight() const { return nWeight; }
+
+private:
+    CMutableTransaction mtx;
+    std::vector<uint256> vWTID;
+    std::vector<CAmount> vMainchainFee;
+    CAmount amountMainchainFees;
+    int64_t nWeight;
+};
+
 // Functions for both WT^ creation and the GUI to use in order to make sure that
 // what the GUI displays (on the pending WT table) is the same as what the WT^
 // creation code will actually select.
 
-// Sort a vector of SidechainWT by mainchain fee in descending order
+// Order of WT(s) paired with their ID by mainchain fee in descending order,
+// then by ID. This is the order of the sidechain tree's WT status index, where
+// negative fees count as zero.
+struct CompareWTMainchainFee
+{
+    bool operator()(const std::pair<SidechainWT, uint256>& a, const std::pair<SidechainWT, uint256>& b) const;
+};
+
+// Sort a vector of SidechainWT by mainchain fee in descending order, WT(s)
+// with the same fee by ID (see CompareWTMainchainFee)
 void SortWTByFee(std::vector<SidechainWT>& vWT);
 
 // Sort a vector of SidechainWTPrime by height in descending order
@@ -5,8 +5,10 @@
 #include <sidechainclient.h>
 
 #include <bmmcache.h>
+#include <bmmproof.h>
 #include <chainparams.h>
 #include <core_io.h>
+#include <mainchainrpc.h>
 #include <miner.h>
 #include <sidechain.h>
 #include <streams.h>
@@ -17,15 +19,59 @@
 #include <util.h>
 
 #include <iostream>
+#include <map>
+#include <set>
 #include <sstream>
 #include <stdlib.h>
 #include <string>
 
-#include <boost/array.hpp>
-#include <boost/asio.hpp>
-#include <boost/foreach.hpp>
+namespace {
 
-using boost::asio::ip::tcp;
+/** Text of a string or numeric field, empty if the field is missing */
+const std::string& GetFieldStr(const UniValue& obj, const std::string& strKey)
+{
+    return find_value(obj, strKey).getValStr();
+}
+
+/** Read an integer field that the mainchain may send as a number or string */
+bool GetFieldInt(const UniValue& obj, const std::string& strKey, int64_t& nOut)
+{
+    const std::string& str = GetFieldStr(obj, strKey);
+    return !str.empty() && ParseInt64(str, &nOut);
+}
+
+/**
+ * Read the result of 'verifybmm': an object holding an object with the BMM
+ * txid and the mainchain block time.
+ */
+bool ParseBMMProof(const UniValue& result, uint256& txid, uint32_t& nTime)
+{
+    if (!result.isObject())
+        return false;
+
+    bool fFoundTx = false;
+    bool fFoundTime = false;
+    for (const UniValue& value : result.getValues()) {
+        if (!value.isObject())
+            continue;
+
+        const std::string& strTxid = GetFieldStr(value, "txid");
+        if (!strTxid.empty()) {
+            txid = uint256S(strTxid);
+            fFoundTx = true;
+        }
+
+        int64_t n = 0;
+        if (GetFieldInt(value, "time", n)) {
+            nTime = n;
+            fFoundTime = true;
+        }
+    }
+
+    return fFoundTx && fFoundTime;
+}
+
+} // namespace
 
 SidechainClient::SidechainClient()
 {
@@ -46,8 +92,8 @@ bool SidechainClient::BroadcastWTPrime(const std::string& hex)
 
     // TODO Read result
     // the mainchain will return the txid if WT^ has been received
-    boost::property_tree::ptree ptree;
-    return SendRequestToMainchain(json, ptree);
+    UniValue reply;
+    return SendRequestToMainchain(json, reply, false /* fIdempotent */);
 }
 
 // TODO return bool & state / fail string
@@ -74,79 +120,54 @@ std::vector<SidechainDeposit> SidechainClient::UpdateDeposits(const std::string&
     }
 
     // Try to request deposits from mainchain
-    boost::property_tree::ptree ptree;
-    if (!SendRequestToMainchain(json, ptree)) {
+    UniValue reply;
+    if (!SendRequestToMainchain(json, reply)) {
         LogPrintf("ERROR Sidechain client failed to request new deposits\n");
         return incoming;
     }
 
+    const UniValue& result = find_value(reply, "result");
+    if (!result.isArray())
+        return incoming;
+
     // Process deposits
-    BOOST_FOREACH(boost::property_tree::ptree::value_type &value, ptree.get_child("result")) {
-        // Looping through list of deposits
+    incoming.reserve(result.size());
+    for (const UniValue& value : result.getValues()) {
+        if (!value.isObject())
+            continue;
+
+        // Read sidechain number, skipping deposits to other sidechains
+        int64_t nSidechain = 0;
+        if (!GetFieldInt(value, "nsidechain", nSidechain) || nSidechain != THIS_SIDECHAIN)
+            continue;
+
         SidechainDeposit deposit;
-        BOOST_FOREACH(boost::property_tree::ptree::value_type &v, value.second.get_child("")) {
-            // Looping through this deposit's members
-            if (v.first == "nsidechain") {
-                // Read sidechain number
-                std::string data = v.second.data();
-                if (!data.length())
-                    continue;
-                uint8_t nSidechain = std::stoi(data);
-                if (nSidechain != THIS_SIDECHAIN)
-                    continue;
-
-                deposit.nSidechain = nSidechain;
-            }
-            else
-            if (v.first == "strdest") {
-                // Read destination string
-                std::string strDest = v.second.data();
-                if (strDest.empty())
-                    continue;
-
-                deposit.strDest = strDest;
-            }
-            else
-            if (v.first == "txhex") {
-                // Read deposit transaction hex
-                std::string data = v.second.data();
-                if (!data.length())
-                    continue;
-                if (!IsHex(data))
-                    continue;
-                if (!DecodeHexTx(deposit.dtx, data))
-                    continue;
-            }
-            else
-            if (v.first == "nburnindex") {
-                // Read deposit output index
-                std::string data = v.second.data();
-                if (!data.length())
-                    continue;
-
-                deposit.nBurnIndex = std::stoi(data);
-            }
-            else
-            if (v.first == "ntx") {
-                // Read mainchain block hash
-                std::string data = v.second.data();
-                if (!data.length())
-                    continue;
-
-                deposit.nTx = std::stoi(data);
-            }
-            else
-            if (v.first == "hashblock") {
-                // Read mainchain block hash
-                std::string data = v.second.data();
-                if (!data.length())
-                    continue;
-
-                deposit.hashMainchainBlock = uint256S(data);
-            }
-        }
+        deposit.nSidechain = nSidechain;
+
+        // Read destination string
+        deposit.strDest = GetFieldStr(value, "strdest");
 
-        if (deposit.nBurnIndex >= deposit.dtx.vout.size()) {
+        // Read deposit transaction hex
+        const std::string& strHex = GetFieldStr(value, "txhex");
+        CMutableTransaction dtx;
+        if (strHex.empty() || !DecodeHexTx(dtx, strHex))
+            continue;
+        deposit.dtx = MakeTransactionRef(std::move(dtx));
+
+        // Read deposit output index & transaction number in mainchain block
+        int64_t nBurnIndex = 0;
+        int64_t nTx = 0;
+        if (!GetFieldInt(value, "nburnindex", nBurnIndex) || nBurnIndex < 0)
+            continue;
+        if (!GetFieldInt(value, "ntx", nTx) || nTx < 0)
+            continue;
+        deposit.nBurnIndex = nBurnIndex;
+        deposit.nTx = nTx;
+
+        // Read mainchain block hash
+        deposit.hashMainchainBlock = uint256S(GetFieldStr(value, "hashblock"));
+
+        if (deposit.nBurnIndex >= deposit.dtx->vout.size()) {
             LogPrintf("%s: Error invalid deposit output index!\n", __func__);
             continue;
         }
@@ -154,7 +175,7 @@ std::vector<SidechainDeposit> SidechainClient::UpdateDeposits(const std::string&
         // Get the user payout amount from the deposit output. At this point the
         // amount is the total CTIP, and the real payout will be calculated
         // later.
-        deposit.amtUserPayout = deposit.dtx.vout[deposit.nBurnIndex].nValue;
+        deposit.amtUserPayout = deposit.dtx->vout[deposit.nBurnIndex].nValue;
 
         // Add this deposit to the list
         incoming.push_back(deposit);
@@ -184,15 +205,15 @@ bool SidechainClient::VerifyDeposit(const uint256& hashMainBlock, const uint256&
     json.append("] }");
 
     // Ask mainchain node to verify deposit
-    boost::property_tree::ptree ptree;
-    if (!SendRequestToMainchain(json, ptree)) {
+    UniValue reply;
+    if (!SendRequestToMainchain(json, reply)) {
         // Can be enabled for debug -- too noisy
         // LogPrintf("ERROR Sidechain client failed to verify deposit!\n");
         return false;
     }
 
     // Process result
-    uint256 txidRet = uint256S(ptree.get("result", ""));
+    uint256 txidRet = uint256S(GetFieldStr(reply, "result"));
     return (txid == txidRet);
 }
 
@@ -210,41 +231,15 @@ bool SidechainClient::VerifyBMM(const uint256& hashMainBlock, const uint256& has
     json.append("] }");
 
     // Try to request BMM proof from mainchain
-    boost::property_tree::ptree ptree;
-    if (!SendRequestToMainchain(json, ptree)) {
+    UniValue reply;
+    if (!SendRequestToMainchain(json, reply)) {
         // Can be enabled for debug -- too noisy
         // LogPrintf("ERROR Sidechain client failed to request BMM proof\n");
         return false;
     }
 
     // Process result
-    bool fFoundTx = false;
-    bool fFoundTime = false;
-    BOOST_FOREACH(boost::property_tree::ptree::value_type &value, ptree.get_child("result")) {
-        BOOST_FOREACH(boost::property_tree::ptree::value_type &v, value.second.get_child("")) {
-            if (v.first == "txid") {
-                // Read BMM txid
-                std::string data = v.second.data();
-                if (!data.length())
-                    continue;
-
-                txid = uint256S(data);
-                fFoundTx = true;
-            }
-            else
-            if (v.first == "time") {
-                // Read mainchain block time
-                std::string data = v.second.data();
-                if (!data.length())
-                    continue;
-
-                nTime = std::stoi(data);
-                fFoundTime = true;
-            }
-        }
-    }
-
-    if (fFoundTx && fFoundTime) {
+    if (ParseBMMProof(find_value(reply, "result"), txid, nTime)) {
         LogPrintf("Sidechain client found BMM for h*: %s\n", hashBMM.ToString());
         return true;
     } else {
@@ -254,6 +249,62 @@ bool SidechainClient::VerifyBMM(const uint256& hashMainBlock, const uint256& has
     }
 }
 
+bool SidechainClient::VerifyDepositBatch(std::vector<SidechainDepositQuery>& vQuery)
+{
+    std::vector<MainchainRPCCall> vCall;
+    vCall.reserve(vQuery.size());
+    for (const SidechainDepositQuery& query : vQuery) {
+        UniValue params(UniValue::VARR);
+        params.push_back(query.hashMainBlock.ToString());
+        params.push_back(query.txid.ToString());
+        params.push_back(query.nTx);
+        vCall.emplace_back("verifydeposit", params);
+    }
+
+    std::vector<UniValue> vResult;
+    if (!SendMainchainRPCBatch(vCall, vResult)) {
+        LogPrintf("ERROR Sidechain client failed to verify deposits!\n");
+        return false;
+    }
+
+    for (size_t i = 0; i < vQuery.size(); i++) {
+        const UniValue& result = vResult[i];
+        vQuery[i].fVerified = result.isStr() && uint256S(result.get_str()) == vQuery[i].txid;
+    }
+
+    return true;
+}
+
+bool SidechainClient::VerifyBMMBatch(std::vector<SidechainBMMQuery>& vQuery)
+{
+    std::vector<MainchainRPCCall> vCall;
+    vCall.reserve(vQuery.size());
+    for (const SidechainBMMQuery& query : vQuery) {
+        UniValue params(UniValue::VARR);
+        params.push_back(query.hashMainBlock.ToString());
+        params.push_back(query.hashBMM.ToString());
+        vCall.emplace_back("verifybmm", params);
+    }
+
+    std::vector<UniValue> vResult;
+    if (!SendMainchainRPCBatch(vCall, vResult)) {
+        LogPrintf("ERROR Sidechain client failed to request BMM proofs!\n");
+        return false;
+    }
+
+    for (size_t i = 0; i < vQuery.size(); i++) {
+        SidechainBMMQuery& query = vQuery[i];
+        query.fFound = false;
+
+        if (ParseBMMProof(vResult[i], query.txid, query.nTime)) {
+            LogPrintf("Sidechain client found BMM for h*: %s\n", query.hashBMM.ToString());
+            query.fFound = true;
+        }
+    }
+
+    return true;
+}
+
 uint256 SidechainClient::SendBMMRequest(const uint256& hashCritical, const uint256& hashBlockMain, int nHeight, CAmount amount)
 {
     uint256 txid = uint256();
@@ -282,24 +333,20 @@ uint256 SidechainClient::SendBMMRequest(const uint256& hashCritical, const uint2
     json.append("] }");
 
     // Try to send critical data request to mainchain
-    boost::property_tree::ptree ptree;
-    if (!SendRequestToMainchain(json, ptree)) {
+    UniValue reply;
+    if (!SendRequestToMainchain(json, reply, false /* fIdempotent */)) {
         LogPrintf("ERROR Sidechain client failed to create BMM request on mainchain!\n");
         return txid; // TODO
     }
 
     // Process result
-    BOOST_FOREACH(boost::property_tree::ptree::value_type &value, ptree.get_child("result")) {
-        BOOST_FOREACH(boost::property_tree::ptree::value_type &v, value.second.get_child("")) {
-            // Looping through members
-            if (v.first == "txid") {
-                // Read txid
-                std::string data = v.second.data();
-                if (!data.length())
-                    continue;
-
-                txid = uint256S(data);
-            }
+    const UniValue& result = find_value(reply, "result");
+    if (result.isObject()) {
+        for (const UniValue& value : result.getValues()) {
+            // Read txid
+            const std::string& strTxid = GetFieldStr(value, "txid");
+            if (!strTxid.empty())
+                txid = uint256S(strTxid);
         }
     }
     if (!txid.IsNull())
@@ -319,33 +366,18 @@ bool SidechainClient::GetCTIP(std::pair<uint256, uint32_t>& ctip)
     json.append("] }");
 
     // Try to request CTIP from mainchain
-    boost::property_tree::ptree ptree;
-    if (!SendRequestToMainchain(json, ptree)) {
+    UniValue reply;
+    if (!SendRequestToMainchain(json, reply)) {
         // TODO LogPrintf("ERROR Sidechain client failed to request CTIP\n");
         return false;
     }
 
     // Process CTIP
-    uint256 txid;
-    uint32_t n;
-    BOOST_FOREACH(boost::property_tree::ptree::value_type &value, ptree.get_child("result")) {
-        if (value.first == "n") {
-            // Read n
-            std::string data = value.second.data();
-            if (!data.length())
-                continue;
-            n = std::stoi(data);
-        }
-        else
-        if (value.first == "txid") {
-            // Read TXID
-            std::string data = value.second.data();
-            if (!data.length())
-                continue;
-
-            txid = uint256S(data);
-        }
-    }
+    const UniValue& result = find_value(reply, "result");
+    int64_t n = 0;
+    if (!GetFieldInt(result, "n", n) || n < 0)
+        return false;
+    uint256 txid = uint256S(GetFieldStr(result, "txid"));
     // TODO LogPrintf("Sidechain client received CTIP\n");
 
     ctip = std::make_pair(txid, n);
@@ -396,7 +428,7 @@ bool SidechainClient::RefreshBMM(const CAmount& amount, std::string& strError, u
             nTxn = block.vtx.size();
             hashCreatedMerkleRoot = block.hashMerkleRoot;
             txid = SendBMMRequest(block.hashMerkleRoot, vHashMainBlock.back(), 0, amount);
-            bmmCache.StorePrevBlockBMMCreated(vHashMainBlock.back());
+            bmmCache.StoreBMMRequest(block.hashMerkleRoot, vHashMainBlock.back());
             return true;
         } else {
             strError = "Failed to create new BMM block!";
@@ -404,40 +436,9 @@ bool SidechainClient::RefreshBMM(const CAmount& amount, std::string& strError, u
         }
     }
 
-    // Check new main:blocks for our BMM requests
-    for (const uint256& u : vHashMainBlock) {
-        // Skip if we've already checked this block
-        if (bmmCache.MainBlockChecked(u))
-            continue;
-
-        // Check main:block for any of our current BMM requests
-        for (const CBlock& b : vBMMCache) {
-            // Send 'verifybmm' rpc request to mainchain
-            const uint256& hashMerkleRoot = b.hashMerkleRoot;
-            uint256 txid;
-            uint32_t nTime = 0;
-            if (VerifyBMM(u, hashMerkleRoot, txid, nTime)) {
-                CBlock block = b;
-
-                // Copy the block time and hash from the mainchain block into
-                // our new sidechain block.
-                block.nTime = nTime;
-                block.hashMainchainBlock = u;
-
-                // Submit BMM block
-                if (SubmitBMMBlock(block)) {
-                    hashConnected = block.GetHash();
-                    hashConnectedMerkleRoot = hashMerkleRoot;
-                } else {
-                    strError = "Failed to submit block with valid BMM!";
-                    return false;
-                }
-            }
-        }
-
-        // Record that we checked this mainchain block
-        bmmCache.AddCheckedMainBlock(u);
-    }
+    // Check new main:blocks for any of our current BMM requests
+    if (!CheckBMMRequests(vHashMainBlock, hashConnected, hashConnectedMerkleRoot, strError))
+        return false;
 
     // Was there a new mainchain block since the last request we made?
     if (!bmmCache.HaveBMMRequestForPrevBlock(vHashMainBlock.back())) {
@@ -453,7 +454,7 @@ bool SidechainClient::RefreshBMM(const CAmount& amount, std::string& strError, u
                 nTxn = block.vtx.size();
                 hashCreatedMerkleRoot = block.hashMerkleRoot;
                 txid = SendBMMRequest(block.hashMerkleRoot, vHashMainBlock.back(), 0, amount);
-                bmmCache.StorePrevBlockBMMCreated(vHashMainBlock.back());
+                bmmCache.StoreBMMRequest(block.hashMerkleRoot, vHashMainBlock.back());
             } else {
                 strError = "Failed to create a new BMM request!";
                 return false;
@@ -467,6 +468,85 @@ bool SidechainClient::RefreshBMM(const CAmount& amount, std::string& strError, u
     return true;
 }
 
+bool SidechainClient::CheckBMMRequests(const std::vector<uint256>& vHashMainBlock, uint256& hashConnected, uint256& hashConnectedMerkleRoot, std::string& strError)
+{
+    // Look up the (main:block, h*) pairs for main:blocks we haven't checked
+    // yet with a single batch of 'verifybmm' requests. Each main:block is
+    // only checked for the requests that it could include, and that its
+    // coinbase has an h* commit for.
+    std::vector<uint256> vHashToCheck;
+    std::vector<SidechainBMMQuery> vQuery;
+    std::map<uint256, BMMProof> mapProof;
+    for (const uint256& u : vHashMainBlock) {
+        // Skip if we've already checked this block
+        if (bmmCache.MainBlockChecked(u))
+            continue;
+
+        vHashToCheck.push_back(u);
+        std::vector<uint256> vRequest = bmmCache.GetBMMRequestsForMainBlock(u);
+        if (vRequest.empty())
+            continue;
+
+        // The proof has the coinbase of the block. If the block can't be
+        // fetched, all of the requests are left to 'verifybmm'.
+        BMMProof proof;
+        std::set<uint256> setCommitted;
+        const bool fHaveProof = GetBMMProof(u, proof);
+        if (fHaveProof) {
+            std::vector<uint256> vHashCritical = proof.GetCriticalHashes();
+            setCommitted.insert(vHashCritical.begin(), vHashCritical.end());
+            mapProof.emplace(u, proof);
+        }
+        for (const uint256& hashMerkleRoot : vRequest) {
+            if (!fHaveProof || setCommitted.count(hashMerkleRoot))
+                vQuery.emplace_back(u, hashMerkleRoot);
+        }
+    }
+
+    if (!vQuery.empty() && !VerifyBMMBatch(vQuery)) {
+        strError = "Failed to request BMM proofs from mainchain!";
+        return false;
+    }
+
+    for (const SidechainBMMQuery& query : vQuery) {
+        if (!query.fFound)
+            continue;
+
+        CBlock block;
+        if (!bmmCache.GetBMMBlock(query.hashBMM, block))
+            continue;
+
+        // Copy the block time and hash from the mainchain block into
+        // our new sidechain block.
+        block.nTime = query.nTime;
+        block.hashMainchainBlock = query.hashMainBlock;
+
+        // Get the BMM proof to store and relay with the block, so that other
+        // nodes can check its BMM without asking the mainchain
+        std::map<uint256, BMMProof>::const_iterator it = mapProof.find(query.hashMainBlock);
+        BMMProof proof;
+        if (it != mapProof.end())
+            bmmProofCache.Add(it->second);
+        else if (GetBMMProof(query.hashMainBlock, proof))
+            bmmProofCache.Add(proof);
+
+        // Submit BMM block
+        if (SubmitBMMBlock(block)) {
+            hashConnected = block.GetHash();
+            hashConnectedMerkleRoot = query.hashBMM;
+        } else {
+            strError = "Failed to submit block with valid BMM!";
+            return false;
+        }
+    }
+
+    // Record that we checked these mainchain blocks
+    for (const uint256& u : vHashToCheck)
+        bmmCache.AddCheckedMainBlock(u);
+
+    return true;
+}
+
 bool SidechainClient::CreateBMMBlock(CBlock& block, std::string& strError, CAmount& nFees, const uint256& hashPrevBlock)
 {
     if (!BlockAssembler(Params()).GenerateBMMBlock(block, strError, &nFees,
@@ -503,28 +583,22 @@ bool SidechainClient::GetAverageFees(int nBlocks, int nStartHeight, CAmount& nAv
     json.append("}");
 
     // Try to request average fees from mainchain
-    boost::property_tree::ptree ptree;
-    if (!SendRequestToMainchain(json, ptree)) {
+    UniValue reply;
+    if (!SendRequestToMainchain(json, reply)) {
         LogPrintf("ERROR Sidechain client failed to request average fees\n");
         return false;
     }
 
     // Process result
-    BOOST_FOREACH(boost::property_tree::ptree::value_type &value, ptree.get_child("result")) {
-        // Looping through members
-        if (value.first == "feeaverage") {
-            // Read
-            std::string data = value.second.data();
-            if (!data.length()) {
-                LogPrintf("ERROR Sidechain client received invalid data\n");
-                return false;
-            }
+    const std::string& strFee = GetFieldStr(find_value(reply, "result"), "feeaverage");
+    if (strFee.empty()) {
+        LogPrintf("ERROR Sidechain client received invalid data\n");
+        return false;
+    }
 
-            if (ParseMoney(data, nAverageFee)) {
-                LogPrintf("Sidechain client received average mainchain fee: %d.\n", nAverageFee);
-                return true;
-            }
-        }
+    if (ParseMoney(strFee, nAverageFee)) {
+        LogPrintf("Sidechain client received average mainchain fee: %d.\n", nAverageFee);
+        return true;
     }
     return false;
 }
@@ -538,14 +612,17 @@ bool SidechainClient::GetBlockCount(int& nBlocks)
     json.append("[] }");
 
     // Try to request mainchain block count
-    boost::property_tree::ptree ptree;
-    if (!SendRequestToMainchain(json, ptree)) {
+    UniValue reply;
+    if (!SendRequestToMainchain(json, reply)) {
         LogPrintf("ERROR Sidechain client failed to request block count\n");
         return false;
     }
 
     // Process result
-    nBlocks = ptree.get("result", 0);
+    int64_t n = 0;
+    if (!GetFieldInt(reply, "result", n))
+        return false;
+    nBlocks = n;
 
     return nBlocks >= 0;
 }
@@ -564,14 +641,17 @@ bool SidechainClient::GetWorkScore(const uint256& hashWTPrime, int& nWorkScore)
     json.append("\"");
     json.append("] }");
 
-    boost::property_tree::ptree ptree;
-    if (!SendRequestToMainchain(json, ptree)) {
+    UniValue reply;
+    if (!SendRequestToMainchain(json, reply)) {
         LogPrintf("ERROR Sidechain client failed to request workscore\n");
         return false;
     }
 
     // Process result, note that starting workscore on mainchain is 1
-    nWorkScore = ptree.get("result", -1);
+    int64_t n = -1;
+    if (!GetFieldInt(reply, "result", n))
+        return false;
+    nWorkScore = n;
 
     return nWorkScore >= 0;
 }
@@ -590,26 +670,20 @@ bool SidechainClient::ListWTPrimeStatus(std::vector<uint256>& vHashWTPrime)
     json.append(UniValue((int)THIS_SIDECHAIN).write());
     json.append("] }");
 
-    boost::property_tree::ptree ptree;
-    if (!SendRequestToMainchain(json, ptree)) {
+    UniValue reply;
+    if (!SendRequestToMainchain(json, reply)) {
         LogPrintf("ERROR Sidechain client failed to request WT^ status\n");
         return false;
     }
 
     // Process result
-    BOOST_FOREACH(boost::property_tree::ptree::value_type &value, ptree.get_child("result")) {
-        BOOST_FOREACH(boost::property_tree::ptree::value_type &v, value.second.get_child("")) {
-            // Looping through members
-            if (v.first == "hashwtprime") {
-                // Read txid
-                std::string data = v.second.data();
-                if (!data.length())
-                    continue;
-
-                uint256 hash = uint256S(data);
-                if (!hash.IsNull())
-                    vHashWTPrime.push_back(hash);
-            }
+    const UniValue& result = find_value(reply, "result");
+    if (result.isArray()) {
+        for (const UniValue& value : result.getValues()) {
+            // Read WT^ hash
+            uint256 hash = uint256S(GetFieldStr(value, "hashwtprime"));
+            if (!hash.IsNull())
+                vHashWTPrime.push_back(hash);
         }
     }
 
@@ -627,18 +701,87 @@ bool SidechainClient::GetBlockHash(int nHeight, uint256& hashBlock)
     json.append("] }");
 
     // Try to request mainchain block hash
-    boost::property_tree::ptree ptree;
-    if (!SendRequestToMainchain(json, ptree)) {
+    UniValue reply;
+    if (!SendRequestToMainchain(json, reply)) {
         LogPrintf("ERROR Sidechain client failed to request block hash!\n");
         return false;
     }
 
-    std::string strHash = ptree.get("result", "");
-    hashBlock = uint256S(strHash);
+    hashBlock = uint256S(GetFieldStr(reply, "result"));
 
     return (!hashBlock.IsNull());
 }
 
+bool SidechainClient::GetBMMProof(const uint256& hashMainBlock, BMMProof& proof)
+{
+    // JSON for 'getblock' mainchain HTTP-RPC, requesting the serialized block
+    std::string json;
+    json.append("{\"jsonrpc\": \"1.0\", \"id\":\"SidechainClient\", ");
+    json.append("\"method\": \"getblock\", \"params\": ");
+    json.append("[\"");
+    json.append(hashMainBlock.ToString());
+    json.append("\",0] }");
+
+    // Try to request mainchain block
+    UniValue reply;
+    if (!SendRequestToMainchain(json, reply)) {
+        LogPrintf("ERROR Sidechain client failed to request mainchain block!\n");
+        return false;
+    }
+
+    const std::string& strHex = GetFieldStr(reply, "result");
+    if (strHex.empty() || !IsHex(strHex))
+        return false;
+
+    CMainchainBlock block;
+    CDataStream ssBlock(ParseHex(strHex), SER_NETWORK, PROTOCOL_VERSION);
+    try {
+        ssBlock >> block;
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+
+    if (block.GetHash() != hashMainBlock || block.vtx.empty())
+        return false;
+
+    proof = CreateBMMProof(block);
+
+    return true;
+}
+
+bool SidechainClient::GetBlockHashBatch(const std::vector<int>& vHeight, std::vector<uint256>& vHash)
+{
+    std::vector<MainchainRPCCall> vCall;
+    vCall.reserve(vHeight.size());
+    for (int nHeight : vHeight) {
+        UniValue params(UniValue::VARR);
+        params.push_back(nHeight);
+        vCall.emplace_back("getblockhash", params);
+    }
+
+    std::vector<UniValue> vResult;
+    if (!SendMainchainRPCBatch(vCall, vResult)) {
+        LogPrintf("ERROR Sidechain client failed to request block hashes!\n");
+        return false;
+    }
+
+    vHash.clear();
+    vHash.reserve(vResult.size());
+    for (const UniValue& result : vResult) {
+        if (!result.isStr())
+            return false;
+
+        uint256 hashBlock = uint256S(result.get_str());
+        if (hashBlock.IsNull())
+            return false;
+
+        vHash.push_back(hashBlock);
+    }
+
+    return true;
+}
+
 bool SidechainClient::HaveSpentWTPrime(const uint256& hashWTPrime)
 {
     // JSON for 'havespentwtprime' mainchain HTTP-RPC
@@ -654,13 +797,14 @@ bool SidechainClient::HaveSpentWTPrime(const uint256& hashWTPrime)
     json.append("] }");
 
     // Try to request mainchain block hash
-    boost::property_tree::ptree ptree;
-    if (!SendRequestToMainchain(json, ptree)) {
+    UniValue reply;
+    if (!SendRequestToMainchain(json, reply)) {
         LogPrintf("ERROR Sidechain client failed to request spent WT^!\n");
         return false;
     }
 
-    bool fSpent = ptree.get("result", false);
+    const UniValue& result = find_value(reply, "result");
+    bool fSpent = result.isBool() && result.get_bool();
 
     return fSpent;
 }
@@ -680,108 +824,34 @@ bool SidechainClient::HaveFailedWTPrime(const uint256& hashWTPrime)
     json.append("] }");
 
     // Try to request mainchain block hash
-    boost::property_tree::ptree ptree;
-    if (!SendRequestToMainchain(json, ptree)) {
+    UniValue reply;
+    if (!SendRequestToMainchain(json, reply)) {
         LogPrintf("ERROR Sidechain client failed to request failed WT^!\n");
         return false;
     }
 
-    bool fFailed = ptree.get("result", false);
+    const UniValue& result = find_value(reply, "result");
+    bool fFailed = result.isBool() && result.get_bool();
 
     return fFailed;
 }
 
-bool SidechainClient::SendRequestToMainchain(const std::string& json, boost::property_tree::ptree &ptree)
+bool SidechainClient::SendRequestToMainchain(const std::string& json, UniValue& reply, bool fIdempotent)
 {
-    // Format user:pass for authentication
-    std::string auth = gArgs.GetArg("-rpcuser", "") + ":" + gArgs.GetArg("-rpcpassword", "");
-    if (auth == ":")
+    std::string strBody;
+    if (!SendMainchainRPC(json, strBody, fIdempotent))
         return false;
 
-    // Mainnet RPC = 8332
-    // Testnet RPC = 18332
-    // Regtest RPC = 18443
-    //
-    bool fRegtest = gArgs.GetBoolArg("-regtest", false);
-    int port = fRegtest ? 18443 : 8332;
-
-    try {
-        // Setup BOOST ASIO for a synchronus call to the mainchain
-        boost::asio::io_service io_service;
-        tcp::resolver resolver(io_service);
-        tcp::resolver::query query("127.0.0.1", std::to_string(port));
-        tcp::resolver::iterator endpoint_iterator = resolver.resolve(query);
-        tcp::resolver::iterator end;
-
-        tcp::socket socket(io_service);
-        boost::system::error_code error = boost::asio::error::host_not_found;
-
-        // Try to connect
-        while (error && endpoint_iterator != end)
-        {
-          socket.close();
-          socket.connect(*endpoint_iterator++, error);
-        }
-
-        if (error) throw boost::system::system_error(error);
-
-        // HTTP request (package the json for sending)
-        boost::asio::streambuf output;
-        std::ostream os(&output);
-        os << "POST / HTTP/1.1\n";
-        os << "Host: 127.0.0.1\n";
-        os << "Content-Type: application/json\n";
-        os << "Authorization: Basic " << EncodeBase64(auth) << std::endl;
-        os << "Connection: close\n";
-        os << "Content-Length: " << json.size() << "\n\n";
-        os << json;
-
-        // Send the request
-        boost::asio::write(socket, output);
-
-        // Read the reponse
-        std::string data;
-        for (;;)
-        {
-            boost::array<char, 4096> buf;
-
-            // Read until end of file (socket closed)
-            boost::system::error_code e;
-            size_t sz = socket.read_some(boost::asio::buffer(buf), e);
-
-            data.insert(data.size(), buf.data(), sz);
-
-            if (e == boost::asio::error::eof)
-                break; // socket closed
-            else if (e)
-                throw boost::system::system_error(e);
-        }
-
-        std::stringstream ss;
-        ss << data;
-
-        // Get response code
-        ss.ignore(std::numeric_limits<std::streamsize>::max(), ' ');
-        int code;
-        ss >> code;
-
-        // Check response code
-        if (code != 200)
-            return false;
+    // Parse json response
+    if (!reply.read(strBody) || !reply.isObject()) {
+        LogPrintf("ERROR Sidechain client (sendRequestToMainchain): invalid response\n");
+        return false;
+    }
 
-        // Skip the rest of the header
-        for (size_t i = 0; i < 5; i++)
-            ss.ignore(std::numeric_limits<std::streamsize>::max(), '\r');
-
-        // Parse json response;
-        std::string JSON;
-        ss >> JSON;
-        std::stringstream jss;
-        jss << JSON;
-        boost::property_tree::json_parser::read_json(jss, ptree);
-    } catch (std::exception &exception) {
-        LogPrintf("ERROR Sidechain client (sendRequestToMainchain): %s\n", exception.what());
+    if (!find_value(reply, "error").isNull()) {
+        LogPrintf("ERROR Sidechain client (sendRequestToMainchain): %s\n", find_value(reply, "error").write());
         return false;
     }
+
     return true;
 }
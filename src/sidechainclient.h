@@ -12,10 +12,38 @@
 #include <string>
 #include <vector>
 
-#include <boost/property_tree/json_parser.hpp>
+class BMMProof;
+class UniValue;
 
 class SidechainDeposit;
 
+/** A BMM commitment to look up with VerifyBMMBatch */
+struct SidechainBMMQuery
+{
+    SidechainBMMQuery(const uint256& hashMainBlockIn, const uint256& hashBMMIn) : hashMainBlock(hashMainBlockIn), hashBMM(hashBMMIn) { }
+
+    uint256 hashMainBlock;
+    uint256 hashBMM;
+
+    // Set by VerifyBMMBatch
+    bool fFound = false;
+    uint256 txid;
+    uint32_t nTime = 0;
+};
+
+/** A deposit to check with VerifyDepositBatch */
+struct SidechainDepositQuery
+{
+    SidechainDepositQuery(const uint256& hashMainBlockIn, const uint256& txidIn, int nTxIn) : hashMainBlock(hashMainBlockIn), txid(txidIn), nTx(nTxIn) { }
+
+    uint256 hashMainBlock;
+    uint256 txid;
+    int nTx;
+
+    // Set by VerifyDepositBatch
+    bool fVerified = false;
+};
+
 // TODO refactor: Move BMM validation cache code here, or remove class status.
 class SidechainClient
 {
@@ -42,6 +70,19 @@ public:
      */
     bool VerifyBMM(const uint256& hashMainBlock, const uint256& hashBMM, uint256& txid, uint32_t& nTime);
 
+    /*
+     * Verify a list of deposits using batched requests. Returns false if the
+     * mainchain could not be reached, otherwise fVerified is set per deposit.
+     */
+    bool VerifyDepositBatch(std::vector<SidechainDepositQuery>& vQuery);
+
+    /*
+     * Search for a list of BMM commitments using batched requests. Returns
+     * false if the mainchain could not be reached, otherwise fFound (and the
+     * txid & time if found) are set per query.
+     */
+    bool VerifyBMMBatch(std::vector<SidechainBMMQuery>& vQuery);
+
     /*
      * Send BMM commitment request to mainchain node, create mainchain BMM
      * request transaction.
@@ -59,6 +100,13 @@ public:
      */
     bool RefreshBMM(const CAmount& amount, std::string& strError, uint256& hashCreatedMerkleRoot, uint256& hashConnected, uint256& hashConnectedMerkleRoot, uint256& txid, int& nTxn, CAmount& nFees, bool fCreateNew = true, const uint256& hashPrevBlock = uint256());
 
+    /*
+     * Check the mainchain blocks in vHashMainBlock that haven't been checked
+     * yet for our cached BMM requests, and submit the BMM blocks that were
+     * included.
+     */
+    bool CheckBMMRequests(const std::vector<uint256>& vHashMainBlock, uint256& hashConnected, uint256& hashConnectedMerkleRoot, std::string& strError);
+
     bool CreateBMMBlock(CBlock& block, std::string& strError, CAmount& nFees, const uint256& hashPrevBlock = uint256());
 
     bool SubmitBMMBlock(const CBlock& block);
@@ -73,15 +121,31 @@ public:
 
     bool GetBlockHash(int nHeight, uint256& hashBlock);
 
+    /*
+     * Request a mainchain block and create the BMM proof for its coinbase,
+     * so that the BMM commits of the block can be checked without the
+     * mainchain.
+     */
+    bool GetBMMProof(const uint256& hashMainBlock, BMMProof& proof);
+
+    /*
+     * Request the mainchain block hashes at a list of heights using batched
+     * requests. Fails unless every hash was returned.
+     */
+    bool GetBlockHashBatch(const std::vector<int>& vHeight, std::vector<uint256>& vHash);
+
     bool HaveSpentWTPrime(const uint256& hashWTPrime);
 
     bool HaveFailedWTPrime(const uint256& hashWTPrime);
 
 private:
     /*
-     * Send json request to local node
+     * Send json request to local node. On success reply holds the parsed
+     * response object and its "error" field is null. Requests that create
+     * something on the mainchain must unset fIdempotent, so that they are
+     * never sent twice.
      */
-    bool SendRequestToMainchain(const std::string& json, boost::property_tree::ptree &ptree);
+    bool SendRequestToMainchain(const std::string& json, UniValue& reply, bool fIdempotent = true);
 };
 
 #endif // SIDECHAINCLIENT_H
@@ -5,9 +5,13 @@
 #include <bmmcache.h>
 #include <deque>
 #include <random.h>
+#include <txdb.h>
 #include <uint256.h>
 #include <validation.h>
 
+#include <atomic>
+#include <thread>
+
 #include <test/test_bitcoin.h>
 
 #include <boost/test/unit_test.hpp>
@@ -872,4 +876,402 @@ BOOST_AUTO_TEST_CASE(bmmcache_replace_tip)
     BOOST_CHECK(vOrphan == vOrphanCheck);
 }
 
+BOOST_AUTO_TEST_CASE(bmmcache_connect_tip)
+{
+    // Test connecting new tips one at a time like mainchain notifications
+
+    // Instance of BMMCache for test
+    BMMCache cache;
+
+    // Nothing to connect to yet
+    bool fReorg = false;
+    std::vector<uint256> vOrphan;
+    BOOST_CHECK(!cache.ConnectMainBlock(GetRandHash(), GetRandHash(), fReorg, vOrphan));
+
+    std::deque<uint256> dHashNew = GenerateRandomHashChain(100);
+    std::deque<uint256> dHashNewCopy = dHashNew;
+    BOOST_CHECK(cache.UpdateMainBlockCache(dHashNewCopy, fReorg, vOrphan));
+
+    // Extend the tip
+    for (int i = 0; i < 10; i++) {
+        uint256 hash = GetRandHash();
+        BOOST_CHECK(cache.ConnectMainBlock(hash, dHashNew.back(), fReorg, vOrphan));
+        dHashNew.push_back(hash);
+    }
+    BOOST_CHECK(!fReorg);
+    BOOST_CHECK(vOrphan.empty());
+    BOOST_CHECK(cache.GetLastMainBlockHash() == dHashNew.back());
+    BOOST_CHECK((unsigned int)cache.GetCachedBlockCount() == dHashNew.size());
+
+    // Repeated notification for the tip is ignored
+    BOOST_CHECK(cache.ConnectMainBlock(dHashNew.back(), dHashNew[dHashNew.size() - 2], fReorg, vOrphan));
+    BOOST_CHECK(!fReorg);
+    BOOST_CHECK((unsigned int)cache.GetCachedBlockCount() == dHashNew.size());
+
+    // Prevblock isn't cached, notifications were missed
+    BOOST_CHECK(!cache.ConnectMainBlock(GetRandHash(), GetRandHash(), fReorg, vOrphan));
+    BOOST_CHECK(cache.GetLastMainBlockHash() == dHashNew.back());
+
+    // Earlier block becomes the tip again without being connected
+    BOOST_CHECK(!cache.ConnectMainBlock(dHashNew[50], dHashNew[49], fReorg, vOrphan));
+    BOOST_CHECK(cache.GetLastMainBlockHash() == dHashNew.back());
+
+    // New tip that forks 3 blocks back from the tip
+    std::vector<uint256> vOrphanCheck;
+    for (size_t i = 0; i < 3; i++) {
+        vOrphanCheck.push_back(dHashNew.back());
+        dHashNew.pop_back();
+    }
+    uint256 hashFork = GetRandHash();
+    BOOST_CHECK(cache.ConnectMainBlock(hashFork, dHashNew.back(), fReorg, vOrphan));
+    dHashNew.push_back(hashFork);
+
+    BOOST_CHECK(fReorg);
+    BOOST_CHECK(vOrphan == vOrphanCheck);
+    BOOST_CHECK(cache.GetLastMainBlockHash() == hashFork);
+    BOOST_CHECK(cache.GetMainPrevBlockHash(hashFork) == dHashNew[dHashNew.size() - 2]);
+
+    std::vector<uint256> vHashCached = cache.GetMainBlockHashCache();
+    BOOST_CHECK(std::equal(vHashCached.begin(), vHashCached.end(), dHashNew.begin()) && vHashCached.size() == dHashNew.size());
+}
+
+BOOST_AUTO_TEST_CASE(bmmcache_bmm_requests)
+{
+    // Test that mainchain blocks are only checked for the BMM requests they
+    // could include
+
+    // Instance of BMMCache for test
+    BMMCache cache;
+
+    std::deque<uint256> dHashNew = GenerateRandomHashChain(10);
+    std::deque<uint256> dHashNewCopy = dHashNew;
+    bool fReorg = false;
+    std::vector<uint256> vOrphan;
+    BOOST_CHECK(cache.UpdateMainBlockCache(dHashNewCopy, fReorg, vOrphan));
+
+    // Two requests created on block 5 and one on block 7
+    uint256 hashRequest1 = GetRandHash();
+    uint256 hashRequest2 = GetRandHash();
+    uint256 hashRequest3 = GetRandHash();
+    cache.StoreBMMRequest(hashRequest1, dHashNew[5]);
+    cache.StoreBMMRequest(hashRequest2, dHashNew[5]);
+    cache.StoreBMMRequest(hashRequest2, dHashNew[5]);
+    cache.StoreBMMRequest(hashRequest3, dHashNew[7]);
+
+    BOOST_CHECK(cache.HaveBMMRequestForPrevBlock(dHashNew[5]));
+    BOOST_CHECK(cache.HaveBMMRequestForPrevBlock(dHashNew[7]));
+    BOOST_CHECK(!cache.HaveBMMRequestForPrevBlock(dHashNew[6]));
+
+    std::vector<uint256> vRequest = cache.GetBMMRequestsForMainBlock(dHashNew[6]);
+    BOOST_CHECK(vRequest.size() == 2);
+    BOOST_CHECK(std::count(vRequest.begin(), vRequest.end(), hashRequest1) == 1);
+    BOOST_CHECK(std::count(vRequest.begin(), vRequest.end(), hashRequest2) == 1);
+
+    vRequest = cache.GetBMMRequestsForMainBlock(dHashNew[8]);
+    BOOST_CHECK(vRequest.size() == 1 && vRequest.front() == hashRequest3);
+
+    // Blocks outside of the window of any request
+    BOOST_CHECK(cache.GetBMMRequestsForMainBlock(dHashNew[5]).empty());
+    BOOST_CHECK(cache.GetBMMRequestsForMainBlock(dHashNew[9]).empty());
+    BOOST_CHECK(cache.GetBMMRequestsForMainBlock(dHashNew[0]).empty());
+
+    // Unknown mainchain block
+    BOOST_CHECK(cache.GetBMMRequestsForMainBlock(GetRandHash()).empty());
+
+    // A mainchain block on a fork of block 7 can also include its requests
+    uint256 hashFork = GetRandHash();
+    BOOST_CHECK(cache.ConnectMainBlock(hashFork, dHashNew[7], fReorg, vOrphan));
+    BOOST_CHECK(fReorg);
+    vRequest = cache.GetBMMRequestsForMainBlock(hashFork);
+    BOOST_CHECK(vRequest.size() == 1 && vRequest.front() == hashRequest3);
+
+    cache.ClearBMMBlocks();
+    BOOST_CHECK(cache.GetBMMRequestsForMainBlock(dHashNew[6]).empty());
+    BOOST_CHECK(cache.GetBMMRequestsForMainBlock(hashFork).empty());
+}
+
+BOOST_AUTO_TEST_CASE(mainblockhashindex)
+{
+    MainBlockHashIndex index;
+    BOOST_CHECK(index.Empty());
+
+    std::deque<uint256> dHash = GenerateRandomHashChain(1000);
+    for (const uint256& u : dHash)
+        index.PushBack(u);
+
+    BOOST_CHECK(index.Size() == 1000);
+    BOOST_CHECK(index.Back() == dHash.back());
+    for (size_t i = 0; i < dHash.size(); i++) {
+        size_t nHeight = 0;
+        BOOST_CHECK(index.Find(dHash[i], nHeight));
+        BOOST_CHECK(nHeight == i);
+        BOOST_CHECK(index.At(i) == dHash[i]);
+    }
+    BOOST_CHECK(!index.Contains(GetRandHash()));
+
+    // Remove blocks from both ends
+    for (int i = 0; i < 100; i++)
+        index.PopBack();
+    index.PopFront(300);
+
+    BOOST_CHECK(index.GetFirstHeight() == 300);
+    BOOST_CHECK(index.GetEndHeight() == 900);
+    BOOST_CHECK(index.Back() == dHash[899]);
+    for (size_t i = 0; i < dHash.size(); i++) {
+        size_t nHeight = 0;
+        bool fFound = index.Find(dHash[i], nHeight);
+        BOOST_CHECK(fFound == (i >= 300 && i < 900));
+        if (fFound)
+            BOOST_CHECK(nHeight == i && index.At(i) == dHash[i]);
+    }
+
+    // Add a different branch after the removed blocks
+    std::deque<uint256> dHashFork = GenerateRandomHashChain(500);
+    for (const uint256& u : dHashFork)
+        index.PushBack(u);
+
+    BOOST_CHECK(index.GetEndHeight() == 1400);
+    for (size_t i = 0; i < dHashFork.size(); i++) {
+        size_t nHeight = 0;
+        BOOST_CHECK(index.Find(dHashFork[i], nHeight));
+        BOOST_CHECK(nHeight == 900 + i);
+    }
+    BOOST_CHECK(!index.Contains(dHash[950]));
+
+    index.Clear();
+    BOOST_CHECK(index.Empty());
+    BOOST_CHECK(!index.Contains(dHashFork.back()));
+}
+
+BOOST_AUTO_TEST_CASE(bmmcache_spill_to_disk)
+{
+    // Only a window of recent blocks is kept in memory, the rest are read
+    // from the database
+    CMainBlockDB db(1 << 20, true);
+
+    BMMCache cache;
+    cache.SetMainBlockDB(&db, MIN_MAIN_BLOCK_CACHE_WINDOW);
+
+    std::deque<uint256> dHashNew = GenerateRandomHashChain(5000);
+    std::deque<uint256> dHashNewCopy = dHashNew;
+    bool fReorg = false;
+    std::vector<uint256> vOrphan;
+    BOOST_CHECK(cache.UpdateMainBlockCache(dHashNewCopy, fReorg, vOrphan));
+    BOOST_CHECK(!fReorg);
+
+    BOOST_CHECK((unsigned int)cache.GetCachedBlockCount() == dHashNew.size());
+    BOOST_CHECK(cache.GetLastMainBlockHash() == dHashNew.back());
+    BOOST_CHECK(cache.HaveMainBlock(dHashNew[10]));
+    BOOST_CHECK(cache.GetMainchainBlockHeight(dHashNew[10]) == 9);
+    BOOST_CHECK(cache.GetMainPrevBlockHash(dHashNew[10]) == dHashNew[9]);
+    BOOST_CHECK(!cache.HaveMainBlock(GetRandHash()));
+
+    std::vector<uint256> vHashCached = cache.GetMainBlockHashCache();
+    BOOST_CHECK(std::equal(vHashCached.begin(), vHashCached.end(), dHashNew.begin()) && vHashCached.size() == dHashNew.size());
+
+    // Reorg near the tip
+    std::vector<uint256> vOrphanCheck;
+    for (size_t i = 0; i < 5; i++) {
+        vOrphanCheck.push_back(dHashNew.back());
+        dHashNew.pop_back();
+    }
+    std::deque<uint256> dHashReorg = GenerateRandomHashChain(10);
+    dHashReorg.push_front(dHashNew.back());
+    dHashNew.insert(dHashNew.end(), dHashReorg.begin() + 1, dHashReorg.end());
+
+    BOOST_CHECK(cache.UpdateMainBlockCache(dHashReorg, fReorg, vOrphan));
+    BOOST_CHECK(fReorg);
+    BOOST_CHECK(vOrphan == vOrphanCheck);
+    BOOST_CHECK((unsigned int)cache.GetCachedBlockCount() == dHashNew.size());
+
+    // Blocks written to disk can't be reorganized from the in memory window
+    std::deque<uint256> dHashDeep = GenerateRandomHashChain(1);
+    dHashDeep.push_front(dHashNew[10]);
+    fReorg = false;
+    vOrphan.clear();
+    BOOST_CHECK(!cache.UpdateMainBlockCache(dHashDeep, fReorg, vOrphan));
+    BOOST_CHECK(!fReorg);
+    BOOST_CHECK(cache.GetLastMainBlockHash() == dHashNew.back());
+
+    // Write and read back the cache
+    BOOST_CHECK(cache.WriteMainBlockDB());
+
+    BMMCache cacheRead;
+    cacheRead.SetMainBlockDB(&db, MIN_MAIN_BLOCK_CACHE_WINDOW);
+    BOOST_CHECK(cacheRead.ReadMainBlockDB());
+    BOOST_CHECK((unsigned int)cacheRead.GetCachedBlockCount() == dHashNew.size());
+    BOOST_CHECK(cacheRead.GetLastMainBlockHash() == dHashNew.back());
+    BOOST_CHECK(cacheRead.GetMainPrevBlockHash(dHashNew[10]) == dHashNew[9]);
+    BOOST_CHECK(!cacheRead.HaveMainBlock(vOrphanCheck.front()));
+
+    vHashCached = cacheRead.GetMainBlockHashCache();
+    BOOST_CHECK(std::equal(vHashCached.begin(), vHashCached.end(), dHashNew.begin()) && vHashCached.size() == dHashNew.size());
+
+    // Nothing on disk is used after a reset
+    cacheRead.ResetMainBlockCache();
+    BOOST_CHECK(cacheRead.GetCachedBlockCount() == 0);
+    BOOST_CHECK(!cacheRead.HaveMainBlock(dHashNew[10]));
+
+    BMMCache cacheEmpty;
+    cacheEmpty.SetMainBlockDB(&db, MIN_MAIN_BLOCK_CACHE_WINDOW);
+    BOOST_CHECK(!cacheEmpty.ReadMainBlockDB());
+}
+
+BOOST_AUTO_TEST_CASE(bmmcache_multithreaded)
+{
+    // Use the cache from several threads at once like validation, the miner,
+    // RPC and the GUI do. Boost checks aren't thread safe so failures are
+    // counted and checked after the threads are done.
+    BMMCache cache;
+    std::atomic<int> nFailures(0);
+
+    // Blocks below the tip of this chain are never reorganized
+    std::deque<uint256> dHashBase = GenerateRandomHashChain(1000);
+    std::deque<uint256> dHashCopy = dHashBase;
+    bool fReorg = false;
+    std::vector<uint256> vOrphan;
+    BOOST_CHECK(cache.UpdateMainBlockCache(dHashCopy, fReorg, vOrphan));
+
+    std::vector<std::thread> vThread;
+
+    // Extend and reorg the mainchain tip
+    vThread.emplace_back([&cache, &nFailures, &dHashBase]() {
+        uint256 hashTip = dHashBase.back();
+        for (int i = 0; i < 2000; i++) {
+            std::deque<uint256> deqHashNew;
+            deqHashNew.push_back(hashTip);
+            deqHashNew.push_back(GetRandHash());
+
+            // Replace the block that was just added every other time
+            if (i % 2) {
+                deqHashNew.front() = cache.GetMainPrevBlockHash(hashTip);
+                if (deqHashNew.front().IsNull())
+                    nFailures++;
+            }
+
+            bool fReorgThread = false;
+            std::vector<uint256> vOrphanThread;
+            if (!cache.UpdateMainBlockCache(deqHashNew, fReorgThread, vOrphanThread))
+                nFailures++;
+            if (fReorgThread != (i % 2 == 1))
+                nFailures++;
+            hashTip = deqHashNew.back();
+        }
+    });
+
+    // Read mainchain blocks that aren't reorganized
+    for (int t = 0; t < 2; t++) {
+        vThread.emplace_back([&cache, &nFailures, &dHashBase]() {
+            for (int i = 0; i < 20000; i++) {
+                size_t nHeight = 1 + (i % (dHashBase.size() - 1));
+                if (!cache.HaveMainBlock(dHashBase[nHeight]))
+                    nFailures++;
+                if (cache.GetMainPrevBlockHash(dHashBase[nHeight]) != dHashBase[nHeight - 1])
+                    nFailures++;
+                if (cache.GetMainchainBlockHeight(dHashBase[nHeight]) != (int)nHeight - 1)
+                    nFailures++;
+                if (cache.GetRecentMainBlockHashes().size() != 3)
+                    nFailures++;
+                if (cache.GetCachedBlockCount() < (int)dHashBase.size())
+                    nFailures++;
+            }
+        });
+    }
+
+    // Cache and look up verified BMM and deposits
+    for (int t = 0; t < 4; t++) {
+        vThread.emplace_back([&cache, &nFailures, t]() {
+            std::deque<uint256> dHash = GenerateRandomHashChain(5000);
+            for (const uint256& u : dHash) {
+                if (t % 2) {
+                    cache.CacheVerifiedBMM(u);
+                    if (!cache.HaveVerifiedBMM(u))
+                        nFailures++;
+                } else {
+                    cache.CacheVerifiedDeposit(u);
+                    if (!cache.HaveVerifiedDeposit(u))
+                        nFailures++;
+                }
+                cache.AddCheckedMainBlock(u);
+                if (!cache.MainBlockChecked(u))
+                    nFailures++;
+                cache.CacheWTID(u);
+                if (!cache.IsMyWT(u))
+                    nFailures++;
+            }
+            for (const uint256& u : dHash) {
+                if (t % 2 ? !cache.HaveVerifiedBMM(u) : !cache.HaveVerifiedDeposit(u))
+                    nFailures++;
+            }
+        });
+    }
+
+    for (std::thread& thread : vThread)
+        thread.join();
+
+    BOOST_CHECK_EQUAL(nFailures, 0);
+    std::vector<uint256> vHash;
+    std::vector<int> vHeight;
+    cache.GetVerifiedBMMCache(vHash, vHeight);
+    BOOST_CHECK(vHash.size() == 10000);
+    cache.GetVerifiedDepositCache(vHash, vHeight);
+    BOOST_CHECK(vHash.size() == 10000);
+    BOOST_CHECK(cache.GetCachedWTID().size() == 20000);
+    BOOST_CHECK((size_t)cache.GetCachedBlockCount() == dHashBase.size() + 1000);
+}
+
+BOOST_AUTO_TEST_CASE(bmmcache_verified_eviction)
+{
+    VerifiedHashCache cache;
+    cache.SetMaxSize(100 * VerifiedHashCache::ENTRY_BYTES);
+    BOOST_CHECK(cache.GetMaxEntries() == 100);
+
+    // Verify 10 hashes at each of 30 sidechain heights
+    std::deque<uint256> dHash = GenerateRandomHashChain(300);
+    for (size_t i = 0; i < dHash.size(); i++)
+        cache.Insert(dHash[i], i / 10);
+
+    // Only the hashes verified at the most recent heights are kept
+    BOOST_CHECK(cache.Size() == 100);
+    for (size_t i = 200; i < dHash.size(); i++)
+        BOOST_CHECK(cache.Contains(dHash[i]));
+
+    std::vector<uint256> vHash;
+    std::vector<int> vHeight;
+    cache.GetEntries(vHash, vHeight);
+    BOOST_CHECK(std::equal(vHash.begin(), vHash.end(), dHash.begin() + 200) && vHash.size() == 100);
+    BOOST_CHECK(vHeight.front() == 20 && vHeight.back() == 29);
+
+    // Hashes verified after a reorg aren't older than what's cached
+    uint256 hashReorg = GetRandHash();
+    cache.Insert(hashReorg, 5);
+    cache.GetEntries(vHash, vHeight);
+    BOOST_CHECK(vHash.back() == hashReorg && vHeight.back() == 29);
+
+    // Adding the same hash again doesn't add an entry
+    cache.Insert(hashReorg, 30);
+    BOOST_CHECK(cache.Size() == 100);
+
+    // Shrinking the cache keeps the most recent entries
+    cache.SetMaxSize(10 * VerifiedHashCache::ENTRY_BYTES);
+    BOOST_CHECK(cache.Size() == 10);
+    BOOST_CHECK(cache.Contains(hashReorg));
+    BOOST_CHECK(cache.Contains(dHash.back()));
+    BOOST_CHECK(!cache.Contains(dHash[200]));
+
+    // Load entries written to disk into an empty cache
+    cache.GetEntries(vHash, vHeight);
+    VerifiedHashCache cacheLoad;
+    cacheLoad.Load(vHash, vHeight);
+    BOOST_CHECK(cacheLoad.Size() == 10);
+    for (const uint256& u : vHash)
+        BOOST_CHECK(cacheLoad.Contains(u));
+
+    // Mismatched heights are ignored
+    VerifiedHashCache cacheBad;
+    vHeight.pop_back();
+    cacheBad.Load(vHash, vHeight);
+    BOOST_CHECK(cacheBad.Size() == 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
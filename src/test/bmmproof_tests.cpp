@@ -0,0 +1,334 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <arith_uint256.h>
+#include <bmmcache.h>
+#include <bmmproof.h>
+#include <consensus/merkle.h>
+#include <random.h>
+#include <script/script.h>
+#include <streams.h>
+#include <txdb.h>
+#include <uint256.h>
+#include <utilstrencodings.h>
+#include <validation.h>
+
+#include <deque>
+#include <string>
+
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+// Header of the output a mainchain miner adds to its coinbase to commit to a
+// BMM h*: OP_RETURN followed by 0xD1617368 and the 32 byte h*
+static const std::string CRITICAL_HASH_COMMIT_HEADER = "6ad1617368";
+
+static CScript GenerateCriticalHashCommit(const uint256& hashCritical)
+{
+    std::vector<unsigned char> vch = ParseHex(CRITICAL_HASH_COMMIT_HEADER);
+    vch.insert(vch.end(), hashCritical.begin(), hashCritical.end());
+    return CScript(vch.begin(), vch.end());
+}
+
+// Regtest mainchain stand-in: a mainchain block with a coinbase that commits
+// to each of vHashCritical, followed by nTx other transactions
+static CMainchainBlock CreateMainchainBlock(const std::vector<uint256>& vHashCritical, int nTx)
+{
+    CMainchainBlock block;
+    block.nVersion = 0x20000000;
+    block.hashPrevBlock = InsecureRand256();
+    block.nTime = 1500000000;
+    block.nBits = 0x207fffff;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << 101 << (int64_t)InsecureRandBits(32);
+    coinbase.vout.push_back(CTxOut(50 * COIN, CScript() << OP_TRUE));
+    for (const uint256& hashCritical : vHashCritical)
+        coinbase.vout.push_back(CTxOut(0, GenerateCriticalHashCommit(hashCritical)));
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+
+    for (int i = 0; i < nTx; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+        tx.vout.push_back(CTxOut(1 * COIN, CScript() << OP_TRUE));
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+
+    std::vector<uint256> vLeaves;
+    for (const CTransactionRef& tx : block.vtx)
+        vLeaves.push_back(tx->GetHash());
+    block.hashMerkleRoot = ComputeMerkleRoot(vLeaves);
+
+    // Regtest difficulty, every other nonce or so is valid
+    while (UintToArith256(block.GetHash()) > arith_uint256().SetCompact(block.nBits))
+        block.nNonce++;
+
+    return block;
+}
+
+static CMainchainBlock CreateMainchainBlock(const uint256& hashCritical, int nTx)
+{
+    return CreateMainchainBlock(std::vector<uint256>{hashCritical}, nTx);
+}
+
+// Connect a mainchain block hash to the tip of the main block cache
+static void CacheMainBlock(const uint256& hash)
+{
+    std::deque<uint256> deqHash;
+    const uint256 hashTip = bmmCache.GetLastMainBlockHash();
+    if (!hashTip.IsNull())
+        deqHash.push_back(hashTip);
+    deqHash.push_back(hash);
+    bool fReorg = false;
+    std::vector<uint256> vOrphan;
+    bmmCache.UpdateMainBlockCache(deqHash, fReorg, vOrphan);
+}
+
+BOOST_FIXTURE_TEST_SUITE(bmmproof_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(bmmproof_check)
+{
+    bmmCache.ResetMainBlockCache();
+
+    const uint256 hashCritical = InsecureRand256();
+    CMainchainBlock blockMain = CreateMainchainBlock(hashCritical, 10);
+    BMMProof proof = CreateBMMProof(blockMain);
+
+    CBlockHeader header;
+    header.hashMerkleRoot = hashCritical;
+    header.hashMainchainBlock = blockMain.GetHash();
+
+    std::string strFail;
+
+    // The mainchain block must be part of the main block cache
+    BOOST_CHECK(!CheckBMMProof(header, proof, strFail));
+    CacheMainBlock(blockMain.GetHash());
+    BOOST_CHECK(CheckBMMProof(header, proof, strFail));
+
+    // The proof survives serialization
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << proof;
+    BMMProof proofRead;
+    ss >> proofRead;
+    BOOST_CHECK(CheckBMMProof(header, proofRead, strFail));
+
+    // Wrong h*
+    CBlockHeader headerBad = header;
+    headerBad.hashMerkleRoot = InsecureRand256();
+    BOOST_CHECK(!CheckBMMProof(headerBad, proof, strFail));
+
+    // Wrong mainchain block
+    headerBad = header;
+    headerBad.hashMainchainBlock = InsecureRand256();
+    BOOST_CHECK(!CheckBMMProof(headerBad, proof, strFail));
+
+    // Bad merkle branch
+    BMMProof proofBad = proof;
+    proofBad.vMerkleBranch[0] = InsecureRand256();
+    BOOST_CHECK(!CheckBMMProof(header, proofBad, strFail));
+
+    // Coinbase with the commit that isn't part of the mainchain block
+    CMainchainBlock blockOther = CreateMainchainBlock(hashCritical, 10);
+    proofBad = proof;
+    proofBad.coinbase = blockOther.vtx[0];
+    BOOST_CHECK(!CheckBMMProof(header, proofBad, strFail));
+
+    // A mainchain block with only the coinbase has an empty branch
+    CMainchainBlock blockSingle = CreateMainchainBlock(hashCritical, 0);
+    CacheMainBlock(blockSingle.GetHash());
+    proof = CreateBMMProof(blockSingle);
+    header.hashMainchainBlock = blockSingle.GetHash();
+    BOOST_CHECK(proof.vMerkleBranch.empty());
+    BOOST_CHECK(CheckBMMProof(header, proof, strFail));
+
+    bmmCache.ResetMainBlockCache();
+}
+
+BOOST_AUTO_TEST_CASE(bmmproof_critical_hash_commit)
+{
+    // h* commits as a mainchain coinbase has them
+    const std::string strHash = "0102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f20";
+    const std::vector<unsigned char> vchHash = ParseHex(strHash);
+    uint256 hashCritical;
+
+    std::vector<unsigned char> vch = ParseHex(CRITICAL_HASH_COMMIT_HEADER + strHash);
+    BOOST_CHECK(CScript(vch.begin(), vch.end()).IsCriticalHashCommit(hashCritical));
+    BOOST_CHECK(hashCritical == uint256(vchHash));
+    BOOST_CHECK(GenerateCriticalHashCommit(hashCritical) == CScript(vch.begin(), vch.end()));
+
+    vch = ParseHex(CRITICAL_HASH_COMMIT_HEADER + std::string(62, 'f') + "00");
+    BOOST_CHECK(CScript(vch.begin(), vch.end()).IsCriticalHashCommit(hashCritical));
+    BOOST_CHECK_EQUAL(hashCritical.GetHex(), "00" + std::string(62, 'f'));
+
+    // Malformed commits
+    const std::vector<std::string> vBad = {
+        // Empty, and the header without h*
+        "",
+        CRITICAL_HASH_COMMIT_HEADER,
+        // h* one byte short, and one byte extra
+        CRITICAL_HASH_COMMIT_HEADER + strHash.substr(2),
+        CRITICAL_HASH_COMMIT_HEADER + strHash + "00",
+        // Not OP_RETURN
+        "51d1617368" + strHash,
+        // Wrong commit header bytes
+        "6ad1617369" + strHash,
+        "6a00617368" + strHash,
+        // The h* pushed as data instead of the fixed header
+        "6a20" + strHash + "000000",
+        // Null h*
+        CRITICAL_HASH_COMMIT_HEADER + std::string(64, '0'),
+    };
+    for (const std::string& strBad : vBad) {
+        vch = ParseHex(strBad);
+        BOOST_CHECK_MESSAGE(!CScript(vch.begin(), vch.end()).IsCriticalHashCommit(hashCritical), strBad);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(bmmproof_contents)
+{
+    // Proofs that can't be valid for any header are rejected on arrival
+    CMainchainBlock blockMain = CreateMainchainBlock(InsecureRand256(), 10);
+    BMMProof proof = CreateBMMProof(blockMain);
+    std::string strFail;
+    BOOST_CHECK(CheckBMMProofContents(proof, strFail));
+
+    // Invalid nBits: zero, negative and overflowing targets
+    for (uint32_t nBits : {0x00000000U, 0x01fedcbaU, 0xff123456U}) {
+        BMMProof proofBad = proof;
+        proofBad.header.nBits = nBits;
+        BOOST_CHECK(!CheckBMMProofContents(proofBad, strFail));
+        BOOST_CHECK_EQUAL(strFail, "invalid mainchain nBits");
+    }
+
+    // A header that doesn't meet its own difficulty
+    BMMProof proofBad = proof;
+    proofBad.header.nBits = 0x1d00ffff;
+    BOOST_CHECK(!CheckBMMProofContents(proofBad, strFail));
+    BOOST_CHECK_EQUAL(strFail, "mainchain proof of work failed");
+
+    // A transaction other than the coinbase
+    proofBad = proof;
+    proofBad.coinbase = blockMain.vtx[1];
+    proofBad.vMerkleBranch = ComputeMerkleBranch({blockMain.vtx[0]->GetHash(), blockMain.vtx[1]->GetHash()}, 1);
+    BOOST_CHECK(!CheckBMMProofContents(proofBad, strFail));
+    BOOST_CHECK_EQUAL(strFail, "not a coinbase");
+
+    // A coinbase of the block without any h* commit
+    CMainchainBlock blockNoCommit = CreateMainchainBlock(std::vector<uint256>(), 3);
+    proofBad = CreateBMMProof(blockNoCommit);
+    BOOST_CHECK(!CheckBMMProofContents(proofBad, strFail));
+    BOOST_CHECK_EQUAL(strFail, "no h* commit");
+}
+
+BOOST_AUTO_TEST_CASE(bmmproof_verify_bmm)
+{
+    bmmCache.ResetMainBlockCache();
+    bmmProofCache.Clear();
+
+    const uint256 hashCritical = InsecureRand256();
+    CMainchainBlock blockMain = CreateMainchainBlock(hashCritical, 100);
+    CacheMainBlock(blockMain.GetHash());
+
+    CBlockHeader header;
+    header.nTime = 1500000000;
+    header.hashPrevBlock = InsecureRand256();
+    header.hashMerkleRoot = hashCritical;
+    header.hashMainchainBlock = blockMain.GetHash();
+
+    // Proofs are found by mainchain block and h*
+    BMMProof proof = CreateBMMProof(blockMain);
+    bmmProofCache.Add(proof);
+    BOOST_CHECK(bmmProofCache.Size() == 1);
+    BMMProof proofCached;
+    BOOST_CHECK(!bmmProofCache.Get(blockMain.GetHash(), InsecureRand256(), proofCached));
+    BOOST_CHECK(bmmProofCache.Get(blockMain.GetHash(), hashCritical, proofCached));
+
+    // BMM is verified with the proof, without a mainchain connection, and
+    // the proof is stored with the block to relay it
+    BOOST_CHECK(VerifyBMMHeaders({header}));
+    BOOST_CHECK(bmmCache.HaveVerifiedBMM(header.GetHash()));
+    BMMProof proofStored;
+    BOOST_CHECK(pblocktree->ReadBMMProof(header.GetHash(), proofStored));
+    BOOST_CHECK(proofStored.GetMainBlockHash() == blockMain.GetHash());
+    BOOST_CHECK(pblocktree->EraseBMMProofs({header.GetHash()}));
+    BOOST_CHECK(!pblocktree->ReadBMMProof(header.GetHash(), proofStored));
+
+    // Proofs are pruned with the blocks they prove
+    {
+        LOCK(cs_main);
+        CBlockIndex* pindex = chainActive.Genesis();
+        BOOST_CHECK(pblocktree->WriteBMMProofs({std::make_pair(pindex->GetBlockHash(), proof)}));
+        PruneOneBlockFile(pindex->nFile);
+        BOOST_CHECK(!pblocktree->ReadBMMProof(pindex->GetBlockHash(), proofStored));
+    }
+
+    bmmProofCache.Clear();
+    bmmCache.ResetMainBlockCache();
+}
+
+BOOST_AUTO_TEST_CASE(bmmproof_cache_limit)
+{
+    bmmProofCache.Clear();
+
+    // The oldest proofs are dropped once the cache is full
+    uint256 hashFirstMain;
+    uint256 hashFirstCritical;
+    for (size_t i = 0; i < MAX_BMM_PROOF_CACHE + 10; i++) {
+        const uint256 hashCritical = InsecureRand256();
+        CMainchainBlock block = CreateMainchainBlock(hashCritical, 0);
+        if (i == 0) {
+            hashFirstMain = block.GetHash();
+            hashFirstCritical = hashCritical;
+        }
+        bmmProofCache.Add(CreateBMMProof(block));
+    }
+    BOOST_CHECK(bmmProofCache.Size() == MAX_BMM_PROOF_CACHE);
+
+    BMMProof proof;
+    BOOST_CHECK(!bmmProofCache.Get(hashFirstMain, hashFirstCritical, proof));
+
+    bmmProofCache.Clear();
+}
+
+BOOST_AUTO_TEST_CASE(bmmproof_cache_peer_limit)
+{
+    bmmProofCache.Clear();
+
+    // A coinbase with many h* commits only takes MAX_BMM_PROOF_HASHES slots
+    std::vector<uint256> vHashCritical;
+    for (size_t i = 0; i < MAX_BMM_PROOF_HASHES + 8; i++)
+        vHashCritical.push_back(InsecureRand256());
+    CMainchainBlock blockMany = CreateMainchainBlock(vHashCritical, 0);
+    BOOST_CHECK_EQUAL(bmmProofCache.Add(CreateBMMProof(blockMany), 1), MAX_BMM_PROOF_HASHES);
+    BOOST_CHECK_EQUAL(bmmProofCache.Add(CreateBMMProof(blockMany), 2), 0U);
+    BOOST_CHECK_EQUAL(bmmProofCache.PeerSize(1), MAX_BMM_PROOF_HASHES);
+    BOOST_CHECK_EQUAL(bmmProofCache.PeerSize(2), 0U);
+
+    // A peer's oldest proofs are dropped once it has too many, the proofs of
+    // other peers stay
+    BMMProof proof;
+    const uint256 hashOther = InsecureRand256();
+    CMainchainBlock blockOther = CreateMainchainBlock(hashOther, 0);
+    BOOST_CHECK_EQUAL(bmmProofCache.Add(CreateBMMProof(blockOther), 2), 1U);
+    for (size_t i = 0; i < MAX_BMM_PROOF_CACHE_PEER; i++)
+        bmmProofCache.Add(CreateBMMProof(CreateMainchainBlock(InsecureRand256(), 0)), 1);
+    BOOST_CHECK_EQUAL(bmmProofCache.PeerSize(1), MAX_BMM_PROOF_CACHE_PEER);
+    BOOST_CHECK(!bmmProofCache.Get(blockMany.GetHash(), vHashCritical[0], proof));
+    BOOST_CHECK(bmmProofCache.Get(blockOther.GetHash(), hashOther, proof));
+    BOOST_CHECK_EQUAL(bmmProofCache.Size(), MAX_BMM_PROOF_CACHE_PEER + 1);
+
+    // Proofs of a peer that disconnected are dropped
+    bmmProofCache.ForgetPeer(1);
+    BOOST_CHECK_EQUAL(bmmProofCache.PeerSize(1), 0U);
+    BOOST_CHECK_EQUAL(bmmProofCache.Size(), 1U);
+    BOOST_CHECK(bmmProofCache.Get(blockOther.GetHash(), hashOther, proof));
+
+    bmmProofCache.Clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
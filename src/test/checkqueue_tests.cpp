@@ -16,6 +16,7 @@
 #include <mutex>
 #include <condition_variable>
 
+#include <set>
 #include <unordered_set>
 #include <memory>
 #include <random.h>
@@ -125,6 +126,19 @@ struct FrozenCleanupCheck {
     void swap(FrozenCleanupCheck& x){std::swap(should_freeze, x.should_freeze);};
 };
 
+struct ThreadCheck {
+    static std::mutex m;
+    static std::set<std::thread::id> threads;
+    bool operator()()
+    {
+        MilliSleep(1);
+        std::lock_guard<std::mutex> l(m);
+        threads.insert(std::this_thread::get_id());
+        return true;
+    }
+    void swap(ThreadCheck& x){};
+};
+
 // Static Allocations
 std::mutex FrozenCleanupCheck::m{};
 std::atomic<uint64_t> FrozenCleanupCheck::nFrozen{0};
@@ -133,6 +147,8 @@ std::mutex UniqueCheck::m;
 std::unordered_multiset<size_t> UniqueCheck::results;
 std::atomic<size_t> FakeCheckCheckCompletion::n_calls{0};
 std::atomic<size_t> MemoryCheck::fake_allocated_memory{0};
+std::mutex ThreadCheck::m;
+std::set<std::thread::id> ThreadCheck::threads;
 
 // Queue Typedefs
 typedef CCheckQueue<FakeCheckCheckCompletion> Correct_Queue;
@@ -142,13 +158,20 @@ typedef CCheckQueue<UniqueCheck> Unique_Queue;
 typedef CCheckQueue<MemoryCheck> Memory_Queue;
 typedef CCheckQueue<FrozenCleanupCheck> FrozenCleanup_Queue;
 
+typedef CWorkStealingCheckQueue<FakeCheckCheckCompletion> Stealing_Correct_Queue;
+typedef CWorkStealingCheckQueue<FailingCheck> Stealing_Failing_Queue;
+typedef CWorkStealingCheckQueue<UniqueCheck> Stealing_Unique_Queue;
+typedef CWorkStealingCheckQueue<MemoryCheck> Stealing_Memory_Queue;
+typedef CWorkStealingCheckQueue<FrozenCleanupCheck> Stealing_FrozenCleanup_Queue;
+
 
 /** This test case checks that the CCheckQueue works properly
  * with each specified size_t Checks pushed.
  */
+template <typename Queue>
 void Correct_Queue_range(std::vector<size_t> range)
 {
-    auto small_queue = std::unique_ptr<Correct_Queue>(new Correct_Queue {QUEUE_BATCH_SIZE});
+    auto small_queue = std::unique_ptr<Queue>(new Queue {QUEUE_BATCH_SIZE});
     boost::thread_group tg;
     for (auto x = 0; x < nScriptCheckThreads; ++x) {
        tg.create_thread([&]{small_queue->Thread();});
@@ -158,7 +181,7 @@ void Correct_Queue_range(std::vector<size_t> range)
     for (auto i : range) {
         size_t total = i;
         FakeCheckCheckCompletion::n_calls = 0;
-        CCheckQueueControl<FakeCheckCheckCompletion> control(small_queue.get());
+        CCheckQueueControl<FakeCheckCheckCompletion, Queue> control(small_queue.get());
         while (total) {
             vChecks.resize(std::min(total, (size_t) InsecureRandRange(10)));
             total -= vChecks.size();
@@ -180,7 +203,8 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_Correct_Zero)
 {
     std::vector<size_t> range;
     range.push_back((size_t)0);
-    Correct_Queue_range(range);
+    Correct_Queue_range<Correct_Queue>(range);
+    Correct_Queue_range<Stealing_Correct_Queue>(range);
 }
 /** Test that 1 check is correct
  */
@@ -188,7 +212,8 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_Correct_One)
 {
     std::vector<size_t> range;
     range.push_back((size_t)1);
-    Correct_Queue_range(range);
+    Correct_Queue_range<Correct_Queue>(range);
+    Correct_Queue_range<Stealing_Correct_Queue>(range);
 }
 /** Test that MAX check is correct
  */
@@ -196,7 +221,8 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_Correct_Max)
 {
     std::vector<size_t> range;
     range.push_back(100000);
-    Correct_Queue_range(range);
+    Correct_Queue_range<Correct_Queue>(range);
+    Correct_Queue_range<Stealing_Correct_Queue>(range);
 }
 /** Test that random numbers of checks are correct
  */
@@ -206,14 +232,16 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_Correct_Random)
     range.reserve(100000/1000);
     for (size_t i = 2; i < 100000; i += std::max((size_t)1, (size_t)InsecureRandRange(std::min((size_t)1000, ((size_t)100000) - i))))
         range.push_back(i);
-    Correct_Queue_range(range);
+    Correct_Queue_range<Correct_Queue>(range);
+    Correct_Queue_range<Stealing_Correct_Queue>(range);
 }
 
 
 /** Test that failing checks are caught */
-BOOST_AUTO_TEST_CASE(test_CheckQueue_Catches_Failure)
+template <typename Queue>
+void Catches_Failure()
 {
-    auto fail_queue = std::unique_ptr<Failing_Queue>(new Failing_Queue {QUEUE_BATCH_SIZE});
+    auto fail_queue = std::unique_ptr<Queue>(new Queue {QUEUE_BATCH_SIZE});
 
     boost::thread_group tg;
     for (auto x = 0; x < nScriptCheckThreads; ++x) {
@@ -221,7 +249,7 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_Catches_Failure)
     }
 
     for (size_t i = 0; i < 1001; ++i) {
-        CCheckQueueControl<FailingCheck> control(fail_queue.get());
+        CCheckQueueControl<FailingCheck, Queue> control(fail_queue.get());
         size_t remaining = i;
         while (remaining) {
             size_t r = InsecureRandRange(10);
@@ -242,11 +270,19 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_Catches_Failure)
     tg.interrupt_all();
     tg.join_all();
 }
+
+BOOST_AUTO_TEST_CASE(test_CheckQueue_Catches_Failure)
+{
+    Catches_Failure<Failing_Queue>();
+    Catches_Failure<Stealing_Failing_Queue>();
+}
+
 // Test that a block validation which fails does not interfere with
 // future blocks, ie, the bad state is cleared.
-BOOST_AUTO_TEST_CASE(test_CheckQueue_Recovers_From_Failure)
+template <typename Queue>
+void Recovers_From_Failure()
 {
-    auto fail_queue = std::unique_ptr<Failing_Queue>(new Failing_Queue {QUEUE_BATCH_SIZE});
+    auto fail_queue = std::unique_ptr<Queue>(new Queue {QUEUE_BATCH_SIZE});
     boost::thread_group tg;
     for (auto x = 0; x < nScriptCheckThreads; ++x) {
        tg.create_thread([&]{fail_queue->Thread();});
@@ -254,7 +290,7 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_Recovers_From_Failure)
 
     for (auto times = 0; times < 10; ++times) {
         for (bool end_fails : {true, false}) {
-            CCheckQueueControl<FailingCheck> control(fail_queue.get());
+            CCheckQueueControl<FailingCheck, Queue> control(fail_queue.get());
             {
                 std::vector<FailingCheck> vChecks;
                 vChecks.resize(100, false);
@@ -269,22 +305,30 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_Recovers_From_Failure)
     tg.join_all();
 }
 
+BOOST_AUTO_TEST_CASE(test_CheckQueue_Recovers_From_Failure)
+{
+    Recovers_From_Failure<Failing_Queue>();
+    Recovers_From_Failure<Stealing_Failing_Queue>();
+}
+
 // Test that unique checks are actually all called individually, rather than
 // just one check being called repeatedly. Test that checks are not called
 // more than once as well
-BOOST_AUTO_TEST_CASE(test_CheckQueue_UniqueCheck)
+template <typename Queue>
+void Unique_Checks()
 {
-    auto queue = std::unique_ptr<Unique_Queue>(new Unique_Queue {QUEUE_BATCH_SIZE});
+    auto queue = std::unique_ptr<Queue>(new Queue {QUEUE_BATCH_SIZE});
     boost::thread_group tg;
     for (auto x = 0; x < nScriptCheckThreads; ++x) {
        tg.create_thread([&]{queue->Thread();});
 
     }
 
+    UniqueCheck::results.clear();
     size_t COUNT = 100000;
     size_t total = COUNT;
     {
-        CCheckQueueControl<UniqueCheck> control(queue.get());
+        CCheckQueueControl<UniqueCheck, Queue> control(queue.get());
         while (total) {
             size_t r = InsecureRandRange(10);
             std::vector<UniqueCheck> vChecks;
@@ -302,15 +346,22 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_UniqueCheck)
     tg.join_all();
 }
 
+BOOST_AUTO_TEST_CASE(test_CheckQueue_UniqueCheck)
+{
+    Unique_Checks<Unique_Queue>();
+    Unique_Checks<Stealing_Unique_Queue>();
+}
+
 
 // Test that blocks which might allocate lots of memory free their memory aggressively.
 //
 // This test attempts to catch a pathological case where by lazily freeing
 // checks might mean leaving a check un-swapped out, and decreasing by 1 each
 // time could leave the data hanging across a sequence of blocks.
-BOOST_AUTO_TEST_CASE(test_CheckQueue_Memory)
+template <typename Queue>
+void Memory_Freed()
 {
-    auto queue = std::unique_ptr<Memory_Queue>(new Memory_Queue {QUEUE_BATCH_SIZE});
+    auto queue = std::unique_ptr<Queue>(new Queue {QUEUE_BATCH_SIZE});
     boost::thread_group tg;
     for (auto x = 0; x < nScriptCheckThreads; ++x) {
        tg.create_thread([&]{queue->Thread();});
@@ -318,7 +369,7 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_Memory)
     for (size_t i = 0; i < 1000; ++i) {
         size_t total = i;
         {
-            CCheckQueueControl<MemoryCheck> control(queue.get());
+            CCheckQueueControl<MemoryCheck, Queue> control(queue.get());
             while (total) {
                 size_t r = InsecureRandRange(10);
                 std::vector<MemoryCheck> vChecks;
@@ -337,18 +388,25 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_Memory)
     tg.join_all();
 }
 
+BOOST_AUTO_TEST_CASE(test_CheckQueue_Memory)
+{
+    Memory_Freed<Memory_Queue>();
+    Memory_Freed<Stealing_Memory_Queue>();
+}
+
 // Test that a new verification cannot occur until all checks
 // have been destructed
-BOOST_AUTO_TEST_CASE(test_CheckQueue_FrozenCleanup)
+template <typename Queue>
+void Frozen_Cleanup()
 {
-    auto queue = std::unique_ptr<FrozenCleanup_Queue>(new FrozenCleanup_Queue {QUEUE_BATCH_SIZE});
+    auto queue = std::unique_ptr<Queue>(new Queue {QUEUE_BATCH_SIZE});
     boost::thread_group tg;
     bool fails = false;
     for (auto x = 0; x < nScriptCheckThreads; ++x) {
         tg.create_thread([&]{queue->Thread();});
     }
     std::thread t0([&]() {
-        CCheckQueueControl<FrozenCleanupCheck> control(queue.get());
+        CCheckQueueControl<FrozenCleanupCheck, Queue> control(queue.get());
         std::vector<FrozenCleanupCheck> vChecks(1);
         // Freezing can't be the default initialized behavior given how the queue
         // swaps in default initialized Checks (otherwise freezing destructor
@@ -380,6 +438,31 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_FrozenCleanup)
     BOOST_REQUIRE(!fails);
 }
 
+BOOST_AUTO_TEST_CASE(test_CheckQueue_FrozenCleanup)
+{
+    Frozen_Cleanup<FrozenCleanup_Queue>();
+    Frozen_Cleanup<Stealing_FrozenCleanup_Queue>();
+}
+
+// Test that the work-stealing queue shares the checks of a single large Add
+// among all workers, rather than leaving them to the master
+BOOST_AUTO_TEST_CASE(test_WorkStealingCheckQueue_Steals)
+{
+    auto queue = std::unique_ptr<CWorkStealingCheckQueue<ThreadCheck>>(new CWorkStealingCheckQueue<ThreadCheck> {QUEUE_BATCH_SIZE});
+    boost::thread_group tg;
+    for (auto x = 0; x < nScriptCheckThreads; ++x) {
+        tg.create_thread([&]{queue->Thread();});
+    }
+    {
+        CCheckQueueControl<ThreadCheck, CWorkStealingCheckQueue<ThreadCheck>> control(queue.get());
+        std::vector<ThreadCheck> vChecks(1000);
+        control.Add(vChecks);
+        BOOST_REQUIRE(control.Wait());
+    }
+    BOOST_CHECK(ThreadCheck::threads.size() > 1);
+    tg.interrupt_all();
+    tg.join_all();
+}
 
 /** Test that CCheckQueueControl is threadsafe */
 BOOST_AUTO_TEST_CASE(test_CheckQueueControl_Locks)
@@ -0,0 +1,124 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coins.h>
+#include <coinsprefetch.h>
+#include <primitives/block.h>
+#include <random.h>
+#include <txdb.h>
+#include <uint256.h>
+
+#include <vector>
+
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+// A transaction spending the outpoints
+static CTransactionRef SpendTx(const std::vector<COutPoint>& vOutPoint)
+{
+    CMutableTransaction tx;
+    for (const COutPoint& out : vOutPoint)
+        tx.vin.emplace_back(out);
+    tx.vout.push_back(CTxOut(1 * COIN, CScript() << OP_TRUE));
+    return MakeTransactionRef(tx);
+}
+
+static void CheckPrefetch(int nThreads, size_t nStored)
+{
+    CCoinsViewDB db(1 << 20, true);
+
+    // Coins in the database
+    std::vector<COutPoint> vStored;
+    {
+        CCoinsViewCache cache(&db);
+        for (size_t i = 0; i < nStored; i++) {
+            COutPoint out(InsecureRand256(), InsecureRandRange(4));
+            cache.AddCoin(out, Coin(CTxOut(i + 1, CScript() << OP_TRUE), 1, false), false);
+            vStored.push_back(out);
+        }
+        cache.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(cache.Flush());
+    }
+
+    CCoinsViewCache cache(&db);
+
+    // One of the coins is cached already
+    cache.AccessCoin(vStored[0]);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 1U);
+
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vout.push_back(CTxOut(50 * COIN, CScript() << OP_TRUE));
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+
+    for (const COutPoint& out : vStored)
+        block.vtx.push_back(SpendTx({out}));
+
+    // Spends an output of the block itself, and a coin that doesn't exist
+    block.vtx.push_back(SpendTx({COutPoint(block.vtx[1]->GetHash(), 0), COutPoint(InsecureRand256(), 0)}));
+
+    CoinsPrefetcher prefetcher(nThreads);
+    BOOST_CHECK_EQUAL(prefetcher.GetThreadCount(), nThreads);
+
+    CoinsPrefetchStats stats = prefetcher.Prefetch(block, cache, db);
+    BOOST_CHECK_EQUAL(stats.nBlocks, 1U);
+    BOOST_CHECK_EQUAL(stats.nInputs, nStored + 2);
+    BOOST_CHECK_EQUAL(stats.nInBlock, 1U);
+    BOOST_CHECK_EQUAL(stats.nHits, 1U);
+    BOOST_CHECK_EQUAL(stats.nMisses, nStored);
+    BOOST_CHECK_EQUAL(stats.nNotFound, 1U);
+
+    // Every stored coin is cached with its value
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), nStored);
+    for (size_t i = 0; i < nStored; i++) {
+        BOOST_CHECK(cache.HaveCoinInCache(vStored[i]));
+        BOOST_CHECK_EQUAL(cache.AccessCoin(vStored[i]).out.nValue, (CAmount)i + 1);
+    }
+
+    // The second time every coin is a hit, and the stats add up
+    stats = prefetcher.Prefetch(block, cache, db);
+    BOOST_CHECK_EQUAL(stats.nHits, nStored);
+    BOOST_CHECK_EQUAL(stats.nMisses, 1U);
+
+    CoinsPrefetchStats total = prefetcher.GetStats();
+    BOOST_CHECK_EQUAL(total.nBlocks, 2U);
+    BOOST_CHECK_EQUAL(total.nInputs, 2 * (nStored + 2));
+    BOOST_CHECK_EQUAL(total.nHits, nStored + 1);
+    BOOST_CHECK_EQUAL(total.nMisses, nStored + 1);
+    BOOST_CHECK_EQUAL(total.nNotFound, 2U);
+
+    // The prefetched entries aren't modified, so nothing is written back
+    // and they can be uncached again
+    for (const COutPoint& out : vStored) {
+        cache.Uncache(out);
+        BOOST_CHECK(!cache.HaveCoinInCache(out));
+    }
+}
+
+BOOST_FIXTURE_TEST_SUITE(coinsprefetch_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(coinsprefetch_serial)
+{
+    CheckPrefetch(1, 100);
+}
+
+BOOST_AUTO_TEST_CASE(coinsprefetch_parallel)
+{
+    CheckPrefetch(4, 1000);
+
+    // Fewer coins than a batch are read by the calling thread only
+    CheckPrefetch(4, 3);
+}
+
+BOOST_AUTO_TEST_CASE(coinsprefetch_many_blocks)
+{
+    // Start and stop the workers while they may still be waking up
+    for (int i = 0; i < 50; i++)
+        CheckPrefetch(MAX_PREFETCH_THREADS, 200);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,183 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coins.h>
+#include <flatmap.h>
+#include <memusage.h>
+#include <random.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+// Hashes everything to a few values, so that long probe sequences, deleted
+// slots and wrapping around the end of the table are exercised
+struct CollidingHasher
+{
+    size_t operator()(uint32_t n) const { return (n % 7) * 0x9e3779b97f4a7c15ULL + 3; }
+};
+
+// Value with a heap allocation, so that leaks and double frees show up
+typedef std::shared_ptr<std::string> Value;
+
+static Value MakeValue(uint32_t n) { return std::make_shared<std::string>(std::to_string(n)); }
+
+template <typename Map>
+static void CheckEqual(const Map& map, const std::map<uint32_t, std::string>& model)
+{
+    BOOST_CHECK_EQUAL(map.size(), model.size());
+    size_t nCount = 0;
+    for (const auto& entry : map) {
+        auto it = model.find(entry.first);
+        BOOST_CHECK(it != model.end() && it->second == *entry.second);
+        nCount++;
+    }
+    BOOST_CHECK_EQUAL(nCount, model.size());
+    for (const auto& entry : model) {
+        auto it = map.find(entry.first);
+        BOOST_CHECK(it != map.end() && *it->second == entry.second);
+    }
+}
+
+template <typename Hash>
+static void RandomOperations(uint32_t nKeys, int nOps)
+{
+    flatmap<uint32_t, Value, Hash> map;
+    std::map<uint32_t, std::string> model;
+
+    for (int i = 0; i < nOps; i++) {
+        const uint32_t key = InsecureRandRange(nKeys);
+        switch (InsecureRandRange(6)) {
+        case 0:
+        case 1: {
+            auto ret = map.emplace(key, MakeValue(i));
+            BOOST_CHECK_EQUAL(ret.second, model.emplace(key, std::to_string(i)).second);
+            BOOST_CHECK_EQUAL(ret.first->first, key);
+            break;
+        }
+        case 2:
+            map[key] = MakeValue(i);
+            model[key] = std::to_string(i);
+            break;
+        case 3:
+            BOOST_CHECK_EQUAL(map.erase(key), model.erase(key));
+            break;
+        case 4: {
+            auto it = map.find(key);
+            BOOST_CHECK_EQUAL(it != map.end(), model.count(key) == 1);
+            if (it != map.end()) {
+                BOOST_CHECK_EQUAL(*it->second, model[key]);
+                map.erase(it);
+                model.erase(key);
+            }
+            break;
+        }
+        case 5:
+            BOOST_CHECK_EQUAL(map.count(key), model.count(key));
+            break;
+        }
+    }
+    CheckEqual(map, model);
+
+    // Erase every other entry while iterating
+    bool fErase = false;
+    for (auto it = map.begin(); it != map.end();) {
+        if (fErase) {
+            model.erase(it->first);
+            it = map.erase(it);
+        } else {
+            it++;
+        }
+        fErase = !fErase;
+    }
+    CheckEqual(map, model);
+
+    map.clear();
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.begin() == map.end());
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), 0U);
+}
+
+BOOST_FIXTURE_TEST_SUITE(flatmap_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(flatmap_random)
+{
+    RandomOperations<std::hash<uint32_t> >(100, 20000);
+    RandomOperations<std::hash<uint32_t> >(10000, 50000);
+    RandomOperations<CollidingHasher>(200, 20000);
+}
+
+BOOST_AUTO_TEST_CASE(flatmap_stable_references)
+{
+    flatmap<uint32_t, uint32_t> map;
+    std::vector<const uint32_t*> vRef;
+    for (uint32_t i = 0; i < 1000; i++)
+        vRef.push_back(&map.emplace(i, i).first->second);
+
+    // Growing the table doesn't move the entries
+    for (uint32_t i = 1000; i < 100000; i++)
+        map.emplace(i, i);
+    for (uint32_t i = 0; i < 1000; i++) {
+        BOOST_CHECK_EQUAL(vRef[i], &map.find(i)->second);
+        BOOST_CHECK_EQUAL(*vRef[i], i);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(flatmap_reuse_entries)
+{
+    flatmap<uint32_t, uint32_t> map;
+    for (uint32_t i = 0; i < 1000; i++)
+        map.emplace(i, i);
+    const size_t nUsage = memusage::DynamicUsage(map);
+
+    // Erased entries and deleted slots are reused, so the same number of
+    // entries never takes more memory
+    for (uint32_t i = 1000; i < 100000; i++) {
+        map.erase(i - 1000);
+        map.emplace(i, i);
+    }
+    BOOST_CHECK_EQUAL(map.size(), 1000U);
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), nUsage);
+}
+
+BOOST_AUTO_TEST_CASE(flatmap_coins)
+{
+    // The coins cache operations with the flat map
+    flatmap<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> map;
+    std::vector<COutPoint> vOutPoint;
+    for (int i = 0; i < 1000; i++) {
+        COutPoint outpoint(InsecureRand256(), InsecureRandRange(10));
+        Coin coin(CTxOut(i, CScript() << OP_TRUE), 1, false);
+        auto ret = map.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::forward_as_tuple(std::move(coin)));
+        BOOST_CHECK(ret.second);
+        ret.first->second.flags = CCoinsCacheEntry::DIRTY;
+        vOutPoint.push_back(outpoint);
+    }
+
+    for (int i = 0; i < 1000; i++) {
+        auto it = map.find(vOutPoint[i]);
+        BOOST_CHECK(it != map.end());
+        BOOST_CHECK_EQUAL(it->second.coin.out.nValue, i);
+    }
+
+    // Emplacing an existing outpoint leaves it as it is
+    auto ret = map.emplace(std::piecewise_construct, std::forward_as_tuple(vOutPoint[0]), std::tuple<>());
+    BOOST_CHECK(!ret.second);
+    BOOST_CHECK_EQUAL(ret.first->second.coin.out.nValue, 0);
+    BOOST_CHECK_EQUAL(ret.first->second.flags, CCoinsCacheEntry::DIRTY);
+
+    // Write out the way BatchWrite does
+    size_t nWritten = 0;
+    for (auto it = map.begin(); it != map.end(); it = map.erase(it))
+        nWritten++;
+    BOOST_CHECK_EQUAL(nWritten, 1000U);
+    BOOST_CHECK(map.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,381 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <mainchainrpc.h>
+#include <tinyformat.h>
+#include <util.h>
+#include <utiltime.h>
+
+#include <test/test_bitcoin.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+
+using boost::asio::ip::tcp;
+
+/**
+ * Mainchain RPC server on a local port that misbehaves on purpose. With
+ * fHang it reads requests and never replies. Otherwise it replies to the
+ * first request on each connection and keeps it open, then closes it when
+ * the next request arrives, without a reply.
+ */
+class FlakyMainchainServer
+{
+public:
+    explicit FlakyMainchainServer(bool fHangIn) : acceptor(io_service, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0)),
+        fHang(fHangIn), fStop(false), nRequests(0)
+    {
+        gArgs.ForceSetArg("-rpcuser", "test");
+        gArgs.ForceSetArg("-rpcpassword", "test");
+        gArgs.ForceSetArg("-mainchainrpcport", std::to_string(acceptor.local_endpoint().port()));
+
+        threadAccept = std::thread(&FlakyMainchainServer::ThreadAccept, this);
+    }
+
+    ~FlakyMainchainServer()
+    {
+        // Close our side so that the connection threads read EOF, then wake
+        // up the accept thread with a connection of our own
+        CloseMainchainRPCConnections();
+        fStop = true;
+        try {
+            tcp::socket socket(io_service);
+            socket.connect(acceptor.local_endpoint());
+        } catch (const boost::system::system_error&) {
+        }
+        threadAccept.join();
+        for (std::thread& thread : vThreadConn)
+            thread.join();
+
+        gArgs.ClearArg("-rpcuser");
+        gArgs.ClearArg("-rpcpassword");
+        gArgs.ClearArg("-mainchainrpcport");
+    }
+
+    int GetRequestCount() const { return nRequests; }
+
+private:
+    boost::asio::io_service io_service;
+    tcp::acceptor acceptor;
+    const bool fHang;
+    std::atomic<bool> fStop;
+    std::atomic<int> nRequests;
+    std::thread threadAccept;
+    std::vector<std::thread> vThreadConn;
+
+    void ThreadAccept()
+    {
+        while (true) {
+            std::shared_ptr<tcp::socket> socket = std::make_shared<tcp::socket>(io_service);
+            boost::system::error_code e;
+            acceptor.accept(*socket, e);
+            if (fStop || e)
+                return;
+            vThreadConn.emplace_back(&FlakyMainchainServer::ThreadConnection, this, socket);
+        }
+    }
+
+    void ThreadConnection(std::shared_ptr<tcp::socket> socket)
+    {
+        boost::asio::streambuf buf;
+        boost::system::error_code e;
+        for (int nRequest = 0; ; nRequest++) {
+            // Read the headers and then the body by its Content-Length
+            size_t nHeader = boost::asio::read_until(*socket, buf, "\r\n\r\n", e);
+            if (e)
+                return;
+            std::string strHeader(boost::asio::buffers_begin(buf.data()), boost::asio::buffers_begin(buf.data()) + nHeader);
+            buf.consume(nHeader);
+
+            size_t nLength = 0;
+            size_t nPos = strHeader.find("Content-Length: ");
+            if (nPos != std::string::npos)
+                nLength = atoi(strHeader.c_str() + nPos + 16);
+            if (buf.size() < nLength)
+                boost::asio::read(*socket, buf, boost::asio::transfer_exactly(nLength - buf.size()), e);
+            if (e)
+                return;
+            buf.consume(nLength);
+            nRequests++;
+
+            if (fHang)
+                continue;
+
+            if (nRequest > 0) {
+                socket->close(e);
+                return;
+            }
+
+            std::string strReply = "{\"result\":1,\"error\":null,\"id\":0}";
+            std::string strResponse = "HTTP/1.1 200 OK\r\nContent-Length: "
+                + std::to_string(strReply.size()) + "\r\n\r\n" + strReply;
+            boost::asio::write(*socket, boost::asio::buffer(strResponse), e);
+        }
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(mainchainrpc_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(mainchainrpc_content_length)
+{
+    std::string strResponse =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: application/json\r\n"
+        "Content-Length: 13\r\n"
+        "\r\n"
+        "{\"result\":1}\n";
+
+    MainchainHTTPResponse response;
+    BOOST_CHECK(response.Feed(strResponse.data(), strResponse.size()) == strResponse.size());
+    BOOST_CHECK(response.IsComplete());
+    BOOST_CHECK(!response.IsError());
+    BOOST_CHECK(response.GetStatus() == 200);
+    BOOST_CHECK(response.KeepAlive());
+    BOOST_CHECK(response.GetBody() == "{\"result\":1}\n");
+}
+
+BOOST_AUTO_TEST_CASE(mainchainrpc_pipelined_data)
+{
+    // Only the first response should be consumed
+    std::string strFirst = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nab";
+    std::string strSecond = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\ncd";
+    std::string strData = strFirst + strSecond;
+
+    MainchainHTTPResponse response;
+    size_t nUsed = response.Feed(strData.data(), strData.size());
+    BOOST_CHECK(nUsed == strFirst.size());
+    BOOST_CHECK(response.IsComplete());
+    BOOST_CHECK(response.GetBody() == "ab");
+
+    response.Reset();
+    BOOST_CHECK(!response.HaveData());
+    BOOST_CHECK(response.Feed(strData.data() + nUsed, strData.size() - nUsed) == strSecond.size());
+    BOOST_CHECK(response.IsComplete());
+    BOOST_CHECK(response.GetBody() == "cd");
+}
+
+BOOST_AUTO_TEST_CASE(mainchainrpc_chunked)
+{
+    std::string strResponse =
+        "HTTP/1.1 200 OK\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "\r\n"
+        "5\r\n"
+        "hello\r\n"
+        "7;ext=1\r\n"
+        ", world\r\n"
+        "0\r\n"
+        "X-Trailer: 1\r\n"
+        "\r\n";
+
+    MainchainHTTPResponse response;
+    BOOST_CHECK(response.Feed(strResponse.data(), strResponse.size()) == strResponse.size());
+    BOOST_CHECK(response.IsComplete());
+    BOOST_CHECK(response.GetStatus() == 200);
+    BOOST_CHECK(response.GetBody() == "hello, world");
+}
+
+BOOST_AUTO_TEST_CASE(mainchainrpc_chunk_sizes)
+{
+    // Chunk sizes with an even and an odd number of hex digits, in both cases
+    for (size_t nSize : {0x10, 0xff, 0xFa, 0x100, 0x1000, 0x12345}) {
+        for (bool fUpper : {false, true}) {
+            std::string strSize = strprintf(fUpper ? "%X" : "%x", nSize);
+            std::string strData(nSize, 'x');
+            std::string strResponse =
+                "HTTP/1.1 200 OK\r\n"
+                "Transfer-Encoding: chunked\r\n"
+                "\r\n" +
+                strSize + "\r\n" +
+                strData + "\r\n"
+                "00\r\n"
+                "\r\n";
+
+            MainchainHTTPResponse response;
+            BOOST_CHECK(response.Feed(strResponse.data(), strResponse.size()) == strResponse.size());
+            BOOST_CHECK(response.IsComplete());
+            BOOST_CHECK(!response.IsError());
+            BOOST_CHECK(response.GetBody() == strData);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(mainchainrpc_byte_by_byte)
+{
+    std::string strResponse =
+        "HTTP/1.1 200 OK\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "\r\n"
+        "a\r\n"
+        "0123456789\r\n"
+        "0\r\n"
+        "\r\n";
+
+    MainchainHTTPResponse response;
+    for (size_t i = 0; i < strResponse.size(); i++) {
+        BOOST_CHECK(!response.IsComplete());
+        BOOST_CHECK(response.Feed(&strResponse[i], 1) == 1);
+    }
+    BOOST_CHECK(response.IsComplete());
+    BOOST_CHECK(response.GetBody() == "0123456789");
+}
+
+BOOST_AUTO_TEST_CASE(mainchainrpc_body_until_close)
+{
+    std::string strResponse =
+        "HTTP/1.0 200 OK\r\n"
+        "\r\n"
+        "{\"result\":null}";
+
+    MainchainHTTPResponse response;
+    response.Feed(strResponse.data(), strResponse.size());
+    BOOST_CHECK(!response.IsComplete());
+
+    response.FeedEOF();
+    BOOST_CHECK(response.IsComplete());
+    BOOST_CHECK(!response.KeepAlive());
+    BOOST_CHECK(response.GetBody() == "{\"result\":null}");
+}
+
+BOOST_AUTO_TEST_CASE(mainchainrpc_keepalive)
+{
+    // HTTP/1.1 connections are persistent unless the server says otherwise
+    std::string strClose = "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+    MainchainHTTPResponse response;
+    response.Feed(strClose.data(), strClose.size());
+    BOOST_CHECK(response.IsComplete());
+    BOOST_CHECK(!response.KeepAlive());
+
+    // HTTP/1.0 connections are closed unless the server asks to keep them
+    std::string strKeepAlive = "HTTP/1.0 200 OK\r\nConnection: Keep-Alive\r\nContent-Length: 0\r\n\r\n";
+    response.Reset();
+    response.Feed(strKeepAlive.data(), strKeepAlive.size());
+    BOOST_CHECK(response.IsComplete());
+    BOOST_CHECK(response.KeepAlive());
+
+    std::string strDefault = "HTTP/1.0 200 OK\r\nContent-Length: 0\r\n\r\n";
+    response.Reset();
+    response.Feed(strDefault.data(), strDefault.size());
+    BOOST_CHECK(response.IsComplete());
+    BOOST_CHECK(!response.KeepAlive());
+}
+
+BOOST_AUTO_TEST_CASE(mainchainrpc_error_status)
+{
+    std::string strResponse = "HTTP/1.1 401 Unauthorized\r\nContent-Length: 0\r\n\r\n";
+
+    MainchainHTTPResponse response;
+    response.Feed(strResponse.data(), strResponse.size());
+    BOOST_CHECK(response.IsComplete());
+    BOOST_CHECK(response.GetStatus() == 401);
+}
+
+BOOST_AUTO_TEST_CASE(mainchainrpc_malformed)
+{
+    std::string strStatus = "SPAM/1.1 200 OK\r\n\r\n";
+    MainchainHTTPResponse response;
+    response.Feed(strStatus.data(), strStatus.size());
+    BOOST_CHECK(response.IsError());
+
+    std::string strChunk = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n";
+    response.Reset();
+    response.Feed(strChunk.data(), strChunk.size());
+    BOOST_CHECK(response.IsError());
+
+    strChunk = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n1g\r\n";
+    response.Reset();
+    response.Feed(strChunk.data(), strChunk.size());
+    BOOST_CHECK(response.IsError());
+
+    std::string strLength = "HTTP/1.1 200 OK\r\nContent-Length: -1\r\n\r\n";
+    response.Reset();
+    response.Feed(strLength.data(), strLength.size());
+    BOOST_CHECK(response.IsError());
+
+    // An incomplete response must not be accepted when the server hangs up
+    std::string strShort = "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nabc";
+    response.Reset();
+    response.Feed(strShort.data(), strShort.size());
+    response.FeedEOF();
+    BOOST_CHECK(!response.IsComplete());
+    BOOST_CHECK(response.IsError());
+}
+
+BOOST_AUTO_TEST_CASE(mainchainrpc_batch_reply)
+{
+    std::vector<UniValue> vResult(4);
+
+    // Replies are matched to calls by id, not by their position
+    std::string strBody =
+        "[{\"result\":\"c\",\"error\":null,\"id\":3},"
+        "{\"result\":null,\"error\":{\"code\":-1,\"message\":\"x\"},\"id\":2}]";
+    BOOST_CHECK(ParseMainchainRPCBatchReply(strBody, 2, 4, vResult));
+    BOOST_CHECK(vResult[2].isNull());
+    BOOST_CHECK(vResult[3].get_str() == "c");
+
+    strBody = "[{\"result\":1,\"error\":null,\"id\":1},{\"result\":0,\"error\":null,\"id\":0}]";
+    BOOST_CHECK(ParseMainchainRPCBatchReply(strBody, 0, 2, vResult));
+    BOOST_CHECK(vResult[0].get_int() == 0);
+    BOOST_CHECK(vResult[1].get_int() == 1);
+
+    // An id outside of the batch is rejected
+    strBody = "[{\"result\":1,\"error\":null,\"id\":2}]";
+    BOOST_CHECK(!ParseMainchainRPCBatchReply(strBody, 0, 2, vResult));
+
+    // So is a reply that is not a batch reply
+    strBody = "{\"result\":1,\"error\":null,\"id\":0}";
+    BOOST_CHECK(!ParseMainchainRPCBatchReply(strBody, 0, 2, vResult));
+}
+
+BOOST_AUTO_TEST_CASE(mainchainrpc_retry)
+{
+    FlakyMainchainServer server(false /* fHang */);
+    const std::string json = "{\"jsonrpc\":\"1.0\",\"id\":0,\"method\":\"getblockcount\",\"params\":[]}";
+    std::string strBody;
+
+    // The first request opens a connection that is kept for the next one
+    BOOST_CHECK(SendMainchainRPC(json, strBody, true /* fIdempotent */));
+    BOOST_CHECK_EQUAL(server.GetRequestCount(), 1);
+
+    // The server closes the connection without a reply, a request that is
+    // safe to run twice is sent again on a new connection
+    BOOST_CHECK(SendMainchainRPC(json, strBody, true /* fIdempotent */));
+    BOOST_CHECK_EQUAL(server.GetRequestCount(), 3);
+    BOOST_CHECK_EQUAL(GetMainchainRPCStats().nIdle, 1U);
+
+    // Other requests are not, the server may have run them already
+    BOOST_CHECK(!SendMainchainRPC(json, strBody, false /* fIdempotent */));
+    BOOST_CHECK_EQUAL(server.GetRequestCount(), 4);
+
+    // Without a connection to reuse they are sent once, as usual
+    BOOST_CHECK(SendMainchainRPC(json, strBody, false /* fIdempotent */));
+    BOOST_CHECK_EQUAL(server.GetRequestCount(), 5);
+}
+
+BOOST_AUTO_TEST_CASE(mainchainrpc_timeout)
+{
+    FlakyMainchainServer server(true /* fHang */);
+    gArgs.ForceSetArg("-mainchainrpctimeout", "1");
+    const std::string json = "{\"jsonrpc\":\"1.0\",\"id\":0,\"method\":\"getblockcount\",\"params\":[]}";
+    std::string strBody;
+
+    // A server that stops responding makes the request fail after the
+    // timeout, and the request isn't sent again
+    int64_t nTimeStart = GetTimeMillis();
+    BOOST_CHECK(!SendMainchainRPC(json, strBody, true /* fIdempotent */));
+    int64_t nElapsed = GetTimeMillis() - nTimeStart;
+    BOOST_CHECK(nElapsed >= 900 && nElapsed < 10000);
+    BOOST_CHECK_EQUAL(server.GetRequestCount(), 1);
+    BOOST_CHECK_EQUAL(GetMainchainRPCStats().nIdle, 0U);
+
+    gArgs.ClearArg("-mainchainrpctimeout");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
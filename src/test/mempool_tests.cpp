@@ -571,4 +571,62 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolSidechainIndexTest)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+
+    // Transactions that are a WT refund, a WT and neither
+    std::vector<CMutableTransaction> vTx(6);
+    for (size_t i = 0; i < vTx.size(); i++) {
+        vTx[i].vin.resize(1);
+        vTx[i].vin[0].prevout = COutPoint(GetRandHash(), 0);
+        vTx[i].vout.resize(1);
+        vTx[i].vout[0].nValue = (i + 1) * COIN;
+    }
+
+    std::vector<uint256> vWTID;
+    for (size_t i = 0; i < vTx.size(); i++) {
+        MemPoolSidechainInfo info;
+        if (i % 3 == 0) {
+            info.type = MemPoolSidechainType::WT_REFUND;
+            info.vchRefundSig = std::vector<unsigned char>(65, i);
+        } else if (i % 3 == 1) {
+            info.type = MemPoolSidechainType::WT;
+        }
+        if (info.type != MemPoolSidechainType::NONE)
+            info.wtID = GetRandHash();
+        vWTID.push_back(info.wtID);
+
+        pool.addUnchecked(vTx[i].GetHash(), entry.SidechainInfo(info).FromTx(vTx[i]));
+    }
+
+    BOOST_CHECK(pool.WTRefundExists(vWTID[0]));
+    BOOST_CHECK(pool.WTRefundExists(vWTID[3]));
+    BOOST_CHECK(!pool.WTRefundExists(vWTID[1]));
+    BOOST_CHECK(!pool.WTRefundExists(GetRandHash()));
+
+    auto vRefund = pool.GetSidechainTxs(MemPoolSidechainType::WT_REFUND);
+    BOOST_CHECK_EQUAL(vRefund.size(), 2);
+    for (const auto& tx : vRefund) {
+        size_t i = tx.first->GetHash() == vTx[0].GetHash() ? 0 : 3;
+        BOOST_CHECK(tx.first->GetHash() == vTx[i].GetHash());
+        BOOST_CHECK(tx.second.wtID == vWTID[i]);
+        BOOST_CHECK(tx.second.vchRefundSig == std::vector<unsigned char>(65, i));
+    }
+    BOOST_CHECK(vRefund.front().second.wtID < vRefund.back().second.wtID);
+
+    BOOST_CHECK_EQUAL(pool.GetSidechainTxs(MemPoolSidechainType::WT).size(), 2);
+
+    // Removing a refund removes it from the index
+    pool.removeRecursive(vTx[0]);
+    BOOST_CHECK(!pool.WTRefundExists(vWTID[0]));
+    BOOST_CHECK(pool.WTRefundExists(vWTID[3]));
+    BOOST_CHECK_EQUAL(pool.GetSidechainTxs(MemPoolSidechainType::WT_REFUND).size(), 1);
+
+    pool.clear();
+    BOOST_CHECK(!pool.WTRefundExists(vWTID[3]));
+    BOOST_CHECK(pool.GetSidechainTxs(MemPoolSidechainType::WT).empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -6,13 +6,18 @@
 #include "bmmcache.h"
 #include "base58.h"
 #include "chainparams.h"
+#include "consensus/merkle.h"
 #include "consensus/validation.h"
 #include "core_io.h"
+#include "depositpipeline.h"
+#include "mainchainrpc.h"
 #include "miner.h"
 #include "policy/policy.h"
+#include "policy/wtprime.h"
 #include "random.h"
 #include "script/sigcache.h"
 #include "sidechain.h"
+#include "txdb.h"
 #include "uint256.h"
 #include "util.h"
 #include "utilstrencodings.h"
@@ -20,8 +25,15 @@
 
 #include "test/test_bitcoin.h"
 
+#include <atomic>
+#include <set>
+#include <thread>
+
+#include <boost/asio.hpp>
 #include <boost/test/unit_test.hpp>
 
+#include <univalue.h>
+
 static CFeeRate blockMinFeeRate = CFeeRate(DEFAULT_BLOCK_MIN_TX_FEE);
 
 static BlockAssembler AssemblerForTest(const CChainParams& params) {
@@ -56,6 +68,70 @@ BOOST_AUTO_TEST_CASE(sidechain_obj)
     BOOST_CHECK(parsed);
 }
 
+BOOST_AUTO_TEST_CASE(sidechain_obj_index)
+{
+    SidechainWT wt;
+    wt.nSidechain = THIS_SIDECHAIN;
+    wt.strDestination = "";
+    wt.strRefundDestination = "";
+    wt.amount = 1 * COIN;
+    wt.mainchainFee = 1000;
+    wt.status = WT_UNSPENT;
+    wt.hashBlindWTX = InsecureRand256();
+
+    SidechainDeposit deposit;
+    deposit.nSidechain = THIS_SIDECHAIN;
+    deposit.strDest = "";
+    deposit.amtUserPayout = 1 * COIN;
+    deposit.nBurnIndex = 0;
+    deposit.nTx = 1;
+    deposit.hashMainchainBlock = InsecureRand256();
+
+    // Sidechain object header followed by garbage
+    CScript scriptInvalid = wt.GetScript();
+    scriptInvalid.resize(10);
+
+    CMutableTransaction mtx;
+    mtx.vout.resize(4);
+    mtx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    mtx.vout[1].scriptPubKey = wt.GetScript();
+    mtx.vout[2].scriptPubKey = deposit.GetScript();
+    mtx.vout[3].scriptPubKey = scriptInvalid;
+
+    SidechainObjIndex objs = ParseSidechainObjs(CTransaction(mtx));
+    BOOST_REQUIRE(objs.vObj.size() == 3);
+    BOOST_CHECK(objs.vWT.size() == 1 && objs.vDeposit.size() == 1 && objs.vWTPrime.empty());
+    BOOST_CHECK(objs.vWT[0].GetID() == wt.GetID());
+    BOOST_CHECK(objs.vDeposit[0] == deposit);
+    BOOST_CHECK(objs.Find(0, 0) == nullptr);
+    BOOST_REQUIRE(objs.Find(0, 2));
+    BOOST_CHECK(objs.Get(*objs.Find(0, 2)).sidechainop == DB_SIDECHAIN_DEPOSIT_OP);
+    BOOST_REQUIRE(objs.Find(0, 3));
+    BOOST_CHECK(!objs.Find(0, 3)->IsValid());
+
+    // Block objects are indexed by transaction and kept once stored
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(CMutableTransaction()));
+    block.vtx.push_back(MakeTransactionRef(mtx));
+    block.vtx.push_back(MakeTransactionRef(mtx));
+    block.hashMerkleRoot = InsecureRand256();
+
+    std::shared_ptr<const SidechainObjIndex> blockObjs = GetBlockSidechainObjs(block);
+    BOOST_CHECK(blockObjs->vObj.size() == 6);
+    BOOST_CHECK(blockObjs->GetTx(0).first == blockObjs->GetTx(0).second);
+    BOOST_CHECK(std::distance(blockObjs->GetTx(2).first, blockObjs->GetTx(2).second) == 3);
+    BOOST_CHECK(blockObjs->Find(2, 1)->nPos == 1);
+    BOOST_CHECK(GetBlockSidechainObjs(block) != blockObjs);
+
+    blockObjs = GetBlockSidechainObjs(block, true /* fStore */);
+    BOOST_CHECK(GetBlockSidechainObjs(block) == blockObjs);
+
+    // A changed merkle root means the stored objects are stale
+    block.vtx.pop_back();
+    block.hashMerkleRoot = InsecureRand256();
+    BOOST_CHECK(GetBlockSidechainObjs(block)->vObj.size() == 3);
+}
+
 BOOST_AUTO_TEST_CASE(sidechain_bmm_cache)
 {
     // Reject null block hash
@@ -285,6 +361,465 @@ BOOST_AUTO_TEST_CASE(sidechain_deposit_sort_deposits)
     BOOST_CHECK(vDepositSorted == vD);
 }
 
+/**
+ * Local stand-in for the mainchain RPC server, answering verifydeposit calls
+ * for the deposits in setTxid. Requests are answered one at a time, each on
+ * its own connection.
+ */
+class TestMainchainServer
+{
+public:
+    explicit TestMainchainServer(const std::set<uint256>& setTxidIn)
+        : setTxid(setTxidIn),
+          acceptor(io_service, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0)),
+          fStop(false), nRequests(0)
+    {
+        thread = std::thread(&TestMainchainServer::Serve, this);
+    }
+
+    ~TestMainchainServer()
+    {
+        // Wake up the accept call
+        fStop = true;
+        boost::system::error_code ec;
+        boost::asio::ip::tcp::socket socket(io_service);
+        socket.connect(acceptor.local_endpoint(), ec);
+        thread.join();
+    }
+
+    int GetPort() const { return acceptor.local_endpoint().port(); }
+
+    int GetRequestCount() const { return nRequests; }
+
+private:
+    void Serve()
+    {
+        while (!fStop) {
+            boost::system::error_code ec;
+            boost::asio::ip::tcp::socket socket(io_service);
+            acceptor.accept(socket, ec);
+            if (ec || fStop)
+                continue;
+
+            boost::asio::streambuf buf;
+            size_t nHeader = boost::asio::read_until(socket, buf, "\r\n\r\n", ec);
+            if (ec)
+                continue;
+
+            std::string strHeader(boost::asio::buffers_begin(buf.data()), boost::asio::buffers_begin(buf.data()) + nHeader);
+            buf.consume(nHeader);
+            size_t nPos = strHeader.find("Content-Length: ");
+            if (nPos == std::string::npos)
+                continue;
+
+            size_t nLength = atoi(strHeader.c_str() + nPos + 16);
+            if (buf.size() < nLength)
+                boost::asio::read(socket, buf, boost::asio::transfer_exactly(nLength - buf.size()), ec);
+            if (ec)
+                continue;
+
+            std::string strBody(boost::asio::buffers_begin(buf.data()), boost::asio::buffers_begin(buf.data()) + nLength);
+            UniValue batch;
+            if (!batch.read(strBody) || !batch.isArray())
+                continue;
+
+            UniValue reply(UniValue::VARR);
+            for (size_t i = 0; i < batch.size(); i++) {
+                const UniValue& params = find_value(batch[i], "params");
+                uint256 txid = uint256S(params[1].get_str());
+
+                UniValue obj(UniValue::VOBJ);
+                obj.pushKV("id", find_value(batch[i], "id"));
+                if (setTxid.count(txid)) {
+                    obj.pushKV("result", txid.ToString());
+                    obj.pushKV("error", NullUniValue);
+                } else {
+                    UniValue error(UniValue::VOBJ);
+                    error.pushKV("code", -1);
+                    error.pushKV("message", "Deposit not found");
+                    obj.pushKV("result", NullUniValue);
+                    obj.pushKV("error", error);
+                }
+                reply.push_back(obj);
+            }
+            nRequests++;
+
+            std::string strReply = reply.write();
+            std::string strResponse = "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: "
+                + std::to_string(strReply.size()) + "\r\n\r\n" + strReply;
+            boost::asio::write(socket, boost::asio::buffer(strResponse), ec);
+        }
+    }
+
+    const std::set<uint256> setTxid;
+    boost::asio::io_service io_service;
+    boost::asio::ip::tcp::acceptor acceptor;
+    std::atomic<bool> fStop;
+    std::atomic<int> nRequests;
+    std::thread thread;
+};
+
+BOOST_AUTO_TEST_CASE(sidechain_deposit_verify_parallel)
+{
+    // Deposits that were verified before are not sent to the mainchain again
+    std::vector<SidechainDeposit> vD = GetTestDeposits();
+    for (SidechainDeposit& d : vD)
+        d.hashMainchainBlock = GetRandHash();
+    for (const SidechainDeposit& d : vD)
+        bmmCache.CacheVerifiedDeposit(d.dtx->GetHash());
+
+    // Without a mainchain block hash a deposit can't be verified
+    vD[3].hashMainchainBlock.SetNull();
+
+    std::vector<bool> vVerified;
+    VerifyDepositsParallel(vD, vVerified);
+    BOOST_CHECK(vVerified.size() == vD.size());
+    for (size_t i = 0; i < vD.size(); i++)
+        BOOST_CHECK(vVerified[i] == (i != 3));
+
+    VerifyDepositsParallel(std::vector<SidechainDeposit>(), vVerified);
+    BOOST_CHECK(vVerified.empty());
+
+    // New deposits are verified in batches sent from several threads, the
+    // mainchain knows about every other one
+    std::vector<SidechainDeposit> vNew;
+    std::set<uint256> setKnown;
+    for (size_t i = 0; i < DEPOSIT_VERIFY_BATCH_SIZE * (DEPOSIT_VERIFY_THREADS + 1) + 1; i++) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(1);
+        mtx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        mtx.vout.resize(1);
+        mtx.vout[0].nValue = 1 * COIN;
+        mtx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+
+        SidechainDeposit d;
+        d.nSidechain = THIS_SIDECHAIN;
+        d.dtx = MakeTransactionRef(mtx);
+        d.nBurnIndex = 0;
+        d.nTx = 1;
+        d.hashMainchainBlock = GetRandHash();
+        vNew.push_back(d);
+
+        if (i % 2 == 0)
+            setKnown.insert(d.dtx->GetHash());
+    }
+
+    // The cached deposits from before are mixed in and not sent again
+    std::vector<SidechainDeposit> vAll = vNew;
+    vAll.insert(vAll.end(), vD.begin(), vD.end());
+
+    {
+        TestMainchainServer server(setKnown);
+        gArgs.ForceSetArg("-rpcuser", "user");
+        gArgs.ForceSetArg("-rpcpassword", "password");
+        gArgs.ForceSetArg("-mainchainrpcport", std::to_string(server.GetPort()));
+
+        VerifyDepositsParallel(vAll, vVerified);
+        BOOST_CHECK(vVerified.size() == vAll.size());
+        for (size_t i = 0; i < vNew.size(); i++) {
+            BOOST_CHECK(vVerified[i] == (i % 2 == 0));
+            BOOST_CHECK(bmmCache.HaveVerifiedDeposit(vNew[i].dtx->GetHash()) == (i % 2 == 0));
+        }
+        for (size_t i = 0; i < vD.size(); i++)
+            BOOST_CHECK(vVerified[vNew.size() + i] == (i != 3));
+
+        const int nBatches = (vNew.size() + DEPOSIT_VERIFY_BATCH_SIZE - 1) / DEPOSIT_VERIFY_BATCH_SIZE;
+        BOOST_CHECK_EQUAL(server.GetRequestCount(), nBatches);
+
+        // Only the deposits the mainchain didn't know about are sent again
+        VerifyDepositsParallel(vAll, vVerified);
+        for (size_t i = 0; i < vNew.size(); i++)
+            BOOST_CHECK(vVerified[i] == (i % 2 == 0));
+        BOOST_CHECK_EQUAL(server.GetRequestCount(), nBatches + (int)((vNew.size() / 2 + DEPOSIT_VERIFY_BATCH_SIZE - 1) / DEPOSIT_VERIFY_BATCH_SIZE));
+
+        CloseMainchainRPCConnections();
+        gArgs.ClearArg("-rpcuser");
+        gArgs.ClearArg("-rpcpassword");
+        gArgs.ClearArg("-mainchainrpcport");
+    }
+
+    // Don't leave the deposits verified for the other tests
+    bmmCache.ClearVerifiedCache();
+}
+
+BOOST_AUTO_TEST_CASE(sidechain_wt_status_index)
+{
+    CSidechainTreeDB db(1 << 20, true /* fMemory */);
+    BOOST_CHECK(db.ReindexWTStatus());
+    CSidechainTreeCache cache(&db);
+
+    // Write WT(s) with random fees to this sidechain and to another one
+    std::vector<SidechainWT> vWT;
+    for (int i = 0; i < 20; i++) {
+        SidechainWT wt;
+        wt.nSidechain = i % 4 ? THIS_SIDECHAIN : THIS_SIDECHAIN + 1;
+        wt.strDestination = "";
+        wt.strRefundDestination = "";
+        wt.amount = 1 * COIN;
+        wt.mainchainFee = InsecureRandRange(10000);
+        wt.status = WT_UNSPENT;
+        wt.hashBlindWTX = InsecureRand256();
+        vWT.push_back(wt);
+    }
+    std::vector<std::pair<uint256, const SidechainObj *> > vIndex;
+    for (const SidechainWT& wt : vWT)
+        vIndex.push_back(std::make_pair(wt.GetID(), &wt));
+    uint64_t nGeneration = cache.GetGeneration();
+    BOOST_CHECK(cache.WriteSidechainIndex(vIndex));
+    BOOST_CHECK(cache.GetGeneration() != nGeneration);
+
+    // The WT(s) are only in the cache until it is flushed
+    BOOST_CHECK(cache.GetCacheSize() == 20);
+    BOOST_CHECK(cache.DynamicMemoryUsage() > 0);
+    BOOST_CHECK(cache.GetWTs(THIS_SIDECHAIN).size() == 15);
+    BOOST_CHECK(db.GetWTs(THIS_SIDECHAIN).empty());
+    nGeneration = cache.GetGeneration();
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(cache.GetCacheSize() == 0);
+    BOOST_CHECK(cache.GetGeneration() == nGeneration);
+
+    // Only this sidechain's WT(s) are returned
+    std::vector<SidechainWT> vOurs = db.GetWTs(THIS_SIDECHAIN);
+    BOOST_CHECK(vOurs.size() == 15);
+    BOOST_CHECK(db.GetWTs(THIS_SIDECHAIN + 1).size() == 5);
+
+    // Unspent WT(s) are returned highest fee first, and bounded
+    SortWTByFee(vOurs);
+    std::vector<SidechainWT> vUnspent = db.GetWTsByStatus(THIS_SIDECHAIN, WT_UNSPENT);
+    BOOST_REQUIRE(vUnspent.size() == 15);
+    for (size_t i = 0; i < vUnspent.size(); i++)
+        BOOST_CHECK(vUnspent[i].mainchainFee == vOurs[i].mainchainFee);
+    std::vector<SidechainWT> vTop = db.GetWTsByStatus(THIS_SIDECHAIN, WT_UNSPENT, 3);
+    BOOST_REQUIRE(vTop.size() == 3);
+    BOOST_CHECK(vTop[2].mainchainFee == vOurs[2].mainchainFee);
+
+    // Status updates move WT(s) between index ranges, both while they are
+    // cached and after they have been flushed
+    std::vector<SidechainWT> vUpdate(vTop.begin(), vTop.begin() + 2);
+    for (SidechainWT& wt : vUpdate)
+        wt.status = WT_IN_WTPRIME;
+    BOOST_CHECK(cache.WriteWTUpdate(vUpdate));
+    BOOST_CHECK(cache.GetGeneration() != nGeneration);
+    for (int i = 0; i < 2; i++) {
+        BOOST_CHECK(cache.GetWTsByStatus(THIS_SIDECHAIN, WT_UNSPENT).size() == 13);
+        BOOST_CHECK(cache.GetWTsByStatus(THIS_SIDECHAIN, WT_UNSPENT, 1)[0].GetID() == vTop[2].GetID());
+        std::vector<SidechainWT> vInWTPrime = cache.GetWTsByStatus(THIS_SIDECHAIN, WT_IN_WTPRIME);
+        BOOST_REQUIRE(vInWTPrime.size() == 2);
+        BOOST_CHECK(vInWTPrime[0].GetID() == vTop[0].GetID());
+        BOOST_CHECK(cache.GetWTsByStatus(THIS_SIDECHAIN, WT_SPENT).empty());
+        BOOST_CHECK(cache.GetWTs(THIS_SIDECHAIN).size() == 15);
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(db.GetWTsByStatus(THIS_SIDECHAIN, WT_IN_WTPRIME).size() == 2);
+}
+
+BOOST_AUTO_TEST_CASE(sidechain_wt_fee_ties)
+{
+    CSidechainTreeDB db(1 << 20, true /* fMemory */);
+    BOOST_CHECK(db.ReindexWTStatus());
+    CSidechainTreeCache cache(&db);
+
+    // WT(s) with only a few different fees, so most of them are tied
+    std::vector<SidechainWT> vWT;
+    for (int i = 0; i < 30; i++) {
+        SidechainWT wt;
+        wt.nSidechain = THIS_SIDECHAIN;
+        wt.strDestination = "";
+        wt.strRefundDestination = "";
+        wt.amount = 1 * COIN;
+        wt.mainchainFee = InsecureRandRange(3) * 1000;
+        wt.status = WT_UNSPENT;
+        wt.hashBlindWTX = InsecureRand256();
+        vWT.push_back(wt);
+    }
+    std::vector<std::pair<uint256, const SidechainObj *> > vIndex;
+    for (const SidechainWT& wt : vWT)
+        vIndex.push_back(std::make_pair(wt.GetID(), &wt));
+    BOOST_CHECK(cache.WriteSidechainIndex(vIndex));
+
+    // Sorting by fee breaks ties by ID, in whatever order the WT(s) start
+    std::vector<SidechainWT> vSorted = vWT;
+    SortWTByFee(vSorted);
+    std::vector<SidechainWT> vReversed(vWT.rbegin(), vWT.rend());
+    SortWTByFee(vReversed);
+    for (size_t i = 0; i < vSorted.size(); i++) {
+        BOOST_CHECK(vSorted[i].GetID() == vReversed[i].GetID());
+        if (i > 0 && vSorted[i].mainchainFee == vSorted[i - 1].mainchainFee)
+            BOOST_CHECK(vSorted[i - 1].GetID() < vSorted[i].GetID());
+    }
+
+    // The WT status index returns the same order, both from the cache and
+    // from the database
+    for (int i = 0; i < 2; i++) {
+        std::vector<SidechainWT> vUnspent = cache.GetWTsByStatus(THIS_SIDECHAIN, WT_UNSPENT);
+        BOOST_REQUIRE(vUnspent.size() == vSorted.size());
+        for (size_t j = 0; j < vSorted.size(); j++)
+            BOOST_CHECK(vUnspent[j].GetID() == vSorted[j].GetID());
+        BOOST_CHECK(cache.Flush());
+    }
+    std::vector<SidechainWT> vUnspent = db.GetWTsByStatus(THIS_SIDECHAIN, WT_UNSPENT);
+    BOOST_REQUIRE(vUnspent.size() == vSorted.size());
+    for (size_t i = 0; i < vSorted.size(); i++)
+        BOOST_CHECK(vUnspent[i].GetID() == vSorted[i].GetID());
+}
+
+// Coins view that stops the node while its coins are being written
+class CCoinsViewCrash : public CCoinsView
+{
+public:
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override
+    {
+        throw std::runtime_error("crash while writing coins");
+    }
+};
+
+BOOST_AUTO_TEST_CASE(sidechain_flush_order)
+{
+    CSidechainTreeDB db(1 << 20, true /* fMemory */);
+    CSidechainTreeCache cache(&db);
+
+    SidechainWT wt;
+    wt.nSidechain = THIS_SIDECHAIN;
+    wt.strDestination = "";
+    wt.strRefundDestination = "";
+    wt.amount = 1 * COIN;
+    wt.mainchainFee = 1000;
+    wt.status = WT_UNSPENT;
+    wt.hashBlindWTX = InsecureRand256();
+    std::vector<std::pair<uint256, const SidechainObj *> > vIndex;
+    vIndex.push_back(std::make_pair(wt.GetID(), &wt));
+    BOOST_CHECK(cache.WriteSidechainIndex(vIndex));
+
+    // The block's coins are written after its sidechain objects, so when the
+    // coins write is interrupted the objects are on disk already
+    CCoinsViewCrash viewCrash;
+    CCoinsViewCache coins(&viewCrash);
+    coins.AddCoin(COutPoint(InsecureRand256(), 0), Coin(CTxOut(1 * COIN, CScript() << OP_TRUE), 1, false), false);
+    coins.SetBestBlock(InsecureRand256());
+    BOOST_CHECK_THROW(FlushChainstateCaches(coins, cache), std::runtime_error);
+
+    CSidechainTreeCache cacheRestart(&db);
+    SidechainWT wtRead;
+    BOOST_CHECK(cacheRestart.GetWT(wt.GetID(), wtRead));
+    BOOST_CHECK(wtRead.GetID() == wt.GetID());
+    BOOST_CHECK(db.GetWTs(THIS_SIDECHAIN).size() == 1);
+}
+
+BOOST_AUTO_TEST_CASE(sidechain_wtprime_builder)
+{
+    std::vector<SidechainWT> vWT;
+    for (int i = 0; i < 200; i++) {
+        SidechainWT wt;
+        wt.nSidechain = THIS_SIDECHAIN;
+        wt.strDestination = "1BvBMSEYstWetqTFn5Au4m4GFg7xJaNVN2";
+        wt.strRefundDestination = "";
+        wt.amount = 1 * COIN;
+        wt.mainchainFee = InsecureRandRange(10000);
+        wt.status = WT_UNSPENT;
+        wt.hashBlindWTX = InsecureRand256();
+        vWT.push_back(wt);
+    }
+
+    // The tracked weight matches the weight of the serialized WT^ as outputs
+    // are added and removed
+    WTPrimeBuilder builder;
+    BOOST_CHECK(builder.GetWeight() == GetTransactionWeight(builder.GetTx()));
+    CAmount amountFees = 0;
+    for (const SidechainWT& wt : vWT) {
+        BOOST_REQUIRE(builder.AddWT(wt, wt.GetID()));
+        BOOST_CHECK(builder.GetWeight() == GetTransactionWeight(builder.GetTx()));
+        amountFees += wt.mainchainFee;
+    }
+    BOOST_CHECK(builder.GetMainchainFees() == amountFees);
+    BOOST_CHECK(builder.GetTx().vout.size() == vWT.size() + 2);
+    BOOST_CHECK(builder.GetTx().vout[2].scriptPubKey == vWT[0].GetDestinationScript());
+    BOOST_CHECK(!vWT[0].GetDestinationScript().empty());
+
+    builder.Truncate(10);
+    BOOST_CHECK(builder.GetWTIDs().size() == 10);
+    BOOST_CHECK(builder.GetWTIDs()[9] == vWT[9].GetID());
+    BOOST_CHECK(builder.GetWeight() == GetTransactionWeight(builder.GetTx()));
+
+    // Outputs stop being added at the weight limit
+    SidechainWT wt = vWT[0];
+    while (builder.AddWT(wt, wt.GetID())) { }
+    BOOST_CHECK(builder.GetWeight() <= MAX_WTPRIME_WEIGHT);
+    BOOST_CHECK(builder.GetWeight() == GetTransactionWeight(builder.GetTx()));
+
+    builder.Clear();
+    BOOST_CHECK(builder.GetWTIDs().empty());
+    BOOST_CHECK(builder.GetMainchainFees() == 0);
+    BOOST_CHECK(builder.GetWeight() == GetTransactionWeight(builder.GetTx()));
+}
+
+BOOST_AUTO_TEST_CASE(sidechain_wtprime_candidate)
+{
+    std::vector<SidechainWT> vWT;
+    for (int i = 0; i < 20; i++) {
+        SidechainWT wt;
+        wt.nSidechain = THIS_SIDECHAIN;
+        wt.strDestination = "1BvBMSEYstWetqTFn5Au4m4GFg7xJaNVN2";
+        wt.strRefundDestination = "";
+        wt.amount = 1 * COIN;
+        wt.mainchainFee = InsecureRandRange(10000);
+        wt.status = WT_UNSPENT;
+        wt.hashBlindWTX = InsecureRand256();
+        vWT.push_back(wt);
+    }
+
+    LOCK(cs_main);
+
+    std::vector<std::pair<uint256, const SidechainObj *> > vIndex;
+    for (const SidechainWT& wt : vWT)
+        vIndex.push_back(std::make_pair(wt.GetID(), &wt));
+    BOOST_CHECK(psidechaintree->WriteSidechainIndex(vIndex));
+
+    const int nHeight = chainActive.Height() + 1;
+
+    // The miner creates the WT^, and block validation replicates it from the
+    // same candidate without building it again
+    CTransactionRef wtPrimeMiner;
+    CTransactionRef wtPrimeDataMiner;
+    BOOST_REQUIRE(CreateWTPrimeTx(nHeight, wtPrimeMiner, wtPrimeDataMiner, false /* fReplicationCheck */,
+                true /* fCheckUnique */));
+    BOOST_CHECK(wtPrimeMiner->vout.size() == vWT.size() + 2);
+
+    CTransactionRef wtPrimeValidation;
+    CTransactionRef wtPrimeDataValidation;
+    BOOST_REQUIRE(CreateWTPrimeTx(nHeight, wtPrimeValidation, wtPrimeDataValidation, true /* fReplicationCheck */));
+    BOOST_CHECK(wtPrimeValidation == wtPrimeMiner);
+    BOOST_CHECK(wtPrimeDataValidation == wtPrimeDataMiner);
+
+    // A new WT with the highest fee changes the WT set, so a new WT^ is
+    // created with its output first
+    SidechainWT wtNew = vWT[0];
+    wtNew.mainchainFee = 20000;
+    wtNew.hashBlindWTX = InsecureRand256();
+    vIndex.clear();
+    vIndex.push_back(std::make_pair(wtNew.GetID(), &wtNew));
+    BOOST_CHECK(psidechaintree->WriteSidechainIndex(vIndex));
+
+    CTransactionRef wtPrimeNew;
+    CTransactionRef wtPrimeDataNew;
+    BOOST_REQUIRE(CreateWTPrimeTx(nHeight, wtPrimeNew, wtPrimeDataNew, true /* fReplicationCheck */));
+    BOOST_CHECK(wtPrimeNew != wtPrimeMiner);
+    BOOST_CHECK(wtPrimeNew->GetHash() != wtPrimeMiner->GetHash());
+    BOOST_CHECK(wtPrimeNew->vout.size() == vWT.size() + 3);
+    BOOST_CHECK(wtPrimeNew->vout[2].nValue == wtNew.amount - wtNew.mainchainFee);
+
+    // Once the new WT isn't unspent anymore the WT^ is created again, the
+    // same as before
+    wtNew.status = WT_IN_WTPRIME;
+    BOOST_CHECK(psidechaintree->WriteWTUpdate(std::vector<SidechainWT>{wtNew}));
+
+    CTransactionRef wtPrimeUpdated;
+    CTransactionRef wtPrimeDataUpdated;
+    BOOST_REQUIRE(CreateWTPrimeTx(nHeight, wtPrimeUpdated, wtPrimeDataUpdated, true /* fReplicationCheck */));
+    BOOST_CHECK(wtPrimeUpdated != wtPrimeNew);
+    BOOST_CHECK(wtPrimeUpdated != wtPrimeMiner);
+    BOOST_CHECK(wtPrimeUpdated->GetHash() == wtPrimeMiner->GetHash());
+}
+
 BOOST_AUTO_TEST_CASE(IsWTPrimeFailCommit)
 {
     uint256 hashWTPrime = GetRandHash();
@@ -436,6 +971,99 @@ BOOST_AUTO_TEST_CASE(IsPrevBlockCommit)
     BOOST_CHECK(h2 == hashPrevSide);
 }
 
+// Check that block is original with its prev block commit pointed at
+// hashPrevMain and its merkle root recomputed
+static void CheckUpdatedPrevBlockCommit(const CBlock& block, const CBlock& original, const uint256& hashPrevMain)
+{
+    bool fMutated = false;
+    BOOST_CHECK(block.hashMerkleRoot == BlockMerkleRoot(block, &fMutated));
+    BOOST_CHECK(!fMutated);
+    BOOST_CHECK(block.hashMerkleRoot != original.hashMerkleRoot);
+
+    // Only the commit output of the coinbase changed
+    BOOST_REQUIRE(block.vtx.size() == original.vtx.size());
+    for (size_t i = 1; i < block.vtx.size(); i++)
+        BOOST_CHECK(block.vtx[i]->GetHash() == original.vtx[i]->GetHash());
+    BOOST_REQUIRE(block.vtx[0]->vout.size() == original.vtx[0]->vout.size());
+    size_t nCommit = 0;
+    for (size_t i = 0; i < block.vtx[0]->vout.size(); i++) {
+        const CScript& script = block.vtx[0]->vout[i].scriptPubKey;
+        const CScript& scriptOriginal = original.vtx[0]->vout[i].scriptPubKey;
+        uint256 hashMain;
+        uint256 hashSide;
+        uint256 hashMainOriginal;
+        uint256 hashSideOriginal;
+        if (scriptOriginal.IsPrevBlockCommit(hashMainOriginal, hashSideOriginal)) {
+            BOOST_CHECK(script.IsPrevBlockCommit(hashMain, hashSide));
+            BOOST_CHECK(hashMain == hashPrevMain);
+            BOOST_CHECK(hashSide == hashSideOriginal);
+            nCommit++;
+        } else {
+            BOOST_CHECK(script == scriptOriginal);
+        }
+        BOOST_CHECK(block.vtx[0]->vout[i].nValue == original.vtx[0]->vout[i].nValue);
+    }
+    BOOST_CHECK(nCommit == 1);
+}
+
+BOOST_AUTO_TEST_CASE(update_prev_block_commit)
+{
+    const uint256 hashPrevSide = GetRandHash();
+
+    // A block with the commit between other coinbase outputs, and a few
+    // transactions so that the merkle root isn't just the coinbase
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << 101 << OP_0;
+    coinbase.vout.push_back(CTxOut(50 * CENT, CScript() << OP_TRUE));
+    coinbase.vout.push_back(CTxOut(0, GeneratePrevBlockCommit(GetRandHash(), hashPrevSide)));
+    coinbase.vout.push_back(CTxOut(0, CScript() << OP_RETURN << ToByteVector(GetRandHash())));
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    for (int i = 0; i < 4; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        tx.vout.push_back(CTxOut(1 * CENT, CScript() << OP_TRUE));
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+
+    // The commit is pointed at the new mainchain tip
+    const CBlock original = block;
+    const uint256 hashMainTip = GetRandHash();
+    BOOST_CHECK(UpdatePrevBlockCommit(block, hashMainTip));
+    CheckUpdatedPrevBlockCommit(block, original, hashMainTip);
+
+    // Updating to the same mainchain tip again changes nothing
+    const CBlock updated = block;
+    BOOST_CHECK(UpdatePrevBlockCommit(block, hashMainTip));
+    BOOST_CHECK(block.hashMerkleRoot == updated.hashMerkleRoot);
+    BOOST_CHECK(block.vtx[0]->GetHash() == updated.vtx[0]->GetHash());
+
+    // Blocks without a commit are left alone
+    CBlock blockNoCommit = original;
+    CMutableTransaction coinbaseNoCommit(*original.vtx[0]);
+    coinbaseNoCommit.vout.erase(coinbaseNoCommit.vout.begin() + 1);
+    blockNoCommit.vtx[0] = MakeTransactionRef(coinbaseNoCommit);
+    blockNoCommit.hashMerkleRoot = BlockMerkleRoot(blockNoCommit);
+    const uint256 hashMerkleRootNoCommit = blockNoCommit.hashMerkleRoot;
+    BOOST_CHECK(!UpdatePrevBlockCommit(blockNoCommit, hashMainTip));
+    BOOST_CHECK(blockNoCommit.hashMerkleRoot == hashMerkleRootNoCommit);
+    CBlock blockEmpty;
+    BOOST_CHECK(!UpdatePrevBlockCommit(blockEmpty, hashMainTip));
+
+    // A block built ahead of time the way the BMM engine does it
+    CBlock blockNext;
+    std::string strError;
+    BOOST_REQUIRE(BlockAssembler(Params()).GenerateBMMBlock(blockNext, strError, nullptr, std::vector<CMutableTransaction>(), uint256(), CScript() << OP_TRUE));
+    const CBlock originalNext = blockNext;
+    BOOST_CHECK(UpdatePrevBlockCommit(blockNext, hashMainTip));
+    CheckUpdatedPrevBlockCommit(blockNext, originalNext, hashMainTip);
+}
+
 BOOST_AUTO_TEST_CASE(wt_refund_script_invalid_address)
 {
     // Test a WT refund script with invalid address / signature
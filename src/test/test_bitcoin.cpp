@@ -80,7 +80,8 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
         mempool.setSanityCheck(1.0);
         pblocktree.reset(new CBlockTreeDB(1 << 20, true));
         pcoinsdbview.reset(new CCoinsViewDB(1 << 23, true));
-        psidechaintree.reset(new CSidechainTreeDB(1 << 20, true));
+        psidechaintreedb.reset(new CSidechainTreeDB(1 << 20, true));
+        psidechaintree.reset(new CSidechainTreeCache(psidechaintreedb.get()));
         pcoinsTip.reset(new CCoinsViewCache(pcoinsdbview.get()));
         if (!LoadGenesisBlock(chainparams)) {
             throw std::runtime_error("LoadGenesisBlock failed.");
@@ -112,6 +113,7 @@ TestingSetup::~TestingSetup()
         pcoinsdbview.reset();
         pblocktree.reset();
         psidechaintree.reset();
+        psidechaintreedb.reset();
         fs::remove_all(pathTemp);
 }
 
@@ -196,7 +198,7 @@ CTxMemPoolEntry TestMemPoolEntryHelper::FromTx(const CMutableTransaction &tx) {
 
 CTxMemPoolEntry TestMemPoolEntryHelper::FromTx(const CTransaction &txn) {
     return CTxMemPoolEntry(MakeTransactionRef(txn), nFee, nTime, nHeight,
-                           spendsCoinbase, fWTRefund, wtID, sigOpCost, lp);
+                           spendsCoinbase, sidechainInfo, sigOpCost, lp);
 }
 
 /**
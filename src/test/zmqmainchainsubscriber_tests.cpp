@@ -0,0 +1,154 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <zmq/zmqmainchainsubscriber.h>
+
+#include <bmmcache.h>
+#include <crypto/common.h>
+#include <primitives/block.h>
+#include <random.h>
+#include <streams.h>
+#include <validation.h>
+#include <version.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+// Mainchain block with only a coinbase, built on hashPrevBlock
+static CMainchainBlock MainchainBlock(const uint256& hashPrevBlock)
+{
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << InsecureRand32();
+    coinbase.vout.push_back(CTxOut(50 * COIN, CScript() << OP_TRUE));
+
+    CMainchainBlock block;
+    block.nVersion = 0x20000000;
+    block.hashPrevBlock = hashPrevBlock;
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    block.hashMerkleRoot = block.vtx[0]->GetHash();
+    block.nTime = 1;
+    block.nBits = 0x207fffff;
+    return block;
+}
+
+// Parts of the rawblock notification the mainchain sends for block
+static std::vector<std::string> RawBlockMessage(const CMainchainBlock& block, uint32_t nSequence)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block;
+
+    unsigned char sequence[4];
+    WriteLE32(sequence, nSequence);
+
+    std::vector<std::string> vPart;
+    vPart.push_back("rawblock");
+    vPart.push_back(std::string(ss.begin(), ss.end()));
+    vPart.push_back(std::string((const char*)sequence, sizeof(sequence)));
+    return vPart;
+}
+
+BOOST_FIXTURE_TEST_SUITE(zmqmainchainsubscriber_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(zmqmainchainsubscriber_rawblock)
+{
+    bmmCache.ResetMainBlockCache();
+
+    // Cache a short mainchain. There is no mainchain to poll, so blocks that
+    // don't connect to the cache leave it as it is.
+    std::deque<uint256> deqHash;
+    uint256 hashTip;
+    for (int i = 0; i < 10; i++) {
+        hashTip = MainchainBlock(hashTip).GetHash();
+        deqHash.push_back(hashTip);
+    }
+    bool fReorg = false;
+    std::vector<uint256> vOrphan;
+    BOOST_REQUIRE(bmmCache.UpdateMainBlockCache(deqHash, fReorg, vOrphan));
+    BOOST_REQUIRE(bmmCache.GetLastMainBlockHash() == hashTip);
+
+    // Not connected, messages are passed to it directly
+    CZMQMainchainSubscriber subscriber("tcp://127.0.0.1:28332");
+    uint32_t nSequence = 0;
+
+    // New blocks in order connect to the cache
+    CMainchainBlock block;
+    for (int i = 0; i < 3; i++) {
+        block = MainchainBlock(hashTip);
+        BOOST_CHECK(subscriber.HandleMessage(RawBlockMessage(block, nSequence++)));
+        hashTip = block.GetHash();
+        BOOST_CHECK(bmmCache.GetLastMainBlockHash() == hashTip);
+        BOOST_CHECK(IsMainchainTipTracked());
+    }
+    BOOST_CHECK_EQUAL(bmmCache.GetCachedBlockCount(), 13);
+
+    // A duplicate notification for the tip leaves the cache as it is
+    BOOST_CHECK(subscriber.HandleMessage(RawBlockMessage(block, nSequence++)));
+    BOOST_CHECK(bmmCache.GetLastMainBlockHash() == hashTip);
+    BOOST_CHECK_EQUAL(bmmCache.GetCachedBlockCount(), 13);
+    BOOST_CHECK(IsMainchainTipTracked());
+
+    // Malformed messages are ignored, without touching the cache or the
+    // sequence number that is expected next
+    CMainchainBlock blockNext = MainchainBlock(hashTip);
+    std::vector<std::string> vPart = RawBlockMessage(blockNext, nSequence);
+    vPart.pop_back();
+    BOOST_CHECK(!subscriber.HandleMessage(vPart));
+
+    vPart = RawBlockMessage(blockNext, nSequence);
+    vPart[0] = "hashblock";
+    BOOST_CHECK(!subscriber.HandleMessage(vPart));
+
+    vPart = RawBlockMessage(blockNext, nSequence);
+    vPart[2].resize(3);
+    BOOST_CHECK(!subscriber.HandleMessage(vPart));
+
+    vPart = RawBlockMessage(blockNext, nSequence);
+    vPart[1].resize(79);
+    BOOST_CHECK(!subscriber.HandleMessage(vPart));
+
+    BOOST_CHECK(!subscriber.HandleMessage(std::vector<std::string>()));
+
+    BOOST_CHECK(bmmCache.GetLastMainBlockHash() == hashTip);
+    BOOST_CHECK(IsMainchainTipTracked());
+
+    BOOST_CHECK(subscriber.HandleMessage(RawBlockMessage(blockNext, nSequence++)));
+    hashTip = blockNext.GetHash();
+    BOOST_CHECK(bmmCache.GetLastMainBlockHash() == hashTip);
+    BOOST_CHECK(IsMainchainTipTracked());
+
+    // Two blocks arrive out of order. The child doesn't connect and the
+    // parent comes after a gap in the sequence, so neither is connected and
+    // the cache would have to be synced by polling the mainchain.
+    CMainchainBlock blockParent = MainchainBlock(hashTip);
+    CMainchainBlock blockChild = MainchainBlock(blockParent.GetHash());
+    BOOST_CHECK(subscriber.HandleMessage(RawBlockMessage(blockChild, nSequence + 1)));
+    BOOST_CHECK(bmmCache.GetLastMainBlockHash() == hashTip);
+    BOOST_CHECK(!IsMainchainTipTracked());
+
+    BOOST_CHECK(subscriber.HandleMessage(RawBlockMessage(blockParent, nSequence)));
+    BOOST_CHECK(bmmCache.GetLastMainBlockHash() == hashTip);
+    BOOST_CHECK(!IsMainchainTipTracked());
+    nSequence++;
+
+    // The next notification in sequence that connects is tracked again
+    block = MainchainBlock(hashTip);
+    BOOST_CHECK(subscriber.HandleMessage(RawBlockMessage(block, nSequence++)));
+    hashTip = block.GetHash();
+    BOOST_CHECK(bmmCache.GetLastMainBlockHash() == hashTip);
+    BOOST_CHECK(IsMainchainTipTracked());
+
+    subscriber.Stop();
+    BOOST_CHECK(!IsMainchainTipTracked());
+
+    bmmCache.ResetMainBlockCache();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -6,8 +6,10 @@
 #include <txdb.h>
 
 #include <chainparams.h>
+#include <compat/endian.h>
 #include <consensus/params.h>
 #include <hash.h>
+#include <memusage.h>
 #include <random.h>
 #include <sidechain.h>
 #include <uint256.h>
@@ -15,6 +17,7 @@
 #include <ui_interface.h>
 #include <init.h>
 
+#include <atomic>
 #include <stdint.h>
 
 #include <boost/thread.hpp>
@@ -30,9 +33,19 @@ static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+// BMM proofs by block hash. A proof stays valid when its block is
+// disconnected, it is erased when the block is pruned or when the mainchain
+// block with the commit is orphaned.
+static const char DB_BMM_PROOF = 'p';
 
 static const char DB_LAST_SIDECHAIN_DEPOSIT = 'x';
 static const char DB_LAST_SIDECHAIN_WTPRIME = 'w';
+static const char DB_SIDECHAIN_WT_STATUS = 'i';
+static const char DB_SIDECHAIN_WT_STATUS_INDEXED = 'I';
+
+static const char DB_MAIN_BLOCK_HASH = 'h';
+static const char DB_MAIN_BLOCK_HEIGHT = 'm';
+static const char DB_MAIN_BLOCK_COUNT = 'n';
 
 namespace {
 
@@ -56,6 +69,46 @@ struct CoinEntry {
     }
 };
 
+/**
+ * Key of the WT status index. Entries sort by sidechain, status and then
+ * mainchain fee with the highest fee first, so that a range of WT(s) with
+ * one status can be read in fee order.
+ */
+struct WTStatusEntry {
+    char key;
+    uint8_t nSidechain;
+    char status;
+    uint64_t nFeeInverted;
+    uint256 id;
+
+    WTStatusEntry(uint8_t nSidechainIn, char statusIn, CAmount fee, const uint256& idIn)
+        : key(DB_SIDECHAIN_WT_STATUS), nSidechain(nSidechainIn), status(statusIn), id(idIn)
+    {
+        // Big endian and inverted so that LevelDB orders higher fees first
+        nFeeInverted = std::numeric_limits<uint64_t>::max() - (uint64_t)std::max(fee, CAmount(0));
+    }
+    explicit WTStatusEntry(const SidechainWT& wt)
+        : WTStatusEntry(wt.nSidechain, wt.status, wt.mainchainFee, wt.GetID()) {}
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        s << key;
+        s << nSidechain;
+        s << status;
+        ser_writedata64(s, htobe64(nFeeInverted));
+        s << id;
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        s >> key;
+        s >> nSidechain;
+        s >> status;
+        nFeeInverted = be64toh(ser_readdata64(s));
+        s >> id;
+    }
+};
+
 }
 
 CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true)
@@ -251,6 +304,24 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::ReadBMMProof(const uint256 &hashBlock, BMMProof &proof) {
+    return Read(std::make_pair(DB_BMM_PROOF, hashBlock), proof);
+}
+
+bool CBlockTreeDB::WriteBMMProofs(const std::vector<std::pair<uint256, BMMProof> >&vect) {
+    CDBBatch batch(*this);
+    for (const std::pair<uint256, BMMProof>& item : vect)
+        batch.Write(std::make_pair(DB_BMM_PROOF, item.first), item.second);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::EraseBMMProofs(const std::vector<uint256> &vHash) {
+    CDBBatch batch(*this);
+    for (const uint256& hash : vHash)
+        batch.Erase(std::make_pair(DB_BMM_PROOF, hash));
+    return WriteBatch(batch);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -306,104 +377,29 @@ bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams,
 CSidechainTreeDB::CSidechainTreeDB(size_t nCacheSize, bool fMemory, bool fWipe)
     : CDBWrapper(GetDataDir() / "blocks" / "sidechain", nCacheSize, fMemory, fWipe) { }
 
-bool CSidechainTreeDB::WriteSidechainIndex(const std::vector<std::pair<uint256, const SidechainObj *> > &list)
-{
-    CDBBatch batch(*this);
-    for (std::vector<std::pair<uint256, const SidechainObj *> >::const_iterator it=list.begin(); it!=list.end(); it++) {
-        const uint256 &objid = it->first;
-        const SidechainObj *obj = it->second;
-        std::pair<char, uint256> key = std::make_pair(obj->sidechainop, objid);
-
-        if (obj->sidechainop == DB_SIDECHAIN_WT_OP) {
-            const SidechainWT *ptr = (const SidechainWT *) obj;
-            batch.Write(key, *ptr);
-        }
-        else
-        if (obj->sidechainop == DB_SIDECHAIN_WTPRIME_OP) {
-            const SidechainWTPrime *ptr = (const SidechainWTPrime *) obj;
-            batch.Write(key, *ptr);
-
-            // Also index the WT^ by the WT^ transaction hash
-            uint256 hashWTPrime = ptr->wtPrime.GetHash();
-            std::pair<char, uint256> keyTx = std::make_pair(DB_SIDECHAIN_WTPRIME_OP, hashWTPrime);
-            batch.Write(keyTx, *ptr);
-
-            // Update DB_LAST_SIDECHAIN_WTPRIME
-            batch.Write(DB_LAST_SIDECHAIN_WTPRIME, hashWTPrime);
-
-            LogPrintf("%s: Writing new WT^ and updating DB_LAST_SIDECHAIN_WTPRIME to: %s",
-                    __func__, hashWTPrime.ToString());
-        }
-        else
-        if (obj->sidechainop == DB_SIDECHAIN_DEPOSIT_OP) {
-            const SidechainDeposit *ptr = (const SidechainDeposit *) obj;
-            batch.Write(key, *ptr);
-
-            // Also index the deposit by the non amount hash
-            uint256 hashNonAmount = ptr->GetID();
-            batch.Write(std::make_pair(DB_SIDECHAIN_DEPOSIT_OP, hashNonAmount), *ptr);
-
-            // Update DB_LAST_SIDECHAIN_DEPOSIT
-            batch.Write(DB_LAST_SIDECHAIN_DEPOSIT, hashNonAmount);
-        }
-    }
-
-    return WriteBatch(batch, true);
-}
-
-bool CSidechainTreeDB::WriteWTUpdate(const std::vector<SidechainWT>& vWT)
+bool CSidechainTreeDB::BatchWrite(const std::map<uint256, SidechainWT>& mapWT,
+        const std::map<uint256, SidechainWTPrime>& mapWTPrime,
+        const std::map<uint256, SidechainDeposit>& mapDeposit,
+        const uint256& hashLastDeposit, const uint256& hashLastWTPrime)
 {
     CDBBatch batch(*this);
 
-    for (const SidechainWT& wt : vWT)
-    {
-        std::pair<char, uint256> key = std::make_pair(wt.sidechainop, wt.GetID());
-        batch.Write(key, wt);
+    for (const auto& it : mapWT) {
+        IndexWT(batch, it.second);
+        batch.Write(std::make_pair(DB_SIDECHAIN_WT_OP, it.first), it.second);
     }
+    for (const auto& it : mapWTPrime)
+        batch.Write(std::make_pair(DB_SIDECHAIN_WTPRIME_OP, it.first), it.second);
+    for (const auto& it : mapDeposit)
+        batch.Write(std::make_pair(DB_SIDECHAIN_DEPOSIT_OP, it.first), it.second);
 
-    return WriteBatch(batch, true);
-}
-
-bool CSidechainTreeDB::WriteWTPrimeUpdate(const SidechainWTPrime& wtPrime)
-{
-    CDBBatch batch(*this);
-
-    std::pair<char, uint256> key = std::make_pair(wtPrime.sidechainop, wtPrime.GetID());
-    batch.Write(key, wtPrime);
-
-    // Also index the WT^ by the WT^ transaction hash
-    uint256 hashWTPrime = wtPrime.wtPrime.GetHash();
-    std::pair<char, uint256> keyTx = std::make_pair(DB_SIDECHAIN_WTPRIME_OP, hashWTPrime);
-    batch.Write(keyTx, wtPrime);
-
-    // Also write wt status updates if WT^ status changes
-    std::vector<SidechainWT> vUpdate;
-    for (const uint256& wtid: wtPrime.vWT) {
-        SidechainWT wt;
-        if (!GetWT(wtid, wt)) {
-            LogPrintf("%s: Failed to read wt of WT^ from LDB!\n", __func__);
-            return false;
-        }
-        if (wtPrime.status == WTPRIME_FAILED) {
-            wt.status = WT_UNSPENT;
-            vUpdate.push_back(wt);
-        }
-        else
-        if (wtPrime.status == WTPRIME_SPENT) {
-            wt.status = WT_SPENT;
-            vUpdate.push_back(wt);
-        }
-        else
-        if (wtPrime.status == WTPRIME_CREATED) {
-            wt.status = WT_IN_WTPRIME;
-            vUpdate.push_back(wt);
-        }
-    }
+    if (!hashLastDeposit.IsNull())
+        batch.Write(DB_LAST_SIDECHAIN_DEPOSIT, hashLastDeposit);
+    if (!hashLastWTPrime.IsNull())
+        batch.Write(DB_LAST_SIDECHAIN_WTPRIME, hashLastWTPrime);
 
-    if (!WriteWTUpdate(vUpdate)) {
-        LogPrintf("%s: Failed to write wt update!\n", __func__);
-        return false;
-    }
+    LogPrint(BCLog::COINDB, "Committing %u WT(s), %u WT^ entries and %u deposit entries to sidechain database...\n",
+            (unsigned int)mapWT.size(), (unsigned int)mapWTPrime.size(), (unsigned int)mapDeposit.size());
 
     return WriteBatch(batch, true);
 }
@@ -435,22 +431,22 @@ bool CSidechainTreeDB::GetDeposit(const uint256& objid, SidechainDeposit& deposi
 std::vector<SidechainWT> CSidechainTreeDB::GetWTs(const uint8_t& nSidechain)
 {
     const char sidechainop = DB_SIDECHAIN_WT_OP;
-    std::ostringstream ss;
-    ::Serialize(ss, std::make_pair(std::make_pair(sidechainop, nSidechain), uint256()));
 
     std::vector<SidechainWT> vWT;
 
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
-    pcursor->Seek(ss.str());
+    pcursor->Seek(sidechainop);
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
 
+        // Stop at the end of the WT key range
         std::pair<char, uint256> key;
+        if (!pcursor->GetKey(key) || key.first != sidechainop)
+            break;
+
         SidechainWT wt;
-        if (pcursor->GetKey(key) && key.first == sidechainop) {
-            if (pcursor->GetSidechainValue(wt))
-                vWT.push_back(wt);
-        }
+        if (pcursor->GetSidechainValue(wt) && wt.nSidechain == nSidechain)
+            vWT.push_back(wt);
 
         pcursor->Next();
     }
@@ -461,24 +457,24 @@ std::vector<SidechainWT> CSidechainTreeDB::GetWTs(const uint8_t& nSidechain)
 std::vector<SidechainWTPrime> CSidechainTreeDB::GetWTPrimes(const uint8_t& nSidechain)
 {
     const char sidechainop = DB_SIDECHAIN_WTPRIME_OP;
-    std::ostringstream ss;
-    ::Serialize(ss, std::make_pair(std::make_pair(sidechainop, nSidechain), uint256()));
 
     std::vector<SidechainWTPrime> vWTPrime;
 
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
-    pcursor->Seek(ss.str());
+    pcursor->Seek(sidechainop);
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
 
+        // Stop at the end of the WT^ key range
         std::pair<char, uint256> key;
+        if (!pcursor->GetKey(key) || key.first != sidechainop)
+            break;
+
         SidechainWTPrime wtPrime;
-        if (pcursor->GetKey(key) && key.first == sidechainop) {
-            if (pcursor->GetSidechainValue(wtPrime)) {
-                // Only return the WT^(s) indexed by ID
-                if (key.second == wtPrime.GetID())
-                    vWTPrime.push_back(wtPrime);
-            }
+        if (pcursor->GetSidechainValue(wtPrime) && wtPrime.nSidechain == nSidechain) {
+            // Only return the WT^(s) indexed by ID
+            if (key.second == wtPrime.GetID())
+                vWTPrime.push_back(wtPrime);
         }
 
         pcursor->Next();
@@ -489,23 +485,24 @@ std::vector<SidechainWTPrime> CSidechainTreeDB::GetWTPrimes(const uint8_t& nSide
 std::vector<SidechainDeposit> CSidechainTreeDB::GetDeposits(const uint8_t& nSidechain)
 {
     const char sidechainop = DB_SIDECHAIN_DEPOSIT_OP;
-    std::ostringstream ss;
-    ::Serialize(ss, std::make_pair(std::make_pair(sidechainop, nSidechain), uint256()));
 
     std::vector<SidechainDeposit> vDeposit;
 
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
-    pcursor->Seek(ss.str());
+    pcursor->Seek(sidechainop);
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
 
+        // Stop at the end of the deposit key range
         std::pair<char, uint256> key;
+        if (!pcursor->GetKey(key) || key.first != sidechainop)
+            break;
+
         SidechainDeposit deposit;
-        if (pcursor->GetKey(key) && key.first == sidechainop) {
-            if (pcursor->GetSidechainValue(deposit))
-                // Only return the deposits(s) indexed by ID
-                if (key.second == deposit.GetID())
-                    vDeposit.push_back(deposit);
+        if (pcursor->GetSidechainValue(deposit) && deposit.nSidechain == nSidechain) {
+            // Only return the deposits(s) indexed by ID
+            if (key.second == deposit.GetID())
+                vDeposit.push_back(deposit);
         }
 
         pcursor->Next();
@@ -513,6 +510,70 @@ std::vector<SidechainDeposit> CSidechainTreeDB::GetDeposits(const uint8_t& nSide
     return vDeposit;
 }
 
+std::vector<SidechainWT> CSidechainTreeDB::GetWTsByStatus(uint8_t nSidechain, char status, size_t nMax)
+{
+    std::vector<SidechainWT> vWT;
+
+    // Seek to the highest fee entry of (nSidechain, status)
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(WTStatusEntry(nSidechain, status, std::numeric_limits<CAmount>::max(), uint256()));
+    while (pcursor->Valid() && vWT.size() < nMax) {
+        boost::this_thread::interruption_point();
+
+        WTStatusEntry entry(0, 0, 0, uint256());
+        if (!pcursor->GetKey(entry) || entry.key != DB_SIDECHAIN_WT_STATUS
+                || entry.nSidechain != nSidechain || entry.status != status)
+            break;
+
+        SidechainWT wt;
+        if (pcursor->GetSidechainValue(wt))
+            vWT.push_back(wt);
+
+        pcursor->Next();
+    }
+    return vWT;
+}
+
+bool CSidechainTreeDB::ReindexWTStatus()
+{
+    if (Exists(DB_SIDECHAIN_WT_STATUS_INDEXED))
+        return true;
+
+    LogPrintf("%s: Building WT status index\n", __func__);
+
+    CDBBatch batch(*this);
+
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(DB_SIDECHAIN_WT_OP);
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+
+        std::pair<char, uint256> key;
+        if (!pcursor->GetKey(key) || key.first != DB_SIDECHAIN_WT_OP)
+            break;
+
+        SidechainWT wt;
+        if (!pcursor->GetSidechainValue(wt))
+            return error("%s: failed to read WT", __func__);
+
+        batch.Write(WTStatusEntry(wt), wt);
+
+        pcursor->Next();
+    }
+    batch.Write(DB_SIDECHAIN_WT_STATUS_INDEXED, '1');
+
+    return WriteBatch(batch, true);
+}
+
+void CSidechainTreeDB::IndexWT(CDBBatch& batch, const SidechainWT& wt)
+{
+    SidechainWT wtOld;
+    if (GetWT(wt.GetID(), wtOld))
+        batch.Erase(WTStatusEntry(wtOld));
+
+    batch.Write(WTStatusEntry(wt), wt);
+}
+
 bool CSidechainTreeDB::HaveDeposits()
 {
     const char sidechainop = DB_SIDECHAIN_DEPOSIT_OP;
@@ -575,6 +636,324 @@ bool CSidechainTreeDB::HaveWTPrime(const uint256& hashWTPrime) const
     return false;
 }
 
+//! Last generation handed out to a CSidechainTreeCache
+static std::atomic<uint64_t> nLastSidechainTreeGeneration(0);
+
+CSidechainTreeCache::CSidechainTreeCache(CSidechainTreeDB* dbIn) : db(dbIn), cachedUsage(0)
+{
+    nGeneration = ++nLastSidechainTreeGeneration;
+}
+
+template <typename T>
+void CSidechainTreeCache::CacheObject(std::map<uint256, T>& map, const uint256& key, const T& obj)
+{
+    auto it = map.find(key);
+    if (it != map.end()) {
+        cachedUsage -= ::GetSerializeSize(it->second, SER_DISK, CLIENT_VERSION);
+        it->second = obj;
+    } else {
+        map.emplace(key, obj);
+    }
+    cachedUsage += ::GetSerializeSize(obj, SER_DISK, CLIENT_VERSION);
+    nGeneration = ++nLastSidechainTreeGeneration;
+}
+
+bool CSidechainTreeCache::WriteSidechainIndex(const std::vector<std::pair<uint256, const SidechainObj *> > &list)
+{
+    LOCK(cs_cache);
+    for (const std::pair<uint256, const SidechainObj *>& item : list) {
+        const uint256 &objid = item.first;
+        const SidechainObj *obj = item.second;
+
+        if (obj->sidechainop == DB_SIDECHAIN_WT_OP) {
+            const SidechainWT *ptr = (const SidechainWT *) obj;
+            CacheObject(mapWT, objid, *ptr);
+        }
+        else
+        if (obj->sidechainop == DB_SIDECHAIN_WTPRIME_OP) {
+            const SidechainWTPrime *ptr = (const SidechainWTPrime *) obj;
+            CacheObject(mapWTPrime, objid, *ptr);
+
+            // Also index the WT^ by the WT^ transaction hash
+            uint256 hashWTPrime = ptr->wtPrime->GetHash();
+            CacheObject(mapWTPrime, hashWTPrime, *ptr);
+
+            // Update DB_LAST_SIDECHAIN_WTPRIME
+            hashLastWTPrime = hashWTPrime;
+
+            LogPrintf("%s: Writing new WT^ and updating DB_LAST_SIDECHAIN_WTPRIME to: %s",
+                    __func__, hashWTPrime.ToString());
+        }
+        else
+        if (obj->sidechainop == DB_SIDECHAIN_DEPOSIT_OP) {
+            const SidechainDeposit *ptr = (const SidechainDeposit *) obj;
+            CacheObject(mapDeposit, objid, *ptr);
+
+            // Also index the deposit by the non amount hash
+            uint256 hashNonAmount = ptr->GetID();
+            CacheObject(mapDeposit, hashNonAmount, *ptr);
+
+            // Update DB_LAST_SIDECHAIN_DEPOSIT
+            hashLastDeposit = hashNonAmount;
+        }
+    }
+    return true;
+}
+
+bool CSidechainTreeCache::WriteWTUpdate(const std::vector<SidechainWT>& vWT)
+{
+    LOCK(cs_cache);
+    return WriteWTUpdateUnlocked(vWT);
+}
+
+bool CSidechainTreeCache::WriteWTUpdateUnlocked(const std::vector<SidechainWT>& vWT)
+{
+    for (const SidechainWT& wt : vWT)
+        CacheObject(mapWT, wt.GetID(), wt);
+
+    return true;
+}
+
+bool CSidechainTreeCache::WriteWTPrimeUpdate(const SidechainWTPrime& wtPrime)
+{
+    LOCK(cs_cache);
+
+    // Also write wt status updates if WT^ status changes
+    std::vector<SidechainWT> vUpdate;
+    for (const uint256& wtid: wtPrime.vWT) {
+        SidechainWT wt;
+        if (!GetWTUnlocked(wtid, wt)) {
+            LogPrintf("%s: Failed to read wt of WT^ from LDB!\n", __func__);
+            return false;
+        }
+        if (wtPrime.status == WTPRIME_FAILED) {
+            wt.status = WT_UNSPENT;
+            vUpdate.push_back(wt);
+        }
+        else
+        if (wtPrime.status == WTPRIME_SPENT) {
+            wt.status = WT_SPENT;
+            vUpdate.push_back(wt);
+        }
+        else
+        if (wtPrime.status == WTPRIME_CREATED) {
+            wt.status = WT_IN_WTPRIME;
+            vUpdate.push_back(wt);
+        }
+    }
+
+    if (!WriteWTUpdateUnlocked(vUpdate)) {
+        LogPrintf("%s: Failed to write wt update!\n", __func__);
+        return false;
+    }
+
+    CacheObject(mapWTPrime, wtPrime.GetID(), wtPrime);
+
+    // Also index the WT^ by the WT^ transaction hash
+    CacheObject(mapWTPrime, wtPrime.wtPrime->GetHash(), wtPrime);
+
+    return true;
+}
+
+bool CSidechainTreeCache::GetWTUnlocked(const uint256& objid, SidechainWT& wt) const
+{
+    auto it = mapWT.find(objid);
+    if (it != mapWT.end()) {
+        wt = it->second;
+        return true;
+    }
+    return db->GetWT(objid, wt);
+}
+
+bool CSidechainTreeCache::GetWT(const uint256& objid, SidechainWT& wt) const
+{
+    LOCK(cs_cache);
+    return GetWTUnlocked(objid, wt);
+}
+
+bool CSidechainTreeCache::GetWTPrime(const uint256& objid, SidechainWTPrime& wtPrime) const
+{
+    LOCK(cs_cache);
+    auto it = mapWTPrime.find(objid);
+    if (it != mapWTPrime.end()) {
+        wtPrime = it->second;
+        return true;
+    }
+    return db->GetWTPrime(objid, wtPrime);
+}
+
+bool CSidechainTreeCache::GetDeposit(const uint256& objid, SidechainDeposit& deposit) const
+{
+    LOCK(cs_cache);
+    auto it = mapDeposit.find(objid);
+    if (it != mapDeposit.end()) {
+        deposit = it->second;
+        return true;
+    }
+    return db->GetDeposit(objid, deposit);
+}
+
+bool CSidechainTreeCache::HaveDeposits() const
+{
+    LOCK(cs_cache);
+    return !mapDeposit.empty() || db->HaveDeposits();
+}
+
+bool CSidechainTreeCache::HaveDepositNonAmount(const uint256& hashNonAmount) const
+{
+    LOCK(cs_cache);
+    return mapDeposit.count(hashNonAmount) || db->HaveDepositNonAmount(hashNonAmount);
+}
+
+bool CSidechainTreeCache::GetLastDeposit(SidechainDeposit& deposit) const
+{
+    LOCK(cs_cache);
+    if (hashLastDeposit.IsNull())
+        return db->GetLastDeposit(deposit);
+
+    auto it = mapDeposit.find(hashLastDeposit);
+    if (it == mapDeposit.end())
+        return false;
+
+    deposit = it->second;
+    return true;
+}
+
+bool CSidechainTreeCache::GetLastWTPrimeHash(uint256& hash) const
+{
+    LOCK(cs_cache);
+    if (hashLastWTPrime.IsNull())
+        return db->GetLastWTPrimeHash(hash);
+
+    hash = hashLastWTPrime;
+    return true;
+}
+
+bool CSidechainTreeCache::HaveWTPrime(const uint256& hashWTPrime) const
+{
+    LOCK(cs_cache);
+    return mapWTPrime.count(hashWTPrime) || db->HaveWTPrime(hashWTPrime);
+}
+
+std::vector<SidechainWT> CSidechainTreeCache::GetWTs(const uint8_t& nSidechain) const
+{
+    LOCK(cs_cache);
+
+    // Replace database WT(s) that have cached updates
+    std::vector<SidechainWT> vWT;
+    for (const SidechainWT& wt : db->GetWTs(nSidechain)) {
+        if (!mapWT.count(wt.GetID()))
+            vWT.push_back(wt);
+    }
+    for (const auto& it : mapWT) {
+        if (it.second.nSidechain == nSidechain)
+            vWT.push_back(it.second);
+    }
+    return vWT;
+}
+
+std::vector<SidechainWTPrime> CSidechainTreeCache::GetWTPrimes(const uint8_t& nSidechain) const
+{
+    LOCK(cs_cache);
+
+    std::vector<SidechainWTPrime> vWTPrime;
+    for (const SidechainWTPrime& wtPrime : db->GetWTPrimes(nSidechain)) {
+        if (!mapWTPrime.count(wtPrime.GetID()))
+            vWTPrime.push_back(wtPrime);
+    }
+    for (const auto& it : mapWTPrime) {
+        // Only return the WT^(s) indexed by ID
+        if (it.second.nSidechain == nSidechain && it.first == it.second.GetID())
+            vWTPrime.push_back(it.second);
+    }
+    return vWTPrime;
+}
+
+std::vector<SidechainDeposit> CSidechainTreeCache::GetDeposits(const uint8_t& nSidechain) const
+{
+    LOCK(cs_cache);
+
+    std::vector<SidechainDeposit> vDeposit;
+    for (const SidechainDeposit& deposit : db->GetDeposits(nSidechain)) {
+        if (!mapDeposit.count(deposit.GetID()))
+            vDeposit.push_back(deposit);
+    }
+    for (const auto& it : mapDeposit) {
+        // Only return the deposits(s) indexed by ID
+        if (it.second.nSidechain == nSidechain && it.first == it.second.GetID())
+            vDeposit.push_back(it.second);
+    }
+    return vDeposit;
+}
+
+std::vector<SidechainWT> CSidechainTreeCache::GetWTsByStatus(uint8_t nSidechain, char status, size_t nMax) const
+{
+    LOCK(cs_cache);
+
+    // The database index entries of cached WT(s) may be stale, so skip them
+    // and read enough extra entries to make up for the skipped ones.
+    size_t nRead = nMax;
+    if (nRead < std::numeric_limits<size_t>::max() - mapWT.size())
+        nRead += mapWT.size();
+
+    std::vector<std::pair<SidechainWT, uint256> > vWTID;
+    for (const SidechainWT& wt : db->GetWTsByStatus(nSidechain, status, nRead)) {
+        uint256 id = wt.GetID();
+        if (!mapWT.count(id))
+            vWTID.emplace_back(wt, id);
+    }
+    for (const auto& it : mapWT) {
+        if (it.second.nSidechain == nSidechain && it.second.status == status)
+            vWTID.emplace_back(it.second, it.first);
+    }
+
+    // Merge in the database index order: highest fee first, then by ID
+    std::sort(vWTID.begin(), vWTID.end(), CompareWTMainchainFee());
+
+    std::vector<SidechainWT> vWT;
+    for (size_t i = 0; i < vWTID.size() && i < nMax; i++)
+        vWT.push_back(vWTID[i].first);
+    return vWT;
+}
+
+bool CSidechainTreeCache::Flush()
+{
+    LOCK(cs_cache);
+    if (mapWT.empty() && mapWTPrime.empty() && mapDeposit.empty()
+            && hashLastDeposit.IsNull() && hashLastWTPrime.IsNull())
+        return true;
+
+    if (!db->BatchWrite(mapWT, mapWTPrime, mapDeposit, hashLastDeposit, hashLastWTPrime))
+        return false;
+
+    mapWT.clear();
+    mapWTPrime.clear();
+    mapDeposit.clear();
+    hashLastDeposit.SetNull();
+    hashLastWTPrime.SetNull();
+    cachedUsage = 0;
+    return true;
+}
+
+size_t CSidechainTreeCache::GetCacheSize() const
+{
+    LOCK(cs_cache);
+    return mapWT.size() + mapWTPrime.size() + mapDeposit.size();
+}
+
+size_t CSidechainTreeCache::DynamicMemoryUsage() const
+{
+    LOCK(cs_cache);
+    return memusage::DynamicUsage(mapWT) + memusage::DynamicUsage(mapWTPrime) +
+        memusage::DynamicUsage(mapDeposit) + cachedUsage;
+}
+
+uint64_t CSidechainTreeCache::GetGeneration() const
+{
+    LOCK(cs_cache);
+    return nGeneration;
+}
+
 namespace {
 
 //! Legacy class to deserialize pre-pertxout database entries without reindex.
@@ -697,3 +1076,39 @@ bool CCoinsViewDB::Upgrade() {
     LogPrintf("[%s].\n", ShutdownRequested() ? "CANCELLED" : "DONE");
     return !ShutdownRequested();
 }
+
+CMainBlockDB::CMainBlockDB(size_t nCacheSize, bool fMemory, bool fWipe)
+    : CDBWrapper(GetDataDir() / "mainblocks", nCacheSize, fMemory, fWipe) { }
+
+bool CMainBlockDB::WriteMainBlocks(uint32_t nHeight, const std::vector<uint256>& vHash, uint32_t nCount)
+{
+    CDBBatch batch(*this);
+    for (const uint256& hash : vHash) {
+        batch.Write(std::make_pair(DB_MAIN_BLOCK_HASH, nHeight), hash);
+        batch.Write(std::make_pair(DB_MAIN_BLOCK_HEIGHT, hash), nHeight);
+        nHeight++;
+    }
+    batch.Write(DB_MAIN_BLOCK_COUNT, nCount);
+
+    return WriteBatch(batch, true);
+}
+
+bool CMainBlockDB::WriteMainBlockCount(uint32_t nCount)
+{
+    return Write(DB_MAIN_BLOCK_COUNT, nCount, true);
+}
+
+bool CMainBlockDB::ReadMainBlockCount(uint32_t& nCount) const
+{
+    return Read(DB_MAIN_BLOCK_COUNT, nCount);
+}
+
+bool CMainBlockDB::ReadMainBlockHash(uint32_t nHeight, uint256& hash) const
+{
+    return Read(std::make_pair(DB_MAIN_BLOCK_HASH, nHeight), hash);
+}
+
+bool CMainBlockDB::ReadMainBlockHeight(const uint256& hash, uint32_t& nHeight) const
+{
+    return Read(std::make_pair(DB_MAIN_BLOCK_HEIGHT, hash), nHeight);
+}
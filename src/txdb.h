@@ -6,10 +6,14 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include <bmmproof.h>
 #include <coins.h>
 #include <dbwrapper.h>
 #include <chain.h>
+#include <sidechain.h>
+#include <sync.h>
 
+#include <limits>
 #include <map>
 #include <string>
 #include <utility>
@@ -17,11 +21,7 @@
 
 class CBlockIndex;
 class CCoinsViewDBCursor;
-class SidechainObj;
-class SidechainDeposit;
 class SidechainTransfer;
-class SidechainWT;
-class SidechainWTPrime;
 class uint256;
 
 //! No need to periodic flush if at least this much space still available.
@@ -34,6 +34,8 @@ static const int64_t nDefaultDbBatchSize = 16 << 20;
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache (MiB)
 static const int64_t nMinDbCache = 4;
+//! Memory allocated to the mainchain block hash DB cache (MiB)
+static const int64_t nMainBlockDBCache = 2;
 //! Max memory allocated to block tree DB specific cache, if no -txindex (MiB)
 static const int64_t nMaxBlockDBCache = 2;
 //! Max memory allocated to block tree DB specific cache, if -txindex (MiB)
@@ -126,6 +128,9 @@ public:
     bool ReadReindexing(bool &fReindexing);
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &vect);
+    bool ReadBMMProof(const uint256 &hashBlock, BMMProof &proof);
+    bool WriteBMMProofs(const std::vector<std::pair<uint256, BMMProof> > &vect);
+    bool EraseBMMProofs(const std::vector<uint256> &vHash);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&, const uint256&)> insertBlockIndex);
@@ -136,9 +141,13 @@ class CSidechainTreeDB : public CDBWrapper
 {
 public:
     CSidechainTreeDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
-    bool WriteSidechainIndex(const std::vector<std::pair<uint256, const SidechainObj *> > &list);
-    bool WriteWTUpdate(const std::vector<SidechainWT>& vWT);
-    bool WriteWTPrimeUpdate(const SidechainWTPrime& wtPrime);
+
+    /** Write the objects collected by a CSidechainTreeCache in one synced
+     * batch. Null last deposit / WT^ hashes are left unchanged. */
+    bool BatchWrite(const std::map<uint256, SidechainWT>& mapWT,
+            const std::map<uint256, SidechainWTPrime>& mapWTPrime,
+            const std::map<uint256, SidechainDeposit>& mapDeposit,
+            const uint256& hashLastDeposit, const uint256& hashLastWTPrime);
 
     bool GetWT(const uint256 & /* WT ID */, SidechainWT &wt);
     bool GetWTPrime(const uint256 & /* WT^ ID */, SidechainWTPrime &wtPrime);
@@ -153,6 +162,109 @@ public:
     std::vector<SidechainWT> GetWTs(const uint8_t & /* nSidechain */);
     std::vector<SidechainWTPrime> GetWTPrimes(const uint8_t & /* nSidechain */);
     std::vector<SidechainDeposit> GetDeposits(const uint8_t & /* nSidechain */);
+
+    /** Return up to nMax WT(s) of nSidechain with the given status, highest
+     * mainchain fee first. Only the matching range of the status index is
+     * read. */
+    std::vector<SidechainWT> GetWTsByStatus(uint8_t nSidechain, char status,
+            size_t nMax = std::numeric_limits<size_t>::max());
+
+    /** Build the WT status index if this database was created without it */
+    bool ReindexWTStatus();
+
+private:
+    /** Add a WT to the status index, replacing the entry for its old status */
+    void IndexWT(CDBBatch& batch, const SidechainWT& wt);
+};
+
+/**
+ * Write-back cache in front of CSidechainTreeDB, in the spirit of
+ * CCoinsViewCache. Sidechain object updates from connecting and
+ * disconnecting blocks are kept in memory, and Flush() writes them with a
+ * single synced batch. Reads see the cached updates. Internally
+ * synchronized so that the GUI and RPC can read while blocks connect.
+ */
+class CSidechainTreeCache
+{
+public:
+    explicit CSidechainTreeCache(CSidechainTreeDB* dbIn);
+
+    bool WriteSidechainIndex(const std::vector<std::pair<uint256, const SidechainObj *> > &list);
+    bool WriteWTUpdate(const std::vector<SidechainWT>& vWT);
+    bool WriteWTPrimeUpdate(const SidechainWTPrime& wtPrime);
+
+    bool GetWT(const uint256 & /* WT ID */, SidechainWT &wt) const;
+    bool GetWTPrime(const uint256 & /* WT^ ID */, SidechainWTPrime &wtPrime) const;
+    bool GetDeposit(const uint256 & /* Deposit ID */, SidechainDeposit &deposit) const;
+    bool HaveDeposits() const;
+    bool HaveDepositNonAmount(const uint256& hashNonAmount) const;
+    bool GetLastDeposit(SidechainDeposit& deposit) const;
+    bool GetLastWTPrimeHash(uint256& hash) const;
+
+    bool HaveWTPrime(const uint256& hashWTPrime) const;
+
+    std::vector<SidechainWT> GetWTs(const uint8_t & /* nSidechain */) const;
+    std::vector<SidechainWTPrime> GetWTPrimes(const uint8_t & /* nSidechain */) const;
+    std::vector<SidechainDeposit> GetDeposits(const uint8_t & /* nSidechain */) const;
+
+    /** See CSidechainTreeDB::GetWTsByStatus */
+    std::vector<SidechainWT> GetWTsByStatus(uint8_t nSidechain, char status,
+            size_t nMax = std::numeric_limits<size_t>::max()) const;
+
+    /** Write the cached updates to the database and empty the cache */
+    bool Flush();
+
+    //! Number of cached sidechain objects
+    size_t GetCacheSize() const;
+
+    //! Memory used by the cached sidechain objects
+    size_t DynamicMemoryUsage() const;
+
+    /** Changes whenever a sidechain object is written. Unique across
+     * instances, so results derived from the objects can be reused for as
+     * long as the generation stays the same. */
+    uint64_t GetGeneration() const;
+
+private:
+    mutable CCriticalSection cs_cache;
+
+    CSidechainTreeDB* db;
+
+    //! Dirty objects, WT^(s) are cached under both their ID and transaction hash
+    std::map<uint256, SidechainWT> mapWT;
+    std::map<uint256, SidechainWTPrime> mapWTPrime;
+    std::map<uint256, SidechainDeposit> mapDeposit;
+
+    //! Updated last deposit / WT^ hashes, null if unchanged
+    uint256 hashLastDeposit;
+    uint256 hashLastWTPrime;
+
+    //! Serialized size of the cached objects
+    size_t cachedUsage;
+
+    uint64_t nGeneration;
+
+    template <typename T>
+    void CacheObject(std::map<uint256, T>& map, const uint256& key, const T& obj);
+
+    bool GetWTUnlocked(const uint256& objid, SidechainWT& wt) const;
+    bool WriteWTUpdateUnlocked(const std::vector<SidechainWT>& vWT);
+};
+
+/** Access to the mainchain block hashes that the BMM cache doesn't keep in memory */
+class CMainBlockDB : public CDBWrapper
+{
+public:
+    explicit CMainBlockDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    /** Write the hashes of blocks starting at nHeight, and the new number of
+     * blocks stored (heights 0 to nCount - 1) */
+    bool WriteMainBlocks(uint32_t nHeight, const std::vector<uint256>& vHash, uint32_t nCount);
+    bool WriteMainBlockCount(uint32_t nCount);
+
+    bool ReadMainBlockCount(uint32_t& nCount) const;
+    bool ReadMainBlockHash(uint32_t nHeight, uint256& hash) const;
+    bool ReadMainBlockHeight(const uint256& hash, uint32_t& nHeight) const;
 };
 
 #endif // BITCOIN_TXDB_H
@@ -12,6 +12,7 @@
 #include <policy/policy.h>
 #include <policy/fees.h>
 #include <reverse_iterator.h>
+#include <sidechain.h>
 #include <streams.h>
 #include <timedata.h>
 #include <util.h>
@@ -20,12 +21,14 @@
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                                  int64_t _nTime, unsigned int _entryHeight,
-                                 bool _spendsCoinbase, bool _fWTRefund, uint256 _wtID, int64_t _sigOpsCost, LockPoints lp):
+                                 bool _spendsCoinbase, const MemPoolSidechainInfo& _sidechainInfo, int64_t _sigOpsCost, LockPoints lp):
     tx(_tx), nFee(_nFee), nTime(_nTime), entryHeight(_entryHeight),
-    spendsCoinbase(_spendsCoinbase), fWTRefund(_fWTRefund), wtID(_wtID), sigOpCost(_sigOpsCost), lockPoints(lp)
+    spendsCoinbase(_spendsCoinbase), sidechainInfo(_sidechainInfo), sigOpCost(_sigOpsCost), lockPoints(lp)
 {
     nTxWeight = GetTransactionWeight(*tx);
-    nUsageSize = RecursiveDynamicUsage(tx);
+    nUsageSize = RecursiveDynamicUsage(tx) + memusage::DynamicUsage(sidechainInfo.vchRefundSig);
+    if (sidechainInfo.wt)
+        nUsageSize += memusage::DynamicUsage(sidechainInfo.wt);
 
     nCountWithDescendants = 1;
     nSizeWithDescendants = GetTxSize();
@@ -413,11 +416,6 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     vTxHashes.emplace_back(tx.GetWitnessHash(), newit);
     newit->vTxHashesIdx = vTxHashes.size() - 1;
 
-    // Keep track of WT refunds
-    if (entry.IsWTRefund()) {
-        setWTRefund.insert(entry.GetWTID());
-    }
-
     return true;
 }
 
@@ -438,11 +436,6 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
         vTxHashes.clear();
     }
 
-    // If we are removing a WT refund request, also remove the WT ID from set
-    if (it->IsWTRefund()) {
-        setWTRefund.erase(it->GetWTID());
-    }
-
     totalTxSize -= it->GetTxSize();
     cachedInnerUsage -= it->DynamicMemoryUsage();
     cachedInnerUsage -= memusage::DynamicUsage(mapLinks[it].parents) + memusage::DynamicUsage(mapLinks[it].children);
@@ -834,6 +827,18 @@ CTransactionRef CTxMemPool::get(const uint256& hash) const
     return i->GetSharedTx();
 }
 
+std::vector<std::pair<CTransactionRef, MemPoolSidechainInfo> > CTxMemPool::GetSidechainTxs(MemPoolSidechainType type) const
+{
+    LOCK(cs);
+    const auto& index = mapTx.get<sidechain_obj>();
+    auto it = index.lower_bound(std::make_pair(type, uint256()));
+
+    std::vector<std::pair<CTransactionRef, MemPoolSidechainInfo> > vTx;
+    for (; it != index.end() && it->GetSidechainType() == type; it++)
+        vTx.emplace_back(it->GetSharedTx(), it->GetSidechainInfo());
+    return vTx;
+}
+
 TxMempoolInfo CTxMemPool::info(const uint256& hash) const
 {
     LOCK(cs);
@@ -918,7 +923,7 @@ bool CCoinsViewMemPool::GetCoin(const COutPoint &outpoint, Coin &coin) const {
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
     // Estimate the overhead of mapTx to be 12 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
+    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
 }
 
 void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants, MemPoolRemovalReason reason) {
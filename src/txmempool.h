@@ -28,10 +28,31 @@
 #include <boost/signals2/signal.hpp>
 
 class CBlockIndex;
+class SidechainWT;
 
 /** Fake height value used in Coin to signify they are only in the memory pool (since 0.8) */
 static const uint32_t MEMPOOL_HEIGHT = 0x7FFFFFFF;
 
+/** Kinds of sidechain transactions tracked by the memory pool */
+enum class MemPoolSidechainType : uint8_t {
+    NONE = 0,
+    WT,         //!< Creates a WT
+    WT_REFUND,  //!< Requests the refund of a WT
+};
+
+/**
+ * Sidechain objects of a memory pool transaction, parsed once when the
+ * transaction is accepted. A transaction that is a WT refund request is
+ * tracked as such even if it also creates a WT.
+ */
+struct MemPoolSidechainInfo
+{
+    MemPoolSidechainType type = MemPoolSidechainType::NONE;
+    uint256 wtID;                              //!< ID of the WT created or refunded
+    std::shared_ptr<const SidechainWT> wt;     //!< The WT created
+    std::vector<unsigned char> vchRefundSig;   //!< Signature of the WT refund request
+};
+
 struct LockPoints
 {
     // Will be set to the blockchain height and median time past
@@ -71,8 +92,7 @@ private:
     int64_t nTime;             //!< Local time when entering the mempool
     unsigned int entryHeight;  //!< Chain height when entering the mempool
     bool spendsCoinbase;       //!< keep track of transactions that spend a coinbase
-    bool fWTRefund;            //!< Track transactions that are WT refund requests
-    uint256 wtID;              //!< The ID of a WT for a WT refund (if it is one)
+    MemPoolSidechainInfo sidechainInfo; //!< Track transactions that are WTs or WT refund requests
     int64_t sigOpCost;         //!< Total sigop cost
     int64_t feeDelta;          //!< Used for determining the priority of the transaction for mining in a block
     LockPoints lockPoints;     //!< Track the height and time at which tx was final
@@ -93,7 +113,7 @@ private:
 public:
     CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                     int64_t _nTime, unsigned int _entryHeight,
-                    bool spendsCoinbase, bool fWTRefund, uint256 wtID,
+                    bool spendsCoinbase, const MemPoolSidechainInfo& sidechainInfo,
                     int64_t nSigOpsCost, LockPoints lp);
 
     const CTransaction& GetTx() const { return *this->tx; }
@@ -124,8 +144,10 @@ public:
 
     bool GetSpendsCoinbase() const { return spendsCoinbase; }
 
-    bool IsWTRefund() const { return fWTRefund; }
-    uint256 GetWTID() const { return wtID; }
+    const MemPoolSidechainInfo& GetSidechainInfo() const { return sidechainInfo; }
+    MemPoolSidechainType GetSidechainType() const { return sidechainInfo.type; }
+    bool IsWTRefund() const { return sidechainInfo.type == MemPoolSidechainType::WT_REFUND; }
+    const uint256& GetWTID() const { return sidechainInfo.wtID; }
 
     uint64_t GetCountWithAncestors() const { return nCountWithAncestors; }
     uint64_t GetSizeWithAncestors() const { return nSizeWithAncestors; }
@@ -202,6 +224,16 @@ struct mempoolentry_txid
     }
 };
 
+// extracts the sidechain type and WT ID from a CTxMemPoolEntry
+struct mempoolentry_sidechain
+{
+    typedef std::pair<MemPoolSidechainType, uint256> result_type;
+    result_type operator() (const CTxMemPoolEntry &entry) const
+    {
+        return std::make_pair(entry.GetSidechainType(), entry.GetWTID());
+    }
+};
+
 /** \class CompareTxMemPoolEntryByDescendantScore
  *
  *  Sort an entry by max(score/size of entry's tx, score/size with all descendants).
@@ -322,6 +354,7 @@ public:
 struct descendant_score {};
 struct entry_time {};
 struct ancestor_score {};
+struct sidechain_obj {};
 
 class CBlockPolicyEstimator;
 
@@ -484,6 +517,11 @@ public:
                 boost::multi_index::tag<ancestor_score>,
                 boost::multi_index::identity<CTxMemPoolEntry>,
                 CompareTxMemPoolEntryByAncestorFee
+            >,
+            // sorted by sidechain type and WT ID
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<sidechain_obj>,
+                mempoolentry_sidechain
             >
         >
     > indexed_transaction_set;
@@ -519,10 +557,6 @@ private:
 
     std::vector<indexed_transaction_set::const_iterator> GetSortedDepthAndScore() const;
 
-    // In mempool WT refund IDs - keep track of them so we don't accept multiple
-    // refunds for the same WT into the mempool.
-    std::set<uint256> setWTRefund;
-
 public:
     indirectmap<COutPoint, const CTransaction*> mapNextTx;
     std::map<uint256, CAmount> mapDeltas;
@@ -652,9 +686,13 @@ public:
     bool WTRefundExists(const uint256& wtid) const
     {
         LOCK(cs);
-        return setWTRefund.count(wtid);
+        return mapTx.get<sidechain_obj>().count(std::make_pair(MemPoolSidechainType::WT_REFUND, wtid));
     }
 
+    /** Get the transactions of one sidechain type and their sidechain objects,
+     * by WT ID */
+    std::vector<std::pair<CTransactionRef, MemPoolSidechainInfo> > GetSidechainTxs(MemPoolSidechainType type) const;
+
     CTransactionRef get(const uint256& hash) const;
     TxMempoolInfo info(const uint256& hash) const;
     std::vector<TxMempoolInfo> infoAll() const;
@@ -14,6 +14,7 @@
 
 class CWallet;
 class CBlockIndex;
+class uint256;
 
 /** General change type (added, updated, removed). */
 enum ChangeType
@@ -106,6 +107,9 @@ public:
     /** Best header has changed */
     boost::signals2::signal<void (bool, const CBlockIndex *)> NotifyHeaderTip;
 
+    /** New mainchain tip added to the main block cache */
+    boost::signals2::signal<void (const uint256& hashMainTip)> NotifyMainchainTip;
+
     /** Banlist did change. */
     boost::signals2::signal<void (void)> BannedListChanged;
 };
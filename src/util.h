@@ -291,6 +291,10 @@ public:
     // Forces an arg setting. Called by SoftSetArg() if the arg hasn't already
     // been set. Also called directly in testing.
     void ForceSetArg(const std::string& strArg, const std::string& strValue);
+
+    // Removes an arg setting, so that it isn't set anymore. Used to restore
+    // args that were forced in testing.
+    void ClearArg(const std::string& strArg);
 };
 
 extern ArgsManager gArgs;
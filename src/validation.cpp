@@ -8,10 +8,12 @@
 #include <arith_uint256.h>
 #include <base58.h>
 #include <bmmcache.h>
+#include <bmmproof.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
 #include <checkqueue.h>
+#include <coinsprefetch.h>
 #include <consensus/consensus.h>
 #include <consensus/merkle.h>
 #include <consensus/params.h>
@@ -21,6 +23,7 @@
 #include <cuckoocache.h>
 #include <hash.h>
 #include <init.h>
+#include <mainchainrpc.h>
 #include <net.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
@@ -48,9 +51,11 @@
 
 #include <future>
 #include <sstream>
+#include <unordered_map>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string/join.hpp>
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
 
 #if defined(NDEBUG)
@@ -245,6 +250,11 @@ const std::string strRefundMessageMagic = "REFUND DhjM9iNapSA 3e243e21\n";
 std::mutex mainBlockCacheMutex;
 std::mutex mainBlockCacheReorgMutex;
 
+/** Whether mainchain tip notifications are keeping the main block cache synced */
+static std::atomic<bool> fMainchainTipTracked(false);
+/** Time of the last successful main block cache sync with the mainchain */
+static std::atomic<int64_t> nLastMainBlockCacheSync(0);
+
 // Internal stuff
 namespace {
     CBlockIndex *&pindexBestInvalid = g_chainstate.pindexBestInvalid;
@@ -291,7 +301,9 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 std::unique_ptr<CCoinsViewDB> pcoinsdbview;
 std::unique_ptr<CCoinsViewCache> pcoinsTip;
 std::unique_ptr<CBlockTreeDB> pblocktree;
-std::unique_ptr<CSidechainTreeDB> psidechaintree;
+std::unique_ptr<CSidechainTreeDB> psidechaintreedb;
+std::unique_ptr<CSidechainTreeCache> psidechaintree;
+std::unique_ptr<CMainBlockDB> pmainblockdb;
 
 enum FlushStateMode {
     FLUSH_STATE_NONE,
@@ -594,38 +606,45 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         return state.Invalid(false, REJECT_DUPLICATE, "txn-already-in-mempool");
     }
 
-    // If this is a wt check that it is valid
-    for (const CTxOut& txout : tx.vout) {
-        const CScript& scriptPubKey = txout.scriptPubKey;
-        std::vector<unsigned char> vch;
-        if (!scriptPubKey.IsSidechainObj(vch))
-            continue;
+    // Parse the sidechain objects of the transaction once, they are kept
+    // with the mempool entry
+    MemPoolSidechainInfo sidechainInfo;
 
-        SidechainObj *obj = ParseSidechainObj(vch);
-        if (!obj)
+    // If this is a wt check that it is valid
+    const SidechainObjIndex sidechainObjs = ParseSidechainObjs(tx);
+    std::vector<CAmount> vBurnAmount;
+    if (!sidechainObjs.vWT.empty()) {
+        // Amounts of the burn outputs a WT can use
+        for (const CTxOut& o : tx.vout) {
+            if (o.scriptPubKey.size() && o.scriptPubKey[0] == OP_RETURN)
+                vBurnAmount.push_back(o.nValue);
+        }
+        std::sort(vBurnAmount.begin(), vBurnAmount.end());
+    }
+    for (const SidechainObjIndex::Entry& entry : sidechainObjs.vObj) {
+        if (!entry.IsValid())
             return state.Invalid(false, REJECT_INVALID, "invalid-sidechain-obj-script");
 
-        if (obj->sidechainop == DB_SIDECHAIN_WT_OP) {
-            SidechainWT *wt = dynamic_cast<SidechainWT*>(obj);
-            // Verify that burn output actually exists
-            bool fBurnFound = false;
-            for (const CTxOut& o : tx.vout) {
-                if (o.scriptPubKey.size()
-                        && o.scriptPubKey[0] == OP_RETURN
-                        && o.nValue == wt->amount)
-                {
-                    // Make sure that the burn amount & fee are valid
-                    if (wt->amount > 0 && wt->mainchainFee > 0 && wt->amount > wt->mainchainFee)
-                        fBurnFound = true;
-                }
-            }
+        if (entry.sidechainop == DB_SIDECHAIN_WT_OP) {
+            const SidechainWT* wt = &sidechainObjs.vWT[entry.nPos];
+            // Verify that burn output actually exists and that the burn
+            // amount & fee are valid
+            bool fBurnFound = std::binary_search(vBurnAmount.begin(), vBurnAmount.end(), wt->amount)
+                    && wt->amount > 0 && wt->mainchainFee > 0 && wt->amount > wt->mainchainFee;
             if (!fBurnFound) {
                 return state.DoS(100, false, REJECT_INVALID, "invalid-wt-missing-or-invalid-burn");
             }
+
+            if (sidechainInfo.type == MemPoolSidechainType::NONE) {
+                sidechainInfo.type = MemPoolSidechainType::WT;
+                sidechainInfo.wtID = wt->GetID();
+                sidechainInfo.wt = std::make_shared<const SidechainWT>(*wt);
+            }
         }
     }
 
     // If this transaction is a WT refund request, verify it.
+    bool fWTRefund = false;
     for (const CTxOut& o : tx.vout) {
         const CScript& scriptPubKey = o.scriptPubKey;
         uint256 wtID;
@@ -649,6 +668,15 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
             return state.DoS(100, error("%s: Invalid WT refund!", __func__),
                         REJECT_INVALID, "verify-wt-refund-invalid");
         }
+
+        // Keep track of the first WT refund request
+        if (!fWTRefund) {
+            fWTRefund = true;
+            sidechainInfo.type = MemPoolSidechainType::WT_REFUND;
+            sidechainInfo.wtID = wtID;
+            sidechainInfo.wt.reset();
+            sidechainInfo.vchRefundSig = vchSig;
+        }
     }
 
     // Check for conflicts with in-memory transactions
@@ -767,17 +795,8 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
             }
         }
 
-        // Keep track of transactions that have a WT refund request script
-        bool fWTRefund = false;
-        uint256 wtID;
-        for (const CTxOut& o : tx.vout) {
-            std::vector<unsigned char> vchSig;
-            if (o.scriptPubKey.IsWTRefundRequest(wtID, vchSig))
-                fWTRefund = true;
-        }
-
         CTxMemPoolEntry entry(ptx, nFees, nAcceptTime, chainActive.Height(),
-                              fSpendsCoinbase, fWTRefund, wtID, nSigOpsCost, lp);
+                              fSpendsCoinbase, sidechainInfo, nSigOpsCost, lp);
         unsigned int nSize = entry.GetTxSize();
 
         // Check that the transaction doesn't have an excessive number of
@@ -1620,6 +1639,8 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
         return DISCONNECT_FAILED;
     }
 
+    std::shared_ptr<const SidechainObjIndex> sidechainObjs = GetBlockSidechainObjs(block);
+
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
         const CTransaction &tx = *(block.vtx[i]);
@@ -1643,16 +1664,15 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
 
             // If this output is a WT^ database entry, reset the status of wt(s)
             // included in the WT^
-            std::vector<unsigned char> vch;
-            if (scriptPubKey.IsSidechainObj(vch)) {
-                SidechainObj *obj = ParseSidechainObj(vch);
-                if (!obj) {
+            const SidechainObjIndex::Entry* entry = sidechainObjs->Find(i, o);
+            if (entry) {
+                if (!entry->IsValid()) {
                     error("DisconnectBlock(): failure reading sidechain obj");
                     return DISCONNECT_FAILED;
                 }
 
-                if (obj->sidechainop == DB_SIDECHAIN_WTPRIME_OP) {
-                    const SidechainWTPrime *wtPrime = (const SidechainWTPrime *) obj;
+                if (entry->sidechainop == DB_SIDECHAIN_WTPRIME_OP) {
+                    const SidechainWTPrime *wtPrime = &sidechainObjs->vWTPrime[entry->nPos];
 
                     std::vector<SidechainWT> vWT;
                     for (const uint256& wtid : wtPrime->vWT) {
@@ -1815,7 +1835,7 @@ static bool WriteTxIndexDataForBlock(const CBlock& block, CValidationState& stat
     return true;
 }
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+static CWorkStealingCheckQueue<CScriptCheck> scriptcheckqueue(128);
 
 void ThreadScriptCheck() {
     RenameThread("bitcoin-scriptch");
@@ -2012,7 +2032,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
 
     CBlockUndo blockundo;
 
-    CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
+    CCheckQueueControl<CScriptCheck, CWorkStealingCheckQueue<CScriptCheck> > control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
 
     std::vector<int> prevheights;
     CAmount nFees = 0;
@@ -2026,6 +2046,8 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     std::multimap<std::pair<CScript, CAmount>, uint256> mapRefundOutputs;
     std::vector<SidechainWT> vRefundedWT;
     std::set<uint256> setRefundWTID;
+    // Sidechain objects of the block, usually already parsed by CheckBlock
+    std::shared_ptr<const SidechainObjIndex> sidechainObjs = GetBlockSidechainObjs(block);
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
         const CTransaction &tx = *(block.vtx[i]);
@@ -2101,28 +2123,20 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
         // Count deposit output amounts and collect deposits
         std::vector<SidechainDeposit> vDeposit;
         if (tx.IsCoinBase()) {
-            for (const CTxOut& out : tx.vout) {
-                const CScript& scriptPubKey = out.scriptPubKey;
-
-                std::vector<unsigned char> vch;
-                if (!scriptPubKey.IsSidechainObj(vch))
-                    continue;
-
-                SidechainObj *obj = ParseSidechainObj(vch);
-                if (!obj) {
+            auto range = sidechainObjs->GetTx(i);
+            for (auto it = range.first; it != range.second; it++) {
+                if (!it->IsValid()) {
                     return state.DoS(90, error("%s: invalid sidechain obj script", __func__), REJECT_INVALID, "invalid-sidechain-obj-script");
                 }
 
-                if (obj->sidechainop != DB_SIDECHAIN_DEPOSIT_OP)
+                if (it->sidechainop != DB_SIDECHAIN_DEPOSIT_OP)
                     continue;
 
-                const SidechainDeposit *deposit = (const SidechainDeposit *) obj;
-
-                nDepositPayout += deposit->amtUserPayout;
+                const SidechainDeposit& deposit = sidechainObjs->vDeposit[it->nPos];
 
-                vDeposit.push_back(SidechainDeposit(deposit));
+                nDepositPayout += deposit.amtUserPayout;
 
-                delete obj;
+                vDeposit.push_back(deposit);
             }
         }
 
@@ -2146,9 +2160,9 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
                 // First deposit should be spending current CTIP, find the
                 // current CTIP in the deposit's inputs
                 bool fFound = false;
-                for (const CTxIn& in : vDeposit.front().dtx.vin) {
-                    if (in.prevout.hash == prev.dtx.GetHash() &&
-                            prev.dtx.vout.size() > in.prevout.n &&
+                for (const CTxIn& in : vDeposit.front().dtx->vin) {
+                    if (in.prevout.hash == prev.dtx->GetHash() &&
+                            prev.dtx->vout.size() > in.prevout.n &&
                             prev.nBurnIndex == in.prevout.n) {
                         fFound = true;
                         break;
@@ -2158,13 +2172,13 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
                     return state.DoS(90, error("%s: invalid sidechain deposit input:\n%s", __func__, vDeposit.front().ToString()), REJECT_INVALID, "invalid-deposit-input");
                 }
                 // Copy the burn amount from CTIP
-                amountPrev = prev.dtx.vout[prev.nBurnIndex].nValue;
+                amountPrev = prev.dtx->vout[prev.nBurnIndex].nValue;
             }
 
             // Check deposit payout amounts & find coinbase output
             for (const SidechainDeposit& d : vDeposit) {
 
-                CAmount burn = d.dtx.vout[d.nBurnIndex].nValue;
+                CAmount burn = d.dtx->vout[d.nBurnIndex].nValue;
                 CAmount payout = burn - amountPrev;
 
                 amountPrev = burn;
@@ -2306,7 +2320,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
         if (psidechaintree->GetWTPrime(hashLatestWTPrime, wtPrimeLatest)) {
             // If we haven't broadcasted the latest WT^ yet, do it now
             if (!bmmCache.HaveBroadcastedWTPrime(hashLatestWTPrime)) {
-                std::string strHex = EncodeHexTx(wtPrimeLatest.wtPrime);
+                std::string strHex = EncodeHexTx(*wtPrimeLatest.wtPrime);
                 if (client.BroadcastWTPrime(strHex)) {
                     bmmCache.StoreBroadcastedWTPrime(hashLatestWTPrime);
                 }
@@ -2339,7 +2353,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
                 // update with the new WT^ status. If the commit is for the
                 // current WT^ (which it always should be in practice) we have
                 // already loaded it.
-                if (hashWTPrime == wtPrimeLatest.wtPrime.GetHash()) {
+                if (hashWTPrime == wtPrimeLatest.wtPrime->GetHash()) {
                     wtPrimeLatest.status = fFailCommit ? WTPRIME_FAILED : WTPRIME_SPENT;
 
                     // Keep track of the height a WT^ was marked failed
@@ -2368,84 +2382,73 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
 
         // Collect & verify sidechain objects
         std::vector<std::pair<uint256, const SidechainObj *> > vSidechainObjects;
+        // New WT^(s) with the block height set, referenced by vSidechainObjects
+        std::deque<SidechainWTPrime> deqWTPrime;
         bool fFoundWTPrime = false;
-        for (const CTransactionRef& tx : block.vtx) {
-            for (const CTxOut& txout : tx->vout) {
-                const CScript& scriptPubKey = txout.scriptPubKey;
-
-                std::vector<unsigned char> vch;
-                if (!scriptPubKey.IsSidechainObj(vch))
-                    continue;
-
-                SidechainObj *obj = ParseSidechainObj(vch);
-                if (!obj)
-                    return state.Error("Invalid sidechain obj script");
-
-                // TODO
-                // Refactor. We are also loading SidechainWT *wt later when
-                // calculating the ID. Instead do it only once.
-
-                // Check validity of wt(s). Block invalid if any wt is invalid.
-                if (obj->sidechainop == DB_SIDECHAIN_WT_OP) {
-                    const SidechainWT *wt = (const SidechainWT *) obj;
-                    // Verify that burn output actually exists
-                    bool fBurnFound = false;
-                    // TODO refactor: looping through vout again during a loop
-                    // through vout... could be more efficient
-                    for (const CTxOut& o : tx->vout) {
-                        if (o.scriptPubKey.size()
-                                && o.scriptPubKey[0] == OP_RETURN
-                                && o.nValue == wt->amount)
-                        {
-                            // Make sure that the burn amount & fee are valid
-                            if (wt->amount > 0 && wt->mainchainFee > 0 && wt->amount > wt->mainchainFee)
-                                fBurnFound = true;
-                        }
-                    }
-                    if (!fBurnFound) {
-                        return state.Error("Invalid WT: invalid-wt-missing-or-invalid-burn");
+        for (const SidechainObjIndex::Entry& entry : sidechainObjs->vObj) {
+            if (!entry.IsValid())
+                return state.Error("Invalid sidechain obj script");
+
+            const CTransaction& tx = *block.vtx[entry.nTx];
+
+            // Check validity of wt(s). Block invalid if any wt is invalid.
+            if (entry.sidechainop == DB_SIDECHAIN_WT_OP) {
+                const SidechainWT& wt = sidechainObjs->vWT[entry.nPos];
+                // Verify that burn output actually exists
+                bool fBurnFound = false;
+                for (const CTxOut& o : tx.vout) {
+                    if (o.scriptPubKey.size()
+                            && o.scriptPubKey[0] == OP_RETURN
+                            && o.nValue == wt.amount)
+                    {
+                        // Make sure that the burn amount & fee are valid
+                        if (wt.amount > 0 && wt.mainchainFee > 0 && wt.amount > wt.mainchainFee)
+                            fBurnFound = true;
                     }
                 }
-
-                // If the object is a wt we do not want the ID to change when
-                // the wt status is changed so that we can update the status
-                // using the same ID in ldb.
-                uint256 id;
-                if (obj->sidechainop == DB_SIDECHAIN_WT_OP) {
-                    const SidechainWT *wt = (const SidechainWT *) obj;
-                    id = wt->GetID();
+                if (!fBurnFound) {
+                    return state.Error("Invalid WT: invalid-wt-missing-or-invalid-burn");
                 }
-                else
-                if (obj->sidechainop == DB_SIDECHAIN_WTPRIME_OP) {
-                    // A block is invalid if it adds a new WT^ when the current
-                    // WT^ status hasn't been updated to either WTPRIME_FAILED
-                    // or WTPRIME_SPENT
-                    if (!hashLatestWTPrime.IsNull()) {
-                        if (wtPrimeLatest.status == WTPRIME_CREATED) {
-                            return state.Error(strprintf("%s Invalid WT^ - current WT^ still pending!\n", __func__));
-                        }
+            }
+
+            // If the object is a wt we do not want the ID to change when
+            // the wt status is changed so that we can update the status
+            // using the same ID in ldb.
+            uint256 id;
+            const SidechainObj *obj = &sidechainObjs->Get(entry);
+            if (entry.sidechainop == DB_SIDECHAIN_WT_OP) {
+                id = sidechainObjs->vWT[entry.nPos].GetID();
+            }
+            else
+            if (entry.sidechainop == DB_SIDECHAIN_WTPRIME_OP) {
+                // A block is invalid if it adds a new WT^ when the current
+                // WT^ status hasn't been updated to either WTPRIME_FAILED
+                // or WTPRIME_SPENT
+                if (!hashLatestWTPrime.IsNull()) {
+                    if (wtPrimeLatest.status == WTPRIME_CREATED) {
+                        return state.Error(strprintf("%s Invalid WT^ - current WT^ still pending!\n", __func__));
                     }
+                }
 
-                    // If we find a WT^ we will call VerifyWTPrimes later
-                    fFoundWTPrime = true;
+                // If we find a WT^ we will call VerifyWTPrimes later
+                fFoundWTPrime = true;
 
-                    SidechainWTPrime *wtPrime = (SidechainWTPrime *) obj;
+                deqWTPrime.push_back(sidechainObjs->vWTPrime[entry.nPos]);
+                SidechainWTPrime *wtPrime = &deqWTPrime.back();
 
-                    // Insert block height
-                    wtPrime->nHeight = pindex->nHeight;
+                // Insert block height
+                wtPrime->nHeight = pindex->nHeight;
 
-                    id = wtPrime->GetID();
-                    obj = (SidechainObj *) wtPrime;
+                id = wtPrime->GetID();
+                obj = wtPrime;
 
-                    LogPrintf("%s: Found new WT^: %s.\n", __func__, wtPrime->wtPrime.GetHash().ToString());
-                }
-                else
-                if (obj->sidechainop == DB_SIDECHAIN_DEPOSIT_OP) {
-                    const SidechainDeposit *deposit = (const SidechainDeposit *) obj;
-                    id = deposit->GetID();
-                }
-                vSidechainObjects.push_back(std::make_pair(id, obj));
+                LogPrintf("%s: Found new WT^: %s.\n", __func__, wtPrime->wtPrime->GetHash().ToString());
             }
+            else
+            if (entry.sidechainop == DB_SIDECHAIN_DEPOSIT_OP) {
+                id = sidechainObjs->vDeposit[entry.nPos].GetID();
+            }
+            vSidechainObjects.push_back(std::make_pair(id, obj));
         }
 
         // Handle WT^ verification & wt status update
@@ -2456,7 +2459,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
             uint256 hashWTPrimeID;
 
             // This will also return a list of wt(s) from the WT^
-            if (!VerifyWTPrimes(strFail, pindex->nHeight, block.vtx, vWT, hashWTPrime, hashWTPrimeID, fCheckBMM /* fReplicate */))
+            if (!VerifyWTPrimes(strFail, pindex->nHeight, *sidechainObjs, vWT, hashWTPrime, hashWTPrimeID, fCheckBMM /* fReplicate */))
                 return state.Error(strprintf("%s: Invalid WT^! Error: %s", __func__, strFail));
 
             if (hashWTPrime.IsNull())
@@ -2472,10 +2475,6 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
             bool ret = psidechaintree->WriteSidechainIndex(vSidechainObjects);
             if (!ret)
                 return state.Error("Failed to write sidechain index!");
-
-            // Cleanup
-            for (size_t i = 0; i < vSidechainObjects.size(); i++)
-                delete vSidechainObjects[i].second;
         }
     }
 
@@ -2538,7 +2537,7 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             nLastSetChain = nNow;
         }
         int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
-        int64_t cacheSize = pcoinsTip->DynamicMemoryUsage();
+        int64_t cacheSize = pcoinsTip->DynamicMemoryUsage() + psidechaintree->DynamicMemoryUsage();
         int64_t nTotalSpace = nCoinCacheUsage + std::max<int64_t>(nMempoolSizeMax - nMempoolUsage, 0);
         // The cache is large and we're within 10% and 10 MiB of the limit, but we have time now (not in the middle of a block processing).
         bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize > std::max((9 * nTotalSpace) / 10, nTotalSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024);
@@ -2590,8 +2589,8 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
             // Flush the chainstate (which may refer to block index entries).
-            if (!pcoinsTip->Flush())
-                return AbortNode(state, "Failed to write to coin database");
+            if (!FlushChainstateCaches(*pcoinsTip, *psidechaintree))
+                return AbortNode(state, "Failed to write to coin or sidechain database");
             nLastFlush = nNow;
         }
     }
@@ -2606,6 +2605,18 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
     return true;
 }
 
+bool FlushChainstateCaches(CCoinsViewCache& coins, CSidechainTreeCache& sidechaintree)
+{
+    // The sidechain objects go first. The coins best block is the last block
+    // considered connected on restart, and ReplayBlocks only replays coins,
+    // so the objects of every block up to it must be on disk already. If we
+    // stop in between, the blocks after the old coins best block are
+    // connected again and write the same objects.
+    if (!sidechaintree.Flush())
+        return false;
+    return coins.Flush();
+}
+
 void FlushStateToDisk() {
     CValidationState state;
     const CChainParams& chainparams = Params();
@@ -2634,6 +2645,9 @@ void static UpdateTip(const CBlockIndex *pindexNew, const CChainParams& chainPar
     // New best block
     mempool.AddTransactionsUpdated(1);
 
+    // Newly verified BMM and deposits are cached at the new height
+    bmmCache.SetSidechainHeight(pindexNew->nHeight);
+
     cvBlockChange.notify_all();
 
     std::vector<std::string> warningMessages;
@@ -2738,6 +2752,7 @@ bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& cha
 }
 
 static int64_t nTimeReadFromDisk = 0;
+static int64_t nTimePrefetch = 0;
 static int64_t nTimeConnectTotal = 0;
 static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
@@ -2833,6 +2848,14 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
+    // Read the block's inputs that aren't cached in parallel, rather than one
+    // at a time as ConnectBlock gets to them
+    if (pcoinsprefetcher) {
+        CoinsPrefetchStats stats = pcoinsprefetcher->Prefetch(blockConnecting, *pcoinsTip, *pcoinsdbview);
+        nTimePrefetch += stats.nTimeTotal;
+        LogPrint(BCLog::BENCH, "  - Prefetch inputs: %.2fms (%u cached, %u read, %u not found) [%.2fs]\n", stats.nTimeTotal * MILLI,
+                stats.nHits, stats.nMisses, stats.nNotFound, nTimePrefetch * MICRO);
+    }
     {
         CCoinsViewCache view(pcoinsTip.get());
         bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams);
@@ -3499,29 +3522,25 @@ bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::P
 
     // Find deposits and verify that they exist with mainchain
     if (fCheckBMM) {
-        for (const CTxOut& out : block.vtx[0]->vout) {
-            const CScript& scriptPubKey = out.scriptPubKey;
-
-            std::vector<unsigned char> vch;
-            if (!scriptPubKey.IsSidechainObj(vch))
-                continue;
+        // Parse the sidechain objects once for this and later checks
+        std::shared_ptr<const SidechainObjIndex> sidechainObjs = GetBlockSidechainObjs(block, fCheckMerkleRoot /* fStore */);
 
-            SidechainObj *obj = ParseSidechainObj(vch);
-            if (!obj) {
+        std::vector<SidechainDepositQuery> vDepositQuery;
+        auto range = sidechainObjs->GetTx(0);
+        for (auto it = range.first; it != range.second; it++) {
+            if (!it->IsValid()) {
                 return state.DoS(90, error("%s: invalid sidechain deposit obj script", __func__), REJECT_INVALID, "invalid-sidechain-obj-script");
             }
 
-            if (obj->sidechainop != DB_SIDECHAIN_DEPOSIT_OP)
-                continue;
-
-            const SidechainDeposit* deposit = (const SidechainDeposit *) obj;
-
-            if (!VerifyDeposit(deposit->hashMainchainBlock, deposit->dtx.GetHash(), deposit->nTx)) {
-                delete obj;
-                return state.DoS(1, error("%s: invalid sidechain deposit", __func__), REJECT_INVALID, "invalid-sidechain-deposit");
+            if (it->sidechainop == DB_SIDECHAIN_DEPOSIT_OP) {
+                const SidechainDeposit& deposit = sidechainObjs->vDeposit[it->nPos];
+                vDepositQuery.emplace_back(deposit.hashMainchainBlock, deposit.dtx->GetHash(), deposit.nTx);
             }
+        }
 
-            delete obj;
+        // Verify all of the deposits with a single batch of requests
+        if (!VerifyDeposits(vDepositQuery)) {
+            return state.DoS(1, error("%s: invalid sidechain deposit", __func__), REJECT_INVALID, "invalid-sidechain-deposit");
         }
     }
 
@@ -3545,6 +3564,24 @@ bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::P
     return true;
 }
 
+/**
+ * Check BMM for a header with a proof from bmmProofCache, without the
+ * mainchain. On success the proof is returned to be stored with the block.
+ */
+static bool VerifyBMMProof(const CBlockHeader& header, BMMProof& proof)
+{
+    if (!bmmProofCache.Get(header.hashMainchainBlock, header.hashMerkleRoot, proof))
+        return false;
+
+    std::string strFail;
+    if (!CheckBMMProof(header, proof, strFail)) {
+        LogPrintf("%s: Invalid BMM proof for block %s: %s\n", __func__, header.GetHash().ToString(), strFail);
+        return false;
+    }
+
+    return true;
+}
+
 bool VerifyBMM(const CBlock& block)
 {
     // Skip genesis block
@@ -3555,6 +3592,15 @@ bool VerifyBMM(const CBlock& block)
     if (bmmCache.HaveVerifiedBMM(block.GetHash()))
         return true;
 
+    // Verify BMM with a proof if we have one
+    BMMProof proof;
+    if (VerifyBMMProof(block, proof)) {
+        bmmCache.CacheVerifiedBMM(block.GetHash());
+        if (pblocktree)
+            pblocktree->WriteBMMProofs({std::make_pair(block.GetHash(), proof)});
+        return true;
+    }
+
     // h*
     const uint256 hashMerkleRoot = block.hashMerkleRoot;
 
@@ -3576,6 +3622,62 @@ bool VerifyBMM(const CBlock& block)
     return true;
 }
 
+bool VerifyBMMHeaders(const std::vector<CBlockHeader>& vHeader)
+{
+    const uint256& hashGenesis = Params().GetConsensus().hashGenesisBlock;
+
+    int64_t nTimeStart = GetTimeMicros();
+
+    // Collect the headers that we haven't verified BMM for yet. Headers that
+    // we have a BMM proof for are verified right away.
+    std::vector<uint256> vHash;
+    std::vector<SidechainBMMQuery> vQuery;
+    std::vector<std::pair<uint256, BMMProof> > vProof;
+    for (const CBlockHeader& header : vHeader) {
+        uint256 hash = header.GetHash();
+        if (hash == hashGenesis || bmmCache.HaveVerifiedBMM(hash))
+            continue;
+
+        BMMProof proof;
+        if (VerifyBMMProof(header, proof)) {
+            bmmCache.CacheVerifiedBMM(hash);
+            vProof.emplace_back(hash, proof);
+            continue;
+        }
+
+        vHash.push_back(hash);
+        vQuery.emplace_back(header.hashMainchainBlock, header.hashMerkleRoot);
+    }
+
+    if (!vProof.empty()) {
+        if (pblocktree)
+            pblocktree->WriteBMMProofs(vProof);
+        LogPrint(BCLog::BENCH, "    - Verify BMM: %u headers verified with proofs: %.2fms\n", vProof.size(), (GetTimeMicros() - nTimeStart) * MILLI);
+    }
+
+    if (vQuery.empty())
+        return true;
+
+    SidechainClient client;
+    if (!client.VerifyBMMBatch(vQuery)) {
+        LogPrintf("%s: Failed to request BMM verification for %u headers!\n", __func__, vQuery.size());
+        return false;
+    }
+
+    // Cache the results so that AcceptBlockHeader finds them
+    size_t nVerified = 0;
+    for (size_t i = 0; i < vQuery.size(); i++) {
+        if (vQuery[i].fFound) {
+            bmmCache.CacheVerifiedBMM(vHash[i]);
+            nVerified++;
+        }
+    }
+
+    LogPrint(BCLog::BENCH, "    - Verify BMM: %u of %u headers verified: %.2fms\n", nVerified, vQuery.size(), (GetTimeMicros() - nTimeStart) * MILLI);
+
+    return true;
+}
+
 bool VerifyDeposit(const uint256& hashMainBlock, const uint256& txid, const int nTx)
 {
     if (hashMainBlock.IsNull()) {
@@ -3600,6 +3702,40 @@ bool VerifyDeposit(const uint256& hashMainBlock, const uint256& txid, const int
     return true;
 }
 
+bool VerifyDeposits(std::vector<SidechainDepositQuery>& vQuery)
+{
+    // Only ask the mainchain about deposits we haven't verified before
+    std::vector<SidechainDepositQuery> vToVerify;
+    for (SidechainDepositQuery& query : vQuery) {
+        if (query.hashMainBlock.IsNull() || query.txid.IsNull())
+            return false;
+
+        query.fVerified = bmmCache.HaveVerifiedDeposit(query.txid);
+        if (!query.fVerified)
+            vToVerify.push_back(query);
+    }
+
+    if (vToVerify.empty())
+        return true;
+
+    SidechainClient client;
+    if (!client.VerifyDepositBatch(vToVerify))
+        return false;
+
+    for (const SidechainDepositQuery& query : vToVerify) {
+        if (!query.fVerified)
+            return false;
+
+        // Cache that we have verified the deposit
+        bmmCache.CacheVerifiedDeposit(query.txid);
+    }
+
+    for (SidechainDepositQuery& query : vQuery)
+        query.fVerified = true;
+
+    return true;
+}
+
 bool IsWitnessEnabled(const CBlockIndex* pindexPrev, const Consensus::Params& params)
 {
     LOCK(cs_main);
@@ -3936,8 +4072,9 @@ bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState&
 
     bool fGenesis = (hash == Params().GetConsensus().hashGenesisBlock);
 
-    // Check for mainchain connection
-    if (!fGenesis && !CheckMainchainConnection()) {
+    // Check for mainchain connection, unless BMM was already verified (for
+    // example by VerifyBMMHeaders) and the mainchain isn't needed
+    if (!fGenesis && !bmmCache.HaveVerifiedBMM(hash) && !CheckMainchainConnection()) {
         SetNetworkActive(false, "Failed to connect to mainchain when checking block header!");
         return false;
     }
@@ -3999,15 +4136,24 @@ bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState&
 // Exposed wrapper for AcceptBlockHeader
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex, CBlockHeader *first_invalid)
 {
+    // Headers with BMM proofs can still be checked against the main block
+    // cache we have if the mainchain can't be reached. Headers without them
+    // fail in VerifyBMMHeaders then.
     bool fReorg = false;
     std::vector<uint256> vOrphan;
-    if (!UpdateMainBlockHashCache(fReorg, vOrphan)) {
+    if (!SyncMainBlockHashCache(fReorg, vOrphan))
         LogPrintf("%s: Failed to update main block hash cache!\n", __func__);
-        return false;
-    }
     if (fReorg)
         HandleMainchainReorg(vOrphan);
 
+    // Verify BMM for the whole batch of headers before taking cs_main, so
+    // that AcceptBlockHeader doesn't have to wait on the mainchain for each
+    // header while holding the lock.
+    if (!VerifyBMMHeaders(headers)) {
+        SetNetworkActive(false, "Failed to connect to mainchain when checking block headers!");
+        return false;
+    }
+
     if (first_invalid != nullptr) first_invalid->SetNull();
     {
         LOCK(cs_main);
@@ -4106,7 +4252,7 @@ bool CChainState::AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CVali
         std::vector<SidechainWT> vWT;
         uint256 hashWTPrime;
         uint256 hashWTPrimeID;
-        if (!VerifyWTPrimes(strFail, pindex->nHeight, block.vtx, vWT, hashWTPrime, hashWTPrimeID, true /* fReplicate */)) {
+        if (!VerifyWTPrimes(strFail, pindex->nHeight, *GetBlockSidechainObjs(block), vWT, hashWTPrime, hashWTPrimeID, true /* fReplicate */)) {
             state.Error(strprintf("%s: invalid-wtprime error: %s", __func__, strFail));
             return error("%s: invalid WT^! Error: %s", __func__, strFail);
         }
@@ -4142,7 +4288,7 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
 {
     bool fReorg = false;
     std::vector<uint256> vOrphan;
-    if (!UpdateMainBlockHashCache(fReorg, vOrphan)) {
+    if (!SyncMainBlockHashCache(fReorg, vOrphan)) {
         LogPrintf("%s: Failed to update main block hash cache!\n", __func__);
         if (!fUnitTest)
             return false;
@@ -4230,9 +4376,11 @@ void PruneOneBlockFile(const int fileNumber)
 {
     LOCK(cs_LastBlockFile);
 
+    std::vector<uint256> vBMMProof;
     for (const auto& entry : mapBlockIndex) {
         CBlockIndex* pindex = entry.second;
         if (pindex->nFile == fileNumber) {
+            vBMMProof.push_back(pindex->GetBlockHash());
             pindex->nStatus &= ~BLOCK_HAVE_DATA;
             pindex->nStatus &= ~BLOCK_HAVE_UNDO;
             pindex->nFile = 0;
@@ -4255,6 +4403,11 @@ void PruneOneBlockFile(const int fileNumber)
         }
     }
 
+    // BMM proofs are pruned with their blocks. The headers are still served,
+    // peers check their BMM with the mainchain instead.
+    if (!vBMMProof.empty() && pblocktree && !pblocktree->EraseBMMProofs(vBMMProof))
+        LogPrintf("%s: Failed to erase BMM proofs of block file %d\n", __func__, fileNumber);
+
     vinfoBlockFile[fileNumber].SetNull();
     setDirtyFileInfo.insert(fileNumber);
 }
@@ -5420,6 +5573,35 @@ bool DumpMempool(void)
     return true;
 }
 
+// The verified BMM and deposit caches are written oldest first as one block
+// of hashes, followed by the sidechain heights they were verified at as
+// VARINT deltas (the heights never decrease).
+static void WriteVerifiedCache(CAutoFile& fileout, const std::vector<uint256>& vHash, const std::vector<int>& vHeight)
+{
+    fileout << vHash;
+
+    int nPrev = 0;
+    for (int nHeight : vHeight) {
+        uint32_t nDelta = nHeight - nPrev;
+        fileout << VARINT(nDelta);
+        nPrev = nHeight;
+    }
+}
+
+static void ReadVerifiedCache(CAutoFile& filein, std::vector<uint256>& vHash, std::vector<int>& vHeight)
+{
+    filein >> vHash;
+
+    vHeight.resize(vHash.size());
+    int nHeight = 0;
+    for (int& n : vHeight) {
+        uint32_t nDelta = 0;
+        filein >> VARINT(nDelta);
+        nHeight += nDelta;
+        n = nHeight;
+    }
+}
+
 void LoadBMMCache()
 {
     fs::path path = GetDataDir() / "bmm.dat";
@@ -5430,7 +5612,9 @@ void LoadBMMCache()
 
     std::vector<uint256> vHashWT;
     std::vector<uint256> vHashBMM;
+    std::vector<int> vHeightBMM;
     std::vector<uint256> vDepositTXID;
+    std::vector<int> vHeightDeposit;
     try {
         int nVersionRequired, nVersionThatWrote;
         filein >> nVersionRequired;
@@ -5446,19 +5630,28 @@ void LoadBMMCache()
             filein >> hash;
             vHashWT.push_back(hash);
         }
-        int nBMM = 0;
-        filein >> nBMM;
-        for (int i = 0; i < nBMM; i++) {
-            uint256 hash;
-            filein >> hash;
-            vHashBMM.push_back(hash);
-        }
-        int nDeposit = 0;
-        filein >> nDeposit;
-        for (int i = 0; i < nDeposit; i++) {
-            uint256 hash;
-            filein >> hash;
-            vDepositTXID.push_back(hash);
+
+        if (nVersionRequired >= BMM_CACHE_COMPACT_VERSION) {
+            ReadVerifiedCache(filein, vHashBMM, vHeightBMM);
+            ReadVerifiedCache(filein, vDepositTXID, vHeightDeposit);
+        } else {
+            // Older versions wrote counted lists of hashes without heights
+            int nBMM = 0;
+            filein >> nBMM;
+            for (int i = 0; i < nBMM; i++) {
+                uint256 hash;
+                filein >> hash;
+                vHashBMM.push_back(hash);
+            }
+            int nDeposit = 0;
+            filein >> nDeposit;
+            for (int i = 0; i < nDeposit; i++) {
+                uint256 hash;
+                filein >> hash;
+                vDepositTXID.push_back(hash);
+            }
+            vHeightBMM.resize(vHashBMM.size());
+            vHeightDeposit.resize(vDepositTXID.size());
         }
     }
     catch (const std::exception& e) {
@@ -5469,23 +5662,23 @@ void LoadBMMCache()
     for (const uint256& u : vHashWT) {
         bmmCache.StoreBroadcastedWTPrime(u);
     }
-    for (const uint256& u : vHashBMM) {
-        bmmCache.CacheVerifiedBMM(u);
-    }
-    for (const uint256& u : vDepositTXID) {
-        bmmCache.CacheVerifiedDeposit(u);
-    }
+    bmmCache.LoadVerifiedBMMCache(vHashBMM, vHeightBMM);
+    bmmCache.LoadVerifiedDepositCache(vDepositTXID, vHeightDeposit);
 }
 
 void DumpBMMCache()
 {
     std::vector<uint256> vHashWT = bmmCache.GetBroadcastedWTPrimeCache();
-    std::vector<uint256> vHashBMM = bmmCache.GetVerifiedBMMCache();
-    std::vector<uint256> vDepositTXID = bmmCache.GetVerifiedDepositCache();
+
+    std::vector<uint256> vHashBMM;
+    std::vector<int> vHeightBMM;
+    bmmCache.GetVerifiedBMMCache(vHashBMM, vHeightBMM);
+
+    std::vector<uint256> vDepositTXID;
+    std::vector<int> vHeightDeposit;
+    bmmCache.GetVerifiedDepositCache(vDepositTXID, vHeightDeposit);
 
     int nWT = vHashWT.size();
-    int nBMM = vHashBMM.size();
-    int nDeposit = vDepositTXID.size();
 
     fs::path path = GetDataDir() / "bmm.dat.new";
     CAutoFile fileout(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
@@ -5494,7 +5687,7 @@ void DumpBMMCache()
     }
 
     try {
-        fileout << 160000; // version required to read: 0.16.00 or later
+        fileout << BMM_CACHE_COMPACT_VERSION; // version required to read
         fileout << CLIENT_VERSION; // version that wrote the file
 
         // Broadcasted WT^ hash cache
@@ -5502,18 +5695,12 @@ void DumpBMMCache()
         for (const uint256& u : vHashWT) {
             fileout << u;
         }
+
         // Verified BMM hash cache
-        fileout << nBMM; // Number of WT^ hashes in file
-        for (const uint256& u : vHashBMM) {
-            fileout << u;
-        }
+        WriteVerifiedCache(fileout, vHashBMM, vHeightBMM);
 
         // Verified deposit txid cache
-        fileout << nDeposit; // Number of WT^ hashes in file
-        for (const uint256& u : vDepositTXID) {
-            fileout << u;
-        }
-
+        WriteVerifiedCache(fileout, vDepositTXID, vHeightDeposit);
     }
     catch (const std::exception& e) {
         LogPrintf("%s: Error writing BMM cache: %s", __func__, e.what());
@@ -5529,6 +5716,13 @@ void DumpBMMCache()
 
 void LoadMainBlockCache()
 {
+    // Mainchain block hashes are kept in the main block database
+    if (bmmCache.ReadMainBlockDB()) {
+        LogPrintf("%s: Loaded %u mainchain block hashes\n", __func__, bmmCache.GetCachedBlockCount());
+        return;
+    }
+
+    // Import the cache written to mainblockhash.dat by older versions
     fs::path path = GetDataDir() / "mainblockhash.dat";
     CAutoFile filein(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
     if (filein.IsNull()) {
@@ -5563,35 +5757,19 @@ void LoadMainBlockCache()
 
 void DumpMainBlockCache()
 {
-    std::vector<uint256> vHash = bmmCache.GetMainBlockHashCache();
-    if (vHash.empty())
+    int count = bmmCache.GetCachedBlockCount();
+    if (!count)
         return;
 
-    int count = vHash.size();
-
-    fs::path path = GetDataDir() / "mainblockhash.dat.new";
-    CAutoFile fileout(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull()) {
+    if (!bmmCache.WriteMainBlockDB()) {
+        LogPrintf("%s: Error writing main block cache\n", __func__);
         return;
     }
 
-    try {
-        fileout << 160000; // version required to read: 0.16.00 or later
-        fileout << CLIENT_VERSION; // version that wrote the file
-        fileout << count; // Number of WT^ hashes in file
-
-        for (const uint256& u : vHash) {
-            fileout << u;
-        }
-    }
-    catch (const std::exception& e) {
-        LogPrintf("%s: Error writing main block cache: %s", __func__, e.what());
-        return;
-    }
-
-    FileCommit(fileout.Get());
-    fileout.fclose();
-    RenameOver(GetDataDir() / "mainblockhash.dat.new", GetDataDir() / "mainblockhash.dat");
+    // The main block database replaces mainblockhash.dat
+    fs::path pathLegacy = GetDataDir() / "mainblockhash.dat";
+    if (fs::exists(pathLegacy))
+        fs::remove(pathLegacy);
 
     LogPrintf("%s: Wrote %u\n", __func__, count);
 }
@@ -5665,6 +5843,106 @@ void LoadWTIDCache()
         bmmCache.CacheWTID(u);
 }
 
+/**
+ * The WT^ that the current sidechain DB selects. The miner, AcceptBlock and
+ * ConnectBlock all create the same WT^ for a tip, so it is kept until the tip
+ * or a sidechain object changes.
+ */
+struct WTPrimeCandidate {
+    uint256 hashTip;
+    uint64_t nGeneration;
+
+    //! Number of unspent WT(s) selected for the WT^
+    size_t nWT;
+    //! Whether the WT^ passed mainchain standardness checks
+    bool fStandard;
+    std::string strReason;
+
+    CTransactionRef wtPrimeTx;
+    CTransactionRef wtPrimeDataTx;
+
+    WTPrimeCandidate() : nGeneration(0), nWT(0), fStandard(false) { }
+};
+
+/** WT^ builder and candidate kept between calls to CreateWTPrimeTx */
+static CCriticalSection cs_wtPrimeBuilder;
+static std::unique_ptr<WTPrimeBuilder> pwtPrimeBuilder;
+static std::shared_ptr<const WTPrimeCandidate> pwtPrimeCandidate;
+
+/** Create the WT^ from the unspent WT(s) with the highest mainchain fees, or
+ * return the candidate created for the same tip and sidechain DB generation */
+static std::shared_ptr<const WTPrimeCandidate> GetWTPrimeCandidate()
+{
+    AssertLockHeld(cs_main);
+    LOCK(cs_wtPrimeBuilder);
+
+    const uint256 hashTip = chainActive.Tip() ? chainActive.Tip()->GetBlockHash() : uint256();
+    const uint64_t nGeneration = psidechaintree->GetGeneration();
+    if (pwtPrimeCandidate && pwtPrimeCandidate->hashTip == hashTip
+            && pwtPrimeCandidate->nGeneration == nGeneration)
+        return pwtPrimeCandidate;
+
+    std::shared_ptr<WTPrimeCandidate> candidate = std::make_shared<WTPrimeCandidate>();
+    candidate->hashTip = hashTip;
+    candidate->nGeneration = nGeneration;
+
+    // Get the unspent WT(s) with the highest mainchain fees from psidechaintree
+    std::vector<SidechainWT> vWT = psidechaintree->GetWTsByStatus(THIS_SIDECHAIN, WT_UNSPENT, MAX_WTPRIME_WT);
+    candidate->nWT = vWT.size();
+
+    if (!vWT.empty()) {
+        if (!pwtPrimeBuilder)
+            pwtPrimeBuilder.reset(new WTPrimeBuilder());
+        WTPrimeBuilder& wtPrimeBuilder = *pwtPrimeBuilder;
+
+        // Keep the outputs of the WT(s) that are still selected in the same
+        // order, and add the rest until the WT^ is full.
+        const std::vector<uint256>& vWTIDBuilt = wtPrimeBuilder.GetWTIDs();
+        std::vector<uint256> vWTID;
+        vWTID.reserve(vWT.size());
+        size_t nKeep = 0;
+        for (const SidechainWT& wt : vWT) {
+            vWTID.push_back(wt.GetID());
+            if (nKeep == vWTID.size() - 1 && nKeep < vWTIDBuilt.size()
+                    && vWTIDBuilt[nKeep] == vWTID.back())
+                nKeep++;
+        }
+        wtPrimeBuilder.Truncate(nKeep);
+
+        for (size_t i = nKeep; i < vWT.size(); i++) {
+            // If the WT doesn't fit, stop
+            if (!wtPrimeBuilder.AddWT(vWT[i], vWTID[i]))
+                break;
+        }
+
+        // WT^ database object for psidechaintree (sidechain only)
+        SidechainWTPrime wtPrime;
+        wtPrime.nSidechain = THIS_SIDECHAIN;
+        wtPrime.vWT = wtPrimeBuilder.GetWTIDs();
+
+        CMutableTransaction wjtx = wtPrimeBuilder.GetTx(); // WT^
+
+        // Update mainchain fee encoding output.
+        wjtx.vout[1].scriptPubKey = EncodeWTFees(wtPrimeBuilder.GetMainchainFees());
+
+        // Check that the WT^ is valid by mainchain policy
+        CFeeRate dust = CFeeRate(DUST_RELAY_TX_FEE);
+        candidate->fStandard = CoreIsStandardTx(wjtx, true, dust, candidate->strReason);
+
+        // Add WT^ transaction to the WT^ database object
+        candidate->wtPrimeTx = MakeTransactionRef(std::move(wjtx));
+        wtPrime.wtPrime = candidate->wtPrimeTx;
+
+        // Output data
+        CMutableTransaction mtx;
+        mtx.vout.push_back(CTxOut(0, wtPrime.GetScript()));
+        candidate->wtPrimeDataTx = MakeTransactionRef(mtx);
+    }
+
+    pwtPrimeCandidate = candidate;
+    return pwtPrimeCandidate;
+}
+
 /** Create joined WT^ to be sent to the mainchain */
 bool CreateWTPrimeTx(int nHeight, CTransactionRef& wtPrimeTx, CTransactionRef& wtPrimeDataTx, bool fReplicationCheck, bool fCheckUnique)
 {
@@ -5704,76 +5982,18 @@ bool CreateWTPrimeTx(int nHeight, CTransactionRef& wtPrimeTx, CTransactionRef& w
         }
     }
 
-    // Get WT(s) from psidechaintree
-    std::vector<SidechainWT> vWT = psidechaintree->GetWTs(THIS_SIDECHAIN);
-    if (vWT.empty()) {
+    std::shared_ptr<const WTPrimeCandidate> candidate = GetWTPrimeCandidate();
+    if (!candidate->nWT) {
         LogPrintf("%s: No wt(s) to create WT^\n", __func__);
         return false;
     }
 
-    // Select only WTs with WT_UNSPENT status
-    SelectUnspentWT(vWT);
-
-    // Sort WTs by mainchain fee amount
-    SortWTByFee(vWT);
-
-    if (!fReplicationCheck && vWT.size() < nMinWT) {
+    if (!fReplicationCheck && candidate->nWT < nMinWT) {
         LogPrintf("%s: Not enough WT(s) to create WT^\n", __func__);
         return false;
     }
 
-    // TODO sort vWT by fees
-
-    // WT^ database object for psidechaintree (sidechain only)
-    SidechainWTPrime wtPrime;
-    wtPrime.nSidechain = THIS_SIDECHAIN;
-
-    CMutableTransaction wjtx; // WT^
-
-    // Add SIDECHAIN_WTPRIME_RETURN_DEST OP_RETURN output
-    wjtx.vout.push_back(CTxOut(0, CScript() << OP_RETURN << ParseHex(HexStr(SIDECHAIN_WTPRIME_RETURN_DEST))));
-
-    // Add a dummy output for mainchain fee encoding (updated later)
-    CAmount amountMainchainFees = 0;
-    wjtx.vout.push_back(CTxOut(0, CScript() << OP_RETURN << CScriptNum(1LL << 40)));
-
-    wjtx.nVersion = 2;
-    wjtx.vin.resize(1); // Dummy vin for serialization...
-    wjtx.vin[0].scriptSig = CScript() << OP_0;
-    for (const SidechainWT& wt : vWT) {
-        CAmount amountWT = wt.amount - wt.mainchainFee;
-
-        amountMainchainFees += wt.mainchainFee;
-
-        // TODO check IsValidDestination
-        // Output to mainchain keyID
-        CTxDestination dest = DecodeDestination(wt.strDestination, true /* fMainchain */);
-        wjtx.vout.push_back(CTxOut(amountWT, GetScriptForDestination(dest)));
-
-        // Add WT objid to WT^ obj
-        wtPrime.vWT.push_back(wt.GetID());
-
-        // Make sure we have room for more outputs
-        if (GetTransactionWeight(wjtx) > MAX_WTPRIME_WEIGHT) {
-            // If we went over size, undo this output and stop
-            wtPrime.vWT.pop_back();
-            wjtx.vout.pop_back();
-
-            // Also remove added fees
-            amountMainchainFees -= wt.mainchainFee;
-
-            break;
-        }
-    }
-
-    // Update mainchain fee encoding output.
-    wjtx.vout[1].scriptPubKey = EncodeWTFees(amountMainchainFees);
-
-    // Did anything make it into the WT^?
-    if (!wjtx.vout.size()) {
-        LogPrintf("%s: ERROR: WT^ empty!\n", __func__);
-        return false;
-    }
+    const uint256 hashWTPrime = candidate->wtPrimeTx->GetHash();
 
     // If the WT^ hash will be the same as a previous WT^ return false. It is
     // possible for a new WT^ to have the same hash as a previous WT^ if all of
@@ -5781,167 +6001,148 @@ bool CreateWTPrimeTx(int nHeight, CTransactionRef& wtPrimeTx, CTransactionRef& w
     // wait for a new WT to be added to the database so that this WT^ will have
     // a unique hash. It would also be possible to remove one of the outputs to
     // obtain a unique WT^ hash (TODO?)
-    if (fCheckUnique && psidechaintree->HaveWTPrime(wjtx.GetHash())) {
+    if (fCheckUnique && psidechaintree->HaveWTPrime(hashWTPrime)) {
         LogPrintf("%s: ERROR: WT^ is not unique!\n", __func__);
         return false;
     }
 
     // Check that the WT^ is valid by mainchain policy
-    CFeeRate dust = CFeeRate(DUST_RELAY_TX_FEE);
-    std::string strReason = "";
-    if (!CoreIsStandardTx(wjtx, true, dust, strReason)) {
-        LogPrintf("%s: ERROR: WT^ failed core standardness tests! Reason: %s\n", __func__, strReason);
+    if (!candidate->fStandard) {
+        LogPrintf("%s: ERROR: WT^ failed core standardness tests! Reason: %s\n", __func__, candidate->strReason);
         return false;
     }
 
-    // Add WT^ transaction to the WT^ database object
-    wtPrime.wtPrime = wjtx;
-
-    // Return the WT^ transaction itself by reference
-    wtPrimeTx = MakeTransactionRef(wjtx);
-
-    // Output data
-    CMutableTransaction mtx;
-    mtx.vout.push_back(CTxOut(0, wtPrime.GetScript()));
-
-    // Return the WT^ data transaction by reference
-    wtPrimeDataTx = MakeTransactionRef(mtx);
+    // Return the WT^ transaction and WT^ data transaction by reference
+    wtPrimeTx = candidate->wtPrimeTx;
+    wtPrimeDataTx = candidate->wtPrimeDataTx;
 
-    LogPrintf("%s: WT^ created! Hash: %s\n", __func__, wjtx.GetHash().ToString());
+    LogPrintf("%s: WT^ created! Hash: %s\n", __func__, hashWTPrime.ToString());
     return true;
 }
 
-bool VerifyWTPrimes(std::string& strFail, int nHeight, const std::vector<CTransactionRef>& vtx, std::vector<SidechainWT>& vWT, uint256& hashWTPrime, uint256& hashWTPrimeID, bool fReplicate) {
+bool VerifyWTPrimes(std::string& strFail, int nHeight, const SidechainObjIndex& sidechainObjs, std::vector<SidechainWT>& vWT, uint256& hashWTPrime, uint256& hashWTPrimeID, bool fReplicate) {
     // Keep track of how many WT^(s) are in the block, only 1 is allowed
     int nWTPrime = 0;
 
-    // Loop through the blocks txns and look for WT^(s) to verify
+    // Loop through the blocks sidechain objects and look for WT^(s) to verify
     CAmount amountMainchainFees = 0;
-    for (const CTransactionRef& tx : vtx) {
-        for (const CTxOut& txout : tx->vout) {
-            const CScript& scriptPubKey = txout.scriptPubKey;
+    for (const SidechainObjIndex::Entry& entry : sidechainObjs.vObj) {
+        if (!entry.IsValid())  {
+            strFail = "Invalid sidechain obj!\n";
+            return false;
+        }
 
-            std::vector<unsigned char> vch;
-            if (!scriptPubKey.IsSidechainObj(vch))
-                continue;
+        if (entry.sidechainop != DB_SIDECHAIN_WTPRIME_OP)
+            continue;
 
-            SidechainObj *obj = ParseSidechainObj(vch);
-            if (!obj)  {
-                strFail = "Invalid sidechain obj!\n";
-                return false;
-            }
+        nWTPrime++;
+        if (nWTPrime > 1) {
+            strFail = "Invalid WT^ - multiple in block!\n";
+            return false;
+        }
 
-            if (obj->sidechainop != DB_SIDECHAIN_WTPRIME_OP)
-                continue;
+        const SidechainWTPrime *wtPrime = &sidechainObjs.vWTPrime[entry.nPos];
 
-            nWTPrime++;
-            if (nWTPrime > 1) {
-                strFail = "Invalid WT^ - multiple in block!\n";
+        // Check that every WT this WT^ has listed is in the db
+        // and verify the status is not spent.
+        for (const uint256& wtid : wtPrime->vWT) {
+            SidechainWT wt;
+
+            if (!psidechaintree->GetWT(wtid, wt)) {
+                strFail = "Invalid wt - does not exist!\n";
+                return false;
+            }
+            if (wt.status != WT_UNSPENT) {
+                strFail = "Invalid wt - spent!\n";
                 return false;
             }
 
-            const SidechainWTPrime *wtPrime = (const SidechainWTPrime *) obj;
+            amountMainchainFees += wt.mainchainFee;
 
-            // Check that every WT this WT^ has listed is in the db
-            // and verify the status is not spent.
-            for (const uint256& wtid : wtPrime->vWT) {
-                SidechainWT wt;
+            vWT.push_back(wt);
+        }
 
-                if (!psidechaintree->GetWT(wtid, wt)) {
-                    strFail = "Invalid wt - does not exist!\n";
-                    return false;
-                }
-                if (wt.status != WT_UNSPENT) {
-                    strFail = "Invalid wt - spent!\n";
-                    return false;
-                }
+        // Check that there are actually enough outputs for this to be valid
+        if (wtPrime->wtPrime->vout.size() < 3) {
+            strFail = "Invalid WT^ - too few outputs!\n";
+            return false;
+        }
 
-                amountMainchainFees += wt.mainchainFee;
+        // Check that the number of outputs equals the number of
+        // WT(s) listed in the WT^ + one encoded mainchain fee output + one
+        // encoded change return dest output
+        if (wtPrime->wtPrime->vout.size() != vWT.size() + 2) {
+            strFail = "Invalid WT^ - missing / extra outputs!\n";
+            return false;
+        }
 
-                vWT.push_back(wt);
-            }
+        // Check that the amount in the encoded mainchain fee output is
+        // equal to the sum of fees from the wt(s)
+        CAmount amountRead = 0;
+        if (!DecodeWTFees(wtPrime->wtPrime->vout[1].scriptPubKey, amountRead)) {
+            strFail = "Invalid WT^ - failed to decode mainchain fee output!\n";
+            return false;
+        }
 
-            // Check that there are actually enough outputs for this to be valid
-            if (wtPrime->wtPrime.vout.size() < 3) {
-                strFail = "Invalid WT^ - too few outputs!\n";
-                return false;
-            }
+        if (amountRead != amountMainchainFees) {
+            strFail = "Invalid WT^ - invalid encoded mainchain fee output!\n";
+            return false;
+        }
 
-            // Check that the number of outputs equals the number of
-            // WT(s) listed in the WT^ + one encoded mainchain fee output + one
-            // encoded change return dest output
-            if (wtPrime->wtPrime.vout.size() != vWT.size() + 2) {
-                strFail = "Invalid WT^ - missing / extra outputs!\n";
-                return false;
+        // Check that every WT listed in the WT^ is included
+        for (const SidechainWT& wt : vWT) {
+            const CScript scriptDestination = wt.GetDestinationScript();
+            bool fFound = false;
+            for (const CTxOut& out : wtPrime->wtPrime->vout) {
+                if (out.nValue == wt.amount - wt.mainchainFee &&
+                        scriptDestination == out.scriptPubKey) {
+                    fFound = true;
+                    break;
+                }
             }
-
-            // Check that the amount in the encoded mainchain fee output is
-            // equal to the sum of fees from the wt(s)
-            CAmount amountRead = 0;
-            if (!DecodeWTFees(wtPrime->wtPrime.vout[1].scriptPubKey, amountRead)) {
-                strFail = "Invalid WT^ - failed to decode mainchain fee output!\n";
+            if (!fFound) {
+                strFail = "Invalid WT^ - missing output!\n";
                 return false;
             }
+        }
 
-            if (amountRead != amountMainchainFees) {
-                strFail = "Invalid WT^ - invalid encoded mainchain fee output!\n";
-                return false;
-            }
+        // Check if standard by mainchain bitcoin core standards
+        CFeeRate dust = CFeeRate(DUST_RELAY_TX_FEE);
+        std::string strReason = "";
+        if (!CoreIsStandardTx(*wtPrime->wtPrime, true, dust, strReason)) {
+            strFail = "Invalid WT^ - failed CoreIsStandardTx!\n";
+            return false;
+        }
 
-            // Check that every WT listed in the WT^ is included
-            for (const SidechainWT& wt : vWT) {
-                bool fFound = false;
-                for (const CTxOut& out : wtPrime->wtPrime.vout) {
-                    if (out.nValue == wt.amount - wt.mainchainFee &&
-                            GetScriptForDestination(DecodeDestination(wt.strDestination, true)) == out.scriptPubKey) {
-                        fFound = true;
-                        break;
-                    }
-                }
-                if (!fFound) {
-                    strFail = "Invalid WT^ - missing output!\n";
-                    return false;
-                }
-            }
+        // Check WT^ weight
+        if (GetTransactionWeight(*wtPrime->wtPrime) > MAX_WTPRIME_WEIGHT) {
+            strFail = "Invalid WT^ - too large!\n";
+            return false;
+        }
 
-            // Check if standard by mainchain bitcoin core standards
-            CFeeRate dust = CFeeRate(DUST_RELAY_TX_FEE);
-            std::string strReason = "";
-            if (!CoreIsStandardTx(wtPrime->wtPrime, true, dust, strReason)) {
-                strFail = "Invalid WT^ - failed CoreIsStandardTx!\n";
+        // Verify that we can replicate this WT^ if fReplicate is set
+        if (fReplicate) {
+            // Try to create the same WT^
+            CTransactionRef wtPrimeTx;
+            CTransactionRef wtPrimeDataTx;
+            if (!CreateWTPrimeTx(nHeight, wtPrimeTx, wtPrimeDataTx, true /* fReplicationCheck */ )) {
+                strFail = "Invalid WT^ - failed to create replicant WT^!\n";
                 return false;
             }
-
-            // Check WT^ weight
-            if (GetTransactionWeight(wtPrime->wtPrime) > MAX_WTPRIME_WEIGHT) {
-                strFail = "Invalid WT^ - too large!\n";
+            // Verify that our WT^ matches the one in this block
+            if (*wtPrimeTx != *wtPrime->wtPrime) {
+                strFail = "Invalid WT^ - replicated WT^ does not match!\n";
                 return false;
             }
+        }
 
-            // Verify that we can replicate this WT^ if fReplicate is set
-            if (fReplicate) {
-                // Try to create the same WT^
-                CTransactionRef wtPrimeTx;
-                CTransactionRef wtPrimeDataTx;
-                if (!CreateWTPrimeTx(nHeight, wtPrimeTx, wtPrimeDataTx, true /* fReplicationCheck */ )) {
-                    strFail = "Invalid WT^ - failed to create replicant WT^!\n";
-                    return false;
-                }
-                // Verify that our WT^ matches the one in this block
-                if (*wtPrimeTx != CTransaction(wtPrime->wtPrime)) {
-                    strFail = "Invalid WT^ - replicated WT^ does not match!\n";
-                    return false;
-                }
-            }
-
-            hashWTPrime = wtPrime->wtPrime.GetHash();
-            hashWTPrimeID = wtPrime->GetID();
+        hashWTPrime = wtPrime->wtPrime->GetHash();
+        hashWTPrimeID = wtPrime->GetID();
 
-            // Update the status of wt(s) included in the WT^ - returned by
-            // reference and applied to the DB if needed
-            for (size_t i = 0; i < vWT.size(); i++)
-                vWT[i].status = WT_IN_WTPRIME;
-        }
+        // Update the status of wt(s) included in the WT^ - returned by
+        // reference and applied to the DB if needed
+        for (size_t i = 0; i < vWT.size(); i++)
+            vWT[i].status = WT_IN_WTPRIME;
     }
     if (!hashWTPrime.IsNull()) {
         std::string strReplicated = fReplicate ? "true" : "false";
@@ -5960,30 +6161,30 @@ bool SortDeposits(const std::vector<SidechainDeposit>& vDeposit, std::vector<Sid
         return true;
     }
 
-    // Find the first deposit in the list by looking for the deposit which
-    // spends a CTIP not in the list. There can only be one. We are also going
-    // to check that there is only one missing CTIP input here.
+    // Map the CTIP output that each deposit creates to the deposit
+    std::unordered_map<COutPoint, size_t, SaltedOutpointHasher> mapCTIP;
+    mapCTIP.reserve(vDeposit.size());
+    for (size_t i = 0; i < vDeposit.size(); i++)
+        mapCTIP.emplace(COutPoint(vDeposit[i].dtx->GetHash(), vDeposit[i].nBurnIndex), i);
+
+    // Find the deposit spending each CTIP output, and the first deposit in
+    // the list by looking for the deposit which spends a CTIP not in the
+    // list. There can only be one. We are also going to check that there is
+    // only one missing CTIP input here.
+    std::unordered_map<COutPoint, size_t, SaltedOutpointHasher> mapSpender;
+    mapSpender.reserve(vDeposit.size());
     int nMissingCTIP = 0;
+    size_t nFirst = 0;
     for (size_t x = 0; x < vDeposit.size(); x++) {
-        const SidechainDeposit dx = vDeposit[x];
-
         // Look for the input of this deposit
         bool fFound = false;
-        for (size_t y = 0; y < vDeposit.size(); y++) {
-            const SidechainDeposit dy = vDeposit[y];
-
-            // The CTIP output of the deposit that might be the input
-            const COutPoint prevout(dy.dtx.GetHash(), dy.nBurnIndex);
-
-            // Look for the CTIP output
-            for (const CTxIn& in : dx.dtx.vin) {
-                if (in.prevout == prevout) {
-                    fFound = true;
-                    break;
-                }
+        for (const CTxIn& in : vDeposit[x].dtx->vin) {
+            if (mapCTIP.count(in.prevout)) {
+                fFound = true;
+                // If more than one deposit spends a CTIP the first one in
+                // the list is used
+                mapSpender.emplace(in.prevout, x);
             }
-            if (fFound)
-                break;
         }
 
         // If we didn't find the CTIP input, this should be the first and only
@@ -5994,88 +6195,61 @@ bool SortDeposits(const std::vector<SidechainDeposit>& vDeposit, std::vector<Sid
                 LogPrintf("%s: Error: Multiple missing CTIP!\n", __func__);
                 return false;
             }
-            // Add the first deposit to the result
-            vDepositSorted.push_back(dx);
-            // We found the first deposit but do not stop the loop here
-            // because we are also checking to make sure there aren't any
-            // other deposits missing a CTIP input from the list.
+            nFirst = x;
         }
     }
 
-    // Now that we know which deposit is first in the list we can add the rest
-    // in CTIP spend order.
-
-    if (vDepositSorted.empty()) {
+    if (!nMissingCTIP) {
         LogPrintf("%s: Error: Coult not find first deposit in list!\n", __func__);
         return false;
     }
 
-    // Track the CTIP output of the latest deposit we have sorted
-    COutPoint prevout(vDepositSorted.back().dtx.GetHash(), vDepositSorted.back().nBurnIndex);
-
-    // Look for the deposit that spends the last sorted CTIP output and sort it.
-    // If we cannot find a deposit spending the CTIP, that should mean we
-    // reached the end of sorting.
-    std::vector<SidechainDeposit>::const_iterator it = vDeposit.begin();
-    while (it != vDeposit.end()) {
-        bool fFound = false;
-        for (const CTxIn& in : it->dtx.vin) {
-            if (in.prevout == prevout) {
-                // Add the sorted deposit to the list
-                vDepositSorted.push_back(*it);
-
-                // Update the CTIP output we are looking for
-                const SidechainDeposit deposit = vDepositSorted.back();
-                prevout = COutPoint(deposit.dtx.GetHash(), deposit.nBurnIndex);
-
-                // Start from begin() again
-                fFound = true;
-                it = vDeposit.begin();
+    // Now that we know which deposit is first in the list we can follow the
+    // CTIP chain. If we cannot find a deposit spending the CTIP, that should
+    // mean we reached the end of sorting.
+    std::vector<size_t> vSorted;
+    vSorted.reserve(vDeposit.size());
+    vSorted.push_back(nFirst);
+    while (vSorted.size() <= vDeposit.size()) {
+        const SidechainDeposit& last = vDeposit[vSorted.back()];
+        auto it = mapSpender.find(COutPoint(last.dtx->GetHash(), last.nBurnIndex));
+        if (it == mapSpender.end())
+            break;
 
-                break;
-            }
-        }
-        if (!fFound)
-            it++;
+        vSorted.push_back(it->second);
     }
 
-    if (vDeposit.size() != vDepositSorted.size()) {
+    if (vDeposit.size() != vSorted.size()) {
         LogPrintf("%s: Error: Invalid result size! In: %u Out: %u\n", __func__,
-                vDeposit.size(), vDepositSorted.size());
+                vDeposit.size(), vSorted.size());
         return false;
     }
 
-    // Double check proper CTIP UTXO ordering.
-    // Loop backwards keeping track of the previous value and verify that the
-    // r-next item in the vector is the CTIP input for the previous value.
-    std::vector<SidechainDeposit>::const_reverse_iterator rit;
-    rit = vDepositSorted.rbegin();
-    SidechainDeposit prev;
-    for (; rit != vDepositSorted.rend(); rit++) {
-        // For the last element in the list we track the value and move on
-        if (rit == vDepositSorted.rbegin())  {
-            prev = *rit;
-            continue;
-        }
+    // Double check proper CTIP UTXO ordering: each deposit after the first
+    // must spend the CTIP output of the deposit before it.
+    for (size_t i = 1; i < vSorted.size(); i++) {
+        const SidechainDeposit& prev = vDeposit[vSorted[i - 1]];
+        const SidechainDeposit& deposit = vDeposit[vSorted[i]];
 
-        // Check if the r-next item is the CTIP for the previous deposit
         bool fFound = false;
-        for (const CTxIn& in : prev.dtx.vin) {
-            if (in.prevout.hash == rit->dtx.GetHash()
-                && rit->dtx.vout.size() > in.prevout.n
-                && rit->nBurnIndex == in.prevout.n) {
+        for (const CTxIn& in : deposit.dtx->vin) {
+            if (in.prevout.hash == prev.dtx->GetHash()
+                && prev.dtx->vout.size() > in.prevout.n
+                && prev.nBurnIndex == in.prevout.n) {
                 fFound = true;
                 break;
             }
         }
         if (!fFound) {
-            LogPrintf("%s: Error: Deposit in sorted list (not first) missing CTIP! Deposit: \n%s\n", __func__, rit->ToString());
+            LogPrintf("%s: Error: Deposit in sorted list (not first) missing CTIP! Deposit: \n%s\n", __func__, deposit.ToString());
             return false;
         }
-        // Update the previous object to this index before moving to r-next
-        prev = *rit;
     }
 
+    vDepositSorted.reserve(vDepositSorted.size() + vSorted.size());
+    for (size_t i : vSorted)
+        vDepositSorted.push_back(vDeposit[i]);
+
     return true;
 }
 
@@ -6146,36 +6320,90 @@ bool UpdateMainBlockHashCache(bool& fReorg, std::vector<uint256>& vDisconnected)
     // else. If it isn't we will continue to update / reorg handling.
     int nCachedBlocks = bmmCache.GetCachedBlockCount();
     if (nMainBlocks + 1 == nCachedBlocks && hashCachedTip == hashMainTip) {
+        nLastMainBlockCacheSync = GetTime();
         return true;
     }
 
     // Otherwise;
     // From the new mainchain tip, start looping back through mainchain blocks
     // while keeping track of them in order until we find one that connects to
-    // one of our cached blocks by prevblock.
-    uint256 hashPrevBlock;
+    // one of our cached blocks by prevblock. The block hashes are requested in
+    // batches walking back from the tip. Usually the cache is only a few
+    // blocks behind, so the first batch is small and each one after that
+    // twice the size, up to MAINCHAIN_RPC_BATCH_SIZE.
     std::deque<uint256> deqHashNew;
-    for (int i = nMainBlocks; i > 0; i--) {
-        // Get the prevblockhash
-        if (!client.GetBlockHash(i - 1, hashPrevBlock)) {
-            LogPrintf("%s: Failed to get to mainchain block: %u\n", __func__, i - 1);
+    bool fConnected = false;
+    size_t nBatch = MAINCHAIN_SYNC_FIRST_BATCH;
+    for (int i = nMainBlocks; i > 0 && !fConnected; ) {
+        std::vector<int> vHeight;
+        for (int j = i - 1; j >= 0 && vHeight.size() < nBatch; j--)
+            vHeight.push_back(j);
+
+        std::vector<uint256> vHash;
+        if (!client.GetBlockHashBatch(vHeight, vHash)) {
+            LogPrintf("%s: Failed to get to mainchain blocks: %d to %d\n", __func__, vHeight.back(), vHeight.front());
             return false;
         }
 
-        // Check if the prevblock is in our cache. Once we find a prevblock in
-        // our cache we can update our cache from that block up to the new
-        // mainchain tip.
-        if (bmmCache.HaveMainBlock(hashPrevBlock)) {
+        for (const uint256& hashPrevBlock : vHash) {
             deqHashNew.push_front(hashPrevBlock);
-            break;
-        }
 
-        deqHashNew.push_front(hashPrevBlock);
+            // Check if the prevblock is in our cache. Once we find a prevblock
+            // in our cache we can update our cache from that block up to the
+            // new mainchain tip.
+            if (bmmCache.HaveMainBlock(hashPrevBlock)) {
+                fConnected = true;
+                break;
+            }
+        }
+        i -= vHeight.size();
+        nBatch = std::min(nBatch * 2, MAINCHAIN_RPC_BATCH_SIZE);
     }
     // Also add the new mainchain tip
     deqHashNew.push_back(hashMainTip);
 
-    return bmmCache.UpdateMainBlockCache(deqHashNew, fReorg, vDisconnected);
+    if (!bmmCache.UpdateMainBlockCache(deqHashNew, fReorg, vDisconnected))
+        return false;
+
+    nLastMainBlockCacheSync = GetTime();
+
+    uiInterface.NotifyMainchainTip(hashMainTip);
+
+    return true;
+}
+
+bool ConnectMainBlockNotification(const uint256& hashBlock, const uint256& hashPrevBlock, bool& fReorg, std::vector<uint256>& vDisconnected)
+{
+    {
+        std::lock_guard<std::mutex> lock(mainBlockCacheMutex);
+
+        if (!bmmCache.ConnectMainBlock(hashBlock, hashPrevBlock, fReorg, vDisconnected))
+            return false;
+    }
+
+    uiInterface.NotifyMainchainTip(hashBlock);
+
+    return true;
+}
+
+void SetMainchainTipTracked(bool fTracked)
+{
+    fMainchainTipTracked = fTracked;
+}
+
+bool IsMainchainTipTracked()
+{
+    return fMainchainTipTracked;
+}
+
+bool SyncMainBlockHashCache(bool& fReorg, std::vector<uint256>& vDisconnected)
+{
+    // While mainchain tip notifications keep the cache up to date, only poll
+    // the mainchain every MAINCHAIN_TIP_POLL_INTERVAL seconds as a fallback.
+    if (fMainchainTipTracked && GetTime() - nLastMainBlockCacheSync < MAINCHAIN_TIP_POLL_INTERVAL)
+        return true;
+
+    return UpdateMainBlockHashCache(fReorg, vDisconnected);
 }
 
 bool VerifyMainBlockCache(std::string& strError)
@@ -6189,21 +6417,28 @@ bool VerifyMainBlockCache(std::string& strError)
     }
 
     // Compare cached hash at height with mainchain block hash at height
-    for (size_t i = 0; i < vHash.size(); i++) {
-        uint256 hashBlock;
+    for (size_t nBegin = 0; nBegin < vHash.size(); nBegin += MAINCHAIN_RPC_BATCH_SIZE) {
+        size_t nEnd = std::min(vHash.size(), nBegin + MAINCHAIN_RPC_BATCH_SIZE);
+
+        std::vector<int> vHeight;
+        for (size_t i = nBegin; i < nEnd; i++)
+            vHeight.push_back(i);
 
-        if (!client.GetBlockHash(i, hashBlock)) {
+        std::vector<uint256> vHashMain;
+        if (!client.GetBlockHashBatch(vHeight, vHashMain)) {
             strError = "Failed to request mainchain block hash!";
             return false;
         }
 
-        if (hashBlock != vHash[i]) {
-            strError = "Invalid hash cached: ";
-            strError += vHash[i].ToString();
-            strError += " height: ";
-            strError += std::to_string(i);
+        for (size_t i = nBegin; i < nEnd; i++) {
+            if (vHashMain[i - nBegin] != vHash[i]) {
+                strError = "Invalid hash cached: ";
+                strError += vHash[i].ToString();
+                strError += " height: ";
+                strError += std::to_string(i);
 
-            return false;
+                return false;
+            }
         }
     }
 
@@ -6268,6 +6503,12 @@ void HandleMainchainReorg(const std::vector<uint256>& vOrphan)
                 continue;
 
             CBlockIndex* pindex = mapBlockMainHashIndex[u];
+
+            // The proof shows a commit in a block that isn't part of the
+            // mainchain anymore, so it can't prove the BMM of the block
+            if (pblocktree)
+                pblocktree->EraseBMMProofs({pindex->GetBlockHash()});
+
             if (!chainActive.Contains(pindex))
                 continue;
 
@@ -35,7 +35,9 @@
 class BMMCache;
 class CBlockIndex;
 class CBlockTreeDB;
+class CSidechainTreeCache;
 class CSidechainTreeDB;
+class CMainBlockDB;
 class CChainParams;
 class CCoinsViewDB;
 class CInv;
@@ -48,6 +50,7 @@ struct ChainTxData;
 
 struct PrecomputedTransactionData;
 struct LockPoints;
+struct SidechainDepositQuery;
 
 /** Default for -whitelistrelay. */
 static const bool DEFAULT_WHITELISTRELAY = true;
@@ -228,6 +231,14 @@ static const char* const SIDECHAIN_TEST_SCRIPT_HEX = "76a914497f7d6b59281591c50b
 
 static const bool DEFAULT_VERIFY_WTPRIME_ACCEPT_BLOCK = true;
 
+//! Seconds between main block cache polls while mainchain tip notifications are received
+static const int64_t MAINCHAIN_TIP_POLL_INTERVAL = 60;
+//! Mainchain block hashes requested at first while walking back from a new
+//! mainchain tip, doubled each time none of them is cached
+static const size_t MAINCHAIN_SYNC_FIRST_BATCH = 8;
+/** bmm.dat files from this version on store the verified caches compactly */
+static const int BMM_CACHE_COMPACT_VERSION = 160001;
+
 extern BMMCache bmmCache;
 
 extern std::mutex mainBlockCacheMutex;
@@ -312,6 +323,11 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune);
 
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
+/**
+ * Write the cached sidechain objects and then the coins of the connected
+ * blocks. Returns false if either write fails.
+ */
+bool FlushChainstateCaches(CCoinsViewCache& coins, CSidechainTreeCache& sidechaintree);
 /** Prune block files and flush state to disk. */
 void PruneAndFlush();
 /** Prune block files up to a given height */
@@ -416,9 +432,19 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
 /** Verify BMM for this block with the mainchain */
 bool VerifyBMM(const CBlock& block);
 
+/**
+ * Verify BMM for a list of block headers with the mainchain using batched
+ * requests and cache the headers that were verified. Returns false only if
+ * the mainchain could not be reached.
+ */
+bool VerifyBMMHeaders(const std::vector<CBlockHeader>& vHeader);
+
 /** Verify deposit with the mainchain */
 bool VerifyDeposit(const uint256& hashMainBlock, const uint256& txid, const int nTx);
 
+/** Verify a list of deposits with the mainchain using batched requests */
+bool VerifyDeposits(std::vector<SidechainDepositQuery>& vQuery);
+
 /** Context-independent validity checks */
 bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckMerkleRoot = true, bool fCheckBMM = true);
 
@@ -485,8 +511,14 @@ extern std::unique_ptr<CCoinsViewCache> pcoinsTip;
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern std::unique_ptr<CBlockTreeDB> pblocktree;
 
-/** Global variable that points to the active sidechain tree (protected by cs_main) */
-extern std::unique_ptr<CSidechainTreeDB> psidechaintree;
+/** Global variable that points to the sidechain tree database */
+extern std::unique_ptr<CSidechainTreeDB> psidechaintreedb;
+
+/** Global variable that points to the active sidechain tree cache (protected by cs_main) */
+extern std::unique_ptr<CSidechainTreeCache> psidechaintree;
+
+/** Global variable that points to the mainchain block hashes that bmmCache doesn't keep in memory */
+extern std::unique_ptr<CMainBlockDB> pmainblockdb;
 
 /**
  * Return the spend height, which is one more than the inputs.GetBestBlock().
@@ -541,12 +573,12 @@ void LoadWTIDCache();
 bool CreateWTPrimeTx(int nHeight, CTransactionRef& wtPrimeTx, CTransactionRef& wtPrimeDataTx, bool fReplicationCheck = false, bool fCheckUnique = false);
 
 /**
- * If there are any WT^(s) (note the limit per block is 1) verify it, and
- * optionally replicate it. This function will return by reference a vector of
- * wt(s) spent by the WT^ if it has been validated - so that ConnectBlock can
- * update their status
+ * If there are any WT^(s) in the block's sidechain objects (note the limit per
+ * block is 1) verify it, and optionally replicate it. This function will
+ * return by reference a vector of wt(s) spent by the WT^ if it has been
+ * validated - so that ConnectBlock can update their status
  */
-bool VerifyWTPrimes(std::string& strFail, int nHeight, const std::vector<CTransactionRef>& vtx, std::vector<SidechainWT>& vWT, uint256& hashWTPrime, uint256& hashWTPrimeID, bool fReplicate = false);
+bool VerifyWTPrimes(std::string& strFail, int nHeight, const SidechainObjIndex& sidechainObjs, std::vector<SidechainWT>& vWT, uint256& hashWTPrime, uint256& hashWTPrimeID, bool fReplicate = false);
 
 /** Sort deposits by CTIP spend order */
 bool SortDeposits(const std::vector<SidechainDeposit>& vDeposit, std::vector<SidechainDeposit>& vDepositSorted);
@@ -566,6 +598,25 @@ uint256 GetMainBlockHash(const CBlockHeader& block);
  */
 bool UpdateMainBlockHashCache(bool& fReorg, std::vector<uint256>& vDisconnected);
 
+/**
+ * Connect a new mainchain tip announced by the mainchain (zmq) to the main
+ * block cache. Returns false if it doesn't connect to the cache and
+ * UpdateMainBlockHashCache must be used instead.
+ */
+bool ConnectMainBlockNotification(const uint256& hashBlock, const uint256& hashPrevBlock, bool& fReorg, std::vector<uint256>& vDisconnected);
+
+/** Set whether mainchain tip notifications are keeping the cache synced */
+void SetMainchainTipTracked(bool fTracked);
+
+/** Whether mainchain tip notifications are keeping the cache synced */
+bool IsMainchainTipTracked();
+
+/**
+ * Like UpdateMainBlockHashCache, but skips polling the mainchain while tip
+ * notifications are being received and the cache was synced recently.
+ */
+bool SyncMainBlockHashCache(bool& fReorg, std::vector<uint256>& vDisconnected);
+
 /* Verify the contents of the mainchain block cache with the mainchain */
 bool VerifyMainBlockCache(std::string& strError);
 
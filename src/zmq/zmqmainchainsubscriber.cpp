@@ -0,0 +1,228 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <zmq/zmqmainchainsubscriber.h>
+
+#include <crypto/common.h>
+#include <hash.h>
+#include <uint256.h>
+#include <util.h>
+#include <validation.h>
+
+#include <algorithm>
+#include <functional>
+#include <string.h>
+#include <vector>
+
+static const char *MSG_RAWBLOCK = "rawblock";
+
+//! Only the block header of a rawblock notification is needed
+static const size_t MAINCHAIN_HEADER_SIZE = 80;
+
+//! Milliseconds to wait for a notification before checking for shutdown
+static const long MAINCHAIN_ZMQ_POLL_TIMEOUT = 500;
+
+// Internal function to receive a multipart message, keeping at most
+// MAINCHAIN_HEADER_SIZE bytes of each part
+static bool zmq_recv_multipart(void *sock, std::vector<std::string>& vPart)
+{
+    vPart.clear();
+    while (1)
+    {
+        zmq_msg_t msg;
+        zmq_msg_init(&msg);
+
+        int rc = zmq_msg_recv(&msg, sock, 0);
+        if (rc == -1)
+        {
+            zmqError("Unable to receive ZMQ msg");
+            zmq_msg_close(&msg);
+            return false;
+        }
+
+        size_t nSize = std::min(zmq_msg_size(&msg), MAINCHAIN_HEADER_SIZE);
+        vPart.emplace_back((const char*)zmq_msg_data(&msg), nSize);
+
+        int more = zmq_msg_more(&msg);
+        zmq_msg_close(&msg);
+
+        if (!more)
+            break;
+    }
+    return true;
+}
+
+CZMQMainchainSubscriber::CZMQMainchainSubscriber(const std::string& addressIn) :
+    address(addressIn), pcontext(nullptr), psocket(nullptr), fStop(false),
+    fHaveSequence(false), nLastSequence(0)
+{
+}
+
+CZMQMainchainSubscriber::~CZMQMainchainSubscriber()
+{
+    Stop();
+}
+
+CZMQMainchainSubscriber* CZMQMainchainSubscriber::Create()
+{
+    if (!gArgs.IsArgSet("-zmqsubmainchainrawblock"))
+        return nullptr;
+
+    CZMQMainchainSubscriber* subscriber = new CZMQMainchainSubscriber(gArgs.GetArg("-zmqsubmainchainrawblock", ""));
+    if (!subscriber->Initialize())
+    {
+        delete subscriber;
+        return nullptr;
+    }
+
+    return subscriber;
+}
+
+bool CZMQMainchainSubscriber::Initialize()
+{
+    LogPrint(BCLog::ZMQ, "zmq: Subscribe to mainchain rawblock at %s\n", address);
+    assert(!pcontext);
+
+    pcontext = zmq_init(1);
+    if (!pcontext)
+    {
+        zmqError("Unable to initialize context");
+        return false;
+    }
+
+    psocket = zmq_socket(pcontext, ZMQ_SUB);
+    if (!psocket)
+    {
+        zmqError("Failed to create socket");
+        Shutdown();
+        return false;
+    }
+
+    int rc = zmq_setsockopt(psocket, ZMQ_SUBSCRIBE, MSG_RAWBLOCK, strlen(MSG_RAWBLOCK));
+    if (rc != 0)
+    {
+        zmqError("Failed to subscribe");
+        Shutdown();
+        return false;
+    }
+
+    rc = zmq_connect(psocket, address.c_str());
+    if (rc != 0)
+    {
+        zmqError("Failed to connect address");
+        Shutdown();
+        return false;
+    }
+
+    threadSubscribe = std::thread(&TraceThread<std::function<void()> >, "mainzmq",
+            std::function<void()>(std::bind(&CZMQMainchainSubscriber::ThreadSubscribe, this)));
+
+    return true;
+}
+
+void CZMQMainchainSubscriber::Shutdown()
+{
+    if (psocket)
+    {
+        int linger = 0;
+        zmq_setsockopt(psocket, ZMQ_LINGER, &linger, sizeof(linger));
+        zmq_close(psocket);
+        psocket = nullptr;
+    }
+
+    if (pcontext)
+    {
+        zmq_ctx_destroy(pcontext);
+        pcontext = nullptr;
+    }
+}
+
+void CZMQMainchainSubscriber::Stop()
+{
+    fStop = true;
+    if (threadSubscribe.joinable())
+        threadSubscribe.join();
+
+    Shutdown();
+
+    // Go back to polling the mainchain for every block
+    SetMainchainTipTracked(false);
+}
+
+void CZMQMainchainSubscriber::ThreadSubscribe()
+{
+    while (!fStop)
+    {
+        zmq_pollitem_t item = { psocket, 0, ZMQ_POLLIN, 0 };
+        int rc = zmq_poll(&item, 1, MAINCHAIN_ZMQ_POLL_TIMEOUT);
+        if (rc == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            zmqError("Failed to poll socket");
+            break;
+        }
+
+        if (!(item.revents & ZMQ_POLLIN))
+            continue;
+
+        std::vector<std::string> vPart;
+        if (!zmq_recv_multipart(psocket, vPart))
+            continue;
+
+        HandleMessage(vPart);
+    }
+
+    SetMainchainTipTracked(false);
+}
+
+bool CZMQMainchainSubscriber::HandleMessage(const std::vector<std::string>& vPart)
+{
+    // Parts: topic, serialized block, 4 byte LE sequence number
+    if (vPart.size() != 3 || vPart[0] != MSG_RAWBLOCK || vPart[2].size() != 4)
+    {
+        LogPrint(BCLog::ZMQ, "zmq: Ignoring unexpected mainchain message\n");
+        return false;
+    }
+
+    uint32_t nSequence = ReadLE32((const unsigned char*)vPart[2].data());
+    return HandleRawBlock((const unsigned char*)vPart[1].data(), vPart[1].size(), nSequence);
+}
+
+bool CZMQMainchainSubscriber::HandleRawBlock(const unsigned char* pData, size_t nSize, uint32_t nSequence)
+{
+    if (nSize < MAINCHAIN_HEADER_SIZE)
+    {
+        LogPrint(BCLog::ZMQ, "zmq: Ignoring invalid mainchain rawblock\n");
+        return false;
+    }
+
+    // Mainchain block hash and prevblock from the block header
+    uint256 hashBlock = Hash(pData, pData + MAINCHAIN_HEADER_SIZE);
+    uint256 hashPrevBlock;
+    memcpy(hashPrevBlock.begin(), pData + 4, hashPrevBlock.size());
+
+    // A gap in the sequence numbers means notifications were missed
+    bool fMissed = fHaveSequence && nSequence != nLastSequence + 1;
+    fHaveSequence = true;
+    nLastSequence = nSequence;
+
+    bool fReorg = false;
+    std::vector<uint256> vDisconnected;
+    bool fSynced = !fMissed && ConnectMainBlockNotification(hashBlock, hashPrevBlock, fReorg, vDisconnected);
+    if (!fSynced)
+    {
+        LogPrint(BCLog::ZMQ, "zmq: Mainchain block %s does not connect to cache, polling mainchain\n", hashBlock.ToString());
+        fReorg = false;
+        vDisconnected.clear();
+        fSynced = UpdateMainBlockHashCache(fReorg, vDisconnected);
+    }
+
+    SetMainchainTipTracked(fSynced);
+
+    if (fReorg)
+        HandleMainchainReorg(vDisconnected);
+
+    return true;
+}
@@ -0,0 +1,59 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ZMQ_ZMQMAINCHAINSUBSCRIBER_H
+#define BITCOIN_ZMQ_ZMQMAINCHAINSUBSCRIBER_H
+
+#include <zmq/zmqconfig.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Subscribes to the mainchain node's zmq "rawblock" notifications and keeps
+ * the main block cache synced with them, so that the mainchain doesn't have to
+ * be polled for every block we process. Whenever a notification doesn't
+ * connect to the cache (missed messages, reorg deeper than the cache) the
+ * cache is synced by polling the mainchain instead.
+ */
+class CZMQMainchainSubscriber
+{
+public:
+    /** A subscriber that isn't connected until Initialize() is called. Used
+     * directly in testing to pass messages to HandleMessage(). */
+    explicit CZMQMainchainSubscriber(const std::string& addressIn);
+    ~CZMQMainchainSubscriber();
+
+    /** Create and start a subscriber if -zmqsubmainchainrawblock is set */
+    static CZMQMainchainSubscriber* Create();
+
+    void Stop();
+
+    /**
+     * Handle the parts of a received message: topic, serialized block and 4
+     * byte LE sequence number. Returns false if the message was ignored
+     * because it isn't a valid rawblock notification.
+     */
+    bool HandleMessage(const std::vector<std::string>& vPart);
+
+private:
+    bool Initialize();
+    void Shutdown();
+
+    void ThreadSubscribe();
+    bool HandleRawBlock(const unsigned char* pData, size_t nSize, uint32_t nSequence);
+
+    std::string address;
+    void *pcontext;
+    void *psocket;
+    std::thread threadSubscribe;
+    std::atomic<bool> fStop;
+
+    bool fHaveSequence;
+    uint32_t nLastSequence;
+};
+
+#endif // BITCOIN_ZMQ_ZMQMAINCHAINSUBSCRIBER_H